@@ -24,6 +24,7 @@ namespace nl
             static void* s_zeroSizeDataPointer;
 
         public:
+            Memory() noexcept; // empty block of zero size
             ~Memory();
 
             Memory(Memory&& memory) noexcept;
@@ -34,6 +35,9 @@ namespace nl
 
             static Memory Allocate(size_t size);
 
+            // Resizes the block while keeping its contents; the block only moves if it cannot grow in place.
+            void Reallocate(size_t size);
+
             operator bool() const { return m_lp != nullptr; }
             operator void* () { return m_lp; }
             operator const void* () const { return m_lp; }
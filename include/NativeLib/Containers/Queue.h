@@ -44,6 +44,11 @@ namespace nl
             return ptr;
         }
 
+        T* _PeekHead() const
+        {
+            return m_pHead;
+        }
+
         bool _TryPopHead(T** ptr)
         {
             if (m_pHead == nullptr)
@@ -98,80 +103,89 @@ namespace nl
     template <typename T>
     class Queue : public BaseQueue<T>
     {
+        typedef BaseQueue<T> super;
+
     public:
         T* PopHead()
         {
-            return _PopHead();
+            return super::_PopHead();
+        }
+
+        T* PeekHead() const
+        {
+            return super::_PeekHead();
         }
 
         T* PopTail()
         {
-            return _PopTail();
+            return super::_PopTail();
         }
 
         bool TryPopHead(T** ptr)
         {
-            return _TryPopHead(ptr);
+            return super::_TryPopHead(ptr);
         }
 
         bool TryPopTail(T** ptr)
         {
-            return _TryPopTail(ptr);
+            return super::_TryPopTail(ptr);
         }
 
         void AddHead(T* ptr)
         {
-            _AddHead(ptr);
+            super::_AddHead(ptr);
         }
 
         void AddTail(T* ptr)
         {
-            _AddTail(ptr);
+            super::_AddTail(ptr);
         }
     };
 
     template <typename T>
     class SafeQueue : public BaseQueue<T>
     {
+        typedef BaseQueue<T> super;
+
     public:
         T* PopHead()
         {
             auto lock = nl::threading::ReadWriteLockScope(&m_lock, true);
-            T* ptr = _PopHead();
+            T* ptr = super::_PopHead();
             return ptr;
         }
 
         T* PopTail()
         {
             auto lock = nl::threading::ReadWriteLockScope(&m_lock, true);
-            T* ptr = _PopTail();
+            T* ptr = super::_PopTail();
             return ptr;
         }
 
         bool TryPopHead(T** ptr)
         {
             auto lock = nl::threading::ReadWriteLockScope(&m_lock, true);
-            bool res = _TryPopHead(ptr);
+            bool res = super::_TryPopHead(ptr);
             return res;
         }
 
         bool TryPopTail(T** ptr)
         {
             auto lock = nl::threading::ReadWriteLockScope(&m_lock, true);
-            bool res = _TryPopTail(ptr);
+            bool res = super::_TryPopTail(ptr);
             return res;
         }
 
         void AddHead(T* ptr)
         {
             auto lock = nl::threading::ReadWriteLockScope(&m_lock, true);
-            _AddHead(ptr);
+            super::_AddHead(ptr);
         }
 
         void AddTail(T* ptr)
         {
             auto lock = nl::threading::ReadWriteLockScope(&m_lock, true);
-            _AddTail(ptr);
+            super::_AddTail(ptr);
         }
 
     private:
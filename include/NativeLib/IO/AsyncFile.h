@@ -0,0 +1,91 @@
+#pragma once
+
+#include <NativeLib/IO/IOEnum.h>
+
+#include <stdint.h>
+#include <string_view>
+#include <functional>
+
+namespace nl
+{
+    namespace io
+    {
+        enum class AsyncFileBackend
+        {
+            IoUring,    // Linux io_uring; submissions are batched into a single system call
+            ThreadPool  // blocking positional reads and writes on worker threads
+        };
+
+        struct AsyncFileOptions
+        {
+            uint32_t QueueDepth = 64; // maximum number of operations queued or in flight
+            int32_t ThreadCount = 0; // workers for the thread pool backend; 0 picks one from the queue depth
+            bool UseThreadPool = false; // use the thread pool backend even if io_uring is available
+        };
+
+        // Receives the number of bytes transferred, which can be short at the end of the file, or a negative
+        // error code if the operation failed.
+        typedef std::function<void(int64_t result)> AsyncFileCallback;
+
+        // File with submit/complete semantics for reaching high queue depths from a single thread.
+        // Operations are queued by the *Async methods and handed to the kernel (or the worker threads) in one batch
+        // by Submit. Callbacks only ever run on the thread calling Submit, Poll, Wait or Drain, never concurrently.
+        // Queuing an operation while QueueDepth operations are outstanding first waits for one to complete.
+        // Buffers must remain valid until the callback of their operation has run.
+        class AsyncFile
+        {
+        public:
+            AsyncFile();
+            ~AsyncFile(); // waits for outstanding operations before the file is closed
+
+            AsyncFile(const AsyncFile&) = delete;
+            AsyncFile(AsyncFile&&) noexcept = delete;
+            AsyncFile& operator =(const AsyncFile&) = delete;
+            AsyncFile& operator =(AsyncFile&&) noexcept = delete;
+
+            operator bool() const;
+            bool IsOpen() const;
+
+            AsyncFileBackend GetBackend() const;
+            uint32_t GetQueueDepth() const;
+            uint32_t GetPending() const; // operations queued or in flight
+            int64_t GetLength() const;
+
+            void Close();
+
+            // Registers buffers with the kernel so fixed reads and writes skip mapping the pages on every operation.
+            // Replaces any earlier registration and waits for outstanding operations first.
+            void RegisterBuffers(void* const* buffers, const size_t* sizes, uint32_t count);
+            void UnregisterBuffers();
+
+            void ReadAsync(void* buffer, int64_t count, int64_t offset, AsyncFileCallback callback);
+            void WriteAsync(const void* buffer, int64_t count, int64_t offset, AsyncFileCallback callback);
+
+            // Reads into or writes from a range of a registered buffer.
+            void ReadFixedAsync(uint32_t buffer_index, size_t buffer_offset, int64_t count, int64_t offset, AsyncFileCallback callback);
+            void WriteFixedAsync(uint32_t buffer_index, size_t buffer_offset, int64_t count, int64_t offset, AsyncFileCallback callback);
+
+            // Flushes written data to the device after every operation queued before it has completed.
+            void FlushAsync(AsyncFileCallback callback);
+
+            // Hands queued operations over for execution and returns how many were submitted.
+            uint32_t Submit();
+
+            // Runs the callbacks of completed operations without blocking and returns how many ran.
+            uint32_t Poll();
+
+            // Submits queued operations and blocks until at least min_completions callbacks ran or nothing is pending.
+            uint32_t Wait(uint32_t min_completions = 1);
+
+            // Blocks until every queued and in-flight operation has completed.
+            void Drain();
+
+            static AsyncFile Open(std::string_view filename, CreateMode mode, bool writable = true, const AsyncFileOptions* options = nullptr);
+
+        private:
+            AsyncFile(struct AsyncFileState* state);
+
+            struct AsyncFileState* m_state;
+        };
+    }
+}
@@ -2,9 +2,10 @@
 
 #include <NativeLib/IO/Stream.h>
 #include <NativeLib/String.h>
+#include <NativeLib/Util.h>
 
-// For the future:
-// - Read and write 7 bit encoded compressed integer
+#include <type_traits>
+#include <cstring>
 
 namespace nl
 {
@@ -13,13 +14,21 @@ namespace nl
         class BinaryReader
         {
         public:
-            BinaryReader(Stream* stream);
+            BinaryReader(Stream* stream); // primitives are read in place when the stream supports TryPeek
 
             Stream* GetStream();
 
             template <typename T>
             BinaryReader& operator >>(T& value)
             {
+                auto peeked = m_stream->TryPeek(sizeof(T));
+                if (peeked)
+                {
+                    memcpy(&value, peeked, sizeof(T));
+                    m_stream->Advance(sizeof(T));
+                    return *this;
+                }
+
                 char* p = reinterpret_cast<char*>(&value);
                 const char* end = p + sizeof(T);
                 while (p < end)
@@ -34,12 +43,55 @@ namespace nl
                 return *this;
             }
 
+            // Values in the stream are little endian, the byte order the library runs on.
+            template <typename T>
+            T ReadLittleEndian()
+            {
+                T value;
+                *this >> value;
+                return value;
+            }
+
+            template <typename T>
+            T ReadBigEndian()
+            {
+                return nl::util::ByteSwap(ReadLittleEndian<T>());
+            }
+
+            // Reads count elements written by BinaryWriter::WriteArray in one piece.
+            template <typename T>
+            void ReadArray(T* values, size_t count)
+            {
+                static_assert(std::is_trivially_copyable_v<T>, "ReadArray requires a trivially copyable type.");
+                ReadBytes(values, count * sizeof(T));
+            }
+
+            template <typename T>
+            void ReadArrayBigEndian(T* values, size_t count)
+            {
+                ReadArray(values, count);
+
+                for (size_t i = 0; i < count; ++i)
+                    values[i] = nl::util::ByteSwap(values[i]);
+            }
+
+            void ReadBytes(void* lp, size_t size);
+
+            // Reads a 7 bit encoded integer with the least significant group first, compatible with .NET.
             int64_t Read7BitEncodedInt();
 
             // Reads a string that is prefixed with 7bit encoded integer length (using Read7BitEncodedInt)
             String ReadString();
 
+            // Batches of integers written by BinaryWriter::WriteVarIntArray; the count is not part of the data.
+            void ReadVarIntArray(uint32_t* values, size_t count);
+            void ReadVarIntArray(int32_t* values, size_t count);
+            void ReadVarIntArray(uint64_t* values, size_t count);
+            void ReadVarIntArray(int64_t* values, size_t count);
+
         private:
+            unsigned char ReadByte();
+
             Stream* m_stream;
         };
 
@@ -50,13 +102,21 @@ namespace nl
         class BinaryWriter
         {
         public:
-            BinaryWriter(Stream* stream);
+            BinaryWriter(Stream* stream); // primitives are written in place when the stream supports AcquireWriteSpan
 
             Stream* GetStream();
 
             template <typename T>
             BinaryWriter& operator <<(const T& value)
             {
+                auto span = m_stream->AcquireWriteSpan(sizeof(T));
+                if (span)
+                {
+                    memcpy(span, &value, sizeof(T));
+                    m_stream->Commit(sizeof(T));
+                    return *this;
+                }
+
                 const char* p = reinterpret_cast<const char*>(&value);
                 const char* end = p + sizeof(T);
                 while (p < end)
@@ -71,12 +131,65 @@ namespace nl
                 return *this;
             }
 
+            // Values are written little endian, the byte order the library runs on.
+            template <typename T>
+            void WriteLittleEndian(T value)
+            {
+                *this << value;
+            }
+
+            template <typename T>
+            void WriteBigEndian(T value)
+            {
+                *this << nl::util::ByteSwap(value);
+            }
+
+            // Writes count elements in one piece instead of one at a time.
+            template <typename T>
+            void WriteArray(const T* values, size_t count)
+            {
+                static_assert(std::is_trivially_copyable_v<T>, "WriteArray requires a trivially copyable type.");
+                WriteBytes(values, count * sizeof(T));
+            }
+
+            template <typename T>
+            void WriteArrayBigEndian(const T* values, size_t count)
+            {
+                T buffer[ArrayChunkSize / sizeof(T)];
+
+                while (count != 0)
+                {
+                    size_t n = nl::util::Min(count, sizeof(buffer) / sizeof(T));
+                    for (size_t i = 0; i < n; ++i)
+                        buffer[i] = nl::util::ByteSwap(values[i]);
+
+                    WriteArray(buffer, n);
+                    values += n;
+                    count -= n;
+                }
+            }
+
+            void WriteBytes(const void* lp, size_t size);
+
+            // Writes a 7 bit encoded integer with the least significant group first, compatible with .NET.
             void Write7BitEncodedInt(int64_t value);
 
             // Writes a string that is prefixed with 7bit encoded integer length (using Write7BitEncodedInt)
             void WriteString(std::string_view value);
 
+            // Writes integers in as few bytes as their values allow. 32 bit values use Stream VByte (see VarInt.h) in
+            // batches of up to VarIntBatchSize values, 64 bit values are 7 bit encoded one after another. Signed
+            // values are zigzag encoded so that small negative values stay small.
+            void WriteVarIntArray(const uint32_t* values, size_t count);
+            void WriteVarIntArray(const int32_t* values, size_t count);
+            void WriteVarIntArray(const uint64_t* values, size_t count);
+            void WriteVarIntArray(const int64_t* values, size_t count);
+
+            static constexpr size_t VarIntBatchSize = 1024;
+
         private:
+            static constexpr size_t ArrayChunkSize = 4096;
+
             Stream* m_stream;
         };
     }
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <NativeLib/Allocators.h>
+#include <NativeLib/IO/Stream.h>
+
+#include <stdint.h>
+
+namespace nl
+{
+    namespace io
+    {
+        // Adds read-ahead and write-behind buffering to another stream so that small reads and writes do not each
+        // reach the underlying stream. The wrapped stream is not owned and must outlive the BufferedStream.
+        // Buffered writes are flushed by Flush, Seek, SetLength, Close and the destructor; call Flush explicitly
+        // to observe write errors since the destructor cannot report them. Writing moves a seekable stream back over
+        // the unread read-ahead; over one that cannot seek, such as a pipe, reads and writes are buffered apart.
+        class BufferedStream : public Stream
+        {
+        public:
+            static constexpr int64_t DefaultBufferSize = 65536;
+
+            BufferedStream(Stream* stream, int64_t buffer_size = DefaultBufferSize);
+            BufferedStream(Stream* stream, int64_t read_buffer_size, int64_t write_buffer_size);
+            ~BufferedStream();
+
+            BufferedStream(const BufferedStream&) = delete;
+            BufferedStream& operator =(const BufferedStream&) = delete;
+
+            Stream* GetStream() { return m_stream; }
+
+            virtual bool CanSeek() const override;
+            virtual bool CanRead() const override;
+            virtual bool CanWrite() const override;
+
+            virtual int64_t GetPosition() const override;
+            virtual int64_t GetLength() const override;
+            virtual int64_t Seek(int64_t offset, SeekMode mode = SeekMode::Begin) override;
+            virtual void SetLength(int64_t length) override;
+            virtual void Flush() override;
+            virtual void Close() override;
+
+            virtual int64_t Read(void* lp, int64_t numberOfBytesToRead) override;
+            virtual int64_t Write(const void* lp, int64_t numberOfBytesToWrite) override;
+            virtual int64_t WriteV(const IOSegment* segments, int32_t count) override;
+
+            // Spans are served from the buffers, so they are limited to the buffer sizes.
+            virtual const void* TryPeek(int64_t size) override;
+            virtual void Advance(int64_t count) override;
+            virtual void* AcquireWriteSpan(int64_t size) override;
+            virtual void Commit(int64_t count) override;
+
+        private:
+            void FlushWrite();
+            void DiscardRead();
+            void WriteInner(const void* lp, int64_t count);
+
+            Stream* m_stream;
+
+            size_t m_read_size;
+            nl::memory::Memory m_read_buffer;
+            size_t m_read_position;
+            size_t m_read_length;
+
+            size_t m_write_size;
+            nl::memory::Memory m_write_buffer;
+            size_t m_write_position;
+        };
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+
+namespace nl
+{
+    namespace io
+    {
+        enum class ChecksumAlgorithm
+        {
+            Crc32c, // Castagnoli CRC, using the SSE 4.2 crc32 instruction when the processor has it
+            XxHash64
+        };
+
+        // CRC-32C of size bytes. Pass the previous result as crc to continue a checksum over more data.
+        uint32_t Crc32c(const void* lp, size_t size, uint32_t crc = 0);
+
+        // XXH64 of size bytes.
+        uint64_t XxHash64(const void* lp, size_t size, uint64_t seed = 0);
+
+        // Incremental checksum of data handed over in pieces of any size.
+        class Checksum
+        {
+        public:
+            Checksum(ChecksumAlgorithm algorithm = ChecksumAlgorithm::Crc32c);
+
+            ChecksumAlgorithm GetAlgorithm() const { return m_algorithm; }
+            size_t GetSize() const { return m_algorithm == ChecksumAlgorithm::Crc32c ? 4 : 8; } // of the value in bytes
+
+            void Reset();
+            void Update(const void* lp, size_t size);
+            uint64_t GetValue() const;
+
+        private:
+            ChecksumAlgorithm m_algorithm;
+            uint32_t m_crc;
+
+            // xxHash64 accumulators and the tail of the input that does not fill a 32 byte stripe yet
+            uint64_t m_accumulators[4];
+            uint64_t m_totalLength;
+            uint8_t m_buffer[32];
+            size_t m_buffered;
+        };
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <NativeLib/IO/Stream.h>
+#include <NativeLib/IO/Checksum.h>
+
+#include <stdint.h>
+
+namespace nl
+{
+    namespace io
+    {
+        enum class ChecksumStreamMode
+        {
+            // Data passes through unchanged and GetChecksum covers everything read or written so far.
+            PassThrough,
+
+            // Data is written as blocks of uint32 length, data and the checksum of both (4 bytes for CRC-32C,
+            // 8 for xxHash64, little endian). Reading verifies every block before handing out any of its data.
+            Framed
+        };
+
+        struct ChecksumOptions
+        {
+            ChecksumAlgorithm Algorithm = ChecksumAlgorithm::Crc32c;
+            ChecksumStreamMode Mode = ChecksumStreamMode::PassThrough;
+            int32_t BlockSize = 65536; // maximum data bytes per block in framed mode
+        };
+
+        // Stream decorator computing or verifying checksums of the data passing through.
+        // A framed stream is used either for reading or for writing; pending data is written as a short block by
+        // Flush, Close or the destructor. The wrapped stream is not owned and must outlive the ChecksumStream.
+        class ChecksumStream : public Stream
+        {
+        public:
+            ChecksumStream(Stream* stream, const ChecksumOptions* options = nullptr);
+            ~ChecksumStream();
+
+            ChecksumStream(const ChecksumStream&) = delete;
+            ChecksumStream& operator =(const ChecksumStream&) = delete;
+
+            Stream* GetStream();
+
+            virtual bool CanSeek() const override;
+            virtual bool CanRead() const override;
+            virtual bool CanWrite() const override;
+
+            virtual int64_t GetPosition() const override; // data bytes read or written through this stream
+            virtual void Flush() override;
+            virtual void Close() override;
+
+            virtual int64_t Read(void* lp, int64_t numberOfBytesToRead) override;
+            virtual int64_t Write(const void* lp, int64_t numberOfBytesToWrite) override;
+
+            virtual const void* TryPeek(int64_t size) override;
+            virtual void Advance(int64_t count) override;
+            virtual void* AcquireWriteSpan(int64_t size) override;
+            virtual void Commit(int64_t count) override;
+
+            // Checksum of the data read or written in pass-through mode since construction or ResetChecksum.
+            uint64_t GetChecksum() const;
+            void ResetChecksum();
+
+        private:
+            void BeginRead();
+            void BeginWrite();
+            bool ReadNextBlock();
+            void WritePendingBlock();
+
+            struct ChecksumStreamState* m_state;
+        };
+    }
+}
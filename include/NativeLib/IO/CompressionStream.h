@@ -0,0 +1,107 @@
+#pragma once
+
+#include <NativeLib/IO/Stream.h>
+
+#include <stdint.h>
+
+namespace nl
+{
+    namespace io
+    {
+        // Frame layout written by CompressionStream, all integers little endian:
+        //   header:  "NLZ1", uint32 maximum uncompressed block size
+        //   blocks:  uint32 compressed size (the high bit marks a stored block), uint32 uncompressed size, data
+        //   end:     uint32 0
+        //   index:   per block uint64 offset of the block in the frame and uint64 uncompressed offset,
+        //            then uint64 uncompressed length, uint32 block count, "NLZI" (only if WriteBlockIndex is set)
+        // Blocks are compressed independently with the LZ codec, so they can be produced in parallel and, through
+        // the index at the end of the frame, decompressed starting at any block.
+
+        struct CompressionOptions
+        {
+            int32_t BlockSize = 262144; // uncompressed bytes per block
+            int32_t ThreadCount = 1; // blocks compressed in parallel; 0 uses one thread per processor
+            bool WriteBlockIndex = true; // allows DecompressionStream to seek
+        };
+
+        // Write-only stream compressing everything written to it into another stream.
+        // The frame is completed by Finish, Close or the destructor; call Finish explicitly to observe errors.
+        // Flush writes out the buffered data as a short block, so flushing often costs compression ratio.
+        // The wrapped stream is not owned and must outlive the CompressionStream.
+        class CompressionStream : public Stream
+        {
+        public:
+            CompressionStream(Stream* stream, const CompressionOptions* options = nullptr);
+            ~CompressionStream();
+
+            CompressionStream(const CompressionStream&) = delete;
+            CompressionStream& operator =(const CompressionStream&) = delete;
+
+            Stream* GetStream();
+
+            virtual bool CanSeek() const override;
+            virtual bool CanRead() const override;
+            virtual bool CanWrite() const override;
+
+            virtual int64_t GetPosition() const override; // uncompressed bytes written
+            virtual void Flush() override;
+            virtual void Close() override; // finishes the frame and closes the wrapped stream
+
+            virtual int64_t Read(void* lp, int64_t numberOfBytesToRead) override;
+            virtual int64_t Write(const void* lp, int64_t numberOfBytesToWrite) override;
+
+            virtual void* AcquireWriteSpan(int64_t size) override;
+            virtual void Commit(int64_t count) override;
+
+            // Writes the remaining data, the end marker and the block index. Writing afterwards is an error.
+            void Finish();
+
+            int64_t GetCompressedLength() const; // frame bytes written to the wrapped stream so far
+
+        private:
+            void CompressPending();
+
+            struct CompressionStreamState* m_state;
+        };
+
+        // Read-only stream decompressing a frame written by CompressionStream.
+        // Seeking is supported when the wrapped stream can seek and the frame has a block index.
+        // The wrapped stream is not owned and must outlive the DecompressionStream.
+        class DecompressionStream : public Stream
+        {
+        public:
+            DecompressionStream(Stream* stream);
+            ~DecompressionStream();
+
+            DecompressionStream(const DecompressionStream&) = delete;
+            DecompressionStream& operator =(const DecompressionStream&) = delete;
+
+            Stream* GetStream();
+
+            virtual bool CanSeek() const override;
+            virtual bool CanRead() const override;
+            virtual bool CanWrite() const override;
+
+            virtual int64_t GetPosition() const override;
+            virtual int64_t GetLength() const override; // requires the block index
+            virtual int64_t Seek(int64_t offset, SeekMode mode = SeekMode::Begin) override;
+            virtual void Close() override;
+
+            virtual int64_t Read(void* lp, int64_t numberOfBytesToRead) override;
+            virtual int64_t Write(const void* lp, int64_t numberOfBytesToWrite) override;
+
+            virtual const void* TryPeek(int64_t size) override;
+            virtual void Advance(int64_t count) override;
+
+            // Random access by block; both require the block index.
+            int64_t GetBlockCount() const;
+            void SeekToBlock(int64_t block);
+
+        private:
+            bool ReadNextBlock();
+            void LoadIndex();
+
+            struct DecompressionStreamState* m_state;
+        };
+    }
+}
@@ -40,6 +40,9 @@ namespace nl
             virtual int64_t Seek(int64_t offset, SeekMode mode) override;
             virtual int64_t Read(void* lp, int64_t numberOfBytesToRead) override;
             virtual int64_t Write(const void* lp, int64_t numberOfBytesToWrite) override;
+            virtual int64_t ReadV(const IOSegment* segments, int32_t count) override;
+            virtual int64_t WriteV(const IOSegment* segments, int32_t count) override;
+            virtual systemlayer::FileHandle GetFileHandle() const override;
             
             static FileStream Open(std::string_view filename, CreateMode mode, bool writable = true);
 
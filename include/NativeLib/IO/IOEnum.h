@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstring>
+
 namespace nl::io
 {
     enum class CreateMode
@@ -17,4 +19,14 @@ namespace nl::io
         Current,
         End
     };
+
+    // One buffer of a scatter/gather transfer (Stream::ReadV and Stream::WriteV).
+    struct IOSegment
+    {
+        IOSegment() : Data(nullptr), Length(0) {}
+        IOSegment(const void* data, size_t length) : Data(const_cast<void*>(data)), Length(length) {}
+
+        void* Data;
+        size_t Length;
+    };
 }
\ No newline at end of file
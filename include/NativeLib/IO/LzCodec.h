@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+
+namespace nl
+{
+    namespace io
+    {
+        // Fast LZ77 block codec using the LZ4 block format: sequences of literals followed by a match of at least
+        // 4 bytes at a distance of up to 64 KB. Blocks are independent of each other.
+
+        // Worst case size of compressing size bytes, for data that does not compress at all.
+        constexpr size_t LzGetMaxCompressedSize(size_t size)
+        {
+            return size + size / 255 + 16;
+        }
+
+        // Compresses size bytes into dst. Returns the compressed size, or 0 if it would exceed dst_capacity.
+        size_t LzCompress(const void* src, size_t size, void* dst, size_t dst_capacity);
+
+        // Decompresses a block produced by LzCompress. Returns the decompressed size, or -1 if the block is
+        // corrupt or decompresses to more than dst_capacity bytes. Never reads or writes outside the buffers.
+        int64_t LzDecompress(const void* src, size_t size, void* dst, size_t dst_capacity);
+    }
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <NativeLib/IO/Stream.h>
+#include <NativeLib/SystemLayer/SystemLayer.h>
+
+#include <NativeLib/Platform/Platform.h>
+#include <NativeLib/IO/IOEnum.h>
+
+#include <stdint.h>
+#include <string_view>
+
+namespace nl
+{
+    namespace io
+    {
+        enum class MemoryAdvice
+        {
+            Normal,
+            Sequential, // read ahead aggressively and drop pages behind
+            Random,     // disable read ahead
+            WillNeed,   // start reading the range in now
+            DontNeed    // the range can be dropped from memory
+        };
+
+        // Stream over a memory mapped file. Reads and writes are plain memory copies, and GetView gives direct
+        // access to the mapped bytes without copying them at all.
+        // Writing past the end grows the mapping (and the file) geometrically; the file is trimmed back to the
+        // length of the stream when it is closed. Growing can move the mapping, which invalidates earlier views.
+        class MappedFileStream : public Stream
+        {
+        public:
+            MappedFileStream();
+            ~MappedFileStream();
+
+            MappedFileStream(const MappedFileStream&) = delete;
+            MappedFileStream(MappedFileStream&&) noexcept = delete;
+            MappedFileStream& operator =(const MappedFileStream&) = delete;
+            MappedFileStream& operator =(MappedFileStream&&) noexcept = delete;
+
+            operator bool() const;
+
+            virtual bool CanSeek() const override;
+            virtual bool CanRead() const override;
+            virtual bool CanWrite() const override;
+
+            bool IsOpen() const;
+            virtual int64_t GetPosition() const override;
+            virtual int64_t GetLength() const override;
+            virtual int64_t Seek(int64_t offset, SeekMode mode = SeekMode::Begin) override;
+            virtual void SetLength(int64_t length) override;
+            virtual void Flush() override; // writes dirty pages; the file on disk keeps the mapped capacity until Close
+            virtual void Close() override;
+
+            virtual int64_t Read(void* lp, int64_t numberOfBytesToRead) override;
+            virtual int64_t Write(const void* lp, int64_t numberOfBytesToWrite) override;
+
+            virtual const void* TryPeek(int64_t size) override;
+            virtual void Advance(int64_t count) override;
+            virtual void* AcquireWriteSpan(int64_t size) override;
+            virtual void Commit(int64_t count) override;
+
+            // Returns the mapped bytes in [offset, offset + length) without copying them.
+            // The view is valid until the mapping grows, shrinks or the stream is closed.
+            std::string_view GetView(int64_t offset, int64_t length) const;
+
+            // Hints the expected access pattern of a range to the OS. A negative length means until the end.
+            void Advise(MemoryAdvice advice, int64_t offset = 0, int64_t length = -1);
+
+            static MappedFileStream Open(std::string_view filename, CreateMode mode, bool writable = true);
+
+        protected:
+            MappedFileStream(systemlayer::FileHandle fp, bool writable);
+
+        private:
+            void Map(int64_t capacity);
+            void RecoverMap(int64_t file_size);
+            void Unmap();
+            void EnsureCapacity(int64_t required);
+
+            systemlayer::FileHandle m_fp;
+            bool m_writable;
+            char* m_data;
+            void* m_mapping; // mapping object handle on Windows
+            int64_t m_capacity; // mapped size, which is also the size of the file on disk
+            int64_t m_length;
+            int64_t m_position;
+        };
+    }
+}
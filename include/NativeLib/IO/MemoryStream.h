@@ -7,10 +7,20 @@ namespace nl
 {
     namespace io
     {
+        // Stream over a growable block of memory.
+        // By default the data lives on the heap and is reallocated geometrically as the stream grows. Passing a
+        // reserved_capacity instead reserves that much address space up front and commits pages as they are
+        // needed, so the data never moves and pointers into it stay valid, but the stream cannot grow beyond it.
         class MemoryStream : public Stream
         {
         public:
-            MemoryStream(int64_t initial_capacity = 1024);
+            MemoryStream(int64_t initial_capacity = 1024, int64_t reserved_capacity = 0);
+            ~MemoryStream();
+
+            MemoryStream(const MemoryStream&) = delete;
+            MemoryStream(MemoryStream&&) noexcept = delete;
+            MemoryStream& operator =(const MemoryStream&) = delete;
+            MemoryStream& operator =(MemoryStream&&) noexcept = delete;
 
             virtual bool CanSeek() const override;
             virtual bool CanRead() const override;
@@ -20,22 +30,40 @@ namespace nl
             virtual int64_t GetLength() const override;
             virtual int64_t Seek(int64_t offset, SeekMode mode = SeekMode::Begin) override;
             virtual void SetLength(int64_t length) override;
+            virtual void Flush() override;
 
             virtual int64_t Read(void* lp, int64_t numberOfBytesToRead) override;
             virtual int64_t Write(const void* lp, int64_t numberOfBytesToWrite) override;
+            virtual int64_t WriteV(const IOSegment* segments, int32_t count) override;
+
+            virtual const void* TryPeek(int64_t size) override;
+            virtual void Advance(int64_t count) override;
+            virtual void* AcquireWriteSpan(int64_t size) override;
+            virtual void Commit(int64_t count) override;
 
             virtual void Remove(int64_t offset, int64_t length);
             virtual void Insert(int64_t offset, int64_t length);
 
+            // The heap block of the stream; empty if the stream was created with a reserved capacity.
             nl::memory::Memory& GetMemory()
             {
                 return m_memory;
             }
 
+            void* GetData() { return m_reserved ? m_reserved : m_memory.Get<char>(); }
+            const void* GetData() const { return m_reserved ? m_reserved : m_memory.Get<char>(); }
+
+            int64_t GetCapacity() const { return m_reserved ? m_committed : (int64_t)m_memory.GetSize(); }
+
         private:
             void AdjustSize(int64_t new_minimum_size);
 
+            char* GetBuffer() { return static_cast<char*>(GetData()); }
+
             nl::memory::Memory m_memory;
+            char* m_reserved;
+            int64_t m_reserved_size;
+            int64_t m_committed;
             int64_t m_position;
             int64_t m_length;
         };
@@ -1,11 +1,28 @@
 #pragma once
 
 #include <NativeLib/IO/IOEnum.h>
+#include <NativeLib/SystemLayer/SystemLayer.h>
+
+#include <functional>
 
 namespace nl
 {
     namespace io
     {
+        struct CopyProgress
+        {
+            int64_t BytesCopied;
+            double ElapsedSeconds;
+            double BytesPerSecond;
+        };
+
+        struct CopyOptions
+        {
+            int64_t ChunkSize = 1048576; // bytes per read and write
+            bool Pipelined = true; // reads the next chunk on a worker thread while the current one is written
+            std::function<void(const CopyProgress&)> Progress; // called after every chunk
+        };
+
         class Stream
         {
         public:
@@ -23,8 +40,31 @@ namespace nl
             virtual int64_t Read(void* lp, int64_t numberOfBytesToRead) = 0;
             virtual int64_t Write(const void* lp, int64_t numberOfBytesToWrite) = 0;
 
-            // Copies the remaining data of this stream to the target.
-            virtual void CopyTo(Stream* stream);
+            // Scatter/gather transfers of several buffers in one call. Return the total number of bytes transferred,
+            // which is only short at the end of the stream. The defaults call Read and Write per segment.
+            virtual int64_t ReadV(const IOSegment* segments, int32_t count);
+            virtual int64_t WriteV(const IOSegment* segments, int32_t count);
+
+            // Copies the remaining data of this stream to the target and returns the number of bytes copied.
+            // Between two file streams the operating system copies the data without it passing through the process.
+            virtual int64_t CopyTo(Stream* stream, const CopyOptions* options = nullptr);
+
+            // The file a stream reads and writes directly, without buffering or mapping, or 0.
+            virtual systemlayer::FileHandle GetFileHandle() const;
+
+            // Zero-copy access for streams that hold their data in memory. The defaults offer no view and callers
+            // fall back to Read and Write; any other call on the stream invalidates a returned pointer.
+
+            // Returns the next size bytes without consuming them, or nullptr if they are not available in one piece.
+            virtual const void* TryPeek(int64_t size);
+
+            // Consumes count bytes, typically ones that were looked at through TryPeek.
+            virtual void Advance(int64_t count);
+
+            // Returns room for at least size bytes at the current position, or nullptr if the stream cannot offer it.
+            // Nothing is written until Commit is called with the number of bytes that were filled in.
+            virtual void* AcquireWriteSpan(int64_t size);
+            virtual void Commit(int64_t count);
         };
     }
 }
\ No newline at end of file
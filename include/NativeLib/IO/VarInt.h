@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+
+namespace nl
+{
+    namespace io
+    {
+        // 7 bit encoded integers (LEB128): 7 bits per byte starting with the least significant group, the high bit
+        // set on every byte but the last. This is the format of .NET's BinaryWriter.Write7BitEncodedInt64.
+        static constexpr size_t VarIntMaxSize = 10;
+
+        // Writes at most VarIntMaxSize bytes and returns the number written.
+        size_t VarIntEncode(uint64_t value, void* dst);
+
+        // Returns the number of bytes consumed, 0 if size ends before the value does or -1 if the value is longer
+        // than VarIntMaxSize.
+        int32_t VarIntDecode(const void* src, size_t size, uint64_t& value);
+
+        // Stream VByte: batches of 32 bit integers as a control section with 2 bits per value (the value's byte
+        // count minus one, the first value in the lowest bits) followed by the values' significant bytes, little
+        // endian. Keeping the lengths apart from the data lets four values be decoded by a single shuffle.
+        constexpr size_t StreamVByteGetMaxEncodedSize(size_t count)
+        {
+            return (count + 3) / 4 + count * sizeof(uint32_t);
+        }
+
+        // Encodes count values into dst, which must hold StreamVByteGetMaxEncodedSize(count) bytes. Returns the
+        // encoded size.
+        size_t StreamVByteEncode(const uint32_t* values, size_t count, void* dst);
+
+        // Size of the encoded batch, given at least its (count + 3) / 4 control bytes.
+        size_t StreamVByteGetEncodedSize(const void* src, size_t count);
+
+        // Decodes count values from a complete batch. Returns the number of bytes consumed.
+        size_t StreamVByteDecode(const void* src, uint32_t* values, size_t count);
+    }
+}
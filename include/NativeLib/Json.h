@@ -13,6 +13,13 @@
 
 #include <stdint.h>
 #include <type_traits>
+#include <string_view>
+#include <functional>
+
+namespace nl::io
+{
+    class Stream;
+}
 
 namespace nl
 {
@@ -51,6 +58,15 @@ namespace nl
         }
     };
 
+    class JsonParseException : public Exception
+    {
+    public:
+        JsonParseException(const char* message) :
+            Exception(message)
+        {
+        }
+    };
+
     struct JsonFormattingOptions
     {
         nl::String Indentation = "    ";
@@ -69,7 +85,7 @@ namespace nl
         JsonType GetType() const { return m_type; }
 
     protected:
-        friend Shared<JsonBase> Json_ReadValue(const nl::String& json, size_t& i, nl::Vector<nl::String>& parse_errors);
+        friend Shared<JsonBase> Json_ReadValue(std::string_view json, size_t& i, nl::Vector<nl::String>& parse_errors);
         JsonBase(JsonType type);
         JsonType m_type;
     };
@@ -162,10 +178,10 @@ namespace nl
         Shared<JsonNumber> SetNumber(const char* pszName, uint32_t value) { return SetNumber(pszName, (int64_t)value); }
 
     protected:
-        friend Shared<JsonBase> Json_ReadValue(const nl::String& json, size_t& i, nl::Vector<nl::String>& parse_errors);
-        friend Shared<JsonBase> ParseJson(const char* pszJson, nl::Vector<nl::String>& parse_errors);
+        friend Shared<JsonBase> Json_ReadValue(std::string_view json, size_t& i, nl::Vector<nl::String>& parse_errors);
+        friend Shared<JsonBase> ParseJson(std::string_view json, nl::Vector<nl::String>& parse_errors);
 
-        bool Read(const nl::String& json, size_t& i, nl::Vector<nl::String>& parse_errors);
+        bool Read(std::string_view json, size_t& i, nl::Vector<nl::String>& parse_errors);
 
     private:
         template <typename T>
@@ -199,6 +215,8 @@ namespace nl
         static constexpr bool IsOfType(JsonType type) { return type == JsonType::Array; }
 
         size_t GetCount() const { return m_items.GetCount(); }
+        nl::Vector<Shared<JsonBase>>& GetItems() { return m_items; }
+        const nl::Vector<Shared<JsonBase>>& GetItems() const { return m_items; }
         Shared<JsonBase> GetItem(size_t index) { return m_items[index]; }
         Shared<const JsonBase> GetItem(size_t index) const { return m_items[index]; }
 
@@ -231,10 +249,10 @@ namespace nl
         Shared<JsonNumber> AddNumber(uint32_t value) { return AddNumber((int64_t)value); }
 
     protected:
-        friend Shared<JsonBase> Json_ReadValue(const nl::String& json, size_t& i, nl::Vector<nl::String>& parse_errors);
-        friend Shared<JsonBase> ParseJson(const char* pszJson, nl::Vector<nl::String>& parse_errors);
+        friend Shared<JsonBase> Json_ReadValue(std::string_view json, size_t& i, nl::Vector<nl::String>& parse_errors);
+        friend Shared<JsonBase> ParseJson(std::string_view json, nl::Vector<nl::String>& parse_errors);
 
-        bool Read(const nl::String& json, size_t& i, nl::Vector<nl::String>& parse_errors);
+        bool Read(std::string_view json, size_t& i, nl::Vector<nl::String>& parse_errors);
 
     private:
         nl::Vector<Shared<JsonBase>> m_items;
@@ -273,7 +291,7 @@ namespace nl
         void SetValue(const nl::String& value) { m_value = value; }
 
     protected:
-        friend Shared<JsonBase> Json_ReadValue(const nl::String& json, size_t& i, nl::Vector<nl::String>& parse_errors);
+        friend Shared<JsonBase> Json_ReadValue(std::string_view json, size_t& i, nl::Vector<nl::String>& parse_errors);
 
     private:
         nl::String m_value;
@@ -341,7 +359,7 @@ namespace nl
         }
 
     protected:
-        friend Shared<JsonBase> Json_ReadValue(const nl::String& json, size_t& i, nl::Vector<nl::String>& parse_errors);
+        friend Shared<JsonBase> Json_ReadValue(std::string_view json, size_t& i, nl::Vector<nl::String>& parse_errors);
 
     private:
         bool m_bIsDouble;
@@ -377,7 +395,7 @@ namespace nl
         void SetValue(bool value) { m_value = value; }
 
     protected:
-        friend Shared<JsonBase> Json_ReadValue(const nl::String& json, size_t& i, nl::Vector<nl::String>& parse_errors);
+        friend Shared<JsonBase> Json_ReadValue(std::string_view json, size_t& i, nl::Vector<nl::String>& parse_errors);
 
     private:
         bool m_value;
@@ -387,18 +405,49 @@ namespace nl
     ////////////////////////////////////////////////////////////////////////////////////////
     ////////////////////////////////////////////////////////////////////////////////////////
 
-    Shared<JsonBase> ParseJson(const char* pszJson, nl::Vector<nl::String>& parse_errors);
+    Shared<JsonBase> ParseJson(std::string_view json, nl::Vector<nl::String>& parse_errors);
 
     template <typename T>
-    inline Shared<T> ParseJson(const char* pszJson, nl::Vector<nl::String>& parse_errors)
+    inline Shared<T> ParseJson(std::string_view json, nl::Vector<nl::String>& parse_errors)
     {
-        auto ptr = ParseJson(pszJson, parse_errors);
-        if (!ptr)
+        auto ptr = ParseJson(json, parse_errors);
+        if (!ptr.has_value())
             return nullptr;
 
         return Shared<T>::Cast(ptr);
     }
 
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // JSON lines (newline delimited JSON), one JSON value per line
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    struct JsonLinesOptions
+    {
+        // Number of worker threads parsing lines, zero uses one per processor.
+        int32_t ThreadCount = 0;
+
+        // Approximate number of bytes given to a worker at a time; a chunk always ends at a line break.
+        size_t ChunkSize = 262144;
+    };
+
+    struct JsonLine
+    {
+        size_t Line; // zero-based line number in the input
+        Shared<JsonBase> Value; // null if the line failed to parse
+        nl::Vector<nl::String> ParseErrors; // offsets are relative to the start of the line
+    };
+
+    // Invoked once per non-blank line, in the order the lines appear in the input.
+    typedef std::function<void(JsonLine& line)> JsonLineHandler;
+
+    // Parses the lines on a pool of worker threads and delivers them in order to the handler.
+    // Returns the number of lines that failed to parse.
+    size_t ParseJsonLines(std::string_view json, const JsonLineHandler& handler, const JsonLinesOptions* options = nullptr);
+    size_t ParseJsonLines(nl::io::Stream* stream, const JsonLineHandler& handler, const JsonLinesOptions* options = nullptr);
+
+    // Parses all lines and returns them in input order.
+    nl::Vector<JsonLine> ParseJsonLines(std::string_view json, const JsonLinesOptions* options = nullptr);
+
     bool GenerateJsonString(nl::String& output, Shared<const JsonBase> pJson, JsonFormattingOptions* formatting = nullptr);
     Shared<JsonBase> CreateJsonObject(JsonType type);
 
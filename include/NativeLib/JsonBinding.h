@@ -0,0 +1,363 @@
+/*
+ * JSON Library by Nicco © 2019
+ */
+
+#pragma once
+
+#include <NativeLib/JsonReader.h>
+#include <NativeLib/Exceptions.h>
+
+#include <stdint.h>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+#include <array>
+
+/*
+ * Binds a struct to JSON so it can be read straight from text without building a document, and written back.
+ * Declare the schema in the same namespace as the struct:
+ *
+ *     struct Login
+ *     {
+ *         nl::String User;
+ *         int32_t Attempts = 0;
+ *         nl::Vector<nl::String> Roles;
+ *     };
+ *
+ *     NL_JSON_SCHEMA(Login,
+ *         NL_JSON_FIELD(Login, User, "user"),
+ *         NL_JSON_FIELD(Login, Attempts, "attempts"),
+ *         NL_JSON_FIELD(Login, Roles, "roles"));
+ *
+ * Member names are dispatched through a perfect hash computed at compile time; duplicate names fail to compile.
+ * Members that are not part of the schema are skipped and members missing from the text keep their current value.
+ * Supported member types are bool, integers, float, double, nl::String, nl::Vector of a supported type and
+ * other structs with a schema.
+ */
+
+#define NL_JSON_FIELD(type, member, name) nl::JsonField<&type::member>(name)
+
+#define NL_JSON_SCHEMA(type, ...) \
+    inline constexpr auto NlJsonSchema(const type*) { return nl::json_internals::MakeJsonSchema<type>(__VA_ARGS__); }
+
+namespace nl
+{
+    namespace json_internals
+    {
+        typedef bool(*BindingReadFunction)(void* obj, JsonReader& reader);
+        typedef void(*BindingWriteFunction)(const void* obj, JsonWriter& writer);
+
+        struct BindingField
+        {
+            std::string_view Name;
+            BindingReadFunction Read = nullptr;
+            BindingWriteFunction Write = nullptr;
+        };
+
+        constexpr uint32_t BindingHash(std::string_view name, uint32_t seed)
+        {
+            uint32_t hash = 2166136261u ^ seed;
+            for (size_t i = 0; i < name.length(); ++i)
+            {
+                hash ^= (uint8_t)name[i];
+                hash *= 16777619u;
+            }
+
+            return hash ^ (hash >> 15);
+        }
+
+        // keep the load factor at or below 1/8 so a collision free seed is found quickly
+        constexpr size_t BindingTableSize(size_t count)
+        {
+            size_t size = 8;
+            while (size < count * 8)
+                size <<= 1;
+
+            return size;
+        }
+
+        template <size_t N>
+        struct BindingHashTable
+        {
+            static constexpr size_t Size = BindingTableSize(N);
+
+            uint32_t Seed = 0;
+            std::array<int16_t, Size> Slots = {};
+        };
+
+        template <size_t N>
+        constexpr BindingHashTable<N> BuildBindingHashTable(const std::array<BindingField, N>& fields)
+        {
+            static_assert(N < 0x7fff, "Too many fields in JSON schema");
+
+            BindingHashTable<N> table;
+
+            for (uint32_t seed = 1; seed < 0x10000; ++seed)
+            {
+                for (auto& slot : table.Slots)
+                    slot = -1;
+
+                bool collision = false;
+                for (size_t i = 0; i < N && !collision; ++i)
+                {
+                    auto& slot = table.Slots[BindingHash(fields[i].Name, seed) & (table.Size - 1)];
+                    if (slot != -1)
+                        collision = true;
+                    else
+                        slot = (int16_t)i;
+                }
+
+                if (!collision)
+                {
+                    table.Seed = seed;
+                    return table;
+                }
+            }
+
+            // only reachable with duplicate names, which makes the schema fail to compile
+            throw ArgumentException("JSON schema contains duplicate member names");
+        }
+
+        template <typename T, size_t N>
+        struct JsonSchema
+        {
+            std::array<BindingField, N> Fields;
+            BindingHashTable<N> Table;
+
+            const BindingField* Find(std::string_view name) const
+            {
+                int16_t index = Table.Slots[BindingHash(name, Table.Seed) & (Table.Size - 1)];
+                if (index < 0)
+                    return nullptr;
+
+                const BindingField& field = Fields[(size_t)index];
+                if (field.Name.length() != name.length() ||
+                    memcmp(field.Name.data(), name.data(), name.length()) != 0)
+                    return nullptr;
+
+                return &field;
+            }
+        };
+
+        template <typename T, typename... TFields>
+        constexpr JsonSchema<T, sizeof...(TFields)> MakeJsonSchema(TFields... fields)
+        {
+            std::array<BindingField, sizeof...(TFields)> list = { fields... };
+            return { list, BuildBindingHashTable(list) };
+        }
+
+        template <typename T>
+        struct BindingMemberTraits;
+
+        template <typename TStruct, typename TMember>
+        struct BindingMemberTraits<TMember TStruct::*>
+        {
+            using Struct = TStruct;
+            using Member = TMember;
+        };
+    }
+
+    // Reads and writes a single value of type T; specialize to support additional types.
+    template <typename T, typename = void>
+    struct JsonValueBinding
+    {
+        static bool Read(T& value, JsonReader& reader)
+        {
+            static constexpr auto schema = NlJsonSchema(static_cast<const T*>(nullptr));
+
+            if (!reader.BeginObject())
+                return false;
+
+            std::string_view name;
+            while (reader.NextMember(name))
+            {
+                auto field = schema.Find(name);
+                if (!field)
+                {
+                    if (!reader.SkipValue())
+                        return false;
+
+                    continue;
+                }
+
+                if (!field->Read(&value, reader))
+                {
+                    nl::String message("Invalid value for member '");
+                    message.Append(field->Name.data(), field->Name.length());
+                    message.Append('\'');
+                    reader.AddError(std::string_view(message.c_str(), message.GetLength()));
+                    return false;
+                }
+            }
+
+            return !reader.HasFailed();
+        }
+
+        static void Write(const T& value, JsonWriter& writer)
+        {
+            static constexpr auto schema = NlJsonSchema(static_cast<const T*>(nullptr));
+
+            writer.BeginObject();
+            for (auto& field : schema.Fields)
+            {
+                writer.WriteName(field.Name);
+                field.Write(&value, writer);
+            }
+            writer.EndObject();
+        }
+    };
+
+    template <>
+    struct JsonValueBinding<bool>
+    {
+        static bool Read(bool& value, JsonReader& reader) { return reader.ReadBoolean(value); }
+        static void Write(bool value, JsonWriter& writer) { writer.WriteBoolean(value); }
+    };
+
+    template <typename T>
+    struct JsonValueBinding<T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+    {
+        static bool Read(T& value, JsonReader& reader)
+        {
+            int64_t number;
+            if (!reader.ReadInteger(number))
+                return false;
+
+            if ((std::is_unsigned_v<T> && number < 0) ||
+                (int64_t)(T)number != number)
+            {
+                reader.AddError("Number out of range");
+                return false;
+            }
+
+            value = (T)number;
+            return true;
+        }
+
+        static void Write(T value, JsonWriter& writer) { writer.WriteInteger((int64_t)value); }
+    };
+
+    template <typename T>
+    struct JsonValueBinding<T, std::enable_if_t<std::is_floating_point_v<T>>>
+    {
+        static bool Read(T& value, JsonReader& reader)
+        {
+            double number;
+            if (!reader.ReadDouble(number))
+                return false;
+
+            value = (T)number;
+            return true;
+        }
+
+        static void Write(T value, JsonWriter& writer) { writer.WriteDouble((double)value); }
+    };
+
+    template <>
+    struct JsonValueBinding<nl::String>
+    {
+        static bool Read(nl::String& value, JsonReader& reader) { return reader.ReadString(value); }
+        static void Write(const nl::String& value, JsonWriter& writer) { writer.WriteString(std::string_view(value.c_str(), value.GetLength())); }
+    };
+
+    template <typename T>
+    struct JsonValueBinding<nl::Vector<T>>
+    {
+        static bool Read(nl::Vector<T>& value, JsonReader& reader)
+        {
+            if (!reader.BeginArray())
+                return false;
+
+            value.Clear();
+            while (reader.NextItem())
+            {
+                T item{};
+                if (!JsonValueBinding<T>::Read(item, reader))
+                    return false;
+
+                value.Add(std::move(item));
+            }
+
+            return !reader.HasFailed();
+        }
+
+        static void Write(const nl::Vector<T>& value, JsonWriter& writer)
+        {
+            writer.BeginArray();
+            for (auto& item : value)
+                JsonValueBinding<T>::Write(item, writer);
+            writer.EndArray();
+        }
+    };
+
+    namespace json_internals
+    {
+        template <auto Member>
+        struct BindingFieldAccess
+        {
+            using Traits = BindingMemberTraits<decltype(Member)>;
+
+            static bool Read(void* obj, JsonReader& reader)
+            {
+                auto& value = static_cast<typename Traits::Struct*>(obj)->*Member;
+                return JsonValueBinding<typename Traits::Member>::Read(value, reader);
+            }
+
+            static void Write(const void* obj, JsonWriter& writer)
+            {
+                auto& value = static_cast<const typename Traits::Struct*>(obj)->*Member;
+                JsonValueBinding<typename Traits::Member>::Write(value, writer);
+            }
+        };
+    }
+
+    template <auto Member>
+    constexpr json_internals::BindingField JsonField(std::string_view name)
+    {
+        return { name, &json_internals::BindingFieldAccess<Member>::Read, &json_internals::BindingFieldAccess<Member>::Write };
+    }
+
+    // Reads value directly from JSON text; returns false and fills parse_errors if the text does not match the schema.
+    template <typename T>
+    bool DeserializeJson(std::string_view json, T& value, nl::Vector<nl::String>& parse_errors)
+    {
+        JsonReader reader(json, parse_errors);
+        if (!JsonValueBinding<T>::Read(value, reader))
+            return false;
+
+        if (!reader.IsEnd())
+        {
+            reader.AddError("Unexpected data after value");
+            return false;
+        }
+
+        return true;
+    }
+
+    // Same as above but throws a JsonParseException with the first error on failure.
+    template <typename T>
+    T DeserializeJson(std::string_view json)
+    {
+        T value{};
+        nl::Vector<nl::String> parse_errors;
+        if (!DeserializeJson(json, value, parse_errors))
+            throw JsonParseException(parse_errors.GetCount() != 0 ? parse_errors[0].c_str() : "Invalid JSON");
+
+        return value;
+    }
+
+    template <typename T>
+    void SerializeJson(nl::String& output, const T& value)
+    {
+        JsonWriter writer(output);
+        JsonValueBinding<T>::Write(value, writer);
+    }
+
+    template <typename T>
+    nl::String SerializeJson(const T& value)
+    {
+        nl::String output;
+        SerializeJson(output, value);
+        return output;
+    }
+}
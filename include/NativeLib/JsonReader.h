@@ -0,0 +1,95 @@
+/*
+ * JSON Library by Nicco © 2019
+ */
+
+#pragma once
+
+#include <NativeLib/Json.h>
+#include <NativeLib/String.h>
+#include <NativeLib/Containers/Vector.h>
+
+#include <stdint.h>
+#include <string_view>
+
+namespace nl
+{
+    // Forward-only reader over JSON text that does not build a document.
+    // Errors are appended to parse_errors with the offset they occurred at, after which every read fails.
+    class JsonReader
+    {
+    public:
+        JsonReader(std::string_view json, nl::Vector<nl::String>& parse_errors);
+
+        JsonReader(const JsonReader&) = delete;
+        JsonReader& operator =(const JsonReader&) = delete;
+
+        size_t GetOffset() const { return m_offset; }
+        bool HasFailed() const { return m_failed; }
+
+        // Type of the next value; fails if there is no valid value at the current offset.
+        bool PeekType(JsonType& type);
+
+        // True if only whitespace remains.
+        bool IsEnd();
+
+        bool ReadNull();
+        bool ReadBoolean(bool& value);
+        bool ReadInteger(int64_t& value);
+        bool ReadDouble(double& value); // accepts integers as well
+        bool ReadString(nl::String& value);
+        bool SkipValue();
+
+        // Objects: BeginObject, then NextMember until it returns false, followed by checking HasFailed.
+        // The name stays valid until the next call on the reader.
+        bool BeginObject();
+        bool NextMember(std::string_view& name);
+
+        // Arrays: BeginArray, then read an item each time NextItem returns true.
+        bool BeginArray();
+        bool NextItem();
+
+        // Fails the reader and records the message with the current offset.
+        void AddError(std::string_view message);
+
+    private:
+        bool Expect(char ch, const char* what);
+        bool NextElement(char close, const char* eof_error);
+
+        std::string_view m_json;
+        size_t m_offset;
+        nl::Vector<nl::String>& m_parse_errors;
+        nl::String m_name;
+        bool m_failed;
+        bool m_needs_comma; // the open container already had an element
+    };
+
+    // Appends compact JSON to a string without building a document.
+    class JsonWriter
+    {
+    public:
+        JsonWriter(nl::String& output);
+
+        JsonWriter(const JsonWriter&) = delete;
+        JsonWriter& operator =(const JsonWriter&) = delete;
+
+        void BeginObject();
+        void EndObject();
+        void BeginArray();
+        void EndArray();
+
+        // Writes a member name; must be followed by exactly one value.
+        void WriteName(std::string_view name);
+
+        void WriteNull();
+        void WriteBoolean(bool value);
+        void WriteInteger(int64_t value);
+        void WriteDouble(double value);
+        void WriteString(std::string_view value);
+
+    private:
+        void BeginValue();
+
+        nl::String& m_output;
+        bool m_needs_comma;
+    };
+}
@@ -0,0 +1,109 @@
+/*
+ * JSON Library by Nicco © 2019
+ */
+
+#pragma once
+
+#include <NativeLib/Json.h>
+#include <NativeLib/String.h>
+#include <NativeLib/Containers/Vector.h>
+
+#include <stdint.h>
+#include <string_view>
+
+namespace nl
+{
+    namespace json_internals
+    {
+        enum class SelectorStepType
+        {
+            Member,         // ".name" or "['name']"
+            Index,          // "[0]"
+            MemberOrIndex,  // JSON pointer reference token; an index if the value is an array
+            Wildcard,       // ".*" or "[*]"
+            Filter          // "[?name]" or "[?name == literal]"
+        };
+
+        enum class SelectorFilterOperator
+        {
+            Exists,
+            Equal,
+            NotEqual,
+            Less,
+            LessOrEqual,
+            Greater,
+            GreaterOrEqual
+        };
+
+        struct SelectorStep
+        {
+            SelectorStepType Type = SelectorStepType::Member;
+            nl::String Name; // member name, or the filtered member
+            size_t Index = 0;
+            bool HasIndex = false;
+
+            SelectorFilterOperator Operator = SelectorFilterOperator::Exists;
+            JsonType LiteralType = JsonType::Null;
+            nl::String LiteralString;
+            double LiteralNumber = 0;
+            bool LiteralBoolean = false;
+        };
+    }
+
+    // A path compiled once and evaluated many times, either against a parsed document or directly against JSON text.
+    // Evaluation returns plain pointers into the document and does not touch any reference counts, so the results
+    // are only valid while the document is alive.
+    class JsonSelector
+    {
+    public:
+        JsonSelector() = default;
+
+        // Compiles an RFC 6901 JSON pointer such as "/users/0/name". An empty pointer selects the whole document.
+        static JsonSelector CompilePointer(std::string_view pointer);
+
+        // Compiles a path such as "$.users[*].name", "users[0]", "users[?active].id" or "users[?age >= 18]".
+        // Filters support ==, !=, <, <=, > and >= against a JSON string, number, true, false or null literal.
+        static JsonSelector CompilePath(std::string_view path);
+
+        bool IsSingular() const; // true if at most one value can match (no wildcards or filters)
+
+        const JsonBase* SelectFirst(const JsonBase* root) const;
+        JsonBase* SelectFirst(JsonBase* root) const;
+        size_t Select(const JsonBase* root, nl::Vector<const JsonBase*>& results) const;
+
+        template <typename T>
+        const T* SelectFirst(const JsonBase* root) const
+        {
+            auto value = SelectFirst(root);
+            if (!value)
+                return nullptr;
+
+            if (!T::IsOfType(value->GetType()))
+                throw IncorrectMemberTypeException();
+
+            return static_cast<const T*>(value);
+        }
+
+        template <typename T>
+        T* SelectFirst(JsonBase* root) const
+        {
+            auto value = SelectFirst(root);
+            if (!value)
+                return nullptr;
+
+            if (!T::IsOfType(value->GetType()))
+                throw IncorrectMemberTypeException();
+
+            return static_cast<T*>(value);
+        }
+
+        // Evaluates against JSON text without building a document, skipping everything that cannot match.
+        // Each result is the text of a matched value which can be handed to ParseJson if needed.
+        // Returns false if the text is malformed along the evaluated path.
+        bool SelectFirst(std::string_view json, std::string_view& result) const;
+        bool Select(std::string_view json, nl::Vector<std::string_view>& results) const;
+
+    private:
+        nl::Vector<json_internals::SelectorStep> m_steps;
+    };
+}
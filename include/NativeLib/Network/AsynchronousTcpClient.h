@@ -1 +1,67 @@
-#pragma once
\ No newline at end of file
+#pragma once
+
+#include <NativeLib/Network/NetworkCommon.h>
+
+#include <functional>
+
+namespace nl::network
+{
+    enum class TcpRequestStatus
+    {
+        Success,
+        ConnectFailed, // no connection to the endpoint could be made in time
+        TimedOut,      // no response within the request timeout
+        Disconnected,  // the connection closed before the response arrived
+        Stopped        // the client was stopped with the request pending
+    };
+
+    // Receives the response to a request on a worker thread; lp is only valid during the call and empty unless the
+    // status is Success. Must not throw.
+    typedef std::function<void(TcpRequestStatus status, const void* lp, size_t size)> TcpResponseHandler;
+
+    // Request/response client keeping a pool of connections per endpoint. Requests are written to the least busy
+    // connection of the pool behind the requests already in flight on it, and the responses are matched to them in
+    // the order they were sent, so a steady stream of calls to a service reuses a few connections instead of making
+    // one per call. On Linux the workers run edge triggered epoll loops like the server's, and every endpoint is
+    // served by one worker, which keeps its pool free of locks.
+    class AsynchronousTcpClient
+    {
+    public:
+        AsynchronousTcpClient();
+        virtual ~AsynchronousTcpClient();
+
+        AsynchronousTcpClient(const AsynchronousTcpClient&) = delete;
+        AsynchronousTcpClient& operator =(const AsynchronousTcpClient&) = delete;
+
+        // thread_count 0 uses one per processor.
+        void Start(int32_t thread_count = 1);
+        // Calls the handlers of the requests still pending with TcpRequestStatus::Stopped. Must not be called
+        // while other threads are still making requests.
+        void Stop();
+
+        // Queues a request to ip (network byte order) and port from any thread; connections are made as needed.
+        void Request(uint32_t ip, uint16_t port, const void* lp, size_t len, TcpResponseHandler handler);
+
+        // max_connections is the limit per endpoint and max_pipelined_requests the requests in flight per
+        // connection; 1 waits for every response before the next request on the connection. The defaults are 4
+        // connections with 16 requests each. Cannot be changed while the client is running.
+        void SetPoolLimits(uint32_t max_connections, uint32_t max_pipelined_requests);
+
+        // In milliseconds, 0 to disable one. The request timeout includes the time spent waiting for a connection;
+        // as the responses behind a late one cannot arrive any sooner, its connection is closed and the other
+        // requests on it fail with Disconnected. Pooled connections are closed once idle for idle_timeout. The
+        // defaults are 5 seconds to connect, no request timeout and a minute idle. Cannot be changed while the
+        // client is running.
+        void SetTimeouts(uint32_t connect_timeout, uint32_t request_timeout, uint32_t idle_timeout);
+
+    protected:
+        // Returns the length of the response at the start of data, 0 if more data is needed, or SIZE_MAX if the
+        // data cannot be a response, which closes the connection. Called on a worker thread. The default reads a
+        // little endian 32 bit length of the bytes that follow it, and the handler gets the response prefix and all.
+        virtual size_t GetResponseLength(const void* data, size_t size);
+
+    private:
+        friend struct TcpClientState;
+        struct TcpClientState* m_state;
+    };
+}
@@ -1,28 +1,96 @@
 #pragma once
 
 #include <NativeLib/Network/NetworkCommon.h>
+#include <NativeLib/Network/Framing.h>
+
+#include <functional>
 
 namespace nl::network
 {
+    enum class TcpServerBackend
+    {
+        Default, // I/O completion ports on Windows, epoll on Linux
+        IoUring  // Linux 6.0+: multishot accept and receive into kernel provided buffers, sends batched per loop
+    };
+
+    // The timeout OnClientTimedOut is called for.
+    enum class TcpServerTimeout
+    {
+        Idle,  // nothing was received or sent
+        Read,  // nothing was received
+        Write  // queued data made no progress, e.g. a client that stopped reading
+    };
+
+    // Called once the server no longer needs a buffer given to Send by reference.
+    typedef std::function<void()> SendReleaseCallback;
+
+    // TCP server calling the virtual handlers from its worker threads. On Linux every worker runs its own edge
+    // triggered epoll loop with a listening socket sharing the port through SO_REUSEPORT, so the kernel spreads the
+    // connections over the workers and a client is always handled by the same thread.
     class AsynchronousTcpServer
     {
     public:
         AsynchronousTcpServer();
         virtual ~AsynchronousTcpServer();
 
-        void Start(uint32_t bind_ip, uint16_t port, int32_t backlog, int32_t thread_count);
+        // bind_ip is in network byte order; port 0 picks a free port. thread_count 0 uses one per processor.
+        // The IoUring backend falls back to the default one where io_uring or buffer rings are unavailable.
+        void Start(uint32_t bind_ip, uint16_t port, int32_t backlog, int32_t thread_count, TcpServerBackend backend = TcpServerBackend::Default);
         void Stop();
 
+        uint16_t GetPort() const; // the port listened on while started
+        TcpServerBackend GetBackend() const; // the backend in use while started
+
         uint32_t GetClientIP(DPID dpid);
         bool GetClientIP(DPID dpid, char* ptr);
         void Disconnect(DPID dpid);
+        // Queues data from any thread. Every connection has a chunked send queue that small sends are copied into
+        // back to back, and the worker writes everything queued for a connection with a single writev per loop.
+        // OnSendCompleted follows once the queue has been handed to the kernel entirely. DPID_ALLPLAYERS sends to
+        // every connected client like Broadcast.
         void Send(DPID dpid, const void* lp, size_t len);
+        // Queues lp by reference instead of copying it. The buffer must stay unchanged until release is called,
+        // which happens on a worker thread once the data was sent or the connection closed, or right away if the
+        // client is gone.
+        void Send(DPID dpid, const void* lp, size_t len, SendReleaseCallback release);
+
+        // Queues the same data for count clients, or for every connected client when dpids is nullptr. The data is
+        // copied once into a reference counted buffer that all the send queues point at, and every worker is woken
+        // once to write to its own clients. Unknown DPIDs are skipped.
+        void Broadcast(const DPID* dpids, size_t count, const void* lp, size_t len);
+        // Broadcasts lp by reference; release is called once the last of the clients is done with it.
+        void Broadcast(const DPID* dpids, size_t count, const void* lp, size_t len, SendReleaseCallback release);
+
+        // Queues lp as one frame behind the prefix set by SetFraming; the prefix and data are copied together, so
+        // frames sent from different threads never interleave. DPID_ALLPLAYERS broadcasts the frame.
+        void SendFrame(DPID dpid, const void* lp, size_t len);
+
+        // Backpressure: OnSendBufferFull is called when the bytes queued for a connection reach high_watermark
+        // and OnSendBufferDrained once they are back down to low_watermark. Send never refuses data, so callers
+        // are expected to hold back in between. The defaults are 1 MB and 256 KB.
+        void SetSendBufferWatermarks(size_t high_watermark, size_t low_watermark);
+
+        // Connection timeouts in milliseconds, 0 to disable one; all are disabled by default. Every worker keeps
+        // one timer per connection in a timer wheel, and a connection's activity only updates timestamps that the
+        // timer checks when it fires, so traffic never touches the wheel. Timeouts are accurate to about 10 ms.
+        // A connection that timed out is disconnected after OnClientTimedOut returns.
+        void SetTimeouts(uint32_t idle_timeout, uint32_t read_timeout, uint32_t write_timeout);
+
+        // Splits what clients send into frames behind a length prefix, and OnClientDataReceived is called once per
+        // frame with the frame alone. Frames within one receive are passed on from the receive buffer itself; only
+        // frames split over receives are collected per client. A client sending a malformed prefix or a frame over
+        // max_frame_size is disconnected. FramePrefix::None, the default, passes the stream on as it arrives.
+        // Cannot be changed while the server is running.
+        void SetFraming(FramePrefix prefix, size_t max_frame_size = FrameDefaultMaxSize);
 
     protected:
         virtual void OnClientConnected(nl::network::DPID dpId) {}
         virtual void OnClientDisconnected(nl::network::DPID dpId) {}
         virtual void OnClientDataReceived(nl::network::DPID dpId, const void* lp, size_t size) {}
         virtual void OnSendCompleted(nl::network::DPID dpId) {}
+        virtual void OnSendBufferFull(nl::network::DPID dpId) {}
+        virtual void OnSendBufferDrained(nl::network::DPID dpId) {}
+        virtual void OnClientTimedOut(nl::network::DPID dpId, TcpServerTimeout timeout) {}
 
     private:
         uint32_t WorkerThread();
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <NativeLib/Allocators.h>
+
+#include <stdint.h>
+
+namespace nl::network
+{
+    // The length prefix in front of every frame of a stream, counting the bytes that follow it.
+    enum class FramePrefix
+    {
+        None,   // no framing, the stream is passed on as it arrives
+        VarInt, // 7 bit encoded like nl::io::VarIntEncode, 1 byte for frames below 128 bytes
+        UInt16, // little endian
+        UInt32  // little endian
+    };
+
+    enum class FrameStatus
+    {
+        Complete,   // a frame was returned
+        Incomplete, // the data was used up without completing a frame
+        Invalid     // the prefix is malformed or over the maximum frame size; the stream cannot be resynchronized
+    };
+
+    static constexpr size_t FrameMaxPrefixSize = 10;
+    static constexpr size_t FrameDefaultMaxSize = 16 << 20;
+
+    // Writes the prefix of a frame of size bytes to dst, which must hold FrameMaxPrefixSize bytes, and returns its
+    // length. Throws ArgumentException if size does not fit the prefix.
+    size_t FrameEncodePrefix(FramePrefix prefix, size_t size, void* dst);
+
+    // Splits a received byte stream into length prefixed frames. A frame lying entirely within the data given to
+    // Decode is returned where it is without copying it; only a frame split over several receives is collected, in
+    // a buffer sized to the frame from its prefix, so its bytes are copied once and nothing is ever moved up.
+    class FrameDecoder
+    {
+    public:
+        FrameDecoder(FramePrefix prefix = FramePrefix::VarInt, size_t max_frame_size = FrameDefaultMaxSize);
+
+        FrameDecoder(const FrameDecoder&) = delete;
+        FrameDecoder& operator =(const FrameDecoder&) = delete;
+
+        // Consumes lp and size up to the end of the next frame and returns it in frame and frame_size; call until
+        // it no longer returns FrameStatus::Complete. A frame is valid until the next call, and one inside the data
+        // points into it. Once Invalid is returned, every call returns it until Reset.
+        FrameStatus Decode(const void*& lp, size_t& size, const void*& frame, size_t& frame_size);
+
+        // Drops a partially received frame.
+        void Reset();
+
+        // Bytes held of a frame not completed yet.
+        size_t GetBufferedSize() const { return m_prefix_length + m_buffered; }
+
+    private:
+        int32_t ReadPrefix(const void* lp, size_t size, uint64_t& length) const;
+
+        FramePrefix m_prefix_type;
+        size_t m_max_frame_size;
+        bool m_invalid;
+
+        // a prefix split over receives
+        uint8_t m_prefix[FrameMaxPrefixSize];
+        size_t m_prefix_length;
+
+        // a frame split over receives, m_expected bytes long; 0 while there is none
+        nl::memory::Memory m_buffer;
+        size_t m_expected;
+        size_t m_buffered;
+        bool m_delivered; // the buffer was returned by the last call
+    };
+}
@@ -1,7 +1,5 @@
 #pragma once
 
-#ifdef NL_PLATFORM_WINDOWS
-
 #include <NativeLib/Containers/Map.h>
 #include <NativeLib/Containers/Stack.h>
 
@@ -9,9 +7,16 @@
 #include <NativeLib/Exceptions.h>
 #include <NativeLib/String.h>
 #include <NativeLib/RAII/Shared.h>
+#include <NativeLib/Threading/Event.h>
+#include <NativeLib/Threading/ReadWriteLock.h>
 
 namespace nl
 {
+    namespace threading
+    {
+        class ThreadPool;
+    }
+
     namespace rpc
     {
         DeclarePassthroughException(RpcException);
@@ -25,12 +30,34 @@ namespace nl
         typedef void(*pfnEventHandler)(class Server* rpc, Events event, intptr_t data);
         typedef void(*pfn)(class Server* rpc, int32_t client_id, nl::Shared<const nl::JsonObject> request, nl::Shared<nl::JsonObject> response);
 
+        // Serves procedures to clients sending requests as packets of an 8 byte header, the packet size and a
+        // request ID, followed by the method name and the request JSON as length prefixed strings. Windows serves a
+        // named pipe through an I/O completion port, Linux a Unix domain socket through epoll; the packets are the
+        // same on both.
         class Server
         {
         public:
             Server();
             ~Server();
+
+#ifdef NL_PLATFORM_WINDOWS
             void Run(const wchar_t* pipeName);
+#else
+            // Listens on a Unix domain socket at path until Stop is called. A socket file left at path by an
+            // earlier run is replaced.
+            void Run(const char* path);
+#endif
+
+            // Makes Run return once the requests given to the dispatch pool have completed. Can be called from any
+            // thread, procedures included.
+            void Stop();
+
+            // Runs the procedures on pool instead of the thread in Run, so a slow one no longer holds up every
+            // client; they must then be thread safe. With ordered, a client's requests run one after the other and
+            // are answered in the order they were sent. Otherwise they run side by side and each response is sent
+            // as soon as it is ready, for the client to match by request ID. nullptr, the default, runs the
+            // procedures inline. The pool must outlive Run, and this cannot be changed while Run is running.
+            void SetDispatch(nl::threading::ThreadPool* pool, bool ordered = true);
 
             void BindEventHandler(pfnEventHandler pfn)
             {
@@ -46,21 +73,41 @@ namespace nl
             void SetTag(intptr_t lUserData) { m_lUserData = lUserData; }
 
         protected:
-            void HandleRequest(class PipeClient* client, class DataBuffer& buffer, int requestId);
+            void HandleRequest(class PipeClient* client, int requestId, const nl::String& method, const nl::String& jsonData);
             void SendError(class PipeClient* client, int requestId, const char* message);
             void SendJson(class PipeClient* client, int requestId, nl::Shared<const nl::JsonObject> json);
 
         private:
             pfnEventHandler m_pfnEventHandler;
             nl::Map<nl::String, pfn> m_procedures;
-            void* m_hIocp;
             intptr_t m_lUserData;
 
             int32_t m_lNextClientId;
+            bool m_running;
+
+            nl::threading::ThreadPool* m_pool; // runs the procedures unless nullptr
+            bool m_ordered;
+            nl::threading::ReadWriteLock m_dispatch_lock;
+            size_t m_outstanding; // requests given to m_pool that have not completed
+            nl::threading::Event m_idle; // set when m_outstanding drops to zero
+
+            void Dispatch(class PipeClient* client, int requestId, nl::String&& method, nl::String&& jsonData);
+            void Submit(struct RpcRequest* request);
+            void Execute(struct RpcRequest* request);
+            void WaitForRequests();
+
+            // Handles the complete packets at the front of the client's buffer. Returns false if the client sent
+            // a malformed packet.
+            bool HandlePackets(class PipeClient* client);
+
+#ifdef NL_PLATFORM_WINDOWS
+            void* m_hIocp;
 
             void ConnectNewClient(const wchar_t* pipeName);
+#else
+            friend struct RpcServerState;
+            struct RpcServerState* m_state;
+#endif
         };
     }
-}
-
-#endif
\ No newline at end of file
+}
\ No newline at end of file
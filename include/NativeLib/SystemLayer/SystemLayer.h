@@ -22,6 +22,9 @@ namespace nl::systemlayer
         typedef int64_t TGetVirtualMemoryPageSize();
         typedef void* TAllocateVirtualMemory(size_t size);
         typedef void TFreeVirtualMemory(void* ptr);
+        typedef void* TReserveVirtualMemory(size_t size); // reserve address space without backing it with memory
+        typedef bool TCommitVirtualMemory(void* ptr, size_t size); // back a page aligned part of a reservation with memory
+        typedef void TReleaseVirtualMemory(void* ptr, size_t size); // release a whole reservation
 
         // file api
         typedef FileHandle TFileOpen(const char* filename, nl::io::CreateMode mode, bool writable);
@@ -34,6 +37,12 @@ namespace nl::systemlayer
         typedef bool TFileFlush(FileHandle fp); // flush
         typedef bool TFileSetEndOfFile(FileHandle fp); // set end of file
         typedef bool TFileOrDirectoryExists(const char* path);
+        typedef int64_t TFileReadAt(FileHandle fp, void* ptr, int64_t numberOfBytesToRead, int64_t offset); // read at offset, thread safe
+        typedef int64_t TFileWriteAt(FileHandle fp, const void* ptr, int64_t numberOfBytesToWrite, int64_t offset); // write at offset, thread safe
+        typedef int64_t TFileGetNativeHandle(FileHandle fp); // OS file descriptor or handle, -1 if the file is not backed by one
+        typedef int64_t TFileReadV(FileHandle fp, const nl::io::IOSegment* segments, int32_t count); // scatter read
+        typedef int64_t TFileWriteV(FileHandle fp, const nl::io::IOSegment* segments, int32_t count); // gather write
+        typedef int64_t TFileCopy(FileHandle source, FileHandle target, int64_t count); // copy between the current positions inside the kernel, -1 if the files do not support it
 
         // sockets api (WIP)
     }
@@ -49,6 +58,9 @@ namespace nl::systemlayer
         delegates::TGetVirtualMemoryPageSize* GetVirtualMemoryPageSize;
         delegates::TAllocateVirtualMemory* AllocateVirtualMemory;
         delegates::TFreeVirtualMemory* FreeVirtualMemory;
+        delegates::TReserveVirtualMemory* ReserveVirtualMemory;
+        delegates::TCommitVirtualMemory* CommitVirtualMemory;
+        delegates::TReleaseVirtualMemory* ReleaseVirtualMemory;
 
         delegates::TFileOpen* FileOpen;
         delegates::TFileClose* FileClose;
@@ -60,6 +72,12 @@ namespace nl::systemlayer
         delegates::TFileFlush* FileFlush;
         delegates::TFileSetEndOfFile* FileSetEndOfFile;
         delegates::TFileOrDirectoryExists* FileOrDirectoryExists;
+        delegates::TFileReadAt* FileReadAt;
+        delegates::TFileWriteAt* FileWriteAt;
+        delegates::TFileGetNativeHandle* FileGetNativeHandle;
+        delegates::TFileReadV* FileReadV;
+        delegates::TFileWriteV* FileWriteV;
+        delegates::TFileCopy* FileCopy;
     };
 
     const SystemLayerFunctions* GetSystemLayerFunctions();
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace nl::threading
+{
+    // Synchronization event that threads can wait on until it becomes signaled.
+    // A manual reset event stays signaled until Reset is called, an auto reset event is reset when a single waiting thread is released.
+    class Event
+    {
+    public:
+        static constexpr uint32_t Infinite = 0xffffffff;
+
+        Event(bool manual_reset = true, bool initial_state = false);
+        ~Event();
+
+        Event(const Event&) = delete;
+        Event& operator =(const Event&) = delete;
+
+        void Set();
+        void Reset();
+
+        // Waits until the event is signaled or the timeout elapses, returns false on timeout.
+        bool Wait(uint32_t milliseconds = Infinite);
+
+    private:
+        void* m_ptr;
+    };
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+namespace nl::threading
+{
+    // Fixed size pool of worker threads executing queued work in the order it was queued.
+    class ThreadPool
+    {
+    public:
+        // Creates thread_count worker threads, or one per processor if thread_count is zero or less.
+        ThreadPool(int32_t thread_count = 0);
+
+        // Waits for all queued work to complete before the worker threads are terminated.
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator =(const ThreadPool&) = delete;
+
+        int32_t GetThreadCount() const;
+
+        // Queues work to be executed on one of the worker threads. The work must not throw.
+        void Queue(std::function<void()> work);
+
+        // Blocks until all queued work has completed.
+        void Wait();
+
+        static int32_t GetProcessorCount();
+
+    private:
+        struct ThreadPoolState* m_state;
+    };
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+namespace nl::threading
+{
+    class ThreadPool;
+
+    // Identifies a scheduled timer; 0 never does.
+    typedef uint64_t TimerId;
+
+    // Hierarchical timing wheel: six levels of 64 slots where a slot of one level spans a whole turn of the level
+    // below. A timer is linked into the slot its expiry falls into on the lowest level that reaches it, so
+    // scheduling and cancelling take the same time however many timers there are, and every turn of a level moves
+    // the timers of the next slot above down a level. Timers never fire early and at most one tick late.
+    class TimerWheel
+    {
+    public:
+        // resolution is the length of a tick in milliseconds.
+        TimerWheel(uint32_t resolution = 1);
+        ~TimerWheel();
+
+        TimerWheel(const TimerWheel&) = delete;
+        TimerWheel& operator =(const TimerWheel&) = delete;
+
+        // Calls callback once in delay milliseconds. All members can be called from any thread, callbacks included.
+        TimerId Schedule(uint32_t delay, std::function<void()> callback);
+        // Calls callback every interval milliseconds until the timer is cancelled.
+        TimerId SchedulePeriodic(uint32_t interval, std::function<void()> callback);
+
+        // Moves a timer to delay milliseconds from now. Returns false if it fired or was cancelled already.
+        bool Reschedule(TimerId id, uint32_t delay);
+        // Returns false if the timer fired or was cancelled already. A callback that is running is not waited for.
+        bool Cancel(TimerId id);
+
+        // Fires the timers that are due, on the calling thread or queued on pool. Returns the number fired.
+        size_t Advance(ThreadPool* pool = nullptr);
+
+        // Milliseconds until Advance has something to do, never past the earliest timer; Event::Infinite if there
+        // is no timer. Meant as the timeout of the wait of an event loop driving the wheel.
+        uint32_t GetNextTimeout() const;
+
+        size_t GetCount() const;
+
+        // Advances the wheel from a thread of its own for using it standalone, firing the timers on pool if one is
+        // given. Stop is called by the destructor.
+        void Start(ThreadPool* pool = nullptr);
+        void Stop();
+
+        // The monotonic clock of the wheel in milliseconds.
+        static uint64_t GetTime();
+
+    private:
+        struct TimerWheelState* m_state;
+    };
+}
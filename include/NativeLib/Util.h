@@ -2,6 +2,9 @@
 
 #include <NativeLib/String.h>
 
+#include <type_traits>
+#include <cstring>
+
 namespace nl::util
 {
     template <typename T>
@@ -54,6 +57,46 @@ namespace nl::util
         return result;
     }
 
+    // Reverses the byte order of an integer or floating point value.
+    template <typename T>
+    inline T ByteSwap(T value)
+    {
+        static_assert(std::is_arithmetic_v<T>, "ByteSwap requires an integer or floating point type.");
+
+        if constexpr (sizeof(T) == 1)
+        {
+            return value;
+        }
+        else
+        {
+            // written with shifts so that compilers emit their byte swap instruction
+            using U = std::conditional_t<sizeof(T) == 2, uint16_t, std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>;
+            static_assert(sizeof(U) == sizeof(T), "ByteSwap supports 1, 2, 4 and 8 byte types.");
+
+            U v;
+            memcpy(&v, &value, sizeof(v));
+
+            if constexpr (sizeof(T) == 2)
+            {
+                v = (U)((v >> 8) | (v << 8));
+            }
+            else if constexpr (sizeof(T) == 4)
+            {
+                v = ((v & 0x000000ffu) << 24) | ((v & 0x0000ff00u) << 8) | ((v & 0x00ff0000u) >> 8) | ((v & 0xff000000u) >> 24);
+            }
+            else
+            {
+                v = ((v & 0x00000000000000ffull) << 56) | ((v & 0x000000000000ff00ull) << 40) |
+                    ((v & 0x0000000000ff0000ull) << 24) | ((v & 0x00000000ff000000ull) << 8) |
+                    ((v & 0x000000ff00000000ull) >> 8) | ((v & 0x0000ff0000000000ull) >> 24) |
+                    ((v & 0x00ff000000000000ull) >> 40) | ((v & 0xff00000000000000ull) >> 56);
+            }
+
+            memcpy(&value, &v, sizeof(v));
+            return value;
+        }
+    }
+
     inline nl::String GetSize(size_t size)
     {
         double v = (double)size;
@@ -24,6 +24,12 @@ namespace nl
         {
         }
 
+        Memory::Memory() noexcept :
+            m_lp(s_zeroSizeDataPointer)
+        {
+            nl::threading::Interlocked::Increment(&s_zeroSizeData.References);
+        }
+
         Memory::~Memory()
         {
             auto info = reinterpret_cast<MemoryDataInfo*>(m_lp) - 1;
@@ -78,6 +84,25 @@ namespace nl
             return Memory(lp);
         }
 
+        void Memory::Reallocate(size_t size)
+        {
+            if (m_lp == s_zeroSizeDataPointer)
+            {
+                *this = Allocate(size);
+                return;
+            }
+
+            auto info = reinterpret_cast<MemoryDataInfo*>(m_lp) - 1;
+            nl_assert_if_debug(info->References == 1);
+
+            auto new_info = reinterpret_cast<MemoryDataInfo*>(nl::memory::Reallocate(info, sizeof(MemoryDataInfo) + size));
+            if (!new_info)
+                throw BadAllocationException();
+
+            new_info->Size = size;
+            m_lp = reinterpret_cast<void*>(new_info + 1);
+        }
+
         ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
         void* Allocate(size_t size)
@@ -0,0 +1,568 @@
+#include "StdAfx.h"
+
+#include <NativeLib/IO/AsyncFile.h>
+#include <NativeLib/SystemLayer/SystemLayer.h>
+#include <NativeLib/Containers/Queue.h>
+#include <NativeLib/Threading/Event.h>
+#include <NativeLib/Threading/ThreadPool.h>
+#include <NativeLib/Exceptions.h>
+#include <NativeLib/Allocators.h>
+#include <NativeLib/Util.h>
+
+//!ALLOW_INCLUDE "IoUring.h"
+#include "IoUring.h"
+
+#ifdef NL_HAS_IO_URING
+//!ALLOW_INCLUDE "sys/uio.h"
+#include <sys/uio.h>
+#endif
+
+namespace nl
+{
+    namespace io
+    {
+        // Linux refuses to transfer more than this in a single read or write
+        static constexpr int64_t AsyncFile_MaxTransfer = 0x7ffff000;
+
+        enum class AsyncFileOperationType
+        {
+            Read,
+            Write,
+            ReadFixed,
+            WriteFixed,
+            Flush
+        };
+
+        struct AsyncFileOperation
+        {
+            AsyncFileOperation* prev = nullptr;
+            AsyncFileOperation* next = nullptr;
+
+            AsyncFileOperationType Type = AsyncFileOperationType::Read;
+            void* Buffer = nullptr;
+            int64_t Count = 0;
+            int64_t Offset = 0;
+            uint32_t BufferIndex = 0;
+
+            AsyncFileCallback Callback;
+            int64_t Result = 0;
+        };
+
+        struct AsyncFileState
+        {
+            systemlayer::FileHandle File = 0;
+            AsyncFileBackend Backend = AsyncFileBackend::ThreadPool;
+            uint32_t QueueDepth = 0;
+            uint32_t Pending = 0;
+
+            nl::Vector<AsyncFileOperation*> FreeOperations;
+
+            nl::Vector<void*> Buffers;
+            nl::Vector<size_t> BufferSizes;
+
+#ifdef NL_HAS_IO_URING
+            IoUring Ring;
+            bool FixedFile = false;
+            bool FixedBuffers = false;
+            int Descriptor = -1;
+#endif
+
+            nl::threading::ThreadPool* Pool = nullptr;
+            nl::Queue<AsyncFileOperation> Queued;
+            nl::SafeQueue<AsyncFileOperation> Completed;
+            nl::threading::Event CompletedEvent{ false, false };
+
+            ~AsyncFileState()
+            {
+                for (auto op : FreeOperations)
+                    nl::memory::Destroy(op);
+            }
+        };
+
+        static AsyncFileOperation* AsyncFile_AllocateOperation(AsyncFileState* state)
+        {
+            if (state->FreeOperations.GetCount() != 0)
+                return state->FreeOperations.PopLast();
+
+            return nl::memory::ConstructThrow<AsyncFileOperation>();
+        }
+
+        static uint32_t AsyncFile_Complete(AsyncFileState* state, AsyncFileOperation* op)
+        {
+            // recycle the operation before the callback runs so it may queue more work
+            AsyncFileCallback callback = std::move(op->Callback);
+            int64_t result = op->Result;
+
+            op->Callback = nullptr;
+            state->FreeOperations.Add(op);
+            --state->Pending;
+
+            if (callback)
+                callback(result);
+
+            return 1;
+        }
+
+        static void AsyncFile_Execute(AsyncFileState* state, AsyncFileOperation* op)
+        {
+            auto functions = systemlayer::GetSystemLayerFunctions();
+
+            switch (op->Type)
+            {
+            case AsyncFileOperationType::Read:
+            case AsyncFileOperationType::ReadFixed:
+                op->Result = functions->FileReadAt(state->File, op->Buffer, op->Count, op->Offset);
+                break;
+            case AsyncFileOperationType::Write:
+            case AsyncFileOperationType::WriteFixed:
+                op->Result = functions->FileWriteAt(state->File, op->Buffer, op->Count, op->Offset);
+                break;
+            case AsyncFileOperationType::Flush:
+                op->Result = functions->FileFlush(state->File) ? 0 : -1;
+                break;
+            }
+        }
+
+#ifdef NL_HAS_IO_URING
+        static void AsyncFile_Prepare(AsyncFileState* state, io_uring_sqe* sqe, AsyncFileOperation* op)
+        {
+            switch (op->Type)
+            {
+            case AsyncFileOperationType::Read:
+                sqe->opcode = IORING_OP_READ;
+                break;
+            case AsyncFileOperationType::Write:
+                sqe->opcode = IORING_OP_WRITE;
+                break;
+            case AsyncFileOperationType::ReadFixed:
+                sqe->opcode = state->FixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+                break;
+            case AsyncFileOperationType::WriteFixed:
+                sqe->opcode = state->FixedBuffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                break;
+            case AsyncFileOperationType::Flush:
+                sqe->opcode = IORING_OP_FSYNC;
+                sqe->flags |= IOSQE_IO_DRAIN; // starts once everything queued before it has completed
+                break;
+            }
+
+            if (state->FixedFile)
+            {
+                sqe->fd = 0;
+                sqe->flags |= IOSQE_FIXED_FILE;
+            }
+            else
+            {
+                sqe->fd = state->Descriptor;
+            }
+
+            if (op->Type != AsyncFileOperationType::Flush)
+            {
+                sqe->addr = (uint64_t)(uintptr_t)op->Buffer;
+                sqe->len = (uint32_t)op->Count;
+                sqe->off = (uint64_t)op->Offset;
+                sqe->buf_index = (uint16_t)op->BufferIndex;
+            }
+
+            sqe->user_data = (uint64_t)(uintptr_t)op;
+        }
+
+        static void AsyncFile_SubmitRing(AsyncFileState* state, uint32_t wait_for)
+        {
+            int result = state->Ring.Submit(wait_for);
+            if (result < 0 &&
+                result != -EAGAIN &&
+                result != -EBUSY) // completion queue is full; reaping makes room
+                throw IOException("Failed to submit to io_uring.");
+        }
+#endif
+
+        static uint32_t AsyncFile_Reap(AsyncFileState* state)
+        {
+            uint32_t count = 0;
+
+#ifdef NL_HAS_IO_URING
+            if (state->Backend == AsyncFileBackend::IoUring)
+            {
+                while (auto cqe = state->Ring.PeekCqe())
+                {
+                    auto op = (AsyncFileOperation*)(uintptr_t)cqe->user_data;
+                    op->Result = cqe->res;
+                    state->Ring.AdvanceCqe();
+
+                    count += AsyncFile_Complete(state, op);
+                }
+
+                return count;
+            }
+#endif
+
+            AsyncFileOperation* op;
+            while (state->Completed.TryPopHead(&op))
+                count += AsyncFile_Complete(state, op);
+
+            return count;
+        }
+
+        static uint32_t AsyncFile_Submit(AsyncFileState* state)
+        {
+#ifdef NL_HAS_IO_URING
+            if (state->Backend == AsyncFileBackend::IoUring)
+            {
+                uint32_t count = state->Ring.GetUnsubmitted();
+                AsyncFile_SubmitRing(state, 0);
+                return count - state->Ring.GetUnsubmitted();
+            }
+#endif
+
+            uint32_t count = 0;
+            AsyncFileOperation* op;
+            while (state->Queued.TryPopHead(&op))
+            {
+                state->Pool->Queue([state, op]()
+                {
+                    AsyncFile_Execute(state, op);
+                    state->Completed.AddTail(op);
+                    state->CompletedEvent.Set();
+                });
+
+                ++count;
+            }
+
+            return count;
+        }
+
+        static uint32_t AsyncFile_Wait(AsyncFileState* state, uint32_t min_completions)
+        {
+            uint32_t count = AsyncFile_Reap(state);
+            AsyncFile_Submit(state);
+
+            while (count < min_completions &&
+                state->Pending != 0)
+            {
+#ifdef NL_HAS_IO_URING
+                if (state->Backend == AsyncFileBackend::IoUring)
+                    AsyncFile_SubmitRing(state, 1);
+                else
+#endif
+                    state->CompletedEvent.Wait();
+
+                count += AsyncFile_Reap(state);
+            }
+
+            return count;
+        }
+
+        static void AsyncFile_Queue(AsyncFileState* state, AsyncFileOperation* op)
+        {
+#ifdef NL_HAS_IO_URING
+            if (state->Backend == AsyncFileBackend::IoUring)
+            {
+                auto sqe = state->Ring.GetSqe();
+                if (!sqe)
+                {
+                    AsyncFile_SubmitRing(state, 0);
+                    sqe = state->Ring.GetSqe();
+                    if (!sqe)
+                    {
+                        state->FreeOperations.Add(op);
+                        throw IOException("The io_uring submission queue is full.");
+                    }
+                }
+
+                AsyncFile_Prepare(state, sqe, op);
+                ++state->Pending;
+                return;
+            }
+#endif
+
+            state->Queued.AddTail(op);
+            ++state->Pending;
+        }
+
+        static void AsyncFile_QueueOperation(AsyncFileState* state, AsyncFileOperationType type, void* buffer, int64_t count, int64_t offset, uint32_t buffer_index, AsyncFileCallback&& callback)
+        {
+            if (!state)
+                throw InvalidOperationException("The file is not open.");
+
+            if (count < 0 ||
+                count > AsyncFile_MaxTransfer)
+                throw ArgumentException("The number of bytes is out of range.");
+
+            if (offset < 0)
+                throw ArgumentException("The offset cannot be negative.");
+
+            // stay within the queue depth by completing older operations first
+            if (state->Pending >= state->QueueDepth)
+                AsyncFile_Wait(state, 1);
+
+            auto op = AsyncFile_AllocateOperation(state);
+            op->Type = type;
+            op->Buffer = buffer;
+            op->Count = count;
+            op->Offset = offset;
+            op->BufferIndex = buffer_index;
+            op->Callback = std::move(callback);
+            op->Result = 0;
+
+            AsyncFile_Queue(state, op);
+        }
+
+        static void* AsyncFile_GetFixedBuffer(AsyncFileState* state, uint32_t buffer_index, size_t buffer_offset, int64_t count)
+        {
+            if (!state)
+                throw InvalidOperationException("The file is not open.");
+
+            if (buffer_index >= state->Buffers.GetCount())
+                throw ArgumentException("The buffer index is not registered.");
+
+            if (count < 0 ||
+                buffer_offset > state->BufferSizes[buffer_index] ||
+                (size_t)count > state->BufferSizes[buffer_index] - buffer_offset)
+                throw ArgumentException("The range is outside of the registered buffer.");
+
+            return (char*)state->Buffers[buffer_index] + buffer_offset;
+        }
+
+        ///////////////////////////////////////////////////////////////
+
+        AsyncFile::AsyncFile() :
+            m_state(nullptr)
+        {
+        }
+
+        AsyncFile::AsyncFile(AsyncFileState* state) :
+            m_state(state)
+        {
+        }
+
+        AsyncFile::~AsyncFile()
+        {
+            Close();
+        }
+
+        AsyncFile::operator bool() const
+        {
+            return m_state != nullptr;
+        }
+
+        bool AsyncFile::IsOpen() const
+        {
+            return m_state != nullptr;
+        }
+
+        AsyncFileBackend AsyncFile::GetBackend() const
+        {
+            nl_assert_if_debug(m_state);
+            return m_state->Backend;
+        }
+
+        uint32_t AsyncFile::GetQueueDepth() const
+        {
+            nl_assert_if_debug(m_state);
+            return m_state->QueueDepth;
+        }
+
+        uint32_t AsyncFile::GetPending() const
+        {
+            return m_state ? m_state->Pending : 0;
+        }
+
+        int64_t AsyncFile::GetLength() const
+        {
+            if (!m_state)
+                throw InvalidOperationException("The file is not open.");
+
+            return systemlayer::GetSystemLayerFunctions()->FileGetSize(m_state->File);
+        }
+
+        void AsyncFile::Close()
+        {
+            if (!m_state)
+                return;
+
+            Drain();
+
+#ifdef NL_HAS_IO_URING
+            m_state->Ring.Close();
+#endif
+
+            if (m_state->Pool)
+                nl::memory::Destroy(m_state->Pool);
+
+            systemlayer::GetSystemLayerFunctions()->FileClose(m_state->File);
+
+            nl::memory::Destroy(m_state);
+            m_state = nullptr;
+        }
+
+        void AsyncFile::RegisterBuffers(void* const* buffers, const size_t* sizes, uint32_t count)
+        {
+            if (!m_state)
+                throw InvalidOperationException("The file is not open.");
+
+            UnregisterBuffers();
+
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                m_state->Buffers.Add(buffers[i]);
+                m_state->BufferSizes.Add(sizes[i]);
+            }
+
+#ifdef NL_HAS_IO_URING
+            if (m_state->Backend == AsyncFileBackend::IoUring &&
+                count != 0)
+            {
+                nl::Vector<iovec> iov;
+                for (uint32_t i = 0; i < count; ++i)
+                    iov.Add(iovec{ buffers[i], sizes[i] });
+
+                // registration can fail on a low locked memory limit; fixed operations then use plain reads and writes
+                m_state->FixedBuffers = m_state->Ring.RegisterBuffers(&iov[0], count) >= 0;
+            }
+#endif
+        }
+
+        void AsyncFile::UnregisterBuffers()
+        {
+            if (!m_state)
+                return;
+
+            Drain();
+
+#ifdef NL_HAS_IO_URING
+            if (m_state->FixedBuffers)
+            {
+                m_state->Ring.UnregisterBuffers();
+                m_state->FixedBuffers = false;
+            }
+#endif
+
+            m_state->Buffers.Clear();
+            m_state->BufferSizes.Clear();
+        }
+
+        void AsyncFile::ReadAsync(void* buffer, int64_t count, int64_t offset, AsyncFileCallback callback)
+        {
+            AsyncFile_QueueOperation(m_state, AsyncFileOperationType::Read, buffer, count, offset, 0, std::move(callback));
+        }
+
+        void AsyncFile::WriteAsync(const void* buffer, int64_t count, int64_t offset, AsyncFileCallback callback)
+        {
+            AsyncFile_QueueOperation(m_state, AsyncFileOperationType::Write, const_cast<void*>(buffer), count, offset, 0, std::move(callback));
+        }
+
+        void AsyncFile::ReadFixedAsync(uint32_t buffer_index, size_t buffer_offset, int64_t count, int64_t offset, AsyncFileCallback callback)
+        {
+            void* buffer = AsyncFile_GetFixedBuffer(m_state, buffer_index, buffer_offset, count);
+            AsyncFile_QueueOperation(m_state, AsyncFileOperationType::ReadFixed, buffer, count, offset, buffer_index, std::move(callback));
+        }
+
+        void AsyncFile::WriteFixedAsync(uint32_t buffer_index, size_t buffer_offset, int64_t count, int64_t offset, AsyncFileCallback callback)
+        {
+            void* buffer = AsyncFile_GetFixedBuffer(m_state, buffer_index, buffer_offset, count);
+            AsyncFile_QueueOperation(m_state, AsyncFileOperationType::WriteFixed, buffer, count, offset, buffer_index, std::move(callback));
+        }
+
+        void AsyncFile::FlushAsync(AsyncFileCallback callback)
+        {
+            // the workers give no ordering, so earlier operations are completed before the flush is queued
+            if (m_state &&
+                m_state->Backend == AsyncFileBackend::ThreadPool)
+                Drain();
+
+            AsyncFile_QueueOperation(m_state, AsyncFileOperationType::Flush, nullptr, 0, 0, 0, std::move(callback));
+        }
+
+        uint32_t AsyncFile::Submit()
+        {
+            if (!m_state)
+                throw InvalidOperationException("The file is not open.");
+
+            return AsyncFile_Submit(m_state);
+        }
+
+        uint32_t AsyncFile::Poll()
+        {
+            if (!m_state)
+                throw InvalidOperationException("The file is not open.");
+
+            return AsyncFile_Reap(m_state);
+        }
+
+        uint32_t AsyncFile::Wait(uint32_t min_completions)
+        {
+            if (!m_state)
+                throw InvalidOperationException("The file is not open.");
+
+            return AsyncFile_Wait(m_state, min_completions);
+        }
+
+        void AsyncFile::Drain()
+        {
+            if (!m_state)
+                return;
+
+            while (m_state->Pending != 0)
+                AsyncFile_Wait(m_state, m_state->Pending);
+        }
+
+        AsyncFile AsyncFile::Open(std::string_view filename, CreateMode mode, bool writable, const AsyncFileOptions* options)
+        {
+            AsyncFileOptions defaults;
+            if (!options)
+                options = &defaults;
+
+            if (options->QueueDepth == 0)
+                throw ArgumentException("The queue depth cannot be zero.");
+
+            auto functions = systemlayer::GetSystemLayerFunctions();
+
+            auto file = functions->FileOpen(nl::String(filename).c_str(), mode, writable);
+            if (file == 0)
+                return AsyncFile();
+
+            AsyncFileState* state = nullptr;
+            try
+            {
+                state = nl::memory::ConstructThrow<AsyncFileState>();
+                state->File = file;
+                state->QueueDepth = options->QueueDepth;
+
+#ifdef NL_HAS_IO_URING
+                int64_t descriptor = functions->FileGetNativeHandle ? functions->FileGetNativeHandle(file) : -1;
+                if (!options->UseThreadPool &&
+                    descriptor != -1 &&
+                    state->Ring.Initialize(options->QueueDepth))
+                {
+                    state->Backend = AsyncFileBackend::IoUring;
+                    state->Descriptor = (int)descriptor;
+
+                    int fd = state->Descriptor;
+                    state->FixedFile = state->Ring.Register(IORING_REGISTER_FILES, &fd, 1) >= 0;
+                }
+#endif
+
+                if (state->Backend == AsyncFileBackend::ThreadPool)
+                {
+                    // the workers mostly sleep in blocking calls so there can be more of them than processors
+                    int32_t threads = options->ThreadCount;
+                    if (threads <= 0)
+                        threads = (int32_t)nl::util::Min<uint32_t>(options->QueueDepth, (uint32_t)nl::threading::ThreadPool::GetProcessorCount() * 4);
+
+                    state->Pool = nl::memory::ConstructThrow<nl::threading::ThreadPool>(threads);
+                }
+            }
+            catch (...)
+            {
+                if (state)
+                    nl::memory::Destroy(state);
+
+                functions->FileClose(file);
+                throw;
+            }
+
+            return AsyncFile(state);
+        }
+    }
+}
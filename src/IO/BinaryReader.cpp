@@ -1,6 +1,8 @@
 #include "StdAfx.h"
 
 #include <NativeLib/IO/BinaryStream.h>
+#include <NativeLib/IO/VarInt.h>
+#include <NativeLib/Exceptions.h>
 
 namespace nl
 {
@@ -16,24 +18,75 @@ namespace nl
             return m_stream;
         }
 
-        int64_t BinaryReader::Read7BitEncodedInt()
+        void BinaryReader::ReadBytes(void* lp, size_t size)
         {
-            int64_t value = 0;
+            auto peeked = m_stream->TryPeek((int64_t)size);
+            if (peeked)
+            {
+                memcpy(lp, peeked, size);
+                m_stream->Advance((int64_t)size);
+                return;
+            }
 
-            for (;;)
+            char* p = static_cast<char*>(lp);
+            const char* end = p + size;
+            while (p < end)
             {
-                unsigned char by = 0;
-                if (m_stream->Read(&by, 1) == 0)
+                int64_t read = m_stream->Read(p, int64_t(end - p));
+                if (read == 0)
                     throw IOException(IOException::ReadFailed);
 
-                value <<= 7;
-                value |= by & 0x7f;
+                p += read;
+            }
+        }
+
+        int64_t BinaryReader::Read7BitEncodedInt()
+        {
+            uint64_t value = 0;
+
+            auto peeked = m_stream->TryPeek(VarIntMaxSize);
+            if (peeked)
+            {
+                int32_t length = VarIntDecode(peeked, VarIntMaxSize, value);
+                if (length <= 0)
+                    throw IOException("Invalid 7 bit encoded integer");
 
-                if ((by & 0x80) == 0)
+                m_stream->Advance(length);
+                return (int64_t)value;
+            }
+
+            // one byte at a time near the end of the stream or when it cannot be peeked into
+            for (size_t i = 0; i < VarIntMaxSize; ++i)
+            {
+                unsigned char by = ReadByte();
+                if (i == VarIntMaxSize - 1 &&
+                    by > 1)
                     break;
+
+                value |= (uint64_t)(by & 0x7f) << (i * 7);
+
+                if ((by & 0x80) == 0)
+                    return (int64_t)value;
+            }
+
+            throw IOException("Invalid 7 bit encoded integer");
+        }
+
+        unsigned char BinaryReader::ReadByte()
+        {
+            auto peeked = m_stream->TryPeek(1);
+            if (peeked)
+            {
+                unsigned char by = *static_cast<const unsigned char*>(peeked);
+                m_stream->Advance(1);
+                return by;
             }
 
-            return value;
+            unsigned char by = 0;
+            if (m_stream->Read(&by, 1) == 0)
+                throw IOException(IOException::ReadFailed);
+
+            return by;
         }
 
         String BinaryReader::ReadString()
@@ -42,21 +95,107 @@ namespace nl
             if (string_length == 0)
                 return String();
 
+            auto peeked = m_stream->TryPeek(string_length);
+            if (peeked)
+            {
+                String str(std::string_view(static_cast<const char*>(peeked), (size_t)string_length));
+                m_stream->Advance(string_length);
+                return str;
+            }
+
             String str;
             str.SetLength(string_length);
-            
-            char* p = str.data();
-            const char* end = p + string_length;
-            while (p < end)
+            ReadBytes(str.data(), (size_t)string_length);
+            return str;
+        }
+
+        void BinaryReader::ReadVarIntArray(uint32_t* values, size_t count)
+        {
+            while (count != 0)
             {
-                int64_t read = m_stream->Read(p, int64_t(end - p));
-                if (read == 0)
-                    throw IOException(IOException::ReadFailed);
+                size_t n = nl::util::Min(count, BinaryWriter::VarIntBatchSize);
+                size_t control_size = (n + 3) / 4;
 
-                p += read;
+                // decode straight out of the stream when the whole batch can be looked at
+                auto control = m_stream->TryPeek((int64_t)control_size);
+                if (control)
+                {
+                    size_t size = StreamVByteGetEncodedSize(control, n);
+                    auto batch = m_stream->TryPeek((int64_t)size);
+                    if (batch)
+                    {
+                        StreamVByteDecode(batch, values, n);
+                        m_stream->Advance((int64_t)size);
+
+                        values += n;
+                        count -= n;
+                        continue;
+                    }
+                }
+
+                uint8_t buffer[StreamVByteGetMaxEncodedSize(BinaryWriter::VarIntBatchSize)];
+                ReadBytes(buffer, control_size);
+                size_t size = StreamVByteGetEncodedSize(buffer, n);
+                ReadBytes(buffer + control_size, size - control_size);
+                StreamVByteDecode(buffer, values, n);
+
+                values += n;
+                count -= n;
             }
+        }
 
-            return str;
+        void BinaryReader::ReadVarIntArray(int32_t* values, size_t count)
+        {
+            ReadVarIntArray(reinterpret_cast<uint32_t*>(values), count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                uint32_t value = (uint32_t)values[i];
+                values[i] = (int32_t)((value >> 1) ^ (0u - (value & 1)));
+            }
+        }
+
+        void BinaryReader::ReadVarIntArray(uint64_t* values, size_t count)
+        {
+            while (count != 0)
+            {
+                size_t n = nl::util::Min(count, BinaryWriter::VarIntBatchSize);
+                size_t window = n * VarIntMaxSize;
+
+                auto peeked = static_cast<const uint8_t*>(m_stream->TryPeek((int64_t)window));
+                if (!peeked)
+                {
+                    // less than a full window is left in the stream or in its buffer
+                    *values++ = (uint64_t)Read7BitEncodedInt();
+                    --count;
+                    continue;
+                }
+
+                size_t offset = 0;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    int32_t length = VarIntDecode(peeked + offset, window - offset, values[i]);
+                    if (length <= 0)
+                        throw IOException("Invalid 7 bit encoded integer");
+
+                    offset += (size_t)length;
+                }
+
+                m_stream->Advance((int64_t)offset);
+                values += n;
+                count -= n;
+            }
+        }
+
+        void BinaryReader::ReadVarIntArray(int64_t* values, size_t count)
+        {
+            ReadVarIntArray(reinterpret_cast<uint64_t*>(values), count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                uint64_t value = (uint64_t)values[i];
+                values[i] = (int64_t)((value >> 1) ^ (0ull - (value & 1)));
+            }
         }
     }
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "StdAfx.h"
 
 #include <NativeLib/IO/BinaryStream.h>
+#include <NativeLib/IO/VarInt.h>
+#include <NativeLib/Exceptions.h>
 
 namespace nl
 {
@@ -16,29 +18,21 @@ namespace nl
             return m_stream;
         }
 
-        void BinaryWriter::Write7BitEncodedInt(int64_t value)
-        {
-            // convert to unsigned to support negative values
-            size_t val = (size_t)value;
-
-            // a 64 bit integer can span 10 bytes due to 7bit encoding
-            const size_t BufferSize = 10;
-            unsigned char buffer[BufferSize];
+        // 64 bit values per batch, which bounds the stack buffer used without AcquireWriteSpan
+        static constexpr size_t BinaryWriter_VarInt64Batch = 256;
 
-            size_t i = BufferSize - 1;
-
-            buffer[i] = val & 0x7f;
-            val >>= 7;
-
-            while (val != 0)
+        void BinaryWriter::WriteBytes(const void* lp, size_t size)
+        {
+            auto span = m_stream->AcquireWriteSpan((int64_t)size);
+            if (span)
             {
-                buffer[i] |= 0x80;
-                buffer[--i] = val & 0x7f;
-                val >>= 7;
+                memcpy(span, lp, size);
+                m_stream->Commit((int64_t)size);
+                return;
             }
 
-            const unsigned char* p = buffer;
-            const unsigned char* end = p + (BufferSize - i);
+            const char* p = static_cast<const char*>(lp);
+            const char* end = p + size;
             while (p < end)
             {
                 int64_t written = m_stream->Write(p, int64_t(end - p));
@@ -49,19 +43,108 @@ namespace nl
             }
         }
 
+        void BinaryWriter::Write7BitEncodedInt(int64_t value)
+        {
+            // negative values are written as their unsigned 64 bit pattern, taking all 10 bytes
+            auto span = m_stream->AcquireWriteSpan(VarIntMaxSize);
+            if (span)
+            {
+                m_stream->Commit((int64_t)VarIntEncode((uint64_t)value, span));
+                return;
+            }
+
+            unsigned char buffer[VarIntMaxSize];
+            WriteBytes(buffer, VarIntEncode((uint64_t)value, buffer));
+        }
+
         void BinaryWriter::WriteString(std::string_view value)
         {
             Write7BitEncodedInt(value.length());
+            WriteBytes(value.data(), value.length());
+        }
 
-            const char* p = value.data();
-            const char* end = p + value.length();
-            while (p < end)
+        void BinaryWriter::WriteVarIntArray(const uint32_t* values, size_t count)
+        {
+            while (count != 0)
             {
-                int64_t written = m_stream->Write(p, int64_t(end - p));
-                if (written == 0)
-                    throw IOException(IOException::WriteFailed);
+                size_t n = nl::util::Min(count, VarIntBatchSize);
 
-                p += written;
+                auto span = m_stream->AcquireWriteSpan((int64_t)StreamVByteGetMaxEncodedSize(n));
+                if (span)
+                {
+                    m_stream->Commit((int64_t)StreamVByteEncode(values, n, span));
+                }
+                else
+                {
+                    uint8_t buffer[StreamVByteGetMaxEncodedSize(VarIntBatchSize)];
+                    WriteBytes(buffer, StreamVByteEncode(values, n, buffer));
+                }
+
+                values += n;
+                count -= n;
+            }
+        }
+
+        void BinaryWriter::WriteVarIntArray(const int32_t* values, size_t count)
+        {
+            uint32_t zigzag[VarIntBatchSize];
+
+            while (count != 0)
+            {
+                size_t n = nl::util::Min(count, VarIntBatchSize);
+                for (size_t i = 0; i < n; ++i)
+                    zigzag[i] = ((uint32_t)values[i] << 1) ^ (uint32_t)(values[i] >> 31);
+
+                WriteVarIntArray(zigzag, n);
+                values += n;
+                count -= n;
+            }
+        }
+
+        void BinaryWriter::WriteVarIntArray(const uint64_t* values, size_t count)
+        {
+            while (count != 0)
+            {
+                size_t n = nl::util::Min(count, BinaryWriter_VarInt64Batch);
+
+                auto span = static_cast<uint8_t*>(m_stream->AcquireWriteSpan((int64_t)(n * VarIntMaxSize)));
+                if (span)
+                {
+                    size_t size = 0;
+                    for (size_t i = 0; i < n; ++i)
+                        size += VarIntEncode(values[i], span + size);
+
+                    m_stream->Commit((int64_t)size);
+                }
+                else
+                {
+                    uint8_t buffer[BinaryWriter_VarInt64Batch * VarIntMaxSize];
+
+                    size_t size = 0;
+                    for (size_t i = 0; i < n; ++i)
+                        size += VarIntEncode(values[i], buffer + size);
+
+                    WriteBytes(buffer, size);
+                }
+
+                values += n;
+                count -= n;
+            }
+        }
+
+        void BinaryWriter::WriteVarIntArray(const int64_t* values, size_t count)
+        {
+            uint64_t zigzag[BinaryWriter_VarInt64Batch];
+
+            while (count != 0)
+            {
+                size_t n = nl::util::Min(count, BinaryWriter_VarInt64Batch);
+                for (size_t i = 0; i < n; ++i)
+                    zigzag[i] = ((uint64_t)values[i] << 1) ^ (uint64_t)(values[i] >> 63);
+
+                WriteVarIntArray(zigzag, n);
+                values += n;
+                count -= n;
             }
         }
     }
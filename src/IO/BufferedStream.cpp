@@ -0,0 +1,347 @@
+#include "StdAfx.h"
+
+#include <NativeLib/IO/BufferedStream.h>
+#include <NativeLib/Exceptions.h>
+#include <NativeLib/Util.h>
+
+namespace nl
+{
+    namespace io
+    {
+        static size_t BufferedStream_GetBufferSize(int64_t size, bool enabled)
+        {
+            if (size < 0)
+                throw ArgumentException("The buffer size cannot be negative.");
+
+            return enabled ? (size_t)size : 0; // a size of 0 disables the buffer
+        }
+
+        BufferedStream::BufferedStream(Stream* stream, int64_t buffer_size) :
+            BufferedStream(stream, buffer_size, buffer_size)
+        {
+        }
+
+        BufferedStream::BufferedStream(Stream* stream, int64_t read_buffer_size, int64_t write_buffer_size) :
+            m_stream(stream),
+            m_read_size(BufferedStream_GetBufferSize(read_buffer_size, stream->CanRead())),
+            m_read_buffer(nl::memory::Memory::Allocate(nl::util::Max<size_t>(m_read_size, 1))),
+            m_read_position(0),
+            m_read_length(0),
+            m_write_size(BufferedStream_GetBufferSize(write_buffer_size, stream->CanWrite())),
+            m_write_buffer(nl::memory::Memory::Allocate(nl::util::Max<size_t>(m_write_size, 1))),
+            m_write_position(0)
+        {
+        }
+
+        BufferedStream::~BufferedStream()
+        {
+            try
+            {
+                FlushWrite();
+            }
+            catch (const Exception&)
+            {
+                // nothing can be reported from a destructor
+            }
+        }
+
+        bool BufferedStream::CanSeek() const
+        {
+            return m_stream->CanSeek();
+        }
+
+        bool BufferedStream::CanRead() const
+        {
+            return m_stream->CanRead();
+        }
+
+        bool BufferedStream::CanWrite() const
+        {
+            return m_stream->CanWrite();
+        }
+
+        int64_t BufferedStream::GetPosition() const
+        {
+            return m_stream->GetPosition() - (int64_t)(m_read_length - m_read_position) + (int64_t)m_write_position;
+        }
+
+        int64_t BufferedStream::GetLength() const
+        {
+            int64_t length = m_stream->GetLength();
+            if (m_write_position != 0)
+                length = nl::util::Max(length, m_stream->GetPosition() + (int64_t)m_write_position);
+
+            return length;
+        }
+
+        int64_t BufferedStream::Seek(int64_t offset, SeekMode mode)
+        {
+            FlushWrite();
+
+            if (m_read_length != 0)
+            {
+                // stay within the read buffer when possible instead of discarding it
+                const int64_t end = m_stream->GetPosition();
+                const int64_t start = end - (int64_t)m_read_length;
+                const int64_t current = start + (int64_t)m_read_position;
+
+                int64_t target = -1;
+                if (mode == SeekMode::Begin)
+                    target = offset;
+                else if (mode == SeekMode::Current)
+                    target = current + offset;
+
+                if (target >= start &&
+                    target <= end)
+                {
+                    m_read_position = (size_t)(target - start);
+                    return target;
+                }
+
+                if (mode == SeekMode::Current)
+                    offset -= (int64_t)(m_read_length - m_read_position);
+
+                m_read_position = 0;
+                m_read_length = 0;
+            }
+
+            return m_stream->Seek(offset, mode);
+        }
+
+        void BufferedStream::SetLength(int64_t length)
+        {
+            FlushWrite();
+            DiscardRead();
+            m_stream->SetLength(length);
+        }
+
+        void BufferedStream::Flush()
+        {
+            FlushWrite();
+            DiscardRead();
+            m_stream->Flush();
+        }
+
+        void BufferedStream::Close()
+        {
+            FlushWrite();
+            m_read_position = 0;
+            m_read_length = 0;
+            m_stream->Close();
+        }
+
+        int64_t BufferedStream::Read(void* lp, int64_t numberOfBytesToRead)
+        {
+            if (numberOfBytesToRead <= 0)
+                return 0;
+
+            FlushWrite();
+
+            char* p = static_cast<char*>(lp);
+            size_t count = (size_t)numberOfBytesToRead;
+
+            size_t available = m_read_length - m_read_position;
+            if (available >= count)
+            {
+                memcpy(p, m_read_buffer.Get<char>() + m_read_position, count);
+                m_read_position += count;
+                return numberOfBytesToRead;
+            }
+
+            memcpy(p, m_read_buffer.Get<char>() + m_read_position, available);
+            m_read_position = 0;
+            m_read_length = 0;
+
+            p += available;
+            count -= available;
+
+            // large reads bypass the buffer
+            if (count >= m_read_size)
+                return (int64_t)available + nl::util::Max<int64_t>(m_stream->Read(p, (int64_t)count), 0);
+
+            // fill with a single read so a stream that returns partial data does not block here
+            m_read_length = (size_t)nl::util::Max<int64_t>(m_stream->Read(m_read_buffer.Get(), (int64_t)m_read_size), 0);
+
+            size_t copy = nl::util::Min(count, m_read_length);
+            memcpy(p, m_read_buffer.Get<char>(), copy);
+            m_read_position = copy;
+
+            return (int64_t)(available + copy);
+        }
+
+        int64_t BufferedStream::Write(const void* lp, int64_t numberOfBytesToWrite)
+        {
+            if (numberOfBytesToWrite <= 0)
+                return 0;
+
+            DiscardRead();
+
+            size_t count = (size_t)numberOfBytesToWrite;
+            if (m_write_size - m_write_position >= count)
+            {
+                memcpy(m_write_buffer.Get<char>() + m_write_position, lp, count);
+                m_write_position += count;
+                return numberOfBytesToWrite;
+            }
+
+            FlushWrite();
+
+            // large writes bypass the buffer
+            if (count >= m_write_size)
+            {
+                WriteInner(lp, numberOfBytesToWrite);
+                return numberOfBytesToWrite;
+            }
+
+            memcpy(m_write_buffer.Get<char>(), lp, count);
+            m_write_position = count;
+            return numberOfBytesToWrite;
+        }
+
+        int64_t BufferedStream::WriteV(const IOSegment* segments, int32_t count)
+        {
+            int64_t total = 0;
+            for (int32_t i = 0; i < count; ++i)
+                total += (int64_t)segments[i].Length;
+
+            if (total <= 0)
+                return 0;
+
+            DiscardRead();
+
+            if (m_write_size - m_write_position < (size_t)total)
+            {
+                FlushWrite();
+
+                // segments that do not fit the buffer go to the inner stream in a single call
+                if (m_write_size < (size_t)total)
+                {
+                    int64_t written = m_stream->WriteV(segments, count);
+                    if (written != total)
+                        throw IOException(IOException::WriteFailed);
+
+                    return total;
+                }
+            }
+
+            char* p = m_write_buffer.Get<char>() + m_write_position;
+            for (int32_t i = 0; i < count; ++i)
+            {
+                memcpy(p, segments[i].Data, segments[i].Length);
+                p += segments[i].Length;
+            }
+
+            m_write_position += (size_t)total;
+            return total;
+        }
+
+        const void* BufferedStream::TryPeek(int64_t size)
+        {
+            if (size < 0 ||
+                (size_t)size > m_read_size)
+                return nullptr;
+
+            size_t count = (size_t)size;
+            if (m_read_length - m_read_position < count)
+            {
+                FlushWrite();
+
+                // move the unread tail to the front and top the buffer up until enough is buffered
+                size_t available = m_read_length - m_read_position;
+                memmove(m_read_buffer.Get<char>(), m_read_buffer.Get<char>() + m_read_position, available);
+                m_read_position = 0;
+                m_read_length = available;
+
+                while (m_read_length < count)
+                {
+                    int64_t read = m_stream->Read(m_read_buffer.Get<char>() + m_read_length, (int64_t)(m_read_size - m_read_length));
+                    if (read <= 0)
+                        return nullptr;
+
+                    m_read_length += (size_t)read;
+                }
+            }
+
+            return m_read_buffer.Get<char>() + m_read_position;
+        }
+
+        void BufferedStream::Advance(int64_t count)
+        {
+            if (count >= 0 &&
+                (size_t)count <= m_read_length - m_read_position)
+            {
+                m_read_position += (size_t)count;
+                return;
+            }
+
+            Seek(count, SeekMode::Current);
+        }
+
+        void* BufferedStream::AcquireWriteSpan(int64_t size)
+        {
+            if (size < 0 ||
+                (size_t)size > m_write_size)
+                return nullptr;
+
+            DiscardRead();
+
+            if (m_write_size - m_write_position < (size_t)size)
+                FlushWrite();
+
+            return m_write_buffer.Get<char>() + m_write_position;
+        }
+
+        void BufferedStream::Commit(int64_t count)
+        {
+            if (count < 0 ||
+                (size_t)count > m_write_size - m_write_position)
+                throw ArgumentException("The count exceeds the acquired write span.");
+
+            m_write_position += (size_t)count;
+        }
+
+        void BufferedStream::FlushWrite()
+        {
+            if (m_write_position == 0)
+                return;
+
+            size_t count = m_write_position;
+            m_write_position = 0;
+            WriteInner(m_write_buffer.Get(), (int64_t)count);
+        }
+
+        void BufferedStream::DiscardRead()
+        {
+            if (m_read_length == 0)
+                return;
+
+            // reads and writes of a pipe or socket are separate directions, so the read-ahead stays valid and dropping
+            // it would lose received data
+            if (!m_stream->CanSeek())
+                return;
+
+            // move the underlying stream back to where the caller believes it is
+            int64_t unread = (int64_t)(m_read_length - m_read_position);
+            m_read_position = 0;
+            m_read_length = 0;
+
+            if (unread != 0)
+                m_stream->Seek(-unread, SeekMode::Current);
+        }
+
+        void BufferedStream::WriteInner(const void* lp, int64_t count)
+        {
+            const char* p = static_cast<const char*>(lp);
+            int64_t total = 0;
+
+            while (total < count)
+            {
+                int64_t written = m_stream->Write(p + total, count - total);
+                if (written <= 0)
+                    throw IOException(IOException::WriteFailed);
+
+                total += written;
+            }
+        }
+    }
+}
@@ -0,0 +1,417 @@
+#include "StdAfx.h"
+
+#include <NativeLib/IO/Checksum.h>
+
+#ifdef NL_ARCHITECTURE_X64
+//!ALLOW_INCLUDE "nmmintrin.h"
+#include <nmmintrin.h>
+
+#ifdef NL_PLATFORM_WINDOWS
+//!ALLOW_INCLUDE "intrin.h"
+#include <intrin.h>
+#define CRC32C_HARDWARE_TARGET
+#else
+#define CRC32C_HARDWARE_TARGET __attribute__((target("sse4.2")))
+#endif
+#endif
+
+namespace nl
+{
+    namespace io
+    {
+        static constexpr uint32_t Crc32c_Polynomial = 0x82f63b78; // reversed Castagnoli polynomial
+        static constexpr size_t Crc32c_LongBlock = 8192;
+        static constexpr size_t Crc32c_ShortBlock = 256;
+
+        struct Crc32cTables
+        {
+            uint32_t Slice[8][256];
+
+            // advance a crc over a block of zeros, which is how the parallel streams are joined
+            uint32_t LongShift[4][256];
+            uint32_t ShortShift[4][256];
+
+            Crc32cTables()
+            {
+                for (uint32_t n = 0; n < 256; ++n)
+                {
+                    uint32_t crc = n;
+                    for (int k = 0; k < 8; ++k)
+                        crc = (crc & 1) ? (crc >> 1) ^ Crc32c_Polynomial : crc >> 1;
+
+                    Slice[0][n] = crc;
+                }
+
+                for (uint32_t n = 0; n < 256; ++n)
+                {
+                    uint32_t crc = Slice[0][n];
+                    for (int k = 1; k < 8; ++k)
+                    {
+                        crc = (crc >> 8) ^ Slice[0][crc & 0xff];
+                        Slice[k][n] = crc;
+                    }
+                }
+
+                BuildShift(LongShift, Crc32c_LongBlock);
+                BuildShift(ShortShift, Crc32c_ShortBlock);
+            }
+
+            void BuildShift(uint32_t(&table)[4][256], size_t count)
+            {
+                // the shift is linear, so running each bit through once is enough to combine any value from them
+                uint32_t bits[32];
+                for (int i = 0; i < 32; ++i)
+                {
+                    uint32_t crc = 1u << i;
+                    for (size_t j = 0; j < count; ++j)
+                        crc = (crc >> 8) ^ Slice[0][crc & 0xff];
+
+                    bits[i] = crc;
+                }
+
+                for (int k = 0; k < 4; ++k)
+                {
+                    for (uint32_t n = 0; n < 256; ++n)
+                    {
+                        uint32_t crc = 0;
+                        for (int b = 0; b < 8; ++b)
+                        {
+                            if (n & (1u << b))
+                                crc ^= bits[k * 8 + b];
+                        }
+
+                        table[k][n] = crc;
+                    }
+                }
+            }
+        };
+
+        static const Crc32cTables& Crc32c_GetTables()
+        {
+            static const Crc32cTables tables;
+            return tables;
+        }
+
+        // Software fallback processing 8 bytes per step; assumes a little endian processor like the rest of the library.
+        static uint32_t Crc32c_Software(uint32_t crc, const uint8_t* p, size_t size)
+        {
+            const auto& t = Crc32c_GetTables().Slice;
+
+            while (size >= sizeof(uint64_t))
+            {
+                uint64_t value;
+                memcpy(&value, p, sizeof(value));
+                value ^= crc;
+
+                crc =
+                    t[7][value & 0xff] ^
+                    t[6][(value >> 8) & 0xff] ^
+                    t[5][(value >> 16) & 0xff] ^
+                    t[4][(value >> 24) & 0xff] ^
+                    t[3][(value >> 32) & 0xff] ^
+                    t[2][(value >> 40) & 0xff] ^
+                    t[1][(value >> 48) & 0xff] ^
+                    t[0][value >> 56];
+
+                p += sizeof(uint64_t);
+                size -= sizeof(uint64_t);
+            }
+
+            while (size-- != 0)
+                crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+
+            return crc;
+        }
+
+#ifdef NL_ARCHITECTURE_X64
+        static inline uint32_t Crc32c_Shift(const uint32_t(&table)[4][256], uint32_t crc)
+        {
+            return
+                table[0][crc & 0xff] ^
+                table[1][(crc >> 8) & 0xff] ^
+                table[2][(crc >> 16) & 0xff] ^
+                table[3][crc >> 24];
+        }
+
+        static inline uint64_t Crc32c_Read64(const uint8_t* p)
+        {
+            uint64_t value;
+            memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        // The crc32 instruction has a latency of three cycles but can start every cycle, so three independent
+        // streams over adjacent blocks are run at once and joined afterwards.
+        CRC32C_HARDWARE_TARGET static uint32_t Crc32c_HardwareBlocks(uint32_t crc, const uint8_t*& p, size_t& size, size_t block, const uint32_t(&shift)[4][256])
+        {
+            while (size >= 3 * block)
+            {
+                uint64_t crc0 = crc;
+                uint64_t crc1 = 0;
+                uint64_t crc2 = 0;
+
+                const uint8_t* end = p + block;
+                while (p < end)
+                {
+                    crc0 = _mm_crc32_u64(crc0, Crc32c_Read64(p));
+                    crc1 = _mm_crc32_u64(crc1, Crc32c_Read64(p + block));
+                    crc2 = _mm_crc32_u64(crc2, Crc32c_Read64(p + 2 * block));
+                    p += sizeof(uint64_t);
+                }
+
+                crc = Crc32c_Shift(shift, (uint32_t)crc0) ^ (uint32_t)crc1;
+                crc = Crc32c_Shift(shift, crc) ^ (uint32_t)crc2;
+
+                p += 2 * block;
+                size -= 3 * block;
+            }
+
+            return crc;
+        }
+
+        CRC32C_HARDWARE_TARGET static uint32_t Crc32c_Hardware(uint32_t crc, const uint8_t* p, size_t size)
+        {
+            const auto& tables = Crc32c_GetTables();
+
+            crc = Crc32c_HardwareBlocks(crc, p, size, Crc32c_LongBlock, tables.LongShift);
+            crc = Crc32c_HardwareBlocks(crc, p, size, Crc32c_ShortBlock, tables.ShortShift);
+
+            uint64_t crc64 = crc;
+            while (size >= sizeof(uint64_t))
+            {
+                crc64 = _mm_crc32_u64(crc64, Crc32c_Read64(p));
+                p += sizeof(uint64_t);
+                size -= sizeof(uint64_t);
+            }
+
+            crc = (uint32_t)crc64;
+            while (size-- != 0)
+                crc = _mm_crc32_u8(crc, *p++);
+
+            return crc;
+        }
+
+        static bool Crc32c_HasHardwareSupport()
+        {
+#ifdef NL_PLATFORM_WINDOWS
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 20)) != 0;
+#else
+            return __builtin_cpu_supports("sse4.2");
+#endif
+        }
+#endif
+
+        using Crc32c_Function = uint32_t(*)(uint32_t crc, const uint8_t* p, size_t size);
+
+        static Crc32c_Function Crc32c_Select()
+        {
+#ifdef NL_ARCHITECTURE_X64
+            if (Crc32c_HasHardwareSupport())
+                return Crc32c_Hardware;
+#endif
+
+            return Crc32c_Software;
+        }
+
+        uint32_t Crc32c(const void* lp, size_t size, uint32_t crc)
+        {
+            static const Crc32c_Function function = Crc32c_Select();
+            return ~function(~crc, static_cast<const uint8_t*>(lp), size);
+        }
+
+        /////////////////////////////////////////////////////
+        /////////////////////////////////////////////////////
+        /////////////////////////////////////////////////////
+
+        static constexpr uint64_t XxHash64_Prime1 = 11400714785074694791ull;
+        static constexpr uint64_t XxHash64_Prime2 = 14029467366897019727ull;
+        static constexpr uint64_t XxHash64_Prime3 = 1609587929392839161ull;
+        static constexpr uint64_t XxHash64_Prime4 = 9650029242287828579ull;
+        static constexpr uint64_t XxHash64_Prime5 = 2870177450012600261ull;
+        static constexpr size_t XxHash64_StripeSize = 32;
+
+        static inline uint64_t XxHash64_RotateLeft(uint64_t value, int count)
+        {
+            return (value << count) | (value >> (64 - count));
+        }
+
+        static inline uint64_t XxHash64_Read64(const uint8_t* p)
+        {
+            uint64_t value;
+            memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        static inline uint64_t XxHash64_Round(uint64_t accumulator, uint64_t input)
+        {
+            accumulator += input * XxHash64_Prime2;
+            accumulator = XxHash64_RotateLeft(accumulator, 31);
+            return accumulator * XxHash64_Prime1;
+        }
+
+        static inline uint64_t XxHash64_Merge(uint64_t hash, uint64_t accumulator)
+        {
+            hash ^= XxHash64_Round(0, accumulator);
+            return hash * XxHash64_Prime1 + XxHash64_Prime4;
+        }
+
+        static void XxHash64_Reset(uint64_t(&accumulators)[4], uint64_t seed)
+        {
+            accumulators[0] = seed + XxHash64_Prime1 + XxHash64_Prime2;
+            accumulators[1] = seed + XxHash64_Prime2;
+            accumulators[2] = seed;
+            accumulators[3] = seed - XxHash64_Prime1;
+        }
+
+        // Consumes all whole stripes and returns the number of bytes consumed.
+        static size_t XxHash64_Stripes(uint64_t(&accumulators)[4], const uint8_t* p, size_t size)
+        {
+            uint64_t v1 = accumulators[0];
+            uint64_t v2 = accumulators[1];
+            uint64_t v3 = accumulators[2];
+            uint64_t v4 = accumulators[3];
+
+            const uint8_t* start = p;
+            const uint8_t* end = p + size - size % XxHash64_StripeSize;
+
+            while (p < end)
+            {
+                v1 = XxHash64_Round(v1, XxHash64_Read64(p));
+                v2 = XxHash64_Round(v2, XxHash64_Read64(p + 8));
+                v3 = XxHash64_Round(v3, XxHash64_Read64(p + 16));
+                v4 = XxHash64_Round(v4, XxHash64_Read64(p + 24));
+                p += XxHash64_StripeSize;
+            }
+
+            accumulators[0] = v1;
+            accumulators[1] = v2;
+            accumulators[2] = v3;
+            accumulators[3] = v4;
+            return (size_t)(p - start);
+        }
+
+        static uint64_t XxHash64_Finish(const uint64_t(&accumulators)[4], uint64_t seed, uint64_t total_length, const uint8_t* p, size_t size)
+        {
+            uint64_t hash;
+            if (total_length >= XxHash64_StripeSize)
+            {
+                hash =
+                    XxHash64_RotateLeft(accumulators[0], 1) +
+                    XxHash64_RotateLeft(accumulators[1], 7) +
+                    XxHash64_RotateLeft(accumulators[2], 12) +
+                    XxHash64_RotateLeft(accumulators[3], 18);
+
+                for (int i = 0; i < 4; ++i)
+                    hash = XxHash64_Merge(hash, accumulators[i]);
+            }
+            else
+            {
+                hash = seed + XxHash64_Prime5;
+            }
+
+            hash += total_length;
+
+            while (size >= 8)
+            {
+                hash ^= XxHash64_Round(0, XxHash64_Read64(p));
+                hash = XxHash64_RotateLeft(hash, 27) * XxHash64_Prime1 + XxHash64_Prime4;
+                p += 8;
+                size -= 8;
+            }
+
+            if (size >= 4)
+            {
+                uint32_t value;
+                memcpy(&value, p, sizeof(value));
+                hash ^= (uint64_t)value * XxHash64_Prime1;
+                hash = XxHash64_RotateLeft(hash, 23) * XxHash64_Prime2 + XxHash64_Prime3;
+                p += 4;
+                size -= 4;
+            }
+
+            while (size-- != 0)
+            {
+                hash ^= *p++ * XxHash64_Prime5;
+                hash = XxHash64_RotateLeft(hash, 11) * XxHash64_Prime1;
+            }
+
+            hash ^= hash >> 33;
+            hash *= XxHash64_Prime2;
+            hash ^= hash >> 29;
+            hash *= XxHash64_Prime3;
+            hash ^= hash >> 32;
+            return hash;
+        }
+
+        uint64_t XxHash64(const void* lp, size_t size, uint64_t seed)
+        {
+            const uint8_t* p = static_cast<const uint8_t*>(lp);
+
+            uint64_t accumulators[4];
+            XxHash64_Reset(accumulators, seed);
+
+            size_t consumed = XxHash64_Stripes(accumulators, p, size);
+            return XxHash64_Finish(accumulators, seed, size, p + consumed, size - consumed);
+        }
+
+        /////////////////////////////////////////////////////
+        /////////////////////////////////////////////////////
+        /////////////////////////////////////////////////////
+
+        Checksum::Checksum(ChecksumAlgorithm algorithm) :
+            m_algorithm(algorithm)
+        {
+            Reset();
+        }
+
+        void Checksum::Reset()
+        {
+            m_crc = 0;
+            XxHash64_Reset(m_accumulators, 0);
+            m_totalLength = 0;
+            m_buffered = 0;
+        }
+
+        void Checksum::Update(const void* lp, size_t size)
+        {
+            if (m_algorithm == ChecksumAlgorithm::Crc32c)
+            {
+                m_crc = Crc32c(lp, size, m_crc);
+                return;
+            }
+
+            const uint8_t* p = static_cast<const uint8_t*>(lp);
+            m_totalLength += size;
+
+            if (m_buffered != 0)
+            {
+                size_t count = size < sizeof(m_buffer) - m_buffered ? size : sizeof(m_buffer) - m_buffered;
+                memcpy(m_buffer + m_buffered, p, count);
+                m_buffered += count;
+                p += count;
+                size -= count;
+
+                if (m_buffered < sizeof(m_buffer))
+                    return;
+
+                XxHash64_Stripes(m_accumulators, m_buffer, sizeof(m_buffer));
+                m_buffered = 0;
+            }
+
+            size_t consumed = XxHash64_Stripes(m_accumulators, p, size);
+
+            m_buffered = size - consumed;
+            memcpy(m_buffer, p + consumed, m_buffered);
+        }
+
+        uint64_t Checksum::GetValue() const
+        {
+            if (m_algorithm == ChecksumAlgorithm::Crc32c)
+                return m_crc;
+
+            return XxHash64_Finish(m_accumulators, 0, m_totalLength, m_buffer, m_buffered);
+        }
+    }
+}
@@ -0,0 +1,429 @@
+#include "StdAfx.h"
+
+#include <NativeLib/IO/ChecksumStream.h>
+#include <NativeLib/Exceptions.h>
+#include <NativeLib/Allocators.h>
+#include <NativeLib/Util.h>
+
+namespace nl
+{
+    namespace io
+    {
+        static constexpr int32_t ChecksumStream_MaxBlockSize = 1 << 30;
+        static constexpr size_t ChecksumStream_ScratchSize = 4096;
+
+        struct ChecksumStreamState
+        {
+            Stream* Inner = nullptr;
+            ChecksumStreamMode Mode = ChecksumStreamMode::PassThrough;
+            Checksum Hash;
+            bool Reading = false;
+            bool Writing = false;
+            int64_t Position = 0;
+
+            // pass-through mode
+            void* AcquiredSpan = nullptr;
+
+            // framed mode; the block buffer has room for the checksum behind the data
+            size_t BlockSize = 0;
+            nl::memory::Memory Block;
+            size_t BlockLength = 0;
+            size_t BlockPosition = 0;
+            uint32_t NextLength = 0; // header of the following block, read together with the current one
+            bool HasNextLength = false;
+            bool EndOfStream = false;
+
+            ChecksumStreamState(ChecksumAlgorithm algorithm) :
+                Hash(algorithm)
+            {
+            }
+
+            uint64_t ComputeBlockChecksum(uint32_t length) const
+            {
+                Checksum checksum(Hash.GetAlgorithm());
+                checksum.Update(&length, sizeof(length));
+                checksum.Update(Block.Get(), length);
+                return checksum.GetValue();
+            }
+        };
+
+        ChecksumStream::ChecksumStream(Stream* stream, const ChecksumOptions* options) :
+            m_state(nullptr)
+        {
+            ChecksumOptions defaults;
+            if (!options)
+                options = &defaults;
+
+            if (options->Mode == ChecksumStreamMode::Framed &&
+                (options->BlockSize <= 0 || options->BlockSize > ChecksumStream_MaxBlockSize))
+                throw ArgumentException("The block size must be between 1 byte and 1 GB.");
+
+            m_state = nl::memory::ConstructThrow<ChecksumStreamState>(options->Algorithm);
+            m_state->Inner = stream;
+            m_state->Mode = options->Mode;
+
+            if (options->Mode == ChecksumStreamMode::Framed)
+            {
+                try
+                {
+                    m_state->BlockSize = (size_t)options->BlockSize;
+                    m_state->Block = nl::memory::Memory::Allocate(m_state->BlockSize + sizeof(uint64_t));
+                }
+                catch (...)
+                {
+                    nl::memory::Destroy(m_state);
+                    throw;
+                }
+            }
+        }
+
+        ChecksumStream::~ChecksumStream()
+        {
+            try
+            {
+                WritePendingBlock();
+            }
+            catch (const Exception&)
+            {
+                // nothing can be reported from a destructor
+            }
+
+            nl::memory::Destroy(m_state);
+        }
+
+        Stream* ChecksumStream::GetStream()
+        {
+            return m_state->Inner;
+        }
+
+        bool ChecksumStream::CanSeek() const
+        {
+            return false;
+        }
+
+        bool ChecksumStream::CanRead() const
+        {
+            return m_state->Inner->CanRead() && !m_state->Writing;
+        }
+
+        bool ChecksumStream::CanWrite() const
+        {
+            return m_state->Inner->CanWrite() && !m_state->Reading;
+        }
+
+        int64_t ChecksumStream::GetPosition() const
+        {
+            return m_state->Position;
+        }
+
+        void ChecksumStream::Flush()
+        {
+            WritePendingBlock();
+            m_state->Inner->Flush();
+        }
+
+        void ChecksumStream::Close()
+        {
+            WritePendingBlock();
+            m_state->Inner->Close();
+        }
+
+        int64_t ChecksumStream::Read(void* lp, int64_t numberOfBytesToRead)
+        {
+            BeginRead();
+
+            if (m_state->Mode == ChecksumStreamMode::PassThrough)
+            {
+                int64_t read = m_state->Inner->Read(lp, numberOfBytesToRead);
+                if (read > 0)
+                {
+                    m_state->Hash.Update(lp, (size_t)read);
+                    m_state->Position += read;
+                }
+
+                return read;
+            }
+
+            char* p = static_cast<char*>(lp);
+            int64_t total = 0;
+
+            while (total < numberOfBytesToRead)
+            {
+                if (m_state->BlockPosition == m_state->BlockLength &&
+                    !ReadNextBlock())
+                    break;
+
+                size_t count = (size_t)nl::util::Min<int64_t>(numberOfBytesToRead - total, (int64_t)(m_state->BlockLength - m_state->BlockPosition));
+                memcpy(p + total, m_state->Block.Get<char>() + m_state->BlockPosition, count);
+                m_state->BlockPosition += count;
+                total += (int64_t)count;
+            }
+
+            m_state->Position += total;
+            return total;
+        }
+
+        int64_t ChecksumStream::Write(const void* lp, int64_t numberOfBytesToWrite)
+        {
+            BeginWrite();
+
+            if (m_state->Mode == ChecksumStreamMode::PassThrough)
+            {
+                int64_t written = m_state->Inner->Write(lp, numberOfBytesToWrite);
+                if (written > 0)
+                {
+                    m_state->Hash.Update(lp, (size_t)written);
+                    m_state->Position += written;
+                }
+
+                return written;
+            }
+
+            const char* p = static_cast<const char*>(lp);
+            int64_t total = 0;
+
+            while (total < numberOfBytesToWrite)
+            {
+                size_t count = (size_t)nl::util::Min<int64_t>(numberOfBytesToWrite - total, (int64_t)(m_state->BlockSize - m_state->BlockLength));
+                memcpy(m_state->Block.Get<char>() + m_state->BlockLength, p + total, count);
+                m_state->BlockLength += count;
+                total += (int64_t)count;
+
+                if (m_state->BlockLength == m_state->BlockSize)
+                    WritePendingBlock();
+            }
+
+            m_state->Position += total;
+            return total;
+        }
+
+        const void* ChecksumStream::TryPeek(int64_t size)
+        {
+            BeginRead();
+
+            if (m_state->Mode == ChecksumStreamMode::PassThrough)
+                return m_state->Inner->TryPeek(size);
+
+            if (size < 0)
+                return nullptr;
+
+            if (m_state->BlockPosition == m_state->BlockLength &&
+                !ReadNextBlock())
+                return nullptr;
+
+            if ((size_t)size > m_state->BlockLength - m_state->BlockPosition)
+                return nullptr;
+
+            return m_state->Block.Get<char>() + m_state->BlockPosition;
+        }
+
+        void ChecksumStream::Advance(int64_t count)
+        {
+            BeginRead();
+
+            if (count < 0)
+                throw ArgumentException("The count cannot be negative.");
+
+            if (m_state->Mode == ChecksumStreamMode::PassThrough)
+            {
+                // skipped data still has to be part of the checksum
+                const void* lp = m_state->Inner->TryPeek(count);
+                if (lp)
+                {
+                    m_state->Hash.Update(lp, (size_t)count);
+                    m_state->Inner->Advance(count);
+                    m_state->Position += count;
+                    return;
+                }
+
+                char scratch[ChecksumStream_ScratchSize];
+                while (count > 0)
+                {
+                    int64_t read = Read(scratch, nl::util::Min<int64_t>(count, sizeof(scratch)));
+                    if (read <= 0)
+                        throw ArgumentException("The count exceeds the remaining data of this ChecksumStream.");
+
+                    count -= read;
+                }
+
+                return;
+            }
+
+            while (count > 0)
+            {
+                if (m_state->BlockPosition == m_state->BlockLength &&
+                    !ReadNextBlock())
+                    throw ArgumentException("The count exceeds the remaining data of this ChecksumStream.");
+
+                size_t step = (size_t)nl::util::Min<int64_t>(count, (int64_t)(m_state->BlockLength - m_state->BlockPosition));
+                m_state->BlockPosition += step;
+                m_state->Position += (int64_t)step;
+                count -= (int64_t)step;
+            }
+        }
+
+        void* ChecksumStream::AcquireWriteSpan(int64_t size)
+        {
+            BeginWrite();
+
+            if (m_state->Mode == ChecksumStreamMode::PassThrough)
+            {
+                m_state->AcquiredSpan = m_state->Inner->AcquireWriteSpan(size);
+                return m_state->AcquiredSpan;
+            }
+
+            if (size < 0 ||
+                (size_t)size > m_state->BlockSize)
+                return nullptr;
+
+            if (m_state->BlockSize - m_state->BlockLength < (size_t)size)
+                WritePendingBlock();
+
+            return m_state->Block.Get<char>() + m_state->BlockLength;
+        }
+
+        void ChecksumStream::Commit(int64_t count)
+        {
+            if (m_state->Mode == ChecksumStreamMode::PassThrough)
+            {
+                if (!m_state->AcquiredSpan)
+                    throw InvalidOperationException("Commit requires a span from AcquireWriteSpan.");
+
+                m_state->Inner->Commit(count);
+                m_state->Hash.Update(m_state->AcquiredSpan, (size_t)count);
+                m_state->AcquiredSpan = nullptr;
+                m_state->Position += count;
+                return;
+            }
+
+            if (count < 0 ||
+                (size_t)count > m_state->BlockSize - m_state->BlockLength)
+                throw ArgumentException("The count exceeds the acquired write span.");
+
+            m_state->BlockLength += (size_t)count;
+            m_state->Position += count;
+
+            if (m_state->BlockLength == m_state->BlockSize)
+                WritePendingBlock();
+        }
+
+        uint64_t ChecksumStream::GetChecksum() const
+        {
+            if (m_state->Mode != ChecksumStreamMode::PassThrough)
+                throw InvalidOperationException("A framed ChecksumStream checks every block itself.");
+
+            return m_state->Hash.GetValue();
+        }
+
+        void ChecksumStream::ResetChecksum()
+        {
+            m_state->Hash.Reset();
+        }
+
+        void ChecksumStream::BeginRead()
+        {
+            if (m_state->Writing &&
+                m_state->Mode == ChecksumStreamMode::Framed)
+                throw InvalidOperationException("A framed ChecksumStream that was written to cannot be read from.");
+
+            m_state->Reading = true;
+        }
+
+        void ChecksumStream::BeginWrite()
+        {
+            if (m_state->Reading &&
+                m_state->Mode == ChecksumStreamMode::Framed)
+                throw InvalidOperationException("A framed ChecksumStream that was read from cannot be written to.");
+
+            m_state->Writing = true;
+        }
+
+        bool ChecksumStream::ReadNextBlock()
+        {
+            auto state = m_state;
+            if (state->EndOfStream)
+                return false;
+
+            state->BlockLength = 0;
+            state->BlockPosition = 0;
+
+            uint32_t length = state->NextLength;
+            if (!state->HasNextLength)
+            {
+                IOSegment header(&length, sizeof(length));
+                int64_t read = state->Inner->ReadV(&header, 1);
+                if (read == 0)
+                {
+                    state->EndOfStream = true;
+                    return false;
+                }
+
+                if (read != (int64_t)sizeof(length))
+                    throw IOException("Unexpected end of the checksummed stream");
+            }
+
+            if (length == 0 ||
+                length > state->BlockSize)
+                throw IOException("Corrupt checksummed block header");
+
+            // the header of the next block comes along, which saves a call per block
+            size_t checksum_size = state->Hash.GetSize();
+            size_t body_size = length + checksum_size;
+
+            IOSegment segments[2] =
+            {
+                IOSegment(state->Block.Get(), body_size),
+                IOSegment(&state->NextLength, sizeof(state->NextLength))
+            };
+
+            int64_t read = state->Inner->ReadV(segments, 2);
+            if (read == (int64_t)body_size)
+            {
+                state->HasNextLength = false;
+                state->EndOfStream = true;
+            }
+            else if (read == (int64_t)(body_size + sizeof(state->NextLength)))
+            {
+                state->HasNextLength = true;
+            }
+            else
+            {
+                throw IOException("Unexpected end of the checksummed stream");
+            }
+
+            uint64_t stored = 0;
+            memcpy(&stored, state->Block.Get<char>() + length, checksum_size);
+
+            if (state->ComputeBlockChecksum(length) != stored)
+                throw IOException("Checksum mismatch in checksummed block");
+
+            state->BlockLength = length;
+            return true;
+        }
+
+        void ChecksumStream::WritePendingBlock()
+        {
+            auto state = m_state;
+            if (state->Mode != ChecksumStreamMode::Framed ||
+                !state->Writing ||
+                state->BlockLength == 0)
+                return;
+
+            uint32_t length = (uint32_t)state->BlockLength;
+            uint64_t checksum = state->ComputeBlockChecksum(length);
+            size_t checksum_size = state->Hash.GetSize();
+
+            IOSegment segments[3] =
+            {
+                IOSegment(&length, sizeof(length)),
+                IOSegment(state->Block.Get(), length),
+                IOSegment(&checksum, checksum_size)
+            };
+
+            state->BlockLength = 0;
+
+            if (state->Inner->WriteV(segments, 3) != (int64_t)(sizeof(length) + length + checksum_size))
+                throw IOException(IOException::WriteFailed);
+        }
+    }
+}
@@ -0,0 +1,703 @@
+#include "StdAfx.h"
+
+#include <NativeLib/IO/CompressionStream.h>
+#include <NativeLib/IO/LzCodec.h>
+#include <NativeLib/Threading/ThreadPool.h>
+#include <NativeLib/Containers/Vector.h>
+#include <NativeLib/Exceptions.h>
+#include <NativeLib/Allocators.h>
+#include <NativeLib/Util.h>
+
+//!ALLOW_INCLUDE "StreamInternal.h"
+#include "StreamInternal.h"
+
+namespace nl
+{
+    namespace io
+    {
+        static constexpr uint32_t Compression_FrameMagic = 0x315a4c4e; // "NLZ1"
+        static constexpr uint32_t Compression_IndexMagic = 0x495a4c4e; // "NLZI"
+        static constexpr uint32_t Compression_StoredFlag = 0x80000000;
+        static constexpr int64_t Compression_HeaderSize = 8;
+        static constexpr int64_t Compression_BlockHeaderSize = 8;
+        static constexpr int64_t Compression_IndexEntrySize = 16;
+        static constexpr int64_t Compression_TrailerSize = 16;
+        static constexpr int32_t Compression_MaxBlockSize = 1 << 30;
+
+        struct CompressionBlockIndexEntry
+        {
+            int64_t Offset; // of the block header, relative to the start of the frame
+            int64_t UncompressedOffset;
+        };
+
+        // Returns false if the stream ended before the first byte, throws if it ended part way.
+        static bool Compression_ReadExact(Stream* stream, void* lp, int64_t count)
+        {
+            char* p = static_cast<char*>(lp);
+            int64_t read_pos = 0;
+
+            while (read_pos < count)
+            {
+                int64_t read = stream->Read(p + read_pos, count - read_pos);
+                if (read <= 0)
+                {
+                    if (read_pos == 0)
+                        return false;
+
+                    throw IOException("Unexpected end of the compressed stream");
+                }
+
+                read_pos += read;
+            }
+
+            return true;
+        }
+
+        static uint32_t Compression_GetUInt32(const void* p)
+        {
+            uint32_t value;
+            memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        static int64_t Compression_GetInt64(const void* p)
+        {
+            int64_t value;
+            memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        /////////////////////////////////////////////////////
+        /////////////////////////////////////////////////////
+        /////////////////////////////////////////////////////
+
+        struct CompressionStreamState
+        {
+            Stream* Inner = nullptr;
+            size_t BlockSize = 0;
+            size_t BatchBlocks = 0; // blocks buffered and compressed together
+            bool WriteIndex = true;
+            bool Finished = false;
+
+            nl::memory::Memory Input;
+            size_t InputLength = 0;
+
+            // one block sized slot per buffered block; a block that does not shrink below its size is stored
+            nl::memory::Memory Output;
+            nl::Vector<size_t> CompressedSizes;
+            nl::Vector<uint32_t> Headers;
+            nl::Vector<IOSegment> Segments;
+
+            nl::Vector<CompressionBlockIndexEntry> Index;
+            int64_t UncompressedWritten = 0;
+            int64_t CompressedWritten = 0;
+
+            nl::threading::ThreadPool* Pool = nullptr;
+
+            ~CompressionStreamState()
+            {
+                if (Pool)
+                    nl::memory::Destroy(Pool);
+            }
+
+            size_t GetInputCapacity() const { return BlockSize * BatchBlocks; }
+
+            void CompressBlock(size_t block)
+            {
+                size_t offset = block * BlockSize;
+                size_t length = nl::util::Min(BlockSize, InputLength - offset);
+
+                CompressedSizes[block] = LzCompress(Input.Get<char>() + offset, length, Output.Get<char>() + offset, length - 1);
+            }
+        };
+
+        CompressionStream::CompressionStream(Stream* stream, const CompressionOptions* options) :
+            m_state(nullptr)
+        {
+            if (!stream->CanWrite())
+                throw ArgumentException("The provided stream cannot be written to.");
+
+            CompressionOptions defaults;
+            if (!options)
+                options = &defaults;
+
+            if (options->BlockSize <= 0 ||
+                options->BlockSize > Compression_MaxBlockSize)
+                throw ArgumentException("The block size must be between 1 byte and 1 GB.");
+
+            int32_t threads = options->ThreadCount > 0 ? options->ThreadCount : nl::threading::ThreadPool::GetProcessorCount();
+
+            m_state = nl::memory::ConstructThrow<CompressionStreamState>();
+
+            try
+            {
+                m_state->Inner = stream;
+                m_state->BlockSize = (size_t)options->BlockSize;
+                m_state->BatchBlocks = (size_t)nl::util::Max(threads, 1);
+                m_state->WriteIndex = options->WriteBlockIndex;
+
+                m_state->Input = nl::memory::Memory::Allocate(m_state->GetInputCapacity());
+                m_state->Output = nl::memory::Memory::Allocate(m_state->GetInputCapacity());
+                for (size_t i = 0; i < m_state->BatchBlocks; ++i)
+                    m_state->CompressedSizes.Add(0);
+
+                if (threads > 1)
+                    m_state->Pool = nl::memory::ConstructThrow<nl::threading::ThreadPool>(threads);
+
+                uint32_t header[2] = { Compression_FrameMagic, (uint32_t)m_state->BlockSize };
+                Stream_WriteAll(stream, header, sizeof(header));
+                m_state->CompressedWritten = Compression_HeaderSize;
+            }
+            catch (...)
+            {
+                nl::memory::Destroy(m_state);
+                throw;
+            }
+        }
+
+        CompressionStream::~CompressionStream()
+        {
+            try
+            {
+                Finish();
+            }
+            catch (const Exception&)
+            {
+                // nothing can be reported from a destructor
+            }
+
+            nl::memory::Destroy(m_state);
+        }
+
+        Stream* CompressionStream::GetStream()
+        {
+            return m_state->Inner;
+        }
+
+        bool CompressionStream::CanSeek() const
+        {
+            return false;
+        }
+
+        bool CompressionStream::CanRead() const
+        {
+            return false;
+        }
+
+        bool CompressionStream::CanWrite() const
+        {
+            return !m_state->Finished;
+        }
+
+        int64_t CompressionStream::GetPosition() const
+        {
+            return m_state->UncompressedWritten + (int64_t)m_state->InputLength;
+        }
+
+        void CompressionStream::Flush()
+        {
+            if (!m_state->Finished)
+                CompressPending();
+
+            m_state->Inner->Flush();
+        }
+
+        void CompressionStream::Close()
+        {
+            Finish();
+            m_state->Inner->Close();
+        }
+
+        int64_t CompressionStream::Read(void* lp, int64_t numberOfBytesToRead)
+        {
+            throw NotSupportedException("A CompressionStream cannot be read from.");
+        }
+
+        int64_t CompressionStream::Write(const void* lp, int64_t numberOfBytesToWrite)
+        {
+            if (m_state->Finished)
+                throw InvalidOperationException("The compressed frame has already been finished.");
+
+            const char* p = static_cast<const char*>(lp);
+            size_t remaining = (size_t)nl::util::Max<int64_t>(numberOfBytesToWrite, 0);
+            size_t capacity = m_state->GetInputCapacity();
+
+            while (remaining != 0)
+            {
+                size_t count = nl::util::Min(remaining, capacity - m_state->InputLength);
+                memcpy(m_state->Input.Get<char>() + m_state->InputLength, p, count);
+                m_state->InputLength += count;
+                p += count;
+                remaining -= count;
+
+                if (m_state->InputLength == capacity)
+                    CompressPending();
+            }
+
+            return numberOfBytesToWrite;
+        }
+
+        void* CompressionStream::AcquireWriteSpan(int64_t size)
+        {
+            if (m_state->Finished ||
+                size < 0 ||
+                (size_t)size > m_state->GetInputCapacity())
+                return nullptr;
+
+            if (m_state->GetInputCapacity() - m_state->InputLength < (size_t)size)
+                CompressPending();
+
+            return m_state->Input.Get<char>() + m_state->InputLength;
+        }
+
+        void CompressionStream::Commit(int64_t count)
+        {
+            if (count < 0 ||
+                (size_t)count > m_state->GetInputCapacity() - m_state->InputLength)
+                throw ArgumentException("The count exceeds the acquired write span.");
+
+            m_state->InputLength += (size_t)count;
+            if (m_state->InputLength == m_state->GetInputCapacity())
+                CompressPending();
+        }
+
+        void CompressionStream::Finish()
+        {
+            if (m_state->Finished)
+                return;
+
+            CompressPending();
+
+            // nothing may be written after a failure part way through the trailer
+            m_state->Finished = true;
+
+            uint32_t end_marker = 0;
+            Stream_WriteAll(m_state->Inner, &end_marker, sizeof(end_marker));
+            m_state->CompressedWritten += sizeof(end_marker);
+
+            if (!m_state->WriteIndex)
+                return;
+
+            if (m_state->Index.GetCount() != 0)
+                Stream_WriteAll(m_state->Inner, m_state->Index.GetArray(), (int64_t)m_state->Index.GetCount() * Compression_IndexEntrySize);
+
+            char trailer[Compression_TrailerSize];
+            uint32_t count = (uint32_t)m_state->Index.GetCount();
+            memcpy(trailer, &m_state->UncompressedWritten, 8);
+            memcpy(trailer + 8, &count, 4);
+            memcpy(trailer + 12, &Compression_IndexMagic, 4);
+            Stream_WriteAll(m_state->Inner, trailer, sizeof(trailer));
+
+            m_state->CompressedWritten += (int64_t)m_state->Index.GetCount() * Compression_IndexEntrySize + Compression_TrailerSize;
+        }
+
+        int64_t CompressionStream::GetCompressedLength() const
+        {
+            return m_state->CompressedWritten;
+        }
+
+        void CompressionStream::CompressPending()
+        {
+            auto state = m_state;
+            if (state->InputLength == 0)
+                return;
+
+            size_t blocks = (state->InputLength + state->BlockSize - 1) / state->BlockSize;
+
+            if (state->Pool &&
+                blocks > 1)
+            {
+                for (size_t i = 0; i < blocks; ++i)
+                    state->Pool->Queue([state, i]() { state->CompressBlock(i); });
+
+                state->Pool->Wait();
+            }
+            else
+            {
+                for (size_t i = 0; i < blocks; ++i)
+                    state->CompressBlock(i);
+            }
+
+            // the batch goes out in a single vectored write, so every block header needs its own storage
+            state->Headers.Clear();
+            for (size_t i = 0; i < blocks * 2; ++i)
+                state->Headers.Add(0);
+
+            uint32_t* header = &state->Headers[0];
+
+            state->Segments.Clear();
+            int64_t total = 0;
+
+            for (size_t i = 0; i < blocks; ++i)
+            {
+                size_t offset = i * state->BlockSize;
+                size_t length = nl::util::Min(state->BlockSize, state->InputLength - offset);
+                size_t compressed = state->CompressedSizes[i];
+
+                const char* data = state->Output.Get<char>() + offset;
+                uint32_t stored_size = (uint32_t)compressed;
+                if (compressed == 0)
+                {
+                    data = state->Input.Get<char>() + offset;
+                    compressed = length;
+                    stored_size = (uint32_t)length | Compression_StoredFlag;
+                }
+
+                header[i * 2] = stored_size;
+                header[i * 2 + 1] = (uint32_t)length;
+
+                state->Segments.Add(IOSegment(&header[i * 2], Compression_BlockHeaderSize));
+                state->Segments.Add(IOSegment(data, compressed));
+
+                if (state->WriteIndex)
+                    state->Index.Add({ state->CompressedWritten + total, state->UncompressedWritten });
+
+                state->UncompressedWritten += (int64_t)length;
+                total += Compression_BlockHeaderSize + (int64_t)compressed;
+            }
+
+            state->InputLength = 0;
+
+            if (state->Inner->WriteV(&state->Segments[0], (int32_t)state->Segments.GetCount()) != total)
+                throw IOException(IOException::WriteFailed);
+
+            state->CompressedWritten += total;
+        }
+
+        /////////////////////////////////////////////////////
+        /////////////////////////////////////////////////////
+        /////////////////////////////////////////////////////
+
+        struct DecompressionStreamState
+        {
+            Stream* Inner = nullptr;
+            int64_t FrameStart = 0;
+            size_t BlockSize = 0;
+
+            nl::memory::Memory Compressed;
+            nl::memory::Memory Block;
+            size_t BlockLength = 0;
+            size_t BlockPosition = 0;
+            int64_t BlockStart = 0; // uncompressed offset of the current block
+            bool EndOfFrame = false;
+
+            bool HasIndex = false;
+            nl::Vector<CompressionBlockIndexEntry> Index;
+            int64_t UncompressedLength = 0;
+        };
+
+        DecompressionStream::DecompressionStream(Stream* stream) :
+            m_state(nullptr)
+        {
+            if (!stream->CanRead())
+                throw ArgumentException("The provided stream cannot be read from.");
+
+            m_state = nl::memory::ConstructThrow<DecompressionStreamState>();
+
+            try
+            {
+                m_state->Inner = stream;
+                if (stream->CanSeek())
+                    m_state->FrameStart = stream->GetPosition();
+
+                uint32_t header[2];
+                if (!Compression_ReadExact(stream, header, sizeof(header)) ||
+                    header[0] != Compression_FrameMagic ||
+                    header[1] == 0 ||
+                    header[1] > (uint32_t)Compression_MaxBlockSize)
+                    throw IOException("The stream does not contain a compressed frame");
+
+                m_state->BlockSize = header[1];
+                m_state->Compressed = nl::memory::Memory::Allocate(m_state->BlockSize);
+                m_state->Block = nl::memory::Memory::Allocate(m_state->BlockSize);
+
+                if (stream->CanSeek())
+                    LoadIndex();
+            }
+            catch (...)
+            {
+                nl::memory::Destroy(m_state);
+                throw;
+            }
+        }
+
+        DecompressionStream::~DecompressionStream()
+        {
+            nl::memory::Destroy(m_state);
+        }
+
+        Stream* DecompressionStream::GetStream()
+        {
+            return m_state->Inner;
+        }
+
+        bool DecompressionStream::CanSeek() const
+        {
+            return m_state->HasIndex;
+        }
+
+        bool DecompressionStream::CanRead() const
+        {
+            return true;
+        }
+
+        bool DecompressionStream::CanWrite() const
+        {
+            return false;
+        }
+
+        int64_t DecompressionStream::GetPosition() const
+        {
+            return m_state->BlockStart + (int64_t)m_state->BlockPosition;
+        }
+
+        int64_t DecompressionStream::GetLength() const
+        {
+            if (!m_state->HasIndex)
+                throw NotSupportedException("The length of a compressed frame without a block index is unknown.");
+
+            return m_state->UncompressedLength;
+        }
+
+        int64_t DecompressionStream::Seek(int64_t offset, SeekMode mode)
+        {
+            if (!m_state->HasIndex)
+                throw NotSupportedException("Seeking requires a seekable stream and a compressed frame with a block index.");
+
+            int64_t pos = 0;
+            switch (mode)
+            {
+            case SeekMode::Begin:
+                pos = offset;
+                break;
+            case SeekMode::Current:
+                pos = GetPosition() + offset;
+                break;
+            case SeekMode::End:
+                pos = m_state->UncompressedLength + offset;
+                break;
+            }
+
+            if (pos < 0)
+                throw IOException(IOException::SeekFailed);
+
+            if (pos >= m_state->BlockStart &&
+                pos < m_state->BlockStart + (int64_t)m_state->BlockLength)
+            {
+                m_state->BlockPosition = (size_t)(pos - m_state->BlockStart);
+                return pos;
+            }
+
+            if (pos >= m_state->UncompressedLength)
+            {
+                m_state->EndOfFrame = true;
+                m_state->BlockStart = pos;
+                m_state->BlockLength = 0;
+                m_state->BlockPosition = 0;
+                return pos;
+            }
+
+            // last block starting at or before the position
+            size_t low = 0;
+            size_t high = m_state->Index.GetCount();
+            while (high - low > 1)
+            {
+                size_t mid = (low + high) / 2;
+                if (m_state->Index[mid].UncompressedOffset <= pos)
+                    low = mid;
+                else
+                    high = mid;
+            }
+
+            SeekToBlock((int64_t)low);
+            m_state->BlockPosition = (size_t)(pos - m_state->BlockStart);
+            return pos;
+        }
+
+        void DecompressionStream::Close()
+        {
+            m_state->Inner->Close();
+        }
+
+        int64_t DecompressionStream::Read(void* lp, int64_t numberOfBytesToRead)
+        {
+            char* p = static_cast<char*>(lp);
+            int64_t total = 0;
+
+            while (total < numberOfBytesToRead)
+            {
+                if (m_state->BlockPosition == m_state->BlockLength &&
+                    !ReadNextBlock())
+                    break;
+
+                size_t count = (size_t)nl::util::Min<int64_t>(numberOfBytesToRead - total, (int64_t)(m_state->BlockLength - m_state->BlockPosition));
+                memcpy(p + total, m_state->Block.Get<char>() + m_state->BlockPosition, count);
+                m_state->BlockPosition += count;
+                total += (int64_t)count;
+            }
+
+            return total;
+        }
+
+        int64_t DecompressionStream::Write(const void* lp, int64_t numberOfBytesToWrite)
+        {
+            throw NotSupportedException("A DecompressionStream cannot be written to.");
+        }
+
+        const void* DecompressionStream::TryPeek(int64_t size)
+        {
+            if (size < 0)
+                return nullptr;
+
+            if (m_state->BlockPosition == m_state->BlockLength &&
+                !ReadNextBlock())
+                return nullptr;
+
+            if ((size_t)size > m_state->BlockLength - m_state->BlockPosition)
+                return nullptr;
+
+            return m_state->Block.Get<char>() + m_state->BlockPosition;
+        }
+
+        void DecompressionStream::Advance(int64_t count)
+        {
+            if (count < 0)
+                throw ArgumentException("The count cannot be negative.");
+
+            while (count > 0)
+            {
+                if (m_state->BlockPosition == m_state->BlockLength &&
+                    !ReadNextBlock())
+                    throw ArgumentException("The count exceeds the remaining data of this DecompressionStream.");
+
+                size_t step = (size_t)nl::util::Min<int64_t>(count, (int64_t)(m_state->BlockLength - m_state->BlockPosition));
+                m_state->BlockPosition += step;
+                count -= (int64_t)step;
+            }
+        }
+
+        int64_t DecompressionStream::GetBlockCount() const
+        {
+            if (!m_state->HasIndex)
+                throw NotSupportedException("The compressed frame has no block index.");
+
+            return (int64_t)m_state->Index.GetCount();
+        }
+
+        void DecompressionStream::SeekToBlock(int64_t block)
+        {
+            if (block < 0 ||
+                block >= GetBlockCount())
+                throw ArgumentException("The block index is out of range.");
+
+            const auto& entry = m_state->Index[(size_t)block];
+            m_state->Inner->Seek(m_state->FrameStart + entry.Offset, SeekMode::Begin);
+
+            m_state->EndOfFrame = false;
+            m_state->BlockStart = entry.UncompressedOffset;
+            m_state->BlockLength = 0;
+            m_state->BlockPosition = 0;
+
+            if (!ReadNextBlock())
+                throw IOException("Corrupt block index");
+        }
+
+        bool DecompressionStream::ReadNextBlock()
+        {
+            auto state = m_state;
+            if (state->EndOfFrame)
+                return false;
+
+            state->BlockStart += (int64_t)state->BlockLength;
+            state->BlockLength = 0;
+            state->BlockPosition = 0;
+
+            uint32_t stored_size;
+            if (!Compression_ReadExact(state->Inner, &stored_size, sizeof(stored_size)))
+                throw IOException("Unexpected end of the compressed stream");
+
+            if (stored_size == 0)
+            {
+                state->EndOfFrame = true;
+                return false;
+            }
+
+            uint32_t length;
+            Compression_ReadExact(state->Inner, &length, sizeof(length));
+
+            bool stored = (stored_size & Compression_StoredFlag) != 0;
+            size_t size = stored_size & ~Compression_StoredFlag;
+
+            if (length == 0 ||
+                length > state->BlockSize ||
+                size > length ||
+                (stored && size != length))
+                throw IOException("Corrupt compressed block");
+
+            if (stored)
+            {
+                if (!Compression_ReadExact(state->Inner, state->Block.Get(), (int64_t)size))
+                    throw IOException("Unexpected end of the compressed stream");
+            }
+            else
+            {
+                if (!Compression_ReadExact(state->Inner, state->Compressed.Get(), (int64_t)size) ||
+                    LzDecompress(state->Compressed.Get(), size, state->Block.Get(), length) != (int64_t)length)
+                    throw IOException("Corrupt compressed block");
+            }
+
+            state->BlockLength = length;
+            return true;
+        }
+
+        void DecompressionStream::LoadIndex()
+        {
+            auto state = m_state;
+            Stream* inner = state->Inner;
+
+            int64_t data_start = state->FrameStart + Compression_HeaderSize;
+            int64_t length = inner->GetLength();
+            if (length - data_start < (int64_t)sizeof(uint32_t) + Compression_TrailerSize)
+                return;
+
+            char trailer[Compression_TrailerSize];
+            inner->Seek(length - Compression_TrailerSize, SeekMode::Begin);
+            Compression_ReadExact(inner, trailer, sizeof(trailer));
+
+            int64_t uncompressed_length = Compression_GetInt64(trailer);
+            uint32_t count = Compression_GetUInt32(trailer + 8);
+            int64_t index_start = length - Compression_TrailerSize - (int64_t)count * Compression_IndexEntrySize;
+
+            if (Compression_GetUInt32(trailer + 12) == Compression_IndexMagic &&
+                index_start - (int64_t)sizeof(uint32_t) >= data_start)
+            {
+                // Seek looks up every position in the entries, so they have to cover the data from its start
+                if (count == 0 ? uncompressed_length != 0 : uncompressed_length <= 0)
+                    throw IOException("Corrupt block index");
+
+                inner->Seek(index_start, SeekMode::Begin);
+
+                CompressionBlockIndexEntry entry;
+                CompressionBlockIndexEntry previous = { Compression_HeaderSize - Compression_BlockHeaderSize, -1 };
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    Compression_ReadExact(inner, &entry, sizeof(entry));
+
+                    if (entry.Offset <= previous.Offset ||
+                        entry.UncompressedOffset <= previous.UncompressedOffset ||
+                        (i == 0 && entry.UncompressedOffset != 0) ||
+                        entry.UncompressedOffset >= uncompressed_length)
+                        throw IOException("Corrupt block index");
+
+                    state->Index.Add(entry);
+                    previous = entry;
+                }
+
+                state->HasIndex = true;
+                state->UncompressedLength = uncompressed_length;
+            }
+
+            inner->Seek(data_start, SeekMode::Begin);
+        }
+    }
+}
@@ -119,6 +119,21 @@ namespace nl
             return systemlayer::GetSystemLayerFunctions()->FileWrite(m_fp, lp, numberOfBytesToWrite);
         }
 
+        int64_t FileStream::ReadV(const IOSegment* segments, int32_t count)
+        {
+            return systemlayer::GetSystemLayerFunctions()->FileReadV(m_fp, segments, count);
+        }
+
+        int64_t FileStream::WriteV(const IOSegment* segments, int32_t count)
+        {
+            return systemlayer::GetSystemLayerFunctions()->FileWriteV(m_fp, segments, count);
+        }
+
+        systemlayer::FileHandle FileStream::GetFileHandle() const
+        {
+            return m_fp;
+        }
+
         FileStream FileStream::Open(std::string_view filename, CreateMode mode, bool writable)
         {
             return FileStream(systemlayer::GetSystemLayerFunctions()->FileOpen(nl::String(filename), mode, writable));
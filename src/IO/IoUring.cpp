@@ -0,0 +1,200 @@
+#include "StdAfx.h"
+
+//!ALLOW_INCLUDE "IoUring.h"
+#include "IoUring.h"
+
+#ifdef NL_HAS_IO_URING
+
+//!ALLOW_INCLUDE "sys/mman.h"
+//!ALLOW_INCLUDE "sys/syscall.h"
+//!ALLOW_INCLUDE "sys/uio.h"
+//!ALLOW_INCLUDE "unistd.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace nl::io
+{
+    IoUring::IoUring() :
+        m_fd(-1),
+        m_features(0),
+        m_ring(MAP_FAILED),
+        m_ring_size(0),
+        m_sqes((io_uring_sqe*)MAP_FAILED),
+        m_sqes_size(0),
+        m_sq_head(nullptr),
+        m_sq_tail(nullptr),
+        m_sq_mask(0),
+        m_sq_entries(0),
+        m_sq_array(nullptr),
+        m_sqe_tail(0),
+        m_sqe_submitted(0),
+        m_cq_head(nullptr),
+        m_cq_tail(nullptr),
+        m_cq_mask(0),
+        m_cqes(nullptr)
+    {
+    }
+
+    IoUring::~IoUring()
+    {
+        Close();
+    }
+
+    bool IoUring::Initialize(uint32_t entries, uint32_t flags)
+    {
+        io_uring_params params = {};
+        params.flags = flags;
+
+        int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0)
+            return false;
+
+        // one mapping holds both rings; kernels before 5.4 without it are treated as unsupported
+        if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        size_t ring_size = sq_size > cq_size ? sq_size : cq_size;
+
+        void* ring = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (ring == MAP_FAILED)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        size_t sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+        {
+            munmap(ring, ring_size);
+            ::close(fd);
+            return false;
+        }
+
+        Close();
+
+        char* base = (char*)ring;
+        m_fd = fd;
+        m_features = params.features;
+        m_ring = ring;
+        m_ring_size = ring_size;
+        m_sqes = (io_uring_sqe*)sqes;
+        m_sqes_size = sqes_size;
+
+        m_sq_head = (uint32_t*)(base + params.sq_off.head);
+        m_sq_tail = (uint32_t*)(base + params.sq_off.tail);
+        m_sq_mask = *(uint32_t*)(base + params.sq_off.ring_mask);
+        m_sq_entries = *(uint32_t*)(base + params.sq_off.ring_entries);
+        m_sq_array = (uint32_t*)(base + params.sq_off.array);
+        m_sqe_tail = *m_sq_tail;
+        m_sqe_submitted = m_sqe_tail;
+
+        m_cq_head = (uint32_t*)(base + params.cq_off.head);
+        m_cq_tail = (uint32_t*)(base + params.cq_off.tail);
+        m_cq_mask = *(uint32_t*)(base + params.cq_off.ring_mask);
+        m_cqes = (io_uring_cqe*)(base + params.cq_off.cqes);
+
+        return true;
+    }
+
+    void IoUring::Close()
+    {
+        if (m_sqes != MAP_FAILED)
+        {
+            munmap(m_sqes, m_sqes_size);
+            m_sqes = (io_uring_sqe*)MAP_FAILED;
+        }
+
+        if (m_ring != MAP_FAILED)
+        {
+            munmap(m_ring, m_ring_size);
+            m_ring = MAP_FAILED;
+        }
+
+        if (m_fd != -1)
+        {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    io_uring_sqe* IoUring::GetSqe()
+    {
+        uint32_t head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sqe_tail - head >= m_sq_entries)
+            return nullptr;
+
+        uint32_t index = m_sqe_tail & m_sq_mask;
+        ++m_sqe_tail;
+
+        io_uring_sqe* sqe = &m_sqes[index];
+        memset(sqe, 0, sizeof(io_uring_sqe));
+        m_sq_array[index] = index;
+        return sqe;
+    }
+
+    int IoUring::Submit(uint32_t wait_for)
+    {
+        uint32_t to_submit = m_sqe_tail - m_sqe_submitted;
+        if (to_submit == 0 &&
+            wait_for == 0)
+            return 0;
+
+        // publish the prepared entries before the kernel is told about them
+        __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+
+        unsigned flags = wait_for != 0 ? IORING_ENTER_GETEVENTS : 0;
+
+        for (;;)
+        {
+            int result = (int)syscall(__NR_io_uring_enter, m_fd, to_submit, wait_for, flags, nullptr, 0);
+            if (result >= 0)
+            {
+                m_sqe_submitted += (uint32_t)result;
+                return result;
+            }
+
+            if (errno != EINTR)
+                return -errno;
+        }
+    }
+
+    io_uring_cqe* IoUring::PeekCqe()
+    {
+        uint32_t head = *m_cq_head;
+        if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+            return nullptr;
+
+        return &m_cqes[head & m_cq_mask];
+    }
+
+    void IoUring::AdvanceCqe()
+    {
+        __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+    }
+
+    int IoUring::Register(uint32_t opcode, const void* arg, uint32_t count)
+    {
+        int result = (int)syscall(__NR_io_uring_register, m_fd, opcode, arg, count);
+        return result < 0 ? -errno : result;
+    }
+
+    int IoUring::RegisterBuffers(const iovec* buffers, uint32_t count)
+    {
+        return Register(IORING_REGISTER_BUFFERS, buffers, count);
+    }
+
+    int IoUring::UnregisterBuffers()
+    {
+        return Register(IORING_UNREGISTER_BUFFERS, nullptr, 0);
+    }
+}
+
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <NativeLib/Platform/Platform.h>
+
+#if defined(NL_PLATFORM_LINUX) && !defined(__EMSCRIPTEN__)
+#define NL_HAS_IO_URING
+
+//!ALLOW_INCLUDE "linux/io_uring.h"
+#include <linux/io_uring.h>
+
+struct iovec;
+
+namespace nl::io
+{
+    // Minimal io_uring instance driven through the raw system calls.
+    // Not thread safe; submission and completion are expected to happen on the same thread.
+    class IoUring
+    {
+    public:
+        IoUring();
+        ~IoUring();
+
+        IoUring(const IoUring&) = delete;
+        IoUring& operator =(const IoUring&) = delete;
+
+        // Returns false if io_uring is unavailable, e.g. an old kernel or blocked by a seccomp policy.
+        bool Initialize(uint32_t entries, uint32_t flags = 0);
+        void Close();
+
+        bool IsInitialized() const { return m_fd != -1; }
+        int GetDescriptor() const { return m_fd; }
+        uint32_t GetEntries() const { return m_sq_entries; }
+        uint32_t GetFeatures() const { return m_features; }
+
+        // Returns a cleared submission entry, or nullptr if the submission queue is full.
+        io_uring_sqe* GetSqe();
+
+        // Number of entries prepared with GetSqe that the kernel has not consumed yet.
+        uint32_t GetUnsubmitted() const { return m_sqe_tail - m_sqe_submitted; }
+
+        // Hands prepared entries to the kernel and optionally waits for wait_for completions.
+        // Returns the number of entries consumed or a negative errno value.
+        int Submit(uint32_t wait_for = 0);
+
+        // Returns the oldest completion without removing it, or nullptr if there is none.
+        io_uring_cqe* PeekCqe();
+        void AdvanceCqe();
+
+        int Register(uint32_t opcode, const void* arg, uint32_t count);
+        int RegisterBuffers(const iovec* buffers, uint32_t count);
+        int UnregisterBuffers();
+
+    private:
+        int m_fd;
+        uint32_t m_features;
+
+        void* m_ring;
+        size_t m_ring_size;
+        io_uring_sqe* m_sqes;
+        size_t m_sqes_size;
+
+        uint32_t* m_sq_head;
+        uint32_t* m_sq_tail;
+        uint32_t m_sq_mask;
+        uint32_t m_sq_entries;
+        uint32_t* m_sq_array;
+        uint32_t m_sqe_tail; // entries handed out by GetSqe
+        uint32_t m_sqe_submitted; // entries consumed by the kernel
+
+        uint32_t* m_cq_head;
+        uint32_t* m_cq_tail;
+        uint32_t m_cq_mask;
+        io_uring_cqe* m_cqes;
+    };
+}
+
+#endif
@@ -0,0 +1,281 @@
+#include "StdAfx.h"
+
+#include <NativeLib/IO/LzCodec.h>
+
+namespace nl
+{
+    namespace io
+    {
+        static constexpr size_t Lz_MinMatch = 4;
+        static constexpr size_t Lz_LastLiterals = 5; // the block always ends with this many literals
+        static constexpr size_t Lz_MatchFindLimit = 12; // no match starts within this many bytes of the end
+        static constexpr size_t Lz_MaxDistance = 65535;
+        static constexpr uint32_t Lz_HashLog = 13;
+        static constexpr uint32_t Lz_SkipTrigger = 6; // step size grows by one every 2^6 failed match attempts
+
+        static inline uint32_t Lz_Read32(const uint8_t* p)
+        {
+            uint32_t value;
+            memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        static inline uint64_t Lz_Read64(const uint8_t* p)
+        {
+            uint64_t value;
+            memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        static inline uint32_t Lz_Hash(uint32_t sequence)
+        {
+            return (sequence * 2654435761u) >> (32 - Lz_HashLog);
+        }
+
+        static inline void Lz_WriteLength(uint8_t*& op, size_t length)
+        {
+            while (length >= 255)
+            {
+                *op++ = 255;
+                length -= 255;
+            }
+
+            *op++ = (uint8_t)length;
+        }
+
+        // Writes the literals and, unless match_length is zero, the match that follows them.
+        static bool Lz_WriteSequence(uint8_t*& op, uint8_t* oend, const uint8_t* literals, size_t literal_length, size_t offset, size_t match_length)
+        {
+            size_t required = 1 + literal_length / 255 + 1 + literal_length;
+            if (match_length != 0)
+                required += 2 + (match_length - Lz_MinMatch) / 255 + 1;
+
+            if ((size_t)(oend - op) < required)
+                return false;
+
+            uint8_t* token = op++;
+            if (literal_length >= 15)
+            {
+                *token = 15 << 4;
+                Lz_WriteLength(op, literal_length - 15);
+            }
+            else
+            {
+                *token = (uint8_t)(literal_length << 4);
+            }
+
+            memcpy(op, literals, literal_length);
+            op += literal_length;
+
+            if (match_length == 0)
+                return true;
+
+            *op++ = (uint8_t)offset;
+            *op++ = (uint8_t)(offset >> 8);
+
+            size_t length = match_length - Lz_MinMatch;
+            if (length >= 15)
+            {
+                *token |= 15;
+                Lz_WriteLength(op, length - 15);
+            }
+            else
+            {
+                *token |= (uint8_t)length;
+            }
+
+            return true;
+        }
+
+        size_t LzCompress(const void* src, size_t size, void* dst, size_t dst_capacity)
+        {
+            const uint8_t* const base = static_cast<const uint8_t*>(src);
+            const uint8_t* const iend = base + size;
+            const uint8_t* ip = base;
+            const uint8_t* anchor = base;
+
+            uint8_t* const ostart = static_cast<uint8_t*>(dst);
+            uint8_t* const oend = ostart + dst_capacity;
+            uint8_t* op = ostart;
+
+            if (size > Lz_MatchFindLimit)
+            {
+                const uint8_t* const mflimit = iend - Lz_MatchFindLimit;
+                const uint8_t* const matchlimit = iend - Lz_LastLiterals;
+
+                // every entry starts out at position 0; the comparison below rejects stale candidates
+                uint32_t table[1 << Lz_HashLog];
+                memset(table, 0, sizeof(table));
+
+                ++ip;
+
+                for (;;)
+                {
+                    const uint8_t* match;
+                    uint32_t attempts = 1 << Lz_SkipTrigger;
+
+                    for (;;)
+                    {
+                        if (ip > mflimit)
+                            goto last_literals;
+
+                        uint32_t sequence = Lz_Read32(ip);
+                        uint32_t h = Lz_Hash(sequence);
+
+                        match = base + table[h];
+                        table[h] = (uint32_t)(ip - base);
+
+                        if (match < ip &&
+                            (size_t)(ip - match) <= Lz_MaxDistance &&
+                            Lz_Read32(match) == sequence)
+                            break;
+
+                        // skip ahead faster through data that does not compress
+                        ip += attempts++ >> Lz_SkipTrigger;
+                    }
+
+                    while (ip > anchor &&
+                        match > base &&
+                        ip[-1] == match[-1])
+                    {
+                        --ip;
+                        --match;
+                    }
+
+                    const uint8_t* p = ip + Lz_MinMatch;
+                    const uint8_t* m = match + Lz_MinMatch;
+
+                    while (p + sizeof(uint64_t) <= matchlimit)
+                    {
+                        uint64_t diff = Lz_Read64(p) ^ Lz_Read64(m);
+                        if (diff != 0)
+                        {
+                            while ((diff & 0xff) == 0)
+                            {
+                                diff >>= 8;
+                                ++p;
+                            }
+
+                            goto match_end;
+                        }
+
+                        p += sizeof(uint64_t);
+                        m += sizeof(uint64_t);
+                    }
+
+                    while (p < matchlimit &&
+                        *p == *m)
+                    {
+                        ++p;
+                        ++m;
+                    }
+
+                match_end:
+                    if (!Lz_WriteSequence(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - match), (size_t)(p - ip)))
+                        return 0;
+
+                    ip = p;
+                    anchor = ip;
+
+                    // index a position inside the match to find the next one sooner
+                    table[Lz_Hash(Lz_Read32(ip - 2))] = (uint32_t)(ip - 2 - base);
+                }
+            }
+
+        last_literals:
+            if (!Lz_WriteSequence(op, oend, anchor, (size_t)(iend - anchor), 0, 0))
+                return 0;
+
+            return (size_t)(op - ostart);
+        }
+
+        static inline bool Lz_ReadLength(const uint8_t*& ip, const uint8_t* iend, size_t& length)
+        {
+            for (;;)
+            {
+                if (ip >= iend)
+                    return false;
+
+                uint8_t by = *ip++;
+                length += by;
+
+                if (by != 255)
+                    return true;
+            }
+        }
+
+        int64_t LzDecompress(const void* src, size_t size, void* dst, size_t dst_capacity)
+        {
+            const uint8_t* ip = static_cast<const uint8_t*>(src);
+            const uint8_t* const iend = ip + size;
+
+            uint8_t* const ostart = static_cast<uint8_t*>(dst);
+            uint8_t* const oend = ostart + dst_capacity;
+            uint8_t* op = ostart;
+
+            for (;;)
+            {
+                if (ip >= iend)
+                    return -1;
+
+                uint8_t token = *ip++;
+
+                size_t literal_length = token >> 4;
+                if (literal_length == 15 &&
+                    !Lz_ReadLength(ip, iend, literal_length))
+                    return -1;
+
+                if ((size_t)(iend - ip) < literal_length ||
+                    (size_t)(oend - op) < literal_length)
+                    return -1;
+
+                memcpy(op, ip, literal_length);
+                op += literal_length;
+                ip += literal_length;
+
+                // the last sequence has no match
+                if (ip == iend)
+                    break;
+
+                if (iend - ip < 2)
+                    return -1;
+
+                size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+                ip += 2;
+
+                if (offset == 0 ||
+                    offset > (size_t)(op - ostart))
+                    return -1;
+
+                size_t match_length = token & 15;
+                if (match_length == 15 &&
+                    !Lz_ReadLength(ip, iend, match_length))
+                    return -1;
+
+                match_length += Lz_MinMatch;
+                if ((size_t)(oend - op) < match_length)
+                    return -1;
+
+                const uint8_t* match = op - offset;
+                uint8_t* const match_end = op + match_length;
+
+                if (offset >= sizeof(uint64_t))
+                {
+                    // chunks never overlap when the source is at least a chunk behind
+                    while ((size_t)(match_end - op) >= sizeof(uint64_t))
+                    {
+                        memcpy(op, match, sizeof(uint64_t));
+                        op += sizeof(uint64_t);
+                        match += sizeof(uint64_t);
+                    }
+                }
+
+                // short distances repeat earlier output, which has to be copied a byte at a time
+                while (op < match_end)
+                    *op++ = *match++;
+            }
+
+            return (int64_t)(op - ostart);
+        }
+    }
+}
@@ -0,0 +1,500 @@
+#include "StdAfx.h"
+
+#include <NativeLib/IO/MappedFileStream.h>
+#include <NativeLib/Exceptions.h>
+#include <NativeLib/Util.h>
+
+//!ALLOW_INCLUDE "Windows.h"
+//!ALLOW_INCLUDE "sys/mman.h"
+//!ALLOW_INCLUDE "unistd.h"
+
+#ifdef NL_PLATFORM_WINDOWS
+#include <Windows.h>
+#endif
+
+#ifdef NL_PLATFORM_LINUX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace nl
+{
+    namespace io
+    {
+        // growth is rounded to this, which is the allocation granularity on Windows and a multiple of the page size elsewhere
+        static constexpr int64_t MappedFileStream_Granularity = 65536;
+
+        static bool MappedFileStream_ResizeFile(systemlayer::FileHandle fp, int64_t size)
+        {
+            auto functions = systemlayer::GetSystemLayerFunctions();
+            return
+                functions->FileSeek(fp, size, SeekMode::Begin) &&
+                functions->FileSetEndOfFile(fp);
+        }
+
+        MappedFileStream::MappedFileStream() :
+            m_fp(0),
+            m_writable(false),
+            m_data(nullptr),
+            m_mapping(nullptr),
+            m_capacity(0),
+            m_length(0),
+            m_position(0)
+        {
+        }
+
+        MappedFileStream::MappedFileStream(systemlayer::FileHandle fp, bool writable) :
+            m_fp(fp),
+            m_writable(writable),
+            m_data(nullptr),
+            m_mapping(nullptr),
+            m_capacity(0),
+            m_length(0),
+            m_position(0)
+        {
+            if (m_fp == 0)
+                return;
+
+            try
+            {
+                int64_t size = systemlayer::GetSystemLayerFunctions()->FileGetSize(m_fp);
+                if (size < 0)
+                    throw IOException("Failed to get the size of the file");
+
+                Map(size);
+                m_length = size;
+            }
+            catch (...)
+            {
+                systemlayer::GetSystemLayerFunctions()->FileClose(m_fp);
+                m_fp = 0;
+                throw;
+            }
+        }
+
+        MappedFileStream::~MappedFileStream()
+        {
+            try
+            {
+                Close();
+            }
+            catch (Exception&)
+            {
+                // nowhere to report the failure
+            }
+        }
+
+        MappedFileStream::operator bool() const
+        {
+            return m_fp != 0;
+        }
+
+        bool MappedFileStream::CanSeek() const
+        {
+            return true;
+        }
+
+        bool MappedFileStream::CanRead() const
+        {
+            return true;
+        }
+
+        bool MappedFileStream::CanWrite() const
+        {
+            return m_writable;
+        }
+
+        bool MappedFileStream::IsOpen() const
+        {
+            return m_fp != 0;
+        }
+
+        int64_t MappedFileStream::GetPosition() const
+        {
+            return m_position;
+        }
+
+        int64_t MappedFileStream::GetLength() const
+        {
+            return m_length;
+        }
+
+        int64_t MappedFileStream::Seek(int64_t offset, SeekMode mode)
+        {
+            int64_t pos = 0;
+
+            switch (mode)
+            {
+            case SeekMode::Begin:
+                pos = offset;
+                break;
+            case SeekMode::Current:
+                pos = m_position + offset;
+                break;
+            case SeekMode::End:
+                pos = m_length + offset;
+                break;
+            }
+
+            if (pos < 0)
+                throw IOException(IOException::SeekFailed);
+
+            m_position = pos;
+            return m_position;
+        }
+
+        void MappedFileStream::SetLength(int64_t length)
+        {
+            if (!m_writable)
+                throw NotSupportedException("The stream is not writable.");
+
+            if (length < 0)
+                throw ArgumentException("The length cannot be negative.");
+
+            // shrinking remaps at the exact size so the capacity beyond the length is always zero filled
+            if (length < m_length)
+                Map(length);
+            else
+                EnsureCapacity(length);
+
+            m_length = length;
+        }
+
+        void MappedFileStream::Flush()
+        {
+            if (!m_writable)
+                return;
+
+            if (m_data != nullptr)
+            {
+#ifdef NL_PLATFORM_WINDOWS
+                if (!FlushViewOfFile(m_data, 0))
+                    throw IOException("Failed to flush the mapped view");
+#else
+                if (msync(m_data, (size_t)m_capacity, MS_SYNC) != 0)
+                    throw IOException("Failed to flush the mapped view");
+#endif
+            }
+
+            // the dirty pages are written, but the file size is metadata the file system flushes separately
+            if (!systemlayer::GetSystemLayerFunctions()->FileFlush(m_fp))
+                throw IOException("Failed to flush file");
+        }
+
+        void MappedFileStream::Close()
+        {
+            if (m_fp == 0)
+                return;
+
+            Unmap();
+
+            auto error = false;
+            if (m_writable &&
+                m_capacity != m_length)
+                error = !MappedFileStream_ResizeFile(m_fp, m_length);
+
+            systemlayer::GetSystemLayerFunctions()->FileClose(m_fp);
+            m_fp = 0;
+            m_capacity = 0;
+            m_length = 0;
+            m_position = 0;
+
+            if (error)
+                throw IOException("Failed to trim the file to the length of the stream");
+        }
+
+        int64_t MappedFileStream::Read(void* lp, int64_t numberOfBytesToRead)
+        {
+            if (m_position >= m_length)
+                return 0;
+
+            numberOfBytesToRead = nl::util::Min(m_length - m_position, numberOfBytesToRead);
+            memcpy(lp, m_data + m_position, (size_t)numberOfBytesToRead);
+            m_position += numberOfBytesToRead;
+            return numberOfBytesToRead;
+        }
+
+        int64_t MappedFileStream::Write(const void* lp, int64_t numberOfBytesToWrite)
+        {
+            if (!m_writable)
+                throw NotSupportedException("The stream is not writable.");
+
+            if (numberOfBytesToWrite <= 0)
+                return 0;
+
+            EnsureCapacity(m_position + numberOfBytesToWrite);
+
+            memcpy(m_data + m_position, lp, (size_t)numberOfBytesToWrite);
+            m_position += numberOfBytesToWrite;
+            if (m_length < m_position)
+                m_length = m_position;
+
+            return numberOfBytesToWrite;
+        }
+
+        const void* MappedFileStream::TryPeek(int64_t size)
+        {
+            if (size < 0 ||
+                size > m_length - m_position)
+                return nullptr;
+
+            return m_data + m_position;
+        }
+
+        void MappedFileStream::Advance(int64_t count)
+        {
+            if (count < 0 ||
+                count > m_length - m_position)
+                throw ArgumentException("The count exceeds the remaining data of this MappedFileStream.");
+
+            m_position += count;
+        }
+
+        void* MappedFileStream::AcquireWriteSpan(int64_t size)
+        {
+            if (!m_writable ||
+                size < 0)
+                return nullptr;
+
+            EnsureCapacity(m_position + size);
+            return m_data + m_position;
+        }
+
+        void MappedFileStream::Commit(int64_t count)
+        {
+            if (count < 0 ||
+                count > m_capacity - m_position)
+                throw ArgumentException("The count exceeds the acquired write span.");
+
+            m_position += count;
+            if (m_length < m_position)
+                m_length = m_position;
+        }
+
+        std::string_view MappedFileStream::GetView(int64_t offset, int64_t length) const
+        {
+            if (offset < 0 ||
+                length < 0 ||
+                offset > m_length - length)
+                throw ArgumentException("The view is outside the valid range of this MappedFileStream.");
+
+            if (length == 0)
+                return std::string_view();
+
+            return std::string_view(m_data + offset, (size_t)length);
+        }
+
+        void MappedFileStream::Advise(MemoryAdvice advice, int64_t offset, int64_t length)
+        {
+            if (offset < 0)
+                throw ArgumentException("The offset cannot be negative.");
+
+            if (length < 0 ||
+                length > m_capacity - offset)
+                length = m_capacity - offset;
+
+            if (m_data == nullptr ||
+                length <= 0)
+                return;
+
+#ifdef NL_PLATFORM_WINDOWS
+            // Windows only takes prefetch requests, the other hints have no equivalent for mapped files
+            if (advice == MemoryAdvice::WillNeed)
+            {
+                WIN32_MEMORY_RANGE_ENTRY entry;
+                entry.VirtualAddress = m_data + offset;
+                entry.NumberOfBytes = (SIZE_T)length;
+                PrefetchVirtualMemory(GetCurrentProcess(), 1, &entry, 0);
+            }
+#else
+            // madvise takes page aligned addresses
+            int64_t page_size = (int64_t)sysconf(_SC_PAGESIZE);
+            int64_t aligned = offset - offset % page_size;
+
+            int flag = MADV_NORMAL;
+            switch (advice)
+            {
+            case MemoryAdvice::Normal: flag = MADV_NORMAL; break;
+            case MemoryAdvice::Sequential: flag = MADV_SEQUENTIAL; break;
+            case MemoryAdvice::Random: flag = MADV_RANDOM; break;
+            case MemoryAdvice::WillNeed: flag = MADV_WILLNEED; break;
+            case MemoryAdvice::DontNeed: flag = MADV_DONTNEED; break;
+            }
+
+            // only a hint; a failure changes nothing about the data
+            madvise(m_data + aligned, (size_t)(length + offset - aligned), flag);
+#endif
+        }
+
+        MappedFileStream MappedFileStream::Open(std::string_view filename, CreateMode mode, bool writable)
+        {
+            return MappedFileStream(systemlayer::GetSystemLayerFunctions()->FileOpen(nl::String(filename), mode, writable), writable);
+        }
+
+        void MappedFileStream::Map(int64_t capacity)
+        {
+            if (capacity == m_capacity &&
+                (m_data != nullptr || capacity == 0))
+                return;
+
+            if (m_fp == 0)
+                throw IOException("The stream is closed");
+
+            auto functions = systemlayer::GetSystemLayerFunctions();
+
+            // the size the file is given back if the new mapping cannot be made, -1 while it is not resized
+            int64_t file_size = -1;
+            if (m_writable &&
+                capacity != m_capacity)
+            {
+                file_size = functions->FileGetSize(m_fp);
+                if (file_size < 0)
+                    throw IOException("Failed to get the size of the file");
+            }
+
+#ifdef NL_PLATFORM_WINDOWS
+            // a mapped file cannot be resized, so the view is always recreated
+            Unmap();
+
+            if (file_size >= 0 &&
+                !MappedFileStream_ResizeFile(m_fp, capacity))
+            {
+                RecoverMap(-1);
+                throw IOException("Failed to resize the mapped file");
+            }
+
+            if (capacity == 0)
+            {
+                m_capacity = 0;
+                return;
+            }
+
+            HANDLE hFile = (HANDLE)functions->FileGetNativeHandle(m_fp);
+            HANDLE hMapping = CreateFileMappingW(
+                hFile,
+                nullptr,
+                m_writable ? PAGE_READWRITE : PAGE_READONLY,
+                (DWORD)((uint64_t)capacity >> 32),
+                (DWORD)((uint64_t)capacity & 0xffffffff),
+                nullptr);
+            if (!hMapping)
+            {
+                RecoverMap(file_size);
+                throw IOException("Failed to map the file");
+            }
+
+            void* data = MapViewOfFile(hMapping, m_writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, (SIZE_T)capacity);
+            if (!data)
+            {
+                CloseHandle(hMapping);
+                RecoverMap(file_size);
+                throw IOException("Failed to map the file");
+            }
+
+            m_mapping = hMapping;
+            m_data = (char*)data;
+            m_capacity = capacity;
+#else
+            if (file_size >= 0)
+            {
+                // unmap before truncating so no pages beyond the end of the file are left mapped
+                if (capacity < m_capacity)
+                    Unmap();
+
+                if (!MappedFileStream_ResizeFile(m_fp, capacity))
+                {
+                    RecoverMap(-1);
+                    throw IOException("Failed to resize the mapped file");
+                }
+            }
+
+            if (capacity == 0)
+            {
+                Unmap();
+                m_capacity = 0;
+                return;
+            }
+
+            void* data;
+            if (m_data != nullptr)
+            {
+                // grows in place when the address space after the mapping is free, otherwise moves without copying
+                data = mremap(m_data, (size_t)m_capacity, (size_t)capacity, MREMAP_MAYMOVE);
+            }
+            else
+            {
+                int fd = (int)functions->FileGetNativeHandle(m_fp);
+                int protection = m_writable ? PROT_READ | PROT_WRITE : PROT_READ;
+                data = mmap(nullptr, (size_t)capacity, protection, MAP_SHARED, fd, 0);
+            }
+
+            if (data == MAP_FAILED)
+            {
+                // a failed mremap leaves the old mapping in place
+                RecoverMap(file_size);
+                throw IOException("Failed to map the file");
+            }
+
+            m_data = (char*)data;
+            m_capacity = capacity;
+#endif
+        }
+
+        // Leaves the stream consistent after Map failed. A stream that still has the view of its capacity goes on
+        // with it, the file given back its old size; one whose view is gone is closed, with the file trimmed to the
+        // data written, so later calls fail rather than reach through a null view.
+        void MappedFileStream::RecoverMap(int64_t file_size)
+        {
+            auto functions = systemlayer::GetSystemLayerFunctions();
+
+            if (m_data != nullptr ||
+                m_capacity == 0)
+            {
+                if (file_size >= 0)
+                    MappedFileStream_ResizeFile(m_fp, file_size);
+
+                return;
+            }
+
+            if (m_writable)
+                MappedFileStream_ResizeFile(m_fp, m_length);
+
+            functions->FileClose(m_fp);
+            m_fp = 0;
+            m_capacity = 0;
+            m_length = 0;
+            m_position = 0;
+        }
+
+        void MappedFileStream::Unmap()
+        {
+            if (m_data == nullptr)
+                return;
+
+#ifdef NL_PLATFORM_WINDOWS
+            UnmapViewOfFile(m_data);
+            CloseHandle((HANDLE)m_mapping);
+            m_mapping = nullptr;
+#else
+            munmap(m_data, (size_t)m_capacity);
+#endif
+
+            m_data = nullptr;
+        }
+
+        void MappedFileStream::EnsureCapacity(int64_t required)
+        {
+            if (required <= m_capacity)
+                return;
+
+            if (!m_writable)
+                throw NotSupportedException("The stream is not writable.");
+
+            // grow geometrically so appending stays linear, but never map less than one granule
+            int64_t capacity = nl::util::Max(required, m_capacity * 2);
+            capacity = (capacity + MappedFileStream_Granularity - 1) & ~(MappedFileStream_Granularity - 1);
+
+            Map(capacity);
+        }
+    }
+}
@@ -1,17 +1,57 @@
 #include "StdAfx.h"
 
 #include <NativeLib/IO/MemoryStream.h>
+#include <NativeLib/SystemLayer/SystemLayer.h>
 #include <NativeLib/Util.h>
 
 namespace nl
 {
     namespace io
     {
-        MemoryStream::MemoryStream(int64_t initial_capacity) :
-            m_memory(nl::memory::Memory::Allocate(initial_capacity)),
+        static int64_t MemoryStream_RoundToPage(int64_t size)
+        {
+            int64_t page_size = systemlayer::GetSystemLayerFunctions()->GetVirtualMemoryPageSize();
+            return (size + page_size - 1) / page_size * page_size;
+        }
+
+        MemoryStream::MemoryStream(int64_t initial_capacity, int64_t reserved_capacity) :
+            m_memory(reserved_capacity == 0 ? nl::memory::Memory::Allocate(initial_capacity) : nl::memory::Memory()),
+            m_reserved(nullptr),
+            m_reserved_size(0),
+            m_committed(0),
             m_position(0),
             m_length(0)
         {
+            if (reserved_capacity == 0)
+                return;
+
+            if (reserved_capacity < 0 ||
+                initial_capacity > reserved_capacity)
+                throw ArgumentException("The reserved capacity must be positive and cover the initial capacity.");
+
+            m_reserved_size = MemoryStream_RoundToPage(reserved_capacity);
+            m_reserved = (char*)systemlayer::GetSystemLayerFunctions()->ReserveVirtualMemory((size_t)m_reserved_size);
+            if (!m_reserved)
+                throw BadAllocationException();
+
+            if (initial_capacity > 0)
+            {
+                try
+                {
+                    AdjustSize(initial_capacity);
+                }
+                catch (...)
+                {
+                    systemlayer::GetSystemLayerFunctions()->ReleaseVirtualMemory(m_reserved, (size_t)m_reserved_size);
+                    throw;
+                }
+            }
+        }
+
+        MemoryStream::~MemoryStream()
+        {
+            if (m_reserved)
+                systemlayer::GetSystemLayerFunctions()->ReleaseVirtualMemory(m_reserved, (size_t)m_reserved_size);
         }
 
         bool MemoryStream::CanSeek() const
@@ -52,30 +92,42 @@ namespace nl
                 pos = m_position + offset;
                 break;
             case SeekMode::End:
-                pos = m_length - offset;
+                pos = m_length + offset;
                 break;
             }
 
             if (pos < 0)
                 throw ArgumentException("The resulting position cannot be negative.");
 
+            m_position = pos;
             return m_position;
         }
 
         void MemoryStream::SetLength(int64_t length)
         {
             if (length > m_length)
+            {
                 AdjustSize(length);
+                memset(GetBuffer() + m_length, 0, length - m_length);
+            }
 
             m_length = length;
             if (m_position > m_length)
                 m_position = m_length;
         }
 
+        void MemoryStream::Flush()
+        {
+            // nothing to flush, the data is only held in memory
+        }
+
         int64_t MemoryStream::Read(void* lp, int64_t numberOfBytesToRead)
         {
+            if (m_position >= m_length)
+                return 0;
+
             numberOfBytesToRead = nl::util::Min(m_length - m_position, numberOfBytesToRead);
-            memcpy(lp, (const char*)m_memory.Get() + m_position, numberOfBytesToRead);
+            memcpy(lp, GetBuffer() + m_position, numberOfBytesToRead);
             m_position += numberOfBytesToRead;
             return numberOfBytesToRead;
         }
@@ -84,7 +136,11 @@ namespace nl
         {
             AdjustSize(m_position + numberOfBytesToWrite);
 
-            memcpy(m_memory.Get<char>() + m_position, lp, numberOfBytesToWrite);
+            // a write past the end leaves a zero filled gap
+            if (m_position > m_length)
+                memset(GetBuffer() + m_length, 0, m_position - m_length);
+
+            memcpy(GetBuffer() + m_position, lp, numberOfBytesToWrite);
             m_position += numberOfBytesToWrite;
             if (m_length < m_position)
                 m_length = m_position;
@@ -92,12 +148,75 @@ namespace nl
             return numberOfBytesToWrite;
         }
 
+        int64_t MemoryStream::WriteV(const IOSegment* segments, int32_t count)
+        {
+            int64_t total = 0;
+            for (int32_t i = 0; i < count; ++i)
+                total += (int64_t)segments[i].Length;
+
+            // grow once for all segments
+            char* p = static_cast<char*>(AcquireWriteSpan(total));
+            for (int32_t i = 0; i < count; ++i)
+            {
+                memcpy(p, segments[i].Data, segments[i].Length);
+                p += segments[i].Length;
+            }
+
+            Commit(total);
+            return total;
+        }
+
+        const void* MemoryStream::TryPeek(int64_t size)
+        {
+            if (size < 0 ||
+                size > m_length - m_position)
+                return nullptr;
+
+            return GetBuffer() + m_position;
+        }
+
+        void MemoryStream::Advance(int64_t count)
+        {
+            if (count < 0 ||
+                count > m_length - m_position)
+                throw ArgumentException("The count exceeds the remaining data of this MemoryStream.");
+
+            m_position += count;
+        }
+
+        void* MemoryStream::AcquireWriteSpan(int64_t size)
+        {
+            if (size < 0)
+                return nullptr;
+
+            AdjustSize(m_position + size);
+
+            if (m_position > m_length)
+            {
+                memset(GetBuffer() + m_length, 0, m_position - m_length);
+                m_length = m_position;
+            }
+
+            return GetBuffer() + m_position;
+        }
+
+        void MemoryStream::Commit(int64_t count)
+        {
+            if (count < 0 ||
+                m_position + count > GetCapacity())
+                throw ArgumentException("The count exceeds the acquired write span.");
+
+            m_position += count;
+            if (m_length < m_position)
+                m_length = m_position;
+        }
+
         void MemoryStream::Remove(int64_t offset, int64_t length)
         {
             if (offset + length > m_length)
                 throw ArgumentException("The argument attempts to remove data outside the valid range of this MemoryStream.");
 
-            memmove(m_memory.Get<char>() + offset, m_memory.Get<char>() + offset + length, m_length - (offset + length));
+            memmove(GetBuffer() + offset, GetBuffer() + offset + length, m_length - (offset + length));
             m_length -= length;
             if (m_position > m_length)
                 m_position = m_length;
@@ -107,29 +226,36 @@ namespace nl
         {
             AdjustSize(m_length + length);
 
-            memmove(m_memory.Get<char>() + offset + length, m_memory.Get<char>() + offset, m_length - (offset + length));
+            memmove(GetBuffer() + offset + length, GetBuffer() + offset, m_length - offset);
             m_length += length;
             if (m_position > offset)
                 m_position += length;
         }
 
-        void MemoryStream::AdjustSize(int64_t new_minimum_size /* ,bool shrink */)
+        void MemoryStream::AdjustSize(int64_t new_minimum_size)
         {
-            if ((int64_t)m_memory.GetSize() > new_minimum_size)
+            int64_t capacity = GetCapacity();
+            if (capacity >= new_minimum_size)
                 return;
 
-            int64_t new_size = m_memory.GetSize();
-            while (new_size < new_minimum_size)
+            // grow geometrically so that writing n bytes costs O(n) in total
+            int64_t new_size = nl::util::Max(new_minimum_size, capacity * 2);
+
+            if (!m_reserved)
             {
-                if (new_size < 1048576) // 1 MB
-                    new_size *= 2;
-                else
-                    new_size += 1048576; // add 1 MB maximum each loop
+                m_memory.Reallocate((size_t)new_size);
+                return;
             }
 
-            auto new_memory = nl::memory::Memory::Allocate(new_size);
-            memcpy(new_memory, m_memory, m_length);
-            m_memory = std::move(new_memory);
+            if (new_minimum_size > m_reserved_size)
+                throw NotSupportedException("The MemoryStream cannot grow beyond its reserved capacity.");
+
+            new_size = nl::util::Min(MemoryStream_RoundToPage(new_size), m_reserved_size);
+
+            if (!systemlayer::GetSystemLayerFunctions()->CommitVirtualMemory(m_reserved + m_committed, (size_t)(new_size - m_committed)))
+                throw BadAllocationException();
+
+            m_committed = new_size;
         }
     }
 }
\ No newline at end of file
@@ -1,7 +1,17 @@
 #include "StdAfx.h"
 
 #include <NativeLib/IO/Stream.h>
+#include <NativeLib/Threading/ThreadPool.h>
 #include <NativeLib/Exceptions.h>
+#include <NativeLib/Allocators.h>
+
+//!ALLOW_INCLUDE "StreamInternal.h"
+#include "StreamInternal.h"
+
+//!ALLOW_INCLUDE "chrono"
+//!ALLOW_INCLUDE "exception"
+#include <chrono>
+#include <exception>
 
 namespace nl
 {
@@ -36,7 +46,117 @@ namespace nl
         {
         }
 
-        void Stream::CopyTo(Stream* stream)
+        int64_t Stream::ReadV(const IOSegment* segments, int32_t count)
+        {
+            int64_t total = 0;
+
+            for (int32_t i = 0; i < count; ++i)
+            {
+                char* p = static_cast<char*>(segments[i].Data);
+                int64_t length = (int64_t)segments[i].Length;
+                int64_t read_pos = 0;
+
+                while (read_pos < length)
+                {
+                    int64_t read = Read(p + read_pos, length - read_pos);
+                    if (read <= 0)
+                        return total + read_pos;
+
+                    read_pos += read;
+                }
+
+                total += length;
+            }
+
+            return total;
+        }
+
+        int64_t Stream::WriteV(const IOSegment* segments, int32_t count)
+        {
+            int64_t total = 0;
+
+            for (int32_t i = 0; i < count; ++i)
+            {
+                const char* p = static_cast<const char*>(segments[i].Data);
+                int64_t length = (int64_t)segments[i].Length;
+                int64_t write_pos = 0;
+
+                while (write_pos < length)
+                {
+                    int64_t written = Write(p + write_pos, length - write_pos);
+                    if (written <= 0)
+                        return total + write_pos;
+
+                    write_pos += written;
+                }
+
+                total += length;
+            }
+
+            return total;
+        }
+
+        void Stream_WriteAll(Stream* stream, const void* lp, int64_t count)
+        {
+            const char* p = static_cast<const char*>(lp);
+            int64_t write_pos = 0;
+
+            while (write_pos < count)
+            {
+                int64_t written = stream->Write(p + write_pos, count - write_pos);
+                if (written <= 0)
+                    throw IOException(IOException::WriteFailed);
+
+                write_pos += written;
+            }
+        }
+
+        // Reads until count bytes are read or the stream ends.
+        static int64_t Stream_ReadFull(Stream* stream, void* lp, int64_t count)
+        {
+            char* p = static_cast<char*>(lp);
+            int64_t read_pos = 0;
+
+            while (read_pos < count)
+            {
+                int64_t read = stream->Read(p + read_pos, count - read_pos);
+                if (read <= 0)
+                    break;
+
+                read_pos += read;
+            }
+
+            return read_pos;
+        }
+
+        struct Stream_CopyProgress
+        {
+            const CopyOptions* Options;
+            std::chrono::steady_clock::time_point Start;
+            int64_t BytesCopied = 0;
+
+            Stream_CopyProgress(const CopyOptions* options) :
+                Options(options),
+                Start(std::chrono::steady_clock::now())
+            {
+            }
+
+            void Add(int64_t count)
+            {
+                BytesCopied += count;
+
+                if (!Options->Progress)
+                    return;
+
+                CopyProgress progress;
+                progress.BytesCopied = BytesCopied;
+                progress.ElapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+                progress.BytesPerSecond = progress.ElapsedSeconds > 0 ? (double)BytesCopied / progress.ElapsedSeconds : 0;
+                Options->Progress(progress);
+            }
+        };
+
+        int64_t Stream::CopyTo(Stream* stream, const CopyOptions* options)
         {
             if (!CanRead())
             {
@@ -48,23 +168,165 @@ namespace nl
                 throw ArgumentException("The provided stream cannot be written to.");
             }
 
-            char buffer[8192];
-            for (;;)
+            CopyOptions defaults;
+            if (!options)
+                options = &defaults;
+
+            if (options->ChunkSize <= 0)
+                throw ArgumentException("The chunk size must be greater than zero.");
+
+            int64_t chunk_size = options->ChunkSize;
+            Stream_CopyProgress progress(options);
+
+            // a source held in memory is written out in place
+            if (CanSeek())
             {
-                int64_t read = Read(buffer, sizeof(buffer));
-                if (read == 0)
-                    break;
+                int64_t remaining = GetLength() - GetPosition();
+                const void* data = remaining > 0 ? TryPeek(remaining) : nullptr;
+                if (data)
+                {
+                    for (int64_t offset = 0; offset < remaining; offset += chunk_size)
+                    {
+                        int64_t count = remaining - offset < chunk_size ? remaining - offset : chunk_size;
+                        Stream_WriteAll(stream, static_cast<const char*>(data) + offset, count);
+                        progress.Add(count);
+                    }
 
-                int64_t write_pos = 0;
-                while (write_pos < read)
+                    Advance(remaining);
+                    return progress.BytesCopied;
+                }
+            }
+
+            // between two files the kernel copies, unless it cannot for these files and the copy carries on below
+            auto source_fp = GetFileHandle();
+            auto target_fp = stream->GetFileHandle();
+            if (source_fp != 0 &&
+                target_fp != 0)
+            {
+                auto functions = systemlayer::GetSystemLayerFunctions();
+                for (;;)
                 {
-                    int64_t written = stream->Write(buffer, read);
-                    if (written == 0)
-                        throw IOException("Failed to write to stream.");
+                    int64_t copied = functions->FileCopy(source_fp, target_fp, chunk_size);
+                    if (copied < 0)
+                        break;
 
-                    write_pos += written;
+                    if (copied == 0)
+                        return progress.BytesCopied;
+
+                    progress.Add(copied);
+                }
+            }
+
+            if (!options->Pipelined)
+            {
+                nl::memory::Memory buffer;
+                for (;;)
+                {
+                    // read straight into the target when it offers room for it
+                    void* span = stream->AcquireWriteSpan(chunk_size);
+                    if (span)
+                    {
+                        int64_t read = Stream_ReadFull(this, span, chunk_size);
+                        stream->Commit(read);
+                        if (read == 0)
+                            break;
+
+                        progress.Add(read);
+                        continue;
+                    }
+
+                    if (buffer.GetSize() == 0)
+                        buffer = nl::memory::Memory::Allocate((size_t)chunk_size);
+
+                    int64_t read = Stream_ReadFull(this, buffer.Get(), chunk_size);
+                    if (read == 0)
+                        break;
+
+                    Stream_WriteAll(stream, buffer.Get(), read);
+                    progress.Add(read);
                 }
+
+                return progress.BytesCopied;
             }
+
+            // double buffered: a worker reads the next chunk while this thread writes the current one
+            nl::memory::Memory buffers[2];
+            buffers[0] = nl::memory::Memory::Allocate((size_t)chunk_size);
+
+            int64_t read = Stream_ReadFull(this, buffers[0].Get(), chunk_size);
+            if (read < chunk_size)
+            {
+                // everything fit in one chunk
+                Stream_WriteAll(stream, buffers[0].Get(), read);
+                if (read != 0)
+                    progress.Add(read);
+
+                return progress.BytesCopied;
+            }
+
+            buffers[1] = nl::memory::Memory::Allocate((size_t)chunk_size);
+
+            // the worker writes these, so they must outlive the pool, which waits for it when destroyed
+            int64_t next_read = 0;
+            std::exception_ptr read_error;
+            nl::threading::ThreadPool reader(1);
+
+            int32_t current = 0;
+            for (;;)
+            {
+                void* next_buffer = buffers[current ^ 1].Get();
+                reader.Queue([this, next_buffer, chunk_size, &next_read, &read_error]()
+                {
+                    try
+                    {
+                        next_read = Stream_ReadFull(this, next_buffer, chunk_size);
+                    }
+                    catch (...)
+                    {
+                        read_error = std::current_exception();
+                    }
+                });
+
+                Stream_WriteAll(stream, buffers[current].Get(), read);
+                progress.Add(read);
+
+                reader.Wait();
+                if (read_error)
+                    std::rethrow_exception(read_error);
+
+                if (next_read == 0)
+                    break;
+
+                read = next_read;
+                current ^= 1;
+            }
+
+            return progress.BytesCopied;
+        }
+
+        systemlayer::FileHandle Stream::GetFileHandle() const
+        {
+            return 0;
+        }
+
+        const void* Stream::TryPeek(int64_t size)
+        {
+            return nullptr;
+        }
+
+        void Stream::Advance(int64_t count)
+        {
+            Seek(count, SeekMode::Current);
+        }
+
+        void* Stream::AcquireWriteSpan(int64_t size)
+        {
+            return nullptr;
+        }
+
+        void Stream::Commit(int64_t count)
+        {
+            throw InvalidOperationException("No write span has been acquired.");
         }
     }
 }
\ No newline at end of file
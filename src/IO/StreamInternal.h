@@ -0,0 +1,9 @@
+#pragma once
+
+#include <NativeLib/IO/Stream.h>
+
+namespace nl::io
+{
+    // Writes all count bytes, calling Write until it took them; throws IOException if the stream stops taking data.
+    void Stream_WriteAll(Stream* stream, const void* lp, int64_t count);
+}
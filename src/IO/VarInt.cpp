@@ -0,0 +1,212 @@
+#include "StdAfx.h"
+
+#include <NativeLib/IO/VarInt.h>
+
+#ifdef NL_ARCHITECTURE_X64
+//!ALLOW_INCLUDE "tmmintrin.h"
+#include <tmmintrin.h>
+
+#ifdef NL_PLATFORM_WINDOWS
+//!ALLOW_INCLUDE "intrin.h"
+#include <intrin.h>
+#define STREAMVBYTE_SIMD_TARGET
+#else
+#define STREAMVBYTE_SIMD_TARGET __attribute__((target("ssse3")))
+#endif
+#endif
+
+namespace nl
+{
+    namespace io
+    {
+        size_t VarIntEncode(uint64_t value, void* dst)
+        {
+            uint8_t* p = static_cast<uint8_t*>(dst);
+
+            while (value >= 0x80)
+            {
+                *p++ = (uint8_t)(value | 0x80);
+                value >>= 7;
+            }
+
+            *p++ = (uint8_t)value;
+            return (size_t)(p - static_cast<uint8_t*>(dst));
+        }
+
+        int32_t VarIntDecode(const void* src, size_t size, uint64_t& value)
+        {
+            const uint8_t* p = static_cast<const uint8_t*>(src);
+            uint64_t result = 0;
+
+            for (size_t i = 0; i < VarIntMaxSize; ++i)
+            {
+                if (i == size)
+                    return 0;
+
+                uint8_t by = p[i];
+
+                // the tenth byte only has room for the top bit of a 64 bit value
+                if (i == VarIntMaxSize - 1 &&
+                    by > 1)
+                    return -1;
+
+                result |= (uint64_t)(by & 0x7f) << (i * 7);
+
+                if ((by & 0x80) == 0)
+                {
+                    value = result;
+                    return (int32_t)(i + 1);
+                }
+            }
+
+            return -1;
+        }
+
+        /////////////////////////////////////////////////////
+        /////////////////////////////////////////////////////
+        /////////////////////////////////////////////////////
+
+        struct StreamVByteTables
+        {
+            uint8_t Length[256]; // data bytes of the four values described by a control byte
+            alignas(16) uint8_t Shuffle[256][16]; // moves those bytes into four 32 bit lanes
+
+            StreamVByteTables()
+            {
+                for (int control = 0; control < 256; ++control)
+                {
+                    uint8_t offset = 0;
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        int length = ((control >> (i * 2)) & 3) + 1;
+                        for (int b = 0; b < 4; ++b)
+                            Shuffle[control][i * 4 + b] = b < length ? (uint8_t)(offset + b) : 0x80; // 0x80 clears the byte
+
+                        offset += (uint8_t)length;
+                    }
+
+                    Length[control] = offset;
+                }
+            }
+        };
+
+        static const StreamVByteTables& StreamVByte_GetTables()
+        {
+            static const StreamVByteTables tables;
+            return tables;
+        }
+
+        size_t StreamVByteEncode(const uint32_t* values, size_t count, void* dst)
+        {
+            uint8_t* control = static_cast<uint8_t*>(dst);
+            size_t control_size = (count + 3) / 4;
+            uint8_t* data = control + control_size;
+
+            // every value is stored with all four bytes and the pointer moves by its length, which avoids branching
+            // on it; there is always room since no value takes more than four bytes
+            for (size_t i = 0; i < count; i += 4)
+            {
+                size_t n = count - i < 4 ? count - i : 4;
+                uint32_t codes = 0;
+
+                for (size_t k = 0; k < n; ++k)
+                {
+                    uint32_t value = values[i + k];
+                    uint32_t code = (uint32_t)(value > 0xff) + (uint32_t)(value > 0xffff) + (uint32_t)(value > 0xffffff);
+
+                    codes |= code << (k * 2);
+                    memcpy(data, &value, sizeof(value));
+                    data += code + 1;
+                }
+
+                control[i >> 2] = (uint8_t)codes;
+            }
+
+            return (size_t)(data - control);
+        }
+
+        size_t StreamVByteGetEncodedSize(const void* src, size_t count)
+        {
+            const uint8_t* control = static_cast<const uint8_t*>(src);
+            const auto& tables = StreamVByte_GetTables();
+
+            size_t size = (count + 3) / 4;
+            for (size_t i = 0; i < count / 4; ++i)
+                size += tables.Length[control[i]];
+
+            for (size_t i = count & ~(size_t)3; i < count; ++i)
+                size += ((control[i >> 2] >> ((i & 3) * 2)) & 3) + 1;
+
+            return size;
+        }
+
+        static const uint8_t* StreamVByte_DecodeScalar(const uint8_t* control, const uint8_t* data, uint32_t* values, size_t begin, size_t count)
+        {
+            for (size_t i = begin; i < count; ++i)
+            {
+                uint32_t length = ((control[i >> 2] >> ((i & 3) * 2)) & 3) + 1;
+
+                uint32_t value = 0;
+                memcpy(&value, data, length);
+                values[i] = value;
+                data += length;
+            }
+
+            return data;
+        }
+
+#ifdef NL_ARCHITECTURE_X64
+        // Decodes four values per control byte while a full 16 byte load stays inside the batch.
+        STREAMVBYTE_SIMD_TARGET static size_t StreamVByte_DecodeSimd(const uint8_t* control, const uint8_t*& data, const uint8_t* data_end, uint32_t* values, size_t count)
+        {
+            const auto& tables = StreamVByte_GetTables();
+
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                if (data_end - data < 16)
+                    break;
+
+                uint8_t c = control[i >> 2];
+                __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+                __m128i shuffle = _mm_load_si128(reinterpret_cast<const __m128i*>(tables.Shuffle[c]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), _mm_shuffle_epi8(input, shuffle));
+
+                data += tables.Length[c];
+            }
+
+            return i;
+        }
+
+        static bool StreamVByte_HasSimdSupport()
+        {
+#ifdef NL_PLATFORM_WINDOWS
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 9)) != 0;
+#else
+            return __builtin_cpu_supports("ssse3");
+#endif
+        }
+#endif
+
+        size_t StreamVByteDecode(const void* src, uint32_t* values, size_t count)
+        {
+            const uint8_t* control = static_cast<const uint8_t*>(src);
+            const uint8_t* data = control + (count + 3) / 4;
+            size_t decoded = 0;
+
+#ifdef NL_ARCHITECTURE_X64
+            static const bool simd = StreamVByte_HasSimdSupport();
+            if (simd)
+            {
+                const uint8_t* data_end = control + StreamVByteGetEncodedSize(src, count);
+                decoded = StreamVByte_DecodeSimd(control, data, data_end, values, count);
+            }
+#endif
+
+            data = StreamVByte_DecodeScalar(control, data, values, decoded, count);
+            return (size_t)(data - control);
+        }
+    }
+}
@@ -8,9 +8,9 @@
 
 namespace nl
 {
-    inline void Json_SkipWhitespace(const nl::String& json, size_t& i)
+    inline void Json_SkipWhitespace(std::string_view json, size_t& i)
     {
-        while (i < json.GetLength())
+        while (i < json.length())
         {
             auto skip = false;
 
@@ -36,169 +36,581 @@ namespace nl
         return ch >= '0' && ch <= '9';
     }
 
-    inline bool Json_ReadNumber(int64_t* pNumber, const nl::String& json, size_t& i)
+    enum class JsonNumberKind
     {
-        int64_t value = 0LL;
-        auto first = true;
-        auto isNegative = false;
+        Invalid,
+        Integer,
+        Double
+    };
 
-        while (i < json.GetLength())
+    // Exact conversion for numbers outside the fast path; defined in JsonParser.cpp.
+    double Json_ParseDoubleSlow(const char* begin, const char* end);
+
+    // Reads a number following the JSON grammar: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+    // Integers that fit in 64 bits are returned through integer, everything else through number.
+    inline JsonNumberKind Json_ParseNumber(std::string_view json, size_t& i, int64_t& integer, double& number)
+    {
+        static const double powers[] =
+        {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+            1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        const size_t start = i;
+        const size_t length = json.length();
+
+        bool negative = false;
+        if (i < length &&
+            json[i] == '-')
+        {
+            negative = true;
+            ++i;
+        }
+
+        if (i >= length ||
+            !Json_CharIsDigit(json[i]))
+            return JsonNumberKind::Invalid;
+
+        uint64_t mantissa = 0;
+        int32_t digits = 0; // significant digits held in mantissa
+        int32_t exponent = 0;
+        bool truncated = false;
+        bool isInteger = true;
+
+        if (json[i] == '0')
+        {
+            ++i;
+            if (i < length &&
+                Json_CharIsDigit(json[i]))
+                return JsonNumberKind::Invalid; // leading zeros are not allowed
+        }
+        else
         {
-            if (first &&
-                json[i] == '-' &&
-                !isNegative)
+            while (i < length &&
+                Json_CharIsDigit(json[i]))
             {
-                isNegative = true;
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (uint8_t)(json[i] - '0');
+                    ++digits;
+                }
+                else
+                {
+                    truncated |= json[i] != '0';
+                    ++exponent;
+                }
+
                 ++i;
-                continue;
             }
+        }
+
+        if (i < length &&
+            json[i] == '.')
+        {
+            isInteger = false;
+            if (++i >= length ||
+                !Json_CharIsDigit(json[i]))
+                return JsonNumberKind::Invalid;
 
-            if (!Json_CharIsDigit(json[i]))
+            while (i < length &&
+                Json_CharIsDigit(json[i]))
             {
-                if (json[i] == '.') // this is a float/double value
-                    return false;
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (uint8_t)(json[i] - '0');
+                    if (mantissa != 0)
+                        ++digits;
+
+                    --exponent;
+                }
+                else
+                {
+                    truncated |= json[i] != '0';
+                }
+
+                ++i;
+            }
+        }
+
+        if (i < length &&
+            (json[i] == 'e' || json[i] == 'E'))
+        {
+            isInteger = false;
+            ++i;
+
+            bool negativeExponent = false;
+            if (i < length &&
+                (json[i] == '+' || json[i] == '-'))
+            {
+                negativeExponent = json[i] == '-';
+                ++i;
+            }
+
+            if (i >= length ||
+                !Json_CharIsDigit(json[i]))
+                return JsonNumberKind::Invalid;
 
-                if (!first)
-                    *pNumber = isNegative ? -value : value;
+            int32_t value = 0;
+            while (i < length &&
+                Json_CharIsDigit(json[i]))
+            {
+                if (value < 100000) // far past the range of double either way
+                    value = value * 10 + (json[i] - '0');
 
-                return !first;
+                ++i;
             }
 
-            if (!first)
-                value *= 10;
+            exponent += negativeExponent ? -value : value;
+        }
 
-            value += (uint8_t)json[i++] - (uint8_t)'0';
+        if (isInteger &&
+            !truncated &&
+            exponent == 0 &&
+            mantissa <= (negative ? 0x8000000000000000ull : 0x7fffffffffffffffull))
+        {
+            integer = negative ? (int64_t)(0 - mantissa) : (int64_t)mantissa;
+            return JsonNumberKind::Integer;
+        }
 
-            first = false;
+        // exact when both the mantissa and the power of ten are representable as doubles
+        if (!truncated &&
+            mantissa <= (1ull << 53) &&
+            exponent >= -22 &&
+            exponent <= 22)
+        {
+            double value = (double)mantissa;
+            value = exponent >= 0 ? value * powers[exponent] : value / powers[-exponent];
+            number = negative ? -value : value;
+            return JsonNumberKind::Double;
         }
 
-        if (isNegative)
-            *pNumber = -value;
+        number = Json_ParseDoubleSlow(json.data() + start, json.data() + i);
+        return JsonNumberKind::Double;
+    }
 
-        *pNumber = value;
-        return true;
+    // Reads an integer; fails if the number has a fraction, an exponent or does not fit in 64 bits.
+    inline bool Json_ReadNumber(int64_t* pNumber, std::string_view json, size_t& i)
+    {
+        double number;
+        return Json_ParseNumber(json, i, *pNumber, number) == JsonNumberKind::Integer;
+    }
+
+    inline bool Json_ReadDouble(double* pNumber, std::string_view json, size_t& i)
+    {
+        int64_t integer;
+        switch (Json_ParseNumber(json, i, integer, *pNumber))
+        {
+        case JsonNumberKind::Integer:
+            *pNumber = (double)integer;
+            return true;
+        case JsonNumberKind::Double:
+            return true;
+        default:
+            return false;
+        }
     }
 
-    inline bool Json_ReadDouble(double* pNumber, const nl::String& json, size_t& i)
+    // Advances past bytes that can be copied verbatim from a string: printable ASCII other than '"' and '\\'.
+    // Checks eight bytes at a time, which is where nearly all the time of string decoding goes.
+    inline void Json_ScanPlain(std::string_view json, size_t& i)
     {
-        double value = 0;
-        auto first = true;
-        auto isNegative = false;
+        const uint64_t ones = 0x0101010101010101ull;
+        const uint64_t highs = 0x8080808080808080ull;
 
-        bool isFractional = false;
-        int32_t fractions = 0;
+        const char* data = json.data();
+        const size_t length = json.length();
 
-        while (i < json.GetLength())
+        while (i + 8 <= length)
         {
-            if (first &&
-                json[i] == '-' &&
-                !isNegative)
-            {
-                isNegative = true;
-                ++i;
-                continue;
-            }
+            uint64_t v;
+            memcpy(&v, data + i, 8);
 
-            if (json[i] == '.' &&
-                !isFractional)
-            {
-                isFractional = true;
-                ++i;
-                continue;
-            }
+            const uint64_t quote = v ^ (ones * '"');
+            const uint64_t backslash = v ^ (ones * '\\');
+
+            // a byte is flagged if it is zero after the xor, below 0x20 or has the high bit set
+            const uint64_t special =
+                ((quote - ones) & ~quote) |
+                ((backslash - ones) & ~backslash) |
+                (v - ones * 0x20) |
+                v;
 
-            if (!Json_CharIsDigit(json[i]))
+            if ((special & highs) != 0)
                 break;
 
-            if (!first)
-                value *= 10;
+            i += 8;
+        }
 
-            value += (uint8_t)json[i++] - (uint8_t)'0';
-            if (isFractional)
-                ++fractions;
+        while (i < length)
+        {
+            uint8_t ch = (uint8_t)data[i];
+            if (ch < 0x20 ||
+                ch >= 0x80 ||
+                ch == '"' ||
+                ch == '\\')
+                break;
 
-            first = false;
+            ++i;
         }
+    }
 
-        if (first)
-            return false;
+    // Returns the length of the well-formed UTF-8 sequence starting at i, or 0 if it is malformed.
+    // Overlong encodings, surrogates and code points above U+10FFFF are rejected.
+    inline size_t Json_Utf8SequenceLength(std::string_view json, size_t i)
+    {
+        const uint8_t* p = (const uint8_t*)json.data() + i;
+        const size_t available = json.length() - i;
+
+        auto continuation = [&](size_t k) { return k < available && (p[k] & 0xc0) == 0x80; };
+
+        const uint8_t ch = p[0];
+        if (ch >= 0xc2 && ch <= 0xdf)
+            return continuation(1) ? 2 : 0;
+
+        if (ch >= 0xe0 && ch <= 0xef)
+        {
+            if (!continuation(1) ||
+                !continuation(2) ||
+                (ch == 0xe0 && p[1] < 0xa0) ||
+                (ch == 0xed && p[1] > 0x9f))
+                return 0;
+
+            return 3;
+        }
 
-        value = value / nl::util::Pow(10, fractions);
+        if (ch >= 0xf0 && ch <= 0xf4)
+        {
+            if (!continuation(1) ||
+                !continuation(2) ||
+                !continuation(3) ||
+                (ch == 0xf0 && p[1] < 0x90) ||
+                (ch == 0xf4 && p[1] > 0x8f))
+                return 0;
+
+            return 4;
+        }
 
-        if (isNegative)
-            *pNumber = -value;
+        return 0;
+    }
+
+    inline bool Json_ReadHex4(std::string_view json, size_t i, uint32_t& value)
+    {
+        if (i + 4 > json.length())
+            return false;
+
+        value = 0;
+        for (size_t k = i; k < i + 4; ++k)
+        {
+            char ch = json[k];
+            uint32_t digit;
+            if (ch >= '0' && ch <= '9')
+                digit = ch - '0';
+            else if (ch >= 'a' && ch <= 'f')
+                digit = ch - 'a' + 10;
+            else if (ch >= 'A' && ch <= 'F')
+                digit = ch - 'A' + 10;
+            else
+                return false;
+
+            value = (value << 4) | digit;
+        }
 
-        *pNumber = value;
         return true;
     }
 
-    inline bool Json_ReadString(nl::String& sb, const nl::String& json, size_t& i, nl::Vector<nl::String>& parse_errors) // expects "\"...\""
+    inline void Json_AppendUtf8(nl::String& sb, uint32_t codepoint)
     {
-        if (json[i] != '"')
+        char buffer[4];
+        size_t length;
+
+        if (codepoint < 0x80)
         {
-            parse_errors.Add(nl::String::Format("Json at offset {} is not a string", i));
+            buffer[0] = (char)codepoint;
+            length = 1;
+        }
+        else if (codepoint < 0x800)
+        {
+            buffer[0] = (char)(0xc0 | (codepoint >> 6));
+            buffer[1] = (char)(0x80 | (codepoint & 0x3f));
+            length = 2;
+        }
+        else if (codepoint < 0x10000)
+        {
+            buffer[0] = (char)(0xe0 | (codepoint >> 12));
+            buffer[1] = (char)(0x80 | ((codepoint >> 6) & 0x3f));
+            buffer[2] = (char)(0x80 | (codepoint & 0x3f));
+            length = 3;
+        }
+        else
+        {
+            buffer[0] = (char)(0xf0 | (codepoint >> 18));
+            buffer[1] = (char)(0x80 | ((codepoint >> 12) & 0x3f));
+            buffer[2] = (char)(0x80 | ((codepoint >> 6) & 0x3f));
+            buffer[3] = (char)(0x80 | (codepoint & 0x3f));
+            length = 4;
+        }
+
+        sb.Append(buffer, length);
+    }
+
+    // Decodes the escape sequence at json[i] ('\\'), including \uXXXX and surrogate pairs.
+    inline bool Json_ReadEscape(nl::String& sb, std::string_view json, size_t& i, nl::Vector<nl::String>& parse_errors)
+    {
+        if (i + 1 >= json.length())
+        {
+            parse_errors.Add(nl::String::Format("EOF at {}", i));
             return false;
         }
 
-        ++i;
-        auto start = i;
-        while (i < json.GetLength())
+        char ch = json[i + 1];
+        switch (ch)
+        {
+        case '"':
+        case '\\':
+        case '/':
+            sb.Append(ch);
+            break;
+        case 'b':
+            sb.Append('\b');
+            break;
+        case 'f':
+            sb.Append('\f');
+            break;
+        case 'n':
+            sb.Append('\n');
+            break;
+        case 'r':
+            sb.Append('\r');
+            break;
+        case 't':
+            sb.Append('\t');
+            break;
+        case 'u':
         {
-            if (json[i] == '\\')
+            uint32_t codepoint;
+            if (!Json_ReadHex4(json, i + 2, codepoint))
             {
-                if (i + 1 >= json.GetLength())
+                parse_errors.Add(nl::String::Format("Invalid \\u escape at offset {}", i));
+                return false;
+            }
+
+            if (codepoint >= 0xd800 && codepoint <= 0xdbff)
+            {
+                uint32_t low;
+                if (i + 12 > json.length() ||
+                    json[i + 6] != '\\' ||
+                    json[i + 7] != 'u' ||
+                    !Json_ReadHex4(json, i + 8, low) ||
+                    low < 0xdc00 ||
+                    low > 0xdfff)
                 {
-                    parse_errors.Add(nl::String::Format("EOF at {}", i));
+                    parse_errors.Add(nl::String::Format("Unpaired surrogate at offset {}", i));
                     return false;
                 }
 
-                auto ch = json[++i];
-                switch (ch)
-                {
-                case '"':
-                case '\\':
-                case '/':
-                    sb.Append(ch);
-                    break;
-                case 'b':
-                    sb.Append('\b');
-                    break;
-                case 'f':
-                    sb.Append('\f');
-                    break;
-                case 'n':
-                    sb.Append('\n');
-                    break;
-                case 'r':
-                    sb.Append('\r');
-                    break;
-                case 't':
-                    sb.Append('\t');
-                    break;
-                case 'u':
+                codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+                i += 6;
+            }
+            else if (codepoint >= 0xdc00 && codepoint <= 0xdfff)
+            {
+                parse_errors.Add(nl::String::Format("Unpaired surrogate at offset {}", i));
+                return false;
+            }
+
+            Json_AppendUtf8(sb, codepoint);
+            i += 6;
+            return true;
+        }
+        default:
+            parse_errors.Add(nl::String::Format("Invalid escape sequence at offset {}", i));
+            return false;
+        }
+
+        i += 2;
+        return true;
+    }
+
+    inline bool Json_ReadString(nl::String& sb, std::string_view json, size_t& i, nl::Vector<nl::String>& parse_errors) // expects "\"...\""
+    {
+        if (i >= json.length() ||
+            json[i] != '"')
+        {
+            parse_errors.Add(nl::String::Format("Json at offset {} is not a string", i));
+            return false;
+        }
+
+        ++i;
+
+        // runs of plain characters and validated UTF-8 are copied in one go
+        size_t start = i;
+        while (true)
+        {
+            Json_ScanPlain(json, i);
+            if (i >= json.length())
+                break;
+
+            const uint8_t ch = (uint8_t)json[i];
+            if (ch >= 0x80)
+            {
+                size_t length = Json_Utf8SequenceLength(json, i);
+                if (length == 0)
                 {
-                    parse_errors.Add(nl::String::Format("\\u0000 type characters are not supported at offset {}", i));
+                    parse_errors.Add(nl::String::Format("Invalid UTF-8 sequence at offset {}", i));
                     return false;
                 }
-                }
 
-                ++i;
+                i += length;
+                continue;
             }
-            else if (json[i] == '"')
+
+            sb.Append(json.data() + start, i - start);
+
+            if (ch == '"')
             {
                 ++i;
                 return true;
             }
 
-            sb.Append(json[i++]);
+            if (ch != '\\')
+            {
+                parse_errors.Add(nl::String::Format("Unescaped control character in string at offset {}", i));
+                return false;
+            }
+
+            if (!Json_ReadEscape(sb, json, i, parse_errors))
+                return false;
+
+            start = i;
         }
 
         parse_errors.Add(nl::String::Format("EOF at {}", i));
         return false;
     }
 
-    inline Shared<JsonBase> Json_ReadValue(const nl::String& json, size_t& i, nl::Vector<nl::String>& parse_errors)
+    inline void Json_AppendEscapedString(nl::String& output, std::string_view s)
+    {
+        static const char hex[] = "0123456789abcdef";
+
+        output.EnsureCapacity(output.GetLength() + s.length() + 2);
+        output.Append('"');
+
+        size_t start = 0;
+        for (size_t i = 0; i < s.length(); ++i)
+        {
+            char ch = s[i];
+            if (ch != '"' &&
+                ch != '\\' &&
+                (uint8_t)ch >= 0x20)
+                continue;
+
+            output.Append(s.data() + start, i - start);
+            start = i + 1;
+
+            output.Append('\\');
+            switch (ch)
+            {
+            case '"': output.Append('"'); break;
+            case '\\': output.Append('\\'); break;
+            case '\b': output.Append('b'); break;
+            case '\f': output.Append('f'); break;
+            case '\n': output.Append('n'); break;
+            case '\r': output.Append('r'); break;
+            case '\t': output.Append('t'); break;
+            default:
+                output.Append("u00");
+                output.Append(hex[(uint8_t)ch >> 4]);
+                output.Append(hex[(uint8_t)ch & 0xf]);
+                break;
+            }
+        }
+
+        output.Append(s.data() + start, s.length() - start);
+        output.Append('"');
+    }
+
+    // Skips a string without decoding it; expects json[i] to be the opening quote.
+    inline bool Json_SkipString(std::string_view json, size_t& i)
     {
+        ++i;
+        while (i < json.length())
+        {
+            char ch = json[i++];
+            if (ch == '"')
+                return true;
+
+            if (ch == '\\')
+                ++i;
+        }
+
+        return false;
+    }
+
+    // Skips a value without building it. Nested objects and arrays are skipped by bracket depth only.
+    inline bool Json_SkipValue(std::string_view json, size_t& i)
+    {
+        if (i >= json.length())
+            return false;
+
+        char ch = json[i];
+        if (ch == '"')
+            return Json_SkipString(json, i);
+
+        if (ch == '{' ||
+            ch == '[')
+        {
+            size_t depth = 0;
+            while (i < json.length())
+            {
+                ch = json[i];
+                if (ch == '"')
+                {
+                    if (!Json_SkipString(json, i))
+                        return false;
+
+                    continue;
+                }
+
+                ++i;
+
+                if (ch == '{' ||
+                    ch == '[')
+                {
+                    ++depth;
+                }
+                else if (ch == '}' ||
+                    ch == ']')
+                {
+                    if (--depth == 0)
+                        return true;
+                }
+            }
+
+            return false;
+        }
+
+        // number or literal
+        auto start = i;
+        while (i < json.length())
+        {
+            ch = json[i];
+            if (ch == ',' || ch == '}' || ch == ']' ||
+                ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
+                break;
+
+            ++i;
+        }
+
+        return i != start;
+    }
+
+    inline Shared<JsonBase> Json_ReadValue(std::string_view json, size_t& i, nl::Vector<nl::String>& parse_errors)
+    {
+        if (i >= json.length())
+        {
+            parse_errors.Add(nl::String::Format("EOF at {}", i));
+            return nullptr;
+        }
+
         char ch = json[i];
 
         if (ch == '"')
@@ -211,22 +623,21 @@ namespace nl
         }
 
         if (Json_CharIsDigit(ch) ||
-            (ch == '-' &&
-                i + 1 < json.GetLength() &&
-                Json_CharIsDigit(json[i + 1])))
+            ch == '-')
         {
-            size_t temp_i = i;
-            int64_t value1;
-            if (Json_ReadNumber(&value1, json, i))
-                return ConstructSharedThrow<JsonNumber>(value1);
-
-            i = temp_i;
-            double value2;
-            if (Json_ReadDouble(&value2, json, i))
-                return ConstructSharedThrow<JsonNumber>(value2);
-
-            parse_errors.Add(nl::String::Format("Value at offset {} is neither number or double.", temp_i));
-            return nullptr;
+            const size_t start = i;
+            int64_t integer;
+            double number;
+            switch (Json_ParseNumber(json, i, integer, number))
+            {
+            case JsonNumberKind::Integer:
+                return ConstructSharedThrow<JsonNumber>(integer);
+            case JsonNumberKind::Double:
+                return ConstructSharedThrow<JsonNumber>(number);
+            default:
+                parse_errors.Add(nl::String::Format("Value at offset {} is not a valid number.", start));
+                return nullptr;
+            }
         }
 
         if (ch == '{')
@@ -247,22 +658,22 @@ namespace nl
             return ary;
         }
 
-        if (i + 4 <= json.GetLength() &&
-            memcmp(json.c_str() + i, "true", 4) == 0)
+        if (i + 4 <= json.length() &&
+            memcmp(json.data() + i, "true", 4) == 0)
         {
             i += 4;
             return ConstructSharedThrow<JsonBoolean>(true);
         }
 
-        if (i + 5 <= json.GetLength() &&
-            memcmp(json.c_str() + i, "false", 5) == 0)
+        if (i + 5 <= json.length() &&
+            memcmp(json.data() + i, "false", 5) == 0)
         {
             i += 5;
             return ConstructSharedThrow<JsonBoolean>(false);
         }
 
-        if (i + 4 <= json.GetLength() &&
-            memcmp(json.c_str() + i, "null", 4) == 0)
+        if (i + 4 <= json.length() &&
+            memcmp(json.data() + i, "null", 4) == 0)
         {
             i += 4;
             return ConstructSharedThrow<JsonNull>();
@@ -0,0 +1,285 @@
+/*
+ * JSON Library by Nicco © 2019
+ */
+
+#include "StdAfx.h"
+
+#include <NativeLib/Json.h>
+#include <NativeLib/IO/Stream.h>
+#include <NativeLib/Containers/Queue.h>
+#include <NativeLib/Threading/Event.h>
+#include <NativeLib/Threading/ThreadPool.h>
+
+//!ALLOW_INCLUDE "JsonInline.inl"
+#include "JsonInline.inl"
+
+#include <NativeLib/Allocators.h>
+#include <NativeLib/Util.h>
+
+//!ALLOW_INCLUDE "exception"
+#include <exception>
+
+namespace nl
+{
+    struct JsonLinesChunk
+    {
+        JsonLinesChunk* prev = nullptr;
+        JsonLinesChunk* next = nullptr;
+
+        nl::String Storage; // owns the text when it was read from a stream
+        std::string_view Text;
+
+        size_t LineCount = 0;
+        nl::Vector<JsonLine> Lines;
+
+        std::exception_ptr Error; // rethrown on the consuming thread
+
+        nl::threading::Event Completed;
+    };
+
+    typedef std::function<JsonLinesChunk*()> JsonLinesChunkSource;
+
+    static void JsonLines_ParseLine(JsonLinesChunk* chunk, size_t line, std::string_view json)
+    {
+        size_t i = 0;
+        Json_SkipWhitespace(json, i);
+        if (i >= json.length())
+            return; // blank line
+
+        JsonLine record;
+        record.Line = line;
+        record.Value = Json_ReadValue(json, i, record.ParseErrors);
+
+        if (record.Value.has_value())
+        {
+            Json_SkipWhitespace(json, i);
+            if (i < json.length())
+            {
+                record.ParseErrors.Add(nl::String::Format("Unexpected data after value at offset {}", i));
+                record.Value.Release();
+            }
+        }
+
+        chunk->Lines.Add(std::move(record));
+    }
+
+    static void JsonLines_ParseChunk(JsonLinesChunk* chunk)
+    {
+        try
+        {
+            const std::string_view text = chunk->Text;
+
+            size_t line = 0;
+            size_t start = 0;
+            while (start < text.length())
+            {
+                size_t end = text.find('\n', start);
+                if (end == std::string_view::npos)
+                    end = text.length();
+
+                JsonLines_ParseLine(chunk, line++, text.substr(start, end - start));
+                start = end + 1;
+            }
+
+            chunk->LineCount = line;
+        }
+        catch (...)
+        {
+            chunk->Error = std::current_exception();
+        }
+
+        chunk->Completed.Set();
+    }
+
+    static size_t JsonLines_Run(const JsonLinesChunkSource& next_chunk, const JsonLineHandler& handler, const JsonLinesOptions& options)
+    {
+        nl::threading::ThreadPool pool(options.ThreadCount);
+
+        // keep enough chunks in flight that workers never wait on the handler
+        const size_t window = (size_t)pool.GetThreadCount() * 2;
+
+        nl::Queue<JsonLinesChunk> inflight;
+        JsonLinesChunk* current = nullptr;
+        size_t count = 0;
+        bool exhausted = false;
+
+        auto fill = [&]()
+        {
+            while (!exhausted && count < window)
+            {
+                auto chunk = next_chunk();
+                if (!chunk)
+                {
+                    exhausted = true;
+                    break;
+                }
+
+                inflight.AddTail(chunk);
+                ++count;
+
+                pool.Queue([chunk]() { JsonLines_ParseChunk(chunk); });
+            }
+        };
+
+        size_t base_line = 0;
+        size_t failed_lines = 0;
+
+        try
+        {
+            fill();
+
+            while (inflight.TryPopHead(&current))
+            {
+                --count;
+                current->Completed.Wait();
+
+                if (current->Error)
+                    std::rethrow_exception(current->Error);
+
+                for (auto& line : current->Lines)
+                {
+                    line.Line += base_line;
+                    if (!line.Value.has_value())
+                        ++failed_lines;
+
+                    handler(line);
+                }
+
+                base_line += current->LineCount;
+
+                nl::memory::Destroy(current);
+                current = nullptr;
+
+                fill();
+            }
+        }
+        catch (...)
+        {
+            pool.Wait();
+
+            if (current)
+                nl::memory::Destroy(current);
+
+            while (inflight.TryPopHead(&current))
+                nl::memory::Destroy(current);
+
+            throw;
+        }
+
+        return failed_lines;
+    }
+
+    size_t ParseJsonLines(std::string_view json, const JsonLineHandler& handler, const JsonLinesOptions* options)
+    {
+        JsonLinesOptions defaults;
+        if (!options)
+            options = &defaults;
+
+        const size_t chunk_size = options->ChunkSize != 0 ? options->ChunkSize : defaults.ChunkSize;
+        size_t offset = 0;
+
+        return JsonLines_Run([&]() -> JsonLinesChunk*
+        {
+            if (offset >= json.length())
+                return nullptr;
+
+            // extend the chunk to include the line break ending the line it stops in
+            size_t end = json.find('\n', nl::util::Min(offset + chunk_size, json.length()) - 1);
+            end = end != std::string_view::npos ? end + 1 : json.length();
+
+            auto chunk = nl::memory::ConstructThrow<JsonLinesChunk>();
+            chunk->Text = json.substr(offset, end - offset);
+            offset = end;
+            return chunk;
+        }, handler, *options);
+    }
+
+    static size_t JsonLines_ReadFully(nl::io::Stream* stream, char* ptr, size_t count)
+    {
+        size_t total = 0;
+        while (total < count)
+        {
+            int64_t read = stream->Read(ptr + total, (int64_t)(count - total));
+            if (read <= 0)
+                break;
+
+            total += (size_t)read;
+        }
+
+        return total;
+    }
+
+    size_t ParseJsonLines(nl::io::Stream* stream, const JsonLineHandler& handler, const JsonLinesOptions* options)
+    {
+        JsonLinesOptions defaults;
+        if (!options)
+            options = &defaults;
+
+        if (!stream->CanRead())
+            throw ArgumentException("The provided stream cannot be read from.");
+
+        const size_t chunk_size = options->ChunkSize != 0 ? options->ChunkSize : defaults.ChunkSize;
+        nl::String carry; // partial line left over from the previous chunk
+        bool eof = false;
+
+        return JsonLines_Run([&]() -> JsonLinesChunk*
+        {
+            if (eof)
+                return nullptr;
+
+            auto chunk = nl::memory::ConstructThrow<JsonLinesChunk>();
+            nl::String& storage = chunk->Storage;
+
+            storage.EnsureCapacity(carry.GetLength() + chunk_size);
+            storage.Append(carry);
+            carry.Clear();
+
+            size_t split = std::string_view::npos;
+            while (split == std::string_view::npos)
+            {
+                // grown geometrically, so a line spanning many chunks is not copied again for each one
+                size_t length = storage.GetLength();
+                if (storage.GetCapacity() < length + chunk_size)
+                    storage.EnsureCapacity(nl::util::Max(storage.GetCapacity() * 2, length + chunk_size));
+
+                storage.SetLength(length + chunk_size);
+
+                size_t read = JsonLines_ReadFully(stream, storage.data() + length, chunk_size);
+                storage.SetLength(length + read);
+
+                if (read < chunk_size)
+                {
+                    eof = true;
+                    break;
+                }
+
+                // only the bytes just read can hold a line break; the carry has none and the rest was searched
+                size_t found = std::string_view(storage.data() + length, read).rfind('\n');
+                if (found != std::string_view::npos)
+                    split = length + found;
+            }
+
+            if (split != std::string_view::npos)
+            {
+                carry.Set(storage.c_str() + split + 1, storage.GetLength() - (split + 1));
+                storage.SetLength(split + 1);
+            }
+
+            if (storage.GetLength() == 0)
+            {
+                nl::memory::Destroy(chunk);
+                return nullptr;
+            }
+
+            chunk->Text = storage;
+            return chunk;
+        }, handler, *options);
+    }
+
+    nl::Vector<JsonLine> ParseJsonLines(std::string_view json, const JsonLinesOptions* options)
+    {
+        nl::Vector<JsonLine> lines;
+        ParseJsonLines(json, [&](JsonLine& line) { lines.Add(std::move(line)); }, options);
+        return lines;
+    }
+}
@@ -19,7 +19,7 @@ namespace nl
     {
     }
 
-    bool JsonObject::Read(const nl::String& json, size_t& i, nl::Vector<nl::String>& parse_errors)
+    bool JsonObject::Read(std::string_view json, size_t& i, nl::Vector<nl::String>& parse_errors)
     {
         if (json[i] != '{')
         {
@@ -28,10 +28,10 @@ namespace nl
         }
 
         ++i;
-        while (i < json.GetLength())
+        while (i < json.length())
         {
             Json_SkipWhitespace(json, i);
-            if (i >= json.GetLength())
+            if (i >= json.length())
             {
                 parse_errors.Add(nl::String::Format("EOF at {}", i));
                 return false;
@@ -53,7 +53,7 @@ namespace nl
                 return false;
 
             Json_SkipWhitespace(json, i);
-            if (i >= json.GetLength())
+            if (i >= json.length())
             {
                 parse_errors.Add(nl::String::Format("EOF at {}", i));
                 return false;
@@ -66,14 +66,14 @@ namespace nl
             }
 
             Json_SkipWhitespace(json, i);
-            if (i >= json.GetLength())
+            if (i >= json.length())
             {
                 parse_errors.Add(nl::String::Format("EOF at {}", i));
                 return false;
             }
 
             auto value = Json_ReadValue(json, i, parse_errors);
-            if (!value)
+            if (!value.has_value())
                 return false;
 
             m_members.Add(name, value);
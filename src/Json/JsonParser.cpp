@@ -9,39 +9,55 @@
 //!ALLOW_INCLUDE "JsonInline.inl"
 #include "JsonInline.inl"
 
+//!ALLOW_INCLUDE "charconv"
+//!ALLOW_INCLUDE "stdlib.h"
+#include <charconv>
+#include <stdlib.h>
+
 #include <NativeLib/Allocators.h>
 
 namespace nl
 {
-    Shared<JsonBase> ParseJson(const char* pszJson, nl::Vector<nl::String>& parse_errors)
+    double Json_ParseDoubleSlow(const char* begin, const char* end)
     {
-        nl::String json = pszJson;
+        double value = 0;
+        auto result = std::from_chars(begin, end, value);
+        if (result.ec == std::errc::result_out_of_range)
+        {
+            // from_chars leaves the value untouched; strtod saturates to infinity or zero
+            char buffer[512];
+            size_t length = nl::util::Min((size_t)(end - begin), sizeof(buffer) - 1);
+            memcpy(buffer, begin, length);
+            buffer[length] = 0;
+            value = strtod(buffer, nullptr);
+        }
+
+        return value;
+    }
 
+    Shared<JsonBase> ParseJson(std::string_view json, nl::Vector<nl::String>& parse_errors)
+    {
         size_t i = 0;
         Json_SkipWhitespace(json, i);
 
-        if (i >= json.GetLength())
+        if (i >= json.length())
         {
             parse_errors.Add(nl::String::Format("EOF at {}", i));
             return nullptr;
         }
 
-        Shared<JsonBase> obj;
+        auto value = Json_ReadValue(json, i, parse_errors);
+        if (!value.has_value())
+            return nullptr;
 
-        if (json[i] == '{')
-        {
-            obj = ConstructSharedThrow<JsonObject>();
-            if (!static_cast<JsonObject*>(obj.get())->Read(json, i, parse_errors))
-                return nullptr;
-        }
-        else if (json[i] == '[')
+        Json_SkipWhitespace(json, i);
+        if (i < json.length())
         {
-            obj = ConstructSharedThrow<JsonArray>();
-            if (!static_cast<JsonArray*>(obj.get())->Read(json, i, parse_errors))
-                return nullptr;
+            parse_errors.Add(nl::String::Format("Unexpected data after value at offset {}", i));
+            return nullptr;
         }
 
-        return obj;
+        return value;
     }
 
     inline void JsonOutputFormattingIndentation(nl::String& output, JsonFormattingOptions* formatting, int count)
@@ -61,40 +77,7 @@ namespace nl
         else if (pJson->GetType() == JsonType::String)
         {
             const nl::String& s = Shared<const JsonString>::Cast(pJson)->GetValue();
-            output.EnsureCapacity(output.GetCapacity() + s.GetLength() + 2);
-            output.Append('"');
-            for (size_t i = 0; i < s.GetLength(); ++i)
-            {
-                char ch = s[i];
-                switch (ch)
-                {
-                case '\\':
-                    output.Append('\\');
-                    output.Append('\\');
-                    break;
-                case '"':
-                    output.Append('\\');
-                    output.Append('"');
-                    break;
-                case '\t':
-                    output.Append('\\');
-                    output.Append('t');
-                    break;
-                case '\r':
-                    output.Append('\\');
-                    output.Append('r');
-                    break;
-                case '\n':
-                    output.Append('\\');
-                    output.Append('n');
-                    break;
-                default:
-                    output.Append(ch);
-                    break;
-                }
-            }
-
-            output.Append('"');
+            Json_AppendEscapedString(output, s);
         }
         else if (pJson->GetType() == JsonType::Number)
         {
@@ -0,0 +1,404 @@
+/*
+ * JSON Library by Nicco © 2019
+ */
+
+#include "StdAfx.h"
+
+#include <NativeLib/JsonReader.h>
+
+//!ALLOW_INCLUDE "JsonInline.inl"
+#include "JsonInline.inl"
+
+#include <cmath>
+
+namespace nl
+{
+    JsonReader::JsonReader(std::string_view json, nl::Vector<nl::String>& parse_errors) :
+        m_json(json),
+        m_offset(0),
+        m_parse_errors(parse_errors),
+        m_failed(false),
+        m_needs_comma(false)
+    {
+    }
+
+    void JsonReader::AddError(std::string_view message)
+    {
+        nl::String error;
+        error.Append(message.data(), message.length());
+        error.Append(" at offset ");
+        error.Append(nl::String::NumberToStringUnsigned(m_offset));
+
+        m_parse_errors.Add(std::move(error));
+        m_failed = true;
+    }
+
+    bool JsonReader::Expect(char ch, const char* what)
+    {
+        if (m_failed)
+            return false;
+
+        Json_SkipWhitespace(m_json, m_offset);
+        if (m_offset >= m_json.length() ||
+            m_json[m_offset] != ch)
+        {
+            AddError(what);
+            return false;
+        }
+
+        ++m_offset;
+        return true;
+    }
+
+    bool JsonReader::PeekType(JsonType& type)
+    {
+        if (m_failed)
+            return false;
+
+        Json_SkipWhitespace(m_json, m_offset);
+        if (m_offset >= m_json.length())
+        {
+            AddError("Unexpected EOF");
+            return false;
+        }
+
+        char ch = m_json[m_offset];
+        switch (ch)
+        {
+        case '"': type = JsonType::String; return true;
+        case '{': type = JsonType::Object; return true;
+        case '[': type = JsonType::Array; return true;
+        case 't':
+        case 'f': type = JsonType::Boolean; return true;
+        case 'n': type = JsonType::Null; return true;
+        }
+
+        if (ch == '-' ||
+            Json_CharIsDigit(ch))
+        {
+            type = JsonType::Number;
+            return true;
+        }
+
+        AddError("No suitable json value found");
+        return false;
+    }
+
+    bool JsonReader::IsEnd()
+    {
+        Json_SkipWhitespace(m_json, m_offset);
+        return m_offset >= m_json.length();
+    }
+
+    bool JsonReader::ReadNull()
+    {
+        if (m_failed)
+            return false;
+
+        Json_SkipWhitespace(m_json, m_offset);
+        if (m_json.substr(m_offset, 4) != "null")
+        {
+            AddError("Expected null");
+            return false;
+        }
+
+        m_offset += 4;
+        return true;
+    }
+
+    bool JsonReader::ReadBoolean(bool& value)
+    {
+        if (m_failed)
+            return false;
+
+        Json_SkipWhitespace(m_json, m_offset);
+        if (m_json.substr(m_offset, 4) == "true")
+        {
+            value = true;
+            m_offset += 4;
+            return true;
+        }
+
+        if (m_json.substr(m_offset, 5) == "false")
+        {
+            value = false;
+            m_offset += 5;
+            return true;
+        }
+
+        AddError("Expected a boolean");
+        return false;
+    }
+
+    bool JsonReader::ReadInteger(int64_t& value)
+    {
+        if (m_failed)
+            return false;
+
+        Json_SkipWhitespace(m_json, m_offset);
+
+        size_t i = m_offset;
+        if (!Json_ReadNumber(&value, m_json, i))
+        {
+            AddError("Expected an integer");
+            return false;
+        }
+
+        m_offset = i;
+        return true;
+    }
+
+    bool JsonReader::ReadDouble(double& value)
+    {
+        if (m_failed)
+            return false;
+
+        Json_SkipWhitespace(m_json, m_offset);
+
+        size_t i = m_offset;
+        if (!Json_ReadDouble(&value, m_json, i))
+        {
+            AddError("Expected a number");
+            return false;
+        }
+
+        m_offset = i;
+        return true;
+    }
+
+    bool JsonReader::ReadString(nl::String& value)
+    {
+        if (m_failed)
+            return false;
+
+        Json_SkipWhitespace(m_json, m_offset);
+        if (m_offset >= m_json.length() ||
+            m_json[m_offset] != '"')
+        {
+            AddError("Expected a string");
+            return false;
+        }
+
+        value.Clear();
+        if (!Json_ReadString(value, m_json, m_offset, m_parse_errors))
+        {
+            m_failed = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool JsonReader::SkipValue()
+    {
+        if (m_failed)
+            return false;
+
+        Json_SkipWhitespace(m_json, m_offset);
+        if (!Json_SkipValue(m_json, m_offset))
+        {
+            AddError("Malformed value");
+            return false;
+        }
+
+        return true;
+    }
+
+    bool JsonReader::BeginObject()
+    {
+        m_needs_comma = false;
+        return Expect('{', "Expected an object");
+    }
+
+    bool JsonReader::NextMember(std::string_view& name)
+    {
+        if (!NextElement('}', "Unexpected EOF in object"))
+            return false;
+
+        if (m_json[m_offset] != '"')
+        {
+            AddError("Expected a member name");
+            return false;
+        }
+
+        // plain ASCII names are returned straight from the text
+        size_t end = m_offset + 1;
+        Json_ScanPlain(m_json, end);
+        if (end < m_json.length() &&
+            m_json[end] == '"')
+        {
+            name = m_json.substr(m_offset + 1, end - (m_offset + 1));
+            m_offset = end + 1;
+        }
+        else
+        {
+            m_name.Clear();
+            if (!Json_ReadString(m_name, m_json, m_offset, m_parse_errors))
+            {
+                m_failed = true;
+                return false;
+            }
+
+            name = m_name;
+        }
+
+        return Expect(':', "Expected ':' after member name");
+    }
+
+    bool JsonReader::BeginArray()
+    {
+        m_needs_comma = false;
+        return Expect('[', "Expected an array");
+    }
+
+    bool JsonReader::NextItem()
+    {
+        return NextElement(']', "Unexpected EOF in array");
+    }
+
+    // Moves to the next element of the open container, requiring exactly one ',' between elements. A nested container
+    // is an element of its parent, so closing it leaves the flag set for the parent.
+    bool JsonReader::NextElement(char close, const char* eof_error)
+    {
+        if (m_failed)
+            return false;
+
+        Json_SkipWhitespace(m_json, m_offset);
+        if (m_offset >= m_json.length())
+        {
+            AddError(eof_error);
+            return false;
+        }
+
+        if (m_json[m_offset] == close)
+        {
+            ++m_offset;
+            m_needs_comma = true;
+            return false;
+        }
+
+        if (m_needs_comma)
+        {
+            if (m_json[m_offset] != ',')
+            {
+                AddError("Expected ','");
+                return false;
+            }
+
+            ++m_offset;
+            Json_SkipWhitespace(m_json, m_offset);
+            if (m_offset >= m_json.length())
+            {
+                AddError(eof_error);
+                return false;
+            }
+
+            if (m_json[m_offset] == close ||
+                m_json[m_offset] == ',')
+            {
+                AddError("Expected a value after ','");
+                return false;
+            }
+        }
+        else if (m_json[m_offset] == ',')
+        {
+            AddError("Unexpected ','");
+            return false;
+        }
+
+        m_needs_comma = true;
+        return true;
+    }
+
+    ///////////////////////////////////////////////////////////////
+    // JsonWriter
+    ///////////////////////////////////////////////////////////////
+
+    JsonWriter::JsonWriter(nl::String& output) :
+        m_output(output),
+        m_needs_comma(false)
+    {
+    }
+
+    void JsonWriter::BeginValue()
+    {
+        if (m_needs_comma)
+            m_output.Append(',');
+
+        m_needs_comma = true;
+    }
+
+    void JsonWriter::BeginObject()
+    {
+        BeginValue();
+        m_output.Append('{');
+        m_needs_comma = false;
+    }
+
+    void JsonWriter::EndObject()
+    {
+        m_output.Append('}');
+        m_needs_comma = true;
+    }
+
+    void JsonWriter::BeginArray()
+    {
+        BeginValue();
+        m_output.Append('[');
+        m_needs_comma = false;
+    }
+
+    void JsonWriter::EndArray()
+    {
+        m_output.Append(']');
+        m_needs_comma = true;
+    }
+
+    void JsonWriter::WriteName(std::string_view name)
+    {
+        BeginValue();
+        Json_AppendEscapedString(m_output, name);
+        m_output.Append(':');
+        m_needs_comma = false;
+    }
+
+    void JsonWriter::WriteNull()
+    {
+        BeginValue();
+        m_output.Append("null");
+    }
+
+    void JsonWriter::WriteBoolean(bool value)
+    {
+        BeginValue();
+        m_output.Append(value ? "true" : "false");
+    }
+
+    void JsonWriter::WriteInteger(int64_t value)
+    {
+        BeginValue();
+        m_output.Append(nl::String::NumberToString(value));
+    }
+
+    void JsonWriter::WriteDouble(double value)
+    {
+        if (!std::isfinite(value))
+        {
+            WriteNull(); // JSON has no representation for infinity or NaN
+            return;
+        }
+
+        BeginValue();
+
+        // enough digits to read back the same double
+        char buffer[64];
+        int len = snprintf(buffer, sizeof(buffer), "%.17g", value);
+        m_output.Append(buffer, (size_t)len);
+    }
+
+    void JsonWriter::WriteString(std::string_view value)
+    {
+        BeginValue();
+        Json_AppendEscapedString(m_output, value);
+    }
+}
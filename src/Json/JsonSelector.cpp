@@ -0,0 +1,817 @@
+/*
+ * JSON Library by Nicco © 2019
+ */
+
+#include "StdAfx.h"
+
+#include <NativeLib/JsonSelector.h>
+
+//!ALLOW_INCLUDE "JsonInline.inl"
+#include "JsonInline.inl"
+
+namespace nl
+{
+    using json_internals::SelectorStep;
+    using json_internals::SelectorStepType;
+    using json_internals::SelectorFilterOperator;
+
+    // Value of a filtered member, taken either from the document or from JSON text
+    struct JsonSelectorOperand
+    {
+        JsonType Type = JsonType::Null;
+        double Number = 0;
+        std::string_view String;
+        bool Boolean = false;
+    };
+
+    static bool JsonSelector_IsNameChar(char ch)
+    {
+        return ch != '.' && ch != '[' && ch != ']' && ch != ' ' && ch != '\t' &&
+            ch != '=' && ch != '!' && ch != '<' && ch != '>';
+    }
+
+    static void JsonSelector_SkipSpaces(std::string_view path, size_t& i)
+    {
+        while (i < path.length() &&
+            (path[i] == ' ' || path[i] == '\t'))
+            ++i;
+    }
+
+    static bool JsonSelector_ParseIndex(std::string_view token, size_t& index)
+    {
+        // RFC 6901: array indices have no leading zeros
+        if (token.empty() ||
+            (token.length() > 1 && token[0] == '0'))
+            return false;
+
+        index = 0;
+        for (char ch : token)
+        {
+            if (!Json_CharIsDigit(ch))
+                return false;
+
+            index = index * 10 + (size_t)(ch - '0');
+        }
+
+        return true;
+    }
+
+    static nl::String JsonSelector_ReadName(std::string_view path, size_t& i)
+    {
+        if (i < path.length() &&
+            (path[i] == '\'' || path[i] == '"'))
+        {
+            char quote = path[i++];
+            nl::String name;
+            while (i < path.length() && path[i] != quote)
+            {
+                if (path[i] == '\\' && i + 1 < path.length())
+                    ++i;
+
+                name.Append(path[i++]);
+            }
+
+            if (i >= path.length())
+                throw ArgumentException("Unterminated quoted name in JSON path.");
+
+            ++i;
+            return name;
+        }
+
+        auto start = i;
+        while (i < path.length() && JsonSelector_IsNameChar(path[i]))
+            ++i;
+
+        if (i == start)
+            throw ArgumentException(nl::String::Format("Expected a member name at offset {} in JSON path.", start));
+
+        return nl::String(path.substr(start, i - start));
+    }
+
+    static void JsonSelector_ReadLiteral(SelectorStep& step, std::string_view path, size_t& i)
+    {
+        if (i >= path.length())
+            throw ArgumentException("Expected a literal in JSON path filter.");
+
+        char ch = path[i];
+        if (ch == '"')
+        {
+            nl::Vector<nl::String> parse_errors;
+            if (!Json_ReadString(step.LiteralString, path, i, parse_errors))
+                throw ArgumentException(nl::String::Format("Invalid string literal at offset {} in JSON path.", i));
+
+            step.LiteralType = JsonType::String;
+        }
+        else if (ch == '\'')
+        {
+            step.LiteralString = JsonSelector_ReadName(path, i);
+            step.LiteralType = JsonType::String;
+        }
+        else if (Json_CharIsDigit(ch) || ch == '-')
+        {
+            size_t start = i;
+            int64_t value;
+            if (Json_ReadNumber(&value, path, i))
+            {
+                step.LiteralNumber = (double)value;
+            }
+            else
+            {
+                i = start;
+                if (!Json_ReadDouble(&step.LiteralNumber, path, i))
+                    throw ArgumentException(nl::String::Format("Invalid number literal at offset {} in JSON path.", start));
+            }
+
+            step.LiteralType = JsonType::Number;
+        }
+        else if (path.substr(i, 4) == "true")
+        {
+            step.LiteralType = JsonType::Boolean;
+            step.LiteralBoolean = true;
+            i += 4;
+        }
+        else if (path.substr(i, 5) == "false")
+        {
+            step.LiteralType = JsonType::Boolean;
+            step.LiteralBoolean = false;
+            i += 5;
+        }
+        else if (path.substr(i, 4) == "null")
+        {
+            step.LiteralType = JsonType::Null;
+            i += 4;
+        }
+        else
+            throw ArgumentException(nl::String::Format("Invalid literal at offset {} in JSON path.", i));
+    }
+
+    static void JsonSelector_ReadFilter(SelectorStep& step, std::string_view path, size_t& i)
+    {
+        step.Type = SelectorStepType::Filter;
+
+        JsonSelector_SkipSpaces(path, i);
+        step.Name = JsonSelector_ReadName(path, i);
+        JsonSelector_SkipSpaces(path, i);
+
+        if (i < path.length() && path[i] == ']')
+        {
+            step.Operator = SelectorFilterOperator::Exists;
+            return;
+        }
+
+        auto op = path.substr(i, 2);
+        if (op == "==") step.Operator = SelectorFilterOperator::Equal;
+        else if (op == "!=") step.Operator = SelectorFilterOperator::NotEqual;
+        else if (op == "<=") step.Operator = SelectorFilterOperator::LessOrEqual;
+        else if (op == ">=") step.Operator = SelectorFilterOperator::GreaterOrEqual;
+        else if (op.substr(0, 1) == "<") step.Operator = SelectorFilterOperator::Less;
+        else if (op.substr(0, 1) == ">") step.Operator = SelectorFilterOperator::Greater;
+        else
+            throw ArgumentException(nl::String::Format("Expected a comparison operator at offset {} in JSON path.", i));
+
+        i += (step.Operator == SelectorFilterOperator::Less || step.Operator == SelectorFilterOperator::Greater) ? 1 : 2;
+
+        JsonSelector_SkipSpaces(path, i);
+        JsonSelector_ReadLiteral(step, path, i);
+        JsonSelector_SkipSpaces(path, i);
+    }
+
+    JsonSelector JsonSelector::CompilePointer(std::string_view pointer)
+    {
+        JsonSelector selector;
+        if (pointer.empty())
+            return selector;
+
+        if (pointer[0] != '/')
+            throw ArgumentException("A JSON pointer must be empty or start with '/'.");
+
+        size_t i = 1;
+        for (;;)
+        {
+            SelectorStep step;
+            step.Type = SelectorStepType::MemberOrIndex;
+
+            while (i < pointer.length() && pointer[i] != '/')
+            {
+                char ch = pointer[i++];
+                if (ch == '~')
+                {
+                    if (i >= pointer.length() ||
+                        (pointer[i] != '0' && pointer[i] != '1'))
+                        throw ArgumentException(nl::String::Format("Invalid escape sequence at offset {} in JSON pointer.", i - 1));
+
+                    ch = pointer[i++] == '0' ? '~' : '/';
+                }
+
+                step.Name.Append(ch);
+            }
+
+            step.HasIndex = JsonSelector_ParseIndex(step.Name, step.Index);
+            selector.m_steps.Add(std::move(step));
+
+            if (i >= pointer.length())
+                break;
+
+            ++i; // '/'
+        }
+
+        return selector;
+    }
+
+    JsonSelector JsonSelector::CompilePath(std::string_view path)
+    {
+        JsonSelector selector;
+
+        size_t i = 0;
+        if (i < path.length() && path[i] == '$')
+            ++i;
+
+        // allow the first member to be written without a leading dot
+        if (i < path.length() && path[i] != '.' && path[i] != '[')
+        {
+            SelectorStep step;
+            step.Name = JsonSelector_ReadName(path, i);
+            selector.m_steps.Add(std::move(step));
+        }
+
+        while (i < path.length())
+        {
+            SelectorStep step;
+            char ch = path[i++];
+
+            if (ch == '.')
+            {
+                if (i < path.length() && path[i] == '*')
+                {
+                    step.Type = SelectorStepType::Wildcard;
+                    ++i;
+                }
+                else
+                {
+                    step.Type = SelectorStepType::Member;
+                    step.Name = JsonSelector_ReadName(path, i);
+                }
+            }
+            else if (ch == '[')
+            {
+                JsonSelector_SkipSpaces(path, i);
+                if (i >= path.length())
+                    throw ArgumentException("Unterminated '[' in JSON path.");
+
+                ch = path[i];
+                if (ch == '*')
+                {
+                    step.Type = SelectorStepType::Wildcard;
+                    ++i;
+                }
+                else if (ch == '?')
+                {
+                    ++i;
+                    JsonSelector_ReadFilter(step, path, i);
+                }
+                else if (ch == '\'' || ch == '"')
+                {
+                    step.Type = SelectorStepType::Member;
+                    step.Name = JsonSelector_ReadName(path, i);
+                }
+                else
+                {
+                    auto start = i;
+                    while (i < path.length() && Json_CharIsDigit(path[i]))
+                        ++i;
+
+                    step.Type = SelectorStepType::Index;
+                    step.HasIndex = true;
+                    if (!JsonSelector_ParseIndex(path.substr(start, i - start), step.Index))
+                        throw ArgumentException(nl::String::Format("Invalid array index at offset {} in JSON path.", start));
+                }
+
+                JsonSelector_SkipSpaces(path, i);
+                if (i >= path.length() || path[i] != ']')
+                    throw ArgumentException(nl::String::Format("Expected ']' at offset {} in JSON path.", i));
+
+                ++i;
+            }
+            else
+                throw ArgumentException(nl::String::Format("Unexpected character '{}' at offset {} in JSON path.", ch, i - 1));
+
+            selector.m_steps.Add(std::move(step));
+        }
+
+        return selector;
+    }
+
+    bool JsonSelector::IsSingular() const
+    {
+        for (const auto& step : m_steps)
+        {
+            if (step.Type == SelectorStepType::Wildcard ||
+                step.Type == SelectorStepType::Filter)
+                return false;
+        }
+
+        return true;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // Filters
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    static bool JsonSelector_Compare(SelectorFilterOperator op, int cmp)
+    {
+        switch (op)
+        {
+        case SelectorFilterOperator::Equal: return cmp == 0;
+        case SelectorFilterOperator::NotEqual: return cmp != 0;
+        case SelectorFilterOperator::Less: return cmp < 0;
+        case SelectorFilterOperator::LessOrEqual: return cmp <= 0;
+        case SelectorFilterOperator::Greater: return cmp > 0;
+        case SelectorFilterOperator::GreaterOrEqual: return cmp >= 0;
+        case SelectorFilterOperator::Exists: return true;
+        }
+
+        return false;
+    }
+
+    static bool JsonSelector_MatchOperand(const SelectorStep& step, const JsonSelectorOperand& operand)
+    {
+        if (step.Operator == SelectorFilterOperator::Exists)
+            return true;
+
+        if (operand.Type != step.LiteralType)
+            return step.Operator == SelectorFilterOperator::NotEqual;
+
+        switch (operand.Type)
+        {
+        case JsonType::Number:
+            return JsonSelector_Compare(step.Operator, operand.Number < step.LiteralNumber ? -1 : (operand.Number > step.LiteralNumber ? 1 : 0));
+        case JsonType::String:
+            return JsonSelector_Compare(step.Operator, operand.String.compare(std::string_view(step.LiteralString)));
+        case JsonType::Boolean:
+            if (step.Operator == SelectorFilterOperator::Equal)
+                return operand.Boolean == step.LiteralBoolean;
+
+            return step.Operator == SelectorFilterOperator::NotEqual && operand.Boolean != step.LiteralBoolean;
+        case JsonType::Null:
+            return step.Operator == SelectorFilterOperator::Equal;
+        default:
+            return false;
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // Document evaluation
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    static const JsonBase* JsonSelector_FindMember(const JsonObject* obj, const nl::String& name)
+    {
+        const size_t length = name.GetLength();
+        for (const auto& member : obj->GetMembers())
+        {
+            if (member.first.GetLength() == length &&
+                memcmp(member.first.c_str(), name.c_str(), length) == 0)
+                return member.second.get();
+        }
+
+        return nullptr;
+    }
+
+    static bool JsonSelector_MatchFilter(const SelectorStep& step, const JsonBase* value)
+    {
+        if (value->GetType() != JsonType::Object)
+            return false;
+
+        auto member = JsonSelector_FindMember(static_cast<const JsonObject*>(value), step.Name);
+        if (!member)
+            return false;
+
+        JsonSelectorOperand operand;
+        operand.Type = member->GetType();
+
+        switch (operand.Type)
+        {
+        case JsonType::Number:
+        {
+            auto number = static_cast<const JsonNumber*>(member);
+            operand.Number = number->IsDouble() ? number->GetDouble() : (double)number->GetValue();
+            break;
+        }
+        case JsonType::String:
+            operand.String = static_cast<const JsonString*>(member)->GetValue();
+            break;
+        case JsonType::Boolean:
+            operand.Boolean = static_cast<const JsonBoolean*>(member)->GetValue();
+            break;
+        default:
+            break;
+        }
+
+        return JsonSelector_MatchOperand(step, operand);
+    }
+
+    // Returns false once the visitor asks to stop.
+    template <typename TVisitor>
+    static bool JsonSelector_Select(const SelectorStep* step, const SelectorStep* end, const JsonBase* value, TVisitor& visitor)
+    {
+        if (step == end)
+            return visitor(value);
+
+        const JsonType type = value->GetType();
+        if (type == JsonType::Object)
+        {
+            auto obj = static_cast<const JsonObject*>(value);
+            switch (step->Type)
+            {
+            case SelectorStepType::Member:
+            case SelectorStepType::MemberOrIndex:
+            {
+                auto member = JsonSelector_FindMember(obj, step->Name);
+                return member ? JsonSelector_Select(step + 1, end, member, visitor) : true;
+            }
+            case SelectorStepType::Wildcard:
+            case SelectorStepType::Filter:
+                for (const auto& member : obj->GetMembers())
+                {
+                    if (step->Type == SelectorStepType::Filter &&
+                        !JsonSelector_MatchFilter(*step, member.second.get()))
+                        continue;
+
+                    if (!JsonSelector_Select(step + 1, end, member.second.get(), visitor))
+                        return false;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        else if (type == JsonType::Array)
+        {
+            const auto& items = static_cast<const JsonArray*>(value)->GetItems();
+            switch (step->Type)
+            {
+            case SelectorStepType::Index:
+            case SelectorStepType::MemberOrIndex:
+                if (step->HasIndex && step->Index < items.GetCount())
+                    return JsonSelector_Select(step + 1, end, items[step->Index].get(), visitor);
+                break;
+            case SelectorStepType::Wildcard:
+            case SelectorStepType::Filter:
+                for (const auto& item : items)
+                {
+                    if (step->Type == SelectorStepType::Filter &&
+                        !JsonSelector_MatchFilter(*step, item.get()))
+                        continue;
+
+                    if (!JsonSelector_Select(step + 1, end, item.get(), visitor))
+                        return false;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        return true;
+    }
+
+    const JsonBase* JsonSelector::SelectFirst(const JsonBase* root) const
+    {
+        const JsonBase* result = nullptr;
+        auto visitor = [&](const JsonBase* value)
+        {
+            result = value;
+            return false;
+        };
+
+        JsonSelector_Select(m_steps.GetArray(), m_steps.GetArray() + m_steps.GetCount(), root, visitor);
+        return result;
+    }
+
+    JsonBase* JsonSelector::SelectFirst(JsonBase* root) const
+    {
+        return const_cast<JsonBase*>(SelectFirst(static_cast<const JsonBase*>(root)));
+    }
+
+    size_t JsonSelector::Select(const JsonBase* root, nl::Vector<const JsonBase*>& results) const
+    {
+        size_t count = 0;
+        auto visitor = [&](const JsonBase* value)
+        {
+            results.Add(value);
+            ++count;
+            return true;
+        };
+
+        JsonSelector_Select(m_steps.GetArray(), m_steps.GetArray() + m_steps.GetCount(), root, visitor);
+        return count;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////
+    // Text evaluation
+    ////////////////////////////////////////////////////////////////////////////////////////
+
+    // Reads a member name at json[i] and compares it without allocating unless it contains escapes.
+    static bool JsonSelector_ReadKey(std::string_view json, size_t& i, const nl::String* name, bool& equal)
+    {
+        if (json[i] != '"')
+            return false;
+
+        const size_t start = i;
+        bool escaped = false;
+
+        ++i;
+        while (i < json.length() && json[i] != '"')
+        {
+            if (json[i] == '\\')
+            {
+                escaped = true;
+                ++i;
+            }
+
+            ++i;
+        }
+
+        if (i >= json.length())
+            return false;
+
+        ++i;
+        equal = false;
+
+        if (!name)
+            return true;
+
+        if (!escaped)
+        {
+            equal = json.substr(start + 1, i - start - 2) == std::string_view(*name);
+            return true;
+        }
+
+        nl::String key;
+        nl::Vector<nl::String> parse_errors;
+        size_t k = start;
+        if (!Json_ReadString(key, json, k, parse_errors))
+            return false;
+
+        equal = key.GetLength() == name->GetLength() && memcmp(key.c_str(), name->c_str(), key.GetLength()) == 0;
+        return true;
+    }
+
+    // Reads up to and including the ':' following a member name.
+    static bool JsonSelector_ReadColon(std::string_view json, size_t& i)
+    {
+        Json_SkipWhitespace(json, i);
+        if (i >= json.length() || json[i] != ':')
+            return false;
+
+        ++i;
+        Json_SkipWhitespace(json, i);
+        return i < json.length();
+    }
+
+    static bool JsonSelector_MatchFilter(const SelectorStep& step, std::string_view json, size_t i)
+    {
+        if (json[i] != '{')
+            return false;
+
+        ++i;
+        while (i < json.length())
+        {
+            Json_SkipWhitespace(json, i);
+            if (i >= json.length() || json[i] == '}')
+                return false;
+
+            if (json[i] == ',')
+            {
+                ++i;
+                continue;
+            }
+
+            bool equal;
+            if (!JsonSelector_ReadKey(json, i, &step.Name, equal) ||
+                !JsonSelector_ReadColon(json, i))
+                return false;
+
+            if (!equal)
+            {
+                if (!Json_SkipValue(json, i))
+                    return false;
+
+                continue;
+            }
+
+            JsonSelectorOperand operand;
+            nl::String string;
+
+            char ch = json[i];
+            if (ch == '"')
+            {
+                nl::Vector<nl::String> parse_errors;
+                if (!Json_ReadString(string, json, i, parse_errors))
+                    return false;
+
+                operand.Type = JsonType::String;
+                operand.String = string;
+            }
+            else if (Json_CharIsDigit(ch) || ch == '-')
+            {
+                size_t start = i;
+                int64_t value;
+                if (Json_ReadNumber(&value, json, i))
+                {
+                    operand.Number = (double)value;
+                }
+                else
+                {
+                    i = start;
+                    if (!Json_ReadDouble(&operand.Number, json, i))
+                        return false;
+                }
+
+                operand.Type = JsonType::Number;
+            }
+            else if (ch == '{')
+                operand.Type = JsonType::Object;
+            else if (ch == '[')
+                operand.Type = JsonType::Array;
+            else if (json.substr(i, 4) == "true")
+            {
+                operand.Type = JsonType::Boolean;
+                operand.Boolean = true;
+            }
+            else if (json.substr(i, 5) == "false")
+                operand.Type = JsonType::Boolean;
+            else if (json.substr(i, 4) == "null")
+                operand.Type = JsonType::Null;
+            else
+                return false;
+
+            return JsonSelector_MatchOperand(step, operand);
+        }
+
+        return false;
+    }
+
+    // Skips the remainder of the object or array that i is currently inside of.
+    static bool JsonSelector_SkipRest(std::string_view json, size_t& i)
+    {
+        size_t depth = 1;
+        while (i < json.length())
+        {
+            char ch = json[i];
+            if (ch == '"')
+            {
+                if (!Json_SkipString(json, i))
+                    return false;
+
+                continue;
+            }
+
+            ++i;
+
+            if (ch == '{' || ch == '[')
+                ++depth;
+            else if ((ch == '}' || ch == ']') && --depth == 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    // Advances i past the value at json[i]. Returns false once the visitor asks to stop or the text is malformed.
+    template <typename TVisitor>
+    static bool JsonSelector_SelectText(const SelectorStep* step, const SelectorStep* end, std::string_view json, size_t& i, TVisitor& visitor, bool& malformed)
+    {
+        if (step == end)
+        {
+            const size_t start = i;
+            if (!Json_SkipValue(json, i))
+            {
+                malformed = true;
+                return false;
+            }
+
+            return visitor(json.substr(start, i - start));
+        }
+
+        const char open = json[i];
+        const bool is_object = open == '{';
+        const bool is_array = open == '[';
+
+        if ((!is_object && !is_array) ||
+            (is_object && step->Type == SelectorStepType::Index) ||
+            (is_array && (step->Type == SelectorStepType::Member || (step->Type == SelectorStepType::MemberOrIndex && !step->HasIndex))))
+        {
+            if (!Json_SkipValue(json, i))
+            {
+                malformed = true;
+                return false;
+            }
+
+            return true;
+        }
+
+        const bool singular = step->Type != SelectorStepType::Wildcard && step->Type != SelectorStepType::Filter;
+        const nl::String* name = is_object && singular ? &step->Name : nullptr;
+        size_t index = 0;
+
+        ++i;
+        while (i < json.length())
+        {
+            Json_SkipWhitespace(json, i);
+            if (i >= json.length())
+                break;
+
+            if (json[i] == (is_object ? '}' : ']'))
+            {
+                ++i;
+                return true;
+            }
+
+            if (json[i] == ',')
+            {
+                ++i;
+                continue;
+            }
+
+            bool candidate;
+            if (is_object)
+            {
+                if (!JsonSelector_ReadKey(json, i, name, candidate) ||
+                    !JsonSelector_ReadColon(json, i))
+                    break;
+
+                if (!singular)
+                    candidate = true;
+            }
+            else
+                candidate = !singular || index == step->Index;
+
+            ++index;
+
+            if (candidate &&
+                step->Type == SelectorStepType::Filter)
+                candidate = JsonSelector_MatchFilter(*step, json, i);
+
+            if (!candidate)
+            {
+                if (!Json_SkipValue(json, i))
+                    break;
+
+                continue;
+            }
+
+            if (!JsonSelector_SelectText(step + 1, end, json, i, visitor, malformed))
+                return false;
+
+            // a member or index matches at most once
+            if (singular)
+            {
+                if (!JsonSelector_SkipRest(json, i))
+                    break;
+
+                return true;
+            }
+        }
+
+        malformed = true;
+        return false;
+    }
+
+    bool JsonSelector::SelectFirst(std::string_view json, std::string_view& result) const
+    {
+        bool found = false;
+        auto visitor = [&](std::string_view value)
+        {
+            result = value;
+            found = true;
+            return false;
+        };
+
+        size_t i = 0;
+        Json_SkipWhitespace(json, i);
+        if (i >= json.length())
+            return false;
+
+        bool malformed = false;
+        JsonSelector_SelectText(m_steps.GetArray(), m_steps.GetArray() + m_steps.GetCount(), json, i, visitor, malformed);
+        return found;
+    }
+
+    bool JsonSelector::Select(std::string_view json, nl::Vector<std::string_view>& results) const
+    {
+        auto visitor = [&](std::string_view value)
+        {
+            results.Add(value);
+            return true;
+        };
+
+        size_t i = 0;
+        Json_SkipWhitespace(json, i);
+        if (i >= json.length())
+            return false;
+
+        bool malformed = false;
+        JsonSelector_SelectText(m_steps.GetArray(), m_steps.GetArray() + m_steps.GetCount(), json, i, visitor, malformed);
+        return !malformed;
+    }
+}
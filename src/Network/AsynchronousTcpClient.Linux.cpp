@@ -0,0 +1,1025 @@
+#include "StdAfx.h"
+
+#include <NativeLib/Network/AsynchronousTcpClient.h>
+#include <NativeLib/Platform/Platform.h>
+#include <NativeLib/Containers/Queue.h>
+#include <NativeLib/Containers/Vector.h>
+#include <NativeLib/Threading/ReadWriteLock.h>
+#include <NativeLib/Threading/ThreadPool.h>
+#include <NativeLib/Threading/TimerWheel.h>
+#include <NativeLib/Threading/Event.h>
+#include <NativeLib/Exceptions.h>
+#include <NativeLib/Allocators.h>
+
+#ifdef NL_PLATFORM_LINUX
+
+//!ALLOW_INCLUDE "sys/epoll.h"
+//!ALLOW_INCLUDE "sys/eventfd.h"
+//!ALLOW_INCLUDE "sys/socket.h"
+//!ALLOW_INCLUDE "netinet/in.h"
+//!ALLOW_INCLUDE "netinet/tcp.h"
+//!ALLOW_INCLUDE "pthread.h"
+//!ALLOW_INCLUDE "unistd.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <unistd.h>
+
+namespace nl::network
+{
+    static constexpr int TcpClient_MaxEvents = 256;
+    static constexpr size_t TcpClient_ReceiveBufferSize = 65536;
+    static constexpr size_t TcpClient_MinimumBufferSize = 4096;
+    static constexpr uint32_t TcpClient_TimerResolution = 10; // milliseconds per tick of the timer wheels
+
+    // epoll data of the wake event; everything else is a connection
+    static char TcpClient_WakeTag;
+
+    struct TcpClientWorker;
+    struct TcpClientPool;
+
+    struct TcpClientRequest
+    {
+        TcpClientRequest* prev = nullptr; // links of nl::Queue
+        TcpClientRequest* next = nullptr;
+
+        uint32_t IP = 0;
+        uint16_t Port = 0;
+        nl::memory::Memory Data; // released once copied to a connection
+        size_t Length = 0;
+        TcpResponseHandler Handler;
+        uint64_t Deadline = UINT64_MAX; // TimerWheel::GetTime() the request times out at
+    };
+
+    // Bytes from Offset to Length are pending. Consumed bytes are only moved out of the way when the end runs out
+    // of room, so consuming many small messages from a large buffer costs nothing per message.
+    struct TcpClientBuffer
+    {
+        nl::memory::Memory Storage;
+        size_t Offset = 0;
+        size_t Length = 0;
+
+        char* GetData() { return Storage.Get<char>() + Offset; }
+        size_t GetSize() const { return Length - Offset; }
+
+        void Append(const void* lp, size_t size)
+        {
+            if (Length + size > Storage.GetSize())
+            {
+                if (Offset != 0)
+                {
+                    memmove(Storage.Get<char>(), GetData(), Length - Offset);
+                    Length -= Offset;
+                    Offset = 0;
+                }
+
+                size_t capacity = Storage.GetSize() != 0 ? Storage.GetSize() : TcpClient_MinimumBufferSize;
+                while (capacity < Length + size)
+                    capacity *= 2;
+
+                if (capacity != Storage.GetSize())
+                    Storage.Reallocate(capacity);
+            }
+
+            memcpy(Storage.Get<char>() + Length, lp, size);
+            Length += size;
+        }
+
+        void Consume(size_t size)
+        {
+            Offset += size;
+            if (Offset == Length)
+                Clear();
+        }
+
+        void Clear()
+        {
+            Offset = 0;
+            Length = 0;
+        }
+    };
+
+    struct TcpClientConnection
+    {
+        TcpClientPool* Pool = nullptr;
+        int Socket = -1;
+        uint64_t Serial = 0; // tells the connection's timer whether it still exists
+        bool Connected = false;
+        bool FlushRequested = false; // waiting in the worker's PendingFlushes
+
+        // written in order, so the responses complete them from the head
+        nl::Queue<TcpClientRequest> InFlight;
+        size_t InFlightCount = 0;
+
+        TcpClientBuffer Output;
+        TcpClientBuffer Input; // the start of a response that did not arrive entirely
+
+        uint64_t ConnectDeadline = UINT64_MAX;
+        uint64_t IdleTime = 0; // the last request completed
+
+        nl::threading::TimerId Timer = 0;
+        uint64_t TimerDeadline = UINT64_MAX;
+    };
+
+    // The connections to an endpoint and the requests waiting for one of them. Only touched by its worker; pools are
+    // kept until the worker stops so their timers can refer to them.
+    struct TcpClientPool
+    {
+        TcpClientWorker* Worker = nullptr;
+        uint32_t IP = 0;
+        uint16_t Port = 0;
+
+        nl::Vector<TcpClientConnection*> Connections;
+        nl::Queue<TcpClientRequest> Waiting;
+        size_t WaitingCount = 0;
+
+        nl::threading::TimerId Timer = 0;
+        uint64_t TimerDeadline = UINT64_MAX;
+    };
+
+    struct TcpClientWorker
+    {
+        struct TcpClientState* State = nullptr;
+        pthread_t Thread;
+        bool ThreadStarted = false;
+
+        int Epoll = -1;
+        int WakeEvent = -1;
+        char* ReceiveBuffer = nullptr; // responses that arrive entirely are handed out from here
+
+        nl::threading::TimerWheel Timers { TcpClient_TimerResolution };
+        uint64_t Now = 0; // TimerWheel::GetTime() of the loop
+        uint64_t NextSerial = 1;
+
+        nl::Vector<TcpClientPool*> Pools;
+        nl::Vector<TcpClientConnection*> PendingFlushes; // written at the end of the loop
+
+        // filled by Request on other threads, which signal the wake event
+        nl::threading::ReadWriteLock HandoffLock;
+        nl::Queue<TcpClientRequest> Handoffs;
+        bool Stopping = false;
+
+        ~TcpClientWorker()
+        {
+            if (ReceiveBuffer)
+                nl::memory::Free(ReceiveBuffer);
+
+            if (WakeEvent != -1)
+                close(WakeEvent);
+
+            if (Epoll != -1)
+                close(Epoll);
+        }
+    };
+
+    struct TcpClientState
+    {
+        AsynchronousTcpClient* Client = nullptr;
+        nl::Vector<TcpClientWorker*> Workers;
+        bool Running = false;
+
+        uint32_t MaxConnections = 4;
+        uint32_t MaxPipelinedRequests = 16;
+        uint32_t ConnectTimeout = 5000;
+        uint32_t RequestTimeout = 0;
+        uint32_t IdleTimeout = 60000;
+
+        static uint64_t GetDeadline(uint64_t now, uint32_t timeout)
+        {
+            return timeout != 0 ? now + timeout : UINT64_MAX;
+        }
+
+        static void Complete(TcpClientRequest* request, TcpRequestStatus status, const void* lp = nullptr, size_t size = 0)
+        {
+            request->Handler(status, lp, size);
+            nl::memory::Destroy(request);
+        }
+
+        static void CompleteAll(nl::Queue<TcpClientRequest>& requests, TcpRequestStatus status)
+        {
+            while (auto request = requests.PopHead())
+                Complete(request, status);
+        }
+
+        TcpClientPool* GetPool(TcpClientWorker* worker, uint32_t ip, uint16_t port)
+        {
+            for (auto pool : worker->Pools)
+            {
+                if (pool->IP == ip &&
+                    pool->Port == port)
+                    return pool;
+            }
+
+            worker->Pools.PrepareAdd(1);
+
+            auto pool = nl::memory::ConstructThrow<TcpClientPool>();
+            pool->Worker = worker;
+            pool->IP = ip;
+            pool->Port = port;
+
+            worker->Pools.Add(pool);
+            return pool;
+        }
+
+        // Moves the requests other threads made to the pools of their endpoints; returns true once Stop was called.
+        bool TakeHandoffs(TcpClientWorker* worker)
+        {
+            nl::Queue<TcpClientRequest> requests;
+
+            worker->HandoffLock.AcquireExclusive();
+            while (auto request = worker->Handoffs.PopHead())
+                requests.AddTail(request);
+
+            bool stopping = worker->Stopping;
+            worker->HandoffLock.ReleaseExclusive();
+
+            while (auto request = requests.PopHead())
+            {
+                TcpClientPool* pool;
+                try
+                {
+                    pool = GetPool(worker, request->IP, request->Port);
+                }
+                catch (const Exception&)
+                {
+                    Complete(request, TcpRequestStatus::ConnectFailed);
+                    continue;
+                }
+
+                request->Deadline = GetDeadline(worker->Now, RequestTimeout);
+                pool->Waiting.AddTail(request);
+                ++pool->WaitingCount;
+
+                Dispatch(pool);
+            }
+
+            return stopping;
+        }
+
+        /////////////////////////////////////////////////////
+        // pools
+
+        // Hands the waiting requests to connections: an idle one, a new one while the pool has room, or else the
+        // one with the fewest requests in flight.
+        void Dispatch(TcpClientPool* pool)
+        {
+            while (pool->WaitingCount != 0)
+            {
+                TcpClientConnection* best = nullptr;
+                for (auto connection : pool->Connections)
+                {
+                    if (connection->InFlightCount < MaxPipelinedRequests &&
+                        (!best || connection->InFlightCount < best->InFlightCount))
+                        best = connection;
+                }
+
+                if ((!best || best->InFlightCount != 0) &&
+                    pool->Connections.GetCount() < MaxConnections)
+                {
+                    auto connection = Connect(pool);
+                    if (connection)
+                        best = connection;
+                    else if (pool->Connections.GetCount() == 0)
+                    {
+                        // nothing left that could take the requests
+                        pool->WaitingCount = 0;
+                        CompleteAll(pool->Waiting, TcpRequestStatus::ConnectFailed);
+                        break;
+                    }
+                }
+
+                if (!best)
+                    break;
+
+                auto request = pool->Waiting.PopHead();
+                --pool->WaitingCount;
+
+                Assign(best, request);
+            }
+
+            UpdatePoolTimer(pool);
+        }
+
+        void Assign(TcpClientConnection* connection, TcpClientRequest* request)
+        {
+            auto worker = connection->Pool->Worker;
+
+            try
+            {
+                worker->PendingFlushes.PrepareAdd(1);
+                connection->Output.Append(request->Data.Get(), request->Length);
+            }
+            catch (const Exception&)
+            {
+                Complete(request, TcpRequestStatus::Disconnected);
+                return;
+            }
+
+            request->Data = nl::memory::Memory();
+
+            connection->InFlight.AddTail(request);
+            ++connection->InFlightCount;
+
+            // everything assigned during the loop goes out with one send per connection at its end
+            if (connection->Connected &&
+                !connection->FlushRequested)
+            {
+                worker->PendingFlushes.Add(connection);
+                connection->FlushRequested = true;
+            }
+
+            UpdateTimer(connection);
+        }
+
+        // The timer of a pool fails the waiting requests that timed out.
+        void UpdatePoolTimer(TcpClientPool* pool)
+        {
+            auto head = pool->Waiting.PeekHead();
+            SetTimer(pool->Worker, pool->Timer, pool->TimerDeadline, head ? head->Deadline : UINT64_MAX, [pool]()
+                {
+                    pool->Worker->State->CheckPool(pool);
+                });
+        }
+
+        void CheckPool(TcpClientPool* pool)
+        {
+            pool->Timer = 0;
+            pool->TimerDeadline = UINT64_MAX;
+
+            while (auto head = pool->Waiting.PeekHead())
+            {
+                if (head->Deadline > pool->Worker->Now)
+                    break;
+
+                pool->Waiting.PopHead();
+                --pool->WaitingCount;
+                Complete(head, TcpRequestStatus::TimedOut);
+            }
+
+            UpdatePoolTimer(pool);
+        }
+
+        // Has the timer fire at deadline, or cancels it for UINT64_MAX. A timer due earlier than needed is left
+        // alone and checks again when it fires, so activity only touches the wheel when a deadline moves closer.
+        template <typename T>
+        static void SetTimer(TcpClientWorker* worker, nl::threading::TimerId& timer, uint64_t& timer_deadline, uint64_t deadline, T callback)
+        {
+            if (deadline == UINT64_MAX)
+            {
+                if (timer != 0)
+                {
+                    worker->Timers.Cancel(timer);
+                    timer = 0;
+                    timer_deadline = UINT64_MAX;
+                }
+                return;
+            }
+
+            if (timer != 0 &&
+                timer_deadline <= deadline)
+                return;
+
+            uint32_t delay = deadline > worker->Now ? (uint32_t)(deadline - worker->Now) : 0;
+            if (timer == 0 ||
+                !worker->Timers.Reschedule(timer, delay))
+                timer = worker->Timers.Schedule(delay, callback);
+
+            timer_deadline = deadline;
+        }
+
+        /////////////////////////////////////////////////////
+        // connections
+
+        // Starts connecting to the pool's endpoint; returns nullptr if that failed right away.
+        TcpClientConnection* Connect(TcpClientPool* pool)
+        {
+            auto worker = pool->Worker;
+
+            int s = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+            if (s == -1)
+                return nullptr;
+
+            int nodelay = 1;
+            setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+            auto connection = nl::memory::Construct<TcpClientConnection>();
+            if (!connection)
+            {
+                close(s);
+                return nullptr;
+            }
+
+            connection->Pool = pool;
+            connection->Socket = s;
+            connection->Serial = worker->NextSerial++;
+            connection->ConnectDeadline = GetDeadline(worker->Now, ConnectTimeout);
+            connection->IdleTime = worker->Now;
+
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = pool->IP;
+            addr.sin_port = htons(pool->Port);
+
+            int result = connect(s, (const sockaddr*)&addr, sizeof(addr));
+            if (result == 0)
+                connection->Connected = true;
+
+            epoll_event ev = {};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            ev.data.ptr = connection;
+
+            try
+            {
+                if ((result == -1 && errno != EINPROGRESS) ||
+                    epoll_ctl(worker->Epoll, EPOLL_CTL_ADD, s, &ev) == -1)
+                    throw SocketException("Failed to connect.", errno);
+
+                pool->Connections.Add(connection);
+            }
+            catch (const Exception&)
+            {
+                close(s);
+                nl::memory::Destroy(connection);
+                return nullptr;
+            }
+
+            UpdateTimer(connection);
+            return connection;
+        }
+
+        // One timer per connection covers the connect timeout, the timeout of the oldest request in flight and the
+        // idle timeout.
+        void UpdateTimer(TcpClientConnection* connection)
+        {
+            uint64_t deadline = UINT64_MAX;
+            if (!connection->Connected)
+                deadline = connection->ConnectDeadline;
+
+            if (connection->InFlightCount != 0)
+            {
+                uint64_t oldest = connection->InFlight.PeekHead()->Deadline;
+                if (oldest < deadline)
+                    deadline = oldest;
+            }
+            else if (connection->Connected)
+            {
+                deadline = GetDeadline(connection->IdleTime, IdleTimeout);
+            }
+
+            auto pool = connection->Pool;
+            uint64_t serial = connection->Serial;
+
+            // the pool and the serial fit in std::function without an allocation
+            SetTimer(pool->Worker, connection->Timer, connection->TimerDeadline, deadline, [pool, serial]()
+                {
+                    pool->Worker->State->CheckConnection(pool, serial);
+                });
+        }
+
+        void CheckConnection(TcpClientPool* pool, uint64_t serial)
+        {
+            TcpClientConnection* connection = nullptr;
+            for (auto candidate : pool->Connections)
+            {
+                if (candidate->Serial == serial)
+                {
+                    connection = candidate;
+                    break;
+                }
+            }
+
+            if (!connection)
+                return;
+
+            connection->Timer = 0;
+            connection->TimerDeadline = UINT64_MAX;
+
+            uint64_t now = pool->Worker->Now;
+
+            if (!connection->Connected &&
+                connection->ConnectDeadline <= now)
+            {
+                CloseConnection(connection, TcpRequestStatus::ConnectFailed);
+                return;
+            }
+
+            if (connection->InFlightCount != 0 &&
+                connection->InFlight.PeekHead()->Deadline <= now)
+            {
+                --connection->InFlightCount;
+                Complete(connection->InFlight.PopHead(), TcpRequestStatus::TimedOut);
+                CloseConnection(connection, TcpRequestStatus::Disconnected);
+                return;
+            }
+
+            if (connection->Connected &&
+                connection->InFlightCount == 0 &&
+                GetDeadline(connection->IdleTime, IdleTimeout) <= now)
+            {
+                CloseConnection(connection, TcpRequestStatus::Disconnected);
+                return;
+            }
+
+            UpdateTimer(connection);
+        }
+
+        // Fails the requests in flight with status and lets the pool replace the connection for the waiting ones.
+        void CloseConnection(TcpClientConnection* connection, TcpRequestStatus status)
+        {
+            auto pool = connection->Pool;
+            auto worker = pool->Worker;
+
+            for (size_t i = 0; i < pool->Connections.GetCount(); ++i)
+            {
+                if (pool->Connections[i] == connection)
+                {
+                    pool->Connections[i] = pool->Connections[pool->Connections.GetCount() - 1];
+                    pool->Connections.PopLast();
+                    break;
+                }
+            }
+
+            if (connection->FlushRequested)
+            {
+                auto& pending = worker->PendingFlushes;
+                size_t index = pending.Find(connection);
+                pending[index] = pending[pending.GetCount() - 1];
+                pending.PopLast();
+            }
+
+            if (connection->Timer != 0)
+                worker->Timers.Cancel(connection->Timer);
+
+            close(connection->Socket);
+
+            CompleteAll(connection->InFlight, status);
+            nl::memory::Destroy(connection);
+
+            if (pool->WaitingCount == 0)
+                return;
+
+            if (status == TcpRequestStatus::ConnectFailed &&
+                pool->Connections.GetCount() == 0)
+            {
+                // the endpoint is unreachable rather than the connection broken
+                pool->WaitingCount = 0;
+                CompleteAll(pool->Waiting, TcpRequestStatus::ConnectFailed);
+                UpdatePoolTimer(pool);
+                return;
+            }
+
+            Dispatch(pool);
+        }
+
+        // Writes the output until the socket would block.
+        static void Flush(TcpClientConnection* connection)
+        {
+            while (connection->Output.GetSize() != 0)
+            {
+                ssize_t sent = send(connection->Socket, connection->Output.GetData(), connection->Output.GetSize(), MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (sent > 0)
+                {
+                    connection->Output.Consume((size_t)sent);
+                    continue;
+                }
+
+                if (sent == -1 &&
+                    errno == EINTR)
+                    continue;
+
+                if (sent == -1 &&
+                    (errno == EAGAIN || errno == EWOULDBLOCK))
+                    return;
+
+                // the worker notices the broken connection through the hang up and closes it
+                shutdown(connection->Socket, SHUT_RDWR);
+                connection->Output.Clear();
+                return;
+            }
+        }
+
+        void FlushPending(TcpClientWorker* worker)
+        {
+            for (auto connection : worker->PendingFlushes)
+            {
+                connection->FlushRequested = false;
+                Flush(connection);
+            }
+
+            worker->PendingFlushes.Clear();
+        }
+
+        // Completes the requests in flight with the responses in data; a response that only started is kept in the
+        // input buffer, which is the only time data is copied. Returns false if the data is not a valid response.
+        bool Deliver(TcpClientConnection* connection, const char* data, size_t size)
+        {
+            bool buffered = connection->Input.GetSize() != 0;
+            if (buffered)
+            {
+                connection->Input.Append(data, size);
+                data = connection->Input.GetData();
+                size = connection->Input.GetSize();
+            }
+
+            size_t used = 0;
+            bool valid = true;
+
+            while (used < size)
+            {
+                size_t length = Client->GetResponseLength(data + used, size - used);
+                if (length == SIZE_MAX ||
+                    (length != 0 && connection->InFlightCount == 0))
+                {
+                    valid = false;
+                    break;
+                }
+
+                if (length == 0 ||
+                    length > size - used)
+                    break;
+
+                --connection->InFlightCount;
+                Complete(connection->InFlight.PopHead(), TcpRequestStatus::Success, data + used, length);
+                used += length;
+            }
+
+            if (buffered)
+                connection->Input.Consume(used);
+            else if (valid && used < size)
+                connection->Input.Append(data + used, size - used);
+
+            return valid;
+        }
+
+        // Returns false if the connection was closed.
+        bool Receive(TcpClientConnection* connection)
+        {
+            auto worker = connection->Pool->Worker;
+            size_t completed = connection->InFlightCount;
+
+            // edge triggered, so the socket is drained until it would block
+            for (;;)
+            {
+                ssize_t received = recv(connection->Socket, worker->ReceiveBuffer, TcpClient_ReceiveBufferSize, 0);
+                if (received > 0)
+                {
+                    bool valid;
+                    try
+                    {
+                        valid = Deliver(connection, worker->ReceiveBuffer, (size_t)received);
+                    }
+                    catch (const Exception&)
+                    {
+                        valid = false; // no room for the rest of a response
+                    }
+
+                    if (!valid)
+                        break;
+
+                    continue;
+                }
+
+                if (received == -1)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    if (errno == EAGAIN ||
+                        errno == EWOULDBLOCK)
+                    {
+                        if (connection->InFlightCount != completed)
+                            OnCompleted(connection);
+
+                        return true;
+                    }
+                }
+
+                break;
+            }
+
+            CloseConnection(connection, TcpRequestStatus::Disconnected);
+            return false;
+        }
+
+        // Responses made room on the connection for waiting requests.
+        void OnCompleted(TcpClientConnection* connection)
+        {
+            if (connection->InFlightCount == 0)
+                connection->IdleTime = connection->Pool->Worker->Now;
+
+            UpdateTimer(connection);
+
+            if (connection->Pool->WaitingCount != 0)
+                Dispatch(connection->Pool);
+        }
+
+        // Returns false if the connection failed and was closed.
+        bool OnConnected(TcpClientConnection* connection)
+        {
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(connection->Socket, SOL_SOCKET, SO_ERROR, &error, &length) == -1 ||
+                error != 0)
+            {
+                CloseConnection(connection, TcpRequestStatus::ConnectFailed);
+                return false;
+            }
+
+            connection->Connected = true;
+            connection->IdleTime = connection->Pool->Worker->Now;
+            UpdateTimer(connection);
+            return true;
+        }
+
+        void Run(TcpClientWorker* worker)
+        {
+            epoll_event events[TcpClient_MaxEvents];
+            bool stopping = false;
+
+            worker->Now = nl::threading::TimerWheel::GetTime();
+
+            while (!stopping)
+            {
+                // the wait ends in time for the next timer
+                int wait = -1;
+                uint32_t timeout = worker->Timers.GetNextTimeout();
+                if (timeout != nl::threading::Event::Infinite)
+                    wait = timeout < INT32_MAX ? (int)timeout : INT32_MAX;
+
+                int count = epoll_wait(worker->Epoll, events, TcpClient_MaxEvents, wait);
+                if (count == -1)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    break;
+                }
+
+                worker->Now = nl::threading::TimerWheel::GetTime();
+
+                for (int i = 0; i < count; ++i)
+                {
+                    void* tag = events[i].data.ptr;
+                    uint32_t flags = events[i].events;
+
+                    if (tag == &TcpClient_WakeTag)
+                    {
+                        uint64_t value;
+                        (void)!read(worker->WakeEvent, &value, sizeof(value));
+
+                        stopping = TakeHandoffs(worker);
+                        continue;
+                    }
+
+                    auto connection = static_cast<TcpClientConnection*>(tag);
+
+                    if (!connection->Connected)
+                    {
+                        if ((flags & (EPOLLOUT | EPOLLERR | EPOLLHUP)) == 0 ||
+                            !OnConnected(connection))
+                            continue;
+                    }
+
+                    if (flags & EPOLLOUT)
+                        Flush(connection);
+
+                    if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                        Receive(connection);
+                }
+
+                worker->Now = nl::threading::TimerWheel::GetTime();
+                worker->Timers.Advance();
+
+                FlushPending(worker);
+            }
+
+            Shutdown(worker);
+        }
+
+        // Fails everything the worker still has and closes its connections.
+        void Shutdown(TcpClientWorker* worker)
+        {
+            nl::Queue<TcpClientRequest> requests;
+
+            worker->HandoffLock.AcquireExclusive();
+            while (auto request = worker->Handoffs.PopHead())
+                requests.AddTail(request);
+            worker->HandoffLock.ReleaseExclusive();
+
+            CompleteAll(requests, TcpRequestStatus::Stopped);
+
+            for (auto pool : worker->Pools)
+            {
+                for (auto connection : pool->Connections)
+                {
+                    close(connection->Socket);
+                    CompleteAll(connection->InFlight, TcpRequestStatus::Stopped);
+                    nl::memory::Destroy(connection);
+                }
+
+                CompleteAll(pool->Waiting, TcpRequestStatus::Stopped);
+                nl::memory::Destroy(pool);
+            }
+
+            worker->Pools.Clear();
+            worker->PendingFlushes.Clear();
+        }
+    };
+
+    static void* _TcpClientWorkerThread(void* lp)
+    {
+        auto worker = static_cast<TcpClientWorker*>(lp);
+        worker->State->Run(worker);
+        return nullptr;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    //////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    //////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    AsynchronousTcpClient::AsynchronousTcpClient()
+    {
+        m_state = nl::memory::ConstructThrow<TcpClientState>();
+        m_state->Client = this;
+    }
+
+    AsynchronousTcpClient::~AsynchronousTcpClient()
+    {
+        if (m_state->Running)
+            Stop();
+
+        nl::memory::Destroy(m_state);
+    }
+
+    void AsynchronousTcpClient::Start(int32_t thread_count)
+    {
+        if (m_state->Running)
+            throw InvalidOperationException("Client already started");
+
+        if (thread_count <= 0)
+            thread_count = nl::threading::ThreadPool::GetProcessorCount();
+
+        auto state = m_state;
+
+        try
+        {
+            for (int32_t i = 0; i < thread_count; ++i)
+            {
+                auto worker = nl::memory::ConstructThrow<TcpClientWorker>();
+                state->Workers.Add(worker);
+
+                worker->State = state;
+
+                worker->ReceiveBuffer = static_cast<char*>(nl::memory::Allocate(TcpClient_ReceiveBufferSize));
+                if (!worker->ReceiveBuffer)
+                    throw BadAllocationException();
+
+                worker->WakeEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (worker->WakeEvent == -1)
+                    throw SocketException("Failed to create the wake event of a worker.", errno);
+
+                worker->Epoll = epoll_create1(EPOLL_CLOEXEC);
+                if (worker->Epoll == -1)
+                    throw SocketException("Failed to create the epoll instance of a worker.", errno);
+
+                epoll_event ev = {};
+                ev.events = EPOLLIN;
+                ev.data.ptr = &TcpClient_WakeTag;
+                if (epoll_ctl(worker->Epoll, EPOLL_CTL_ADD, worker->WakeEvent, &ev) == -1)
+                    throw SocketException("Failed to add the wake event to epoll.", errno);
+            }
+
+            for (auto worker : state->Workers)
+            {
+                if (pthread_create(&worker->Thread, nullptr, _TcpClientWorkerThread, worker) != 0)
+                    throw InvalidOperationException("Failed to create client worker thread.");
+
+                worker->ThreadStarted = true;
+            }
+        }
+        catch (...)
+        {
+            state->Running = true;
+            Stop();
+            throw;
+        }
+
+        state->Running = true;
+    }
+
+    void AsynchronousTcpClient::Stop()
+    {
+        if (!m_state->Running)
+            throw InvalidOperationException("Client is not running");
+
+        auto state = m_state;
+
+        for (auto worker : state->Workers)
+        {
+            worker->HandoffLock.AcquireExclusive();
+            worker->Stopping = true;
+            worker->HandoffLock.ReleaseExclusive();
+
+            uint64_t value = 1;
+            if (worker->WakeEvent != -1)
+                (void)!write(worker->WakeEvent, &value, sizeof(value));
+        }
+
+        for (auto worker : state->Workers)
+        {
+            if (worker->ThreadStarted)
+                pthread_join(worker->Thread, nullptr);
+
+            nl::memory::Destroy(worker);
+        }
+
+        state->Workers.Clear();
+        state->Running = false;
+    }
+
+    void AsynchronousTcpClient::Request(uint32_t ip, uint16_t port, const void* lp, size_t len, TcpResponseHandler handler)
+    {
+        if (!handler)
+            throw ArgumentException("A request needs a response handler.");
+
+        if (len == 0)
+            throw ArgumentException("A request cannot be empty.");
+
+        if (!m_state->Running)
+            throw InvalidOperationException("Client is not running");
+
+        auto request = nl::memory::ConstructThrow<TcpClientRequest>();
+        request->IP = ip;
+        request->Port = port;
+        request->Length = len;
+        request->Handler = std::move(handler);
+
+        try
+        {
+            request->Data = nl::memory::Memory::Allocate(len);
+        }
+        catch (...)
+        {
+            nl::memory::Destroy(request);
+            throw;
+        }
+
+        memcpy(request->Data.Get(), lp, len);
+
+        // every endpoint belongs to one worker, which keeps its pool to itself
+        auto& workers = m_state->Workers;
+        auto worker = workers[(((size_t)ip * 2654435761u) ^ port) % workers.GetCount()];
+
+        worker->HandoffLock.AcquireExclusive();
+        if (worker->Stopping)
+        {
+            worker->HandoffLock.ReleaseExclusive();
+            nl::memory::Destroy(request);
+            throw InvalidOperationException("Client is not running");
+        }
+
+        worker->Handoffs.AddTail(request);
+        worker->HandoffLock.ReleaseExclusive();
+
+        uint64_t value = 1;
+        (void)!write(worker->WakeEvent, &value, sizeof(value));
+    }
+
+    void AsynchronousTcpClient::SetPoolLimits(uint32_t max_connections, uint32_t max_pipelined_requests)
+    {
+        if (max_connections == 0 ||
+            max_pipelined_requests == 0)
+            throw ArgumentException("The pool limits must be at least one.");
+
+        if (m_state->Running)
+            throw InvalidOperationException("The pool limits cannot be changed while the client is running.");
+
+        m_state->MaxConnections = max_connections;
+        m_state->MaxPipelinedRequests = max_pipelined_requests;
+    }
+
+    void AsynchronousTcpClient::SetTimeouts(uint32_t connect_timeout, uint32_t request_timeout, uint32_t idle_timeout)
+    {
+        if (m_state->Running)
+            throw InvalidOperationException("The timeouts cannot be changed while the client is running.");
+
+        m_state->ConnectTimeout = connect_timeout;
+        m_state->RequestTimeout = request_timeout;
+        m_state->IdleTimeout = idle_timeout;
+    }
+
+    size_t AsynchronousTcpClient::GetResponseLength(const void* data, size_t size)
+    {
+        if (size < sizeof(uint32_t))
+            return 0;
+
+        uint32_t length;
+        memcpy(&length, data, sizeof(length));
+        return (size_t)length + sizeof(length);
+    }
+}
+
+#endif
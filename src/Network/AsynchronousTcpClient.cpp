@@ -1,3 +1,74 @@
 #include "StdAfx.h"
 
-#include <NativeLib/Network/AsynchronousTcpClient.h>
\ No newline at end of file
+#include <NativeLib/Network/AsynchronousTcpClient.h>
+#include <NativeLib/Platform/Platform.h>
+#include <NativeLib/Allocators.h>
+
+#ifdef NL_PLATFORM_WINDOWS
+
+namespace nl::network
+{
+    // The Windows client is not written yet; it is expected to run on I/O completion ports like the server.
+    struct TcpClientState
+    {
+        uint32_t MaxConnections = 4;
+        uint32_t MaxPipelinedRequests = 16;
+        uint32_t ConnectTimeout = 5000;
+        uint32_t RequestTimeout = 0;
+        uint32_t IdleTimeout = 60000;
+    };
+
+    AsynchronousTcpClient::AsynchronousTcpClient()
+    {
+        m_state = nl::memory::ConstructThrow<TcpClientState>();
+    }
+
+    AsynchronousTcpClient::~AsynchronousTcpClient()
+    {
+        nl::memory::Destroy(m_state);
+    }
+
+    void AsynchronousTcpClient::Start(int32_t thread_count)
+    {
+        throw NotImplementedException();
+    }
+
+    void AsynchronousTcpClient::Stop()
+    {
+        throw InvalidOperationException("Client is not running");
+    }
+
+    void AsynchronousTcpClient::Request(uint32_t ip, uint16_t port, const void* lp, size_t len, TcpResponseHandler handler)
+    {
+        throw InvalidOperationException("Client is not running");
+    }
+
+    void AsynchronousTcpClient::SetPoolLimits(uint32_t max_connections, uint32_t max_pipelined_requests)
+    {
+        if (max_connections == 0 ||
+            max_pipelined_requests == 0)
+            throw ArgumentException("The pool limits must be at least one.");
+
+        m_state->MaxConnections = max_connections;
+        m_state->MaxPipelinedRequests = max_pipelined_requests;
+    }
+
+    void AsynchronousTcpClient::SetTimeouts(uint32_t connect_timeout, uint32_t request_timeout, uint32_t idle_timeout)
+    {
+        m_state->ConnectTimeout = connect_timeout;
+        m_state->RequestTimeout = request_timeout;
+        m_state->IdleTimeout = idle_timeout;
+    }
+
+    size_t AsynchronousTcpClient::GetResponseLength(const void* data, size_t size)
+    {
+        if (size < sizeof(uint32_t))
+            return 0;
+
+        uint32_t length;
+        memcpy(&length, data, sizeof(length));
+        return (size_t)length + sizeof(length);
+    }
+}
+
+#endif
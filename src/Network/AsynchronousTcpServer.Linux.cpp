@@ -0,0 +1,2302 @@
+#include "StdAfx.h"
+
+#include <NativeLib/Network/AsynchronousTcpServer.h>
+#include <NativeLib/Platform/Platform.h>
+#include <NativeLib/Threading/ReadWriteLock.h>
+#include <NativeLib/Threading/Interlocked.h>
+#include <NativeLib/Threading/ThreadPool.h>
+#include <NativeLib/Threading/TimerWheel.h>
+#include <NativeLib/Threading/Event.h>
+#include <NativeLib/Exceptions.h>
+#include <NativeLib/Allocators.h>
+#include <NativeLib/Util.h>
+
+#ifdef NL_PLATFORM_LINUX
+
+//!ALLOW_INCLUDE "sys/epoll.h"
+//!ALLOW_INCLUDE "sys/eventfd.h"
+//!ALLOW_INCLUDE "sys/socket.h"
+//!ALLOW_INCLUDE "netinet/in.h"
+//!ALLOW_INCLUDE "netinet/tcp.h"
+//!ALLOW_INCLUDE "arpa/inet.h"
+//!ALLOW_INCLUDE "pthread.h"
+//!ALLOW_INCLUDE "sys/uio.h"
+//!ALLOW_INCLUDE "unistd.h"
+//!ALLOW_INCLUDE "IO/IoUring.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "IO/IoUring.h"
+
+#ifdef NL_HAS_IO_URING
+//!ALLOW_INCLUDE "sys/mman.h"
+#include <sys/mman.h>
+#endif
+
+namespace nl::network
+{
+    static constexpr int TcpServer_MaxEvents = 256;
+    static constexpr size_t TcpServer_ReceiveBufferSize = 65536;
+    static constexpr size_t TcpServer_SendChunkSize = 16384;
+    static constexpr int TcpServer_MaxSendSegments = 64; // iovecs per writev
+    static constexpr uint32_t TcpServer_TimerResolution = 10; // milliseconds per tick of the timeout wheels
+
+    // A DPID is the client's slot in the table plus one in the low bits and the slot's generation above them, so an
+    // ID kept after its client left never matches the next client in the same slot.
+#ifdef NL_ARCHITECTURE_X64
+    static constexpr int TcpServer_SlotBits = 32;
+#else
+    static constexpr int TcpServer_SlotBits = 20; // a million clients, 4096 generations per slot
+#endif
+    static constexpr DPID TcpServer_SlotMask = ((DPID)1 << TcpServer_SlotBits) - 1;
+    static constexpr uint32_t TcpServer_GenerationMask = (uint32_t)(~(DPID)0 >> TcpServer_SlotBits);
+
+    // epoll data of the two descriptors every worker has besides its clients
+    static char TcpServer_ListenerTag;
+    static char TcpServer_WakeTag;
+
+#ifdef NL_HAS_IO_URING
+    static constexpr uint32_t TcpServer_RingEntries = 512;
+    static constexpr uint32_t TcpServer_ProvidedBufferCount = 256; // power of two, as the buffer ring requires
+    static constexpr size_t TcpServer_ProvidedBufferSize = 16384;
+    static constexpr uint16_t TcpServer_BufferGroup = 0;
+
+    // user_data of the requests not tied to a client; a client's requests carry its address with the kind in the
+    // low bits, which can never collide with these
+    static constexpr uint64_t TcpServer_AcceptData = 1;
+    static constexpr uint64_t TcpServer_WakeData = 2;
+    static constexpr uint64_t TcpServer_CancelData = 3;
+    static constexpr uint64_t TcpServer_ProvideData = 4;
+    static constexpr uint64_t TcpServer_TimeoutData = 5;
+
+    static constexpr uint64_t TcpServer_ReceiveKind = 0;
+    static constexpr uint64_t TcpServer_SendKind = 1;
+    static constexpr uint64_t TcpServer_KindMask = 7;
+#endif
+
+    struct TcpServerWorker;
+
+    // the worker running on the calling thread, if any
+    static thread_local TcpServerWorker* TcpServer_CurrentWorker = nullptr;
+
+    // Data broadcast to several clients, held once by the send queue of every one of them.
+    struct TcpServerSharedPayload
+    {
+        volatile int32_t References = 1; // queues of different workers drop theirs concurrently
+        const char* Data = nullptr;
+        size_t Length = 0;
+        nl::memory::Memory Storage; // empty when the caller's buffer is referenced
+        SendReleaseCallback Release;
+
+        static TcpServerSharedPayload* Create(const char* p, size_t size)
+        {
+            return Create(nullptr, 0, p, size);
+        }
+
+        static TcpServerSharedPayload* Create(const char* prefix, size_t prefix_size, const char* p, size_t size)
+        {
+            auto payload = nl::memory::ConstructThrow<TcpServerSharedPayload>();
+            try
+            {
+                payload->Storage = nl::memory::Memory::Allocate(prefix_size + size);
+            }
+            catch (...)
+            {
+                nl::memory::Destroy(payload);
+                throw;
+            }
+
+            if (prefix_size != 0)
+                memcpy(payload->Storage.Get(), prefix, prefix_size);
+
+            if (size != 0)
+                memcpy(payload->Storage.Get<char>() + prefix_size, p, size);
+
+            payload->Data = payload->Storage.Get<char>();
+            payload->Length = prefix_size + size;
+            return payload;
+        }
+
+        void AddReference()
+        {
+            nl::threading::Interlocked::Increment(&References);
+        }
+
+        // Frees the payload with the last reference; calls the release callback, so no send lock may be held.
+        void RemoveReference()
+        {
+            if (nl::threading::Interlocked::Decrement(&References) != 0)
+                return;
+
+            if (Release)
+                Release();
+
+            nl::memory::Destroy(this);
+        }
+    };
+
+    // Part of a send queue: a buffer small sends are copied into, a caller's buffer held by reference or a shared
+    // broadcast payload.
+    struct TcpServerSendChunk
+    {
+        TcpServerSendChunk* Next = nullptr;
+        const char* Data = nullptr;
+        size_t Offset = 0; // bytes already sent
+        size_t Length = 0;
+        nl::memory::Memory Storage; // empty for a referenced buffer
+        SendReleaseCallback Release;
+        TcpServerSharedPayload* Shared = nullptr;
+    };
+
+    struct TcpServerSendQueue
+    {
+        TcpServerSendChunk* Head = nullptr;
+        TcpServerSendChunk* Tail = nullptr;
+        TcpServerSendChunk* Spare = nullptr; // the last emptied copy chunk, reused by the next one
+        size_t Length = 0; // bytes not sent yet
+
+        ~TcpServerSendQueue()
+        {
+            TcpServerSendChunk* released = nullptr;
+            Clear(released);
+            Free(released);
+
+            if (Spare)
+                nl::memory::Destroy(Spare);
+        }
+
+        void Link(TcpServerSendChunk* chunk)
+        {
+            if (Tail)
+                Tail->Next = chunk;
+            else
+                Head = chunk;
+
+            Tail = chunk;
+        }
+
+        // Copies the data behind what the tail chunk already holds, so runs of small sends end up contiguous.
+        void Append(const char* p, size_t size)
+        {
+            Append(nullptr, 0, p, size);
+        }
+
+        // Appends prefix and data as one piece, so either both are queued or neither is.
+        void Append(const char* prefix, size_t prefix_size, const char* p, size_t data_size)
+        {
+            size_t size = prefix_size + data_size;
+
+            size_t room = 0;
+            if (Tail &&
+                Tail->Storage.GetSize() != 0)
+                room = Tail->Storage.GetSize() - Tail->Length;
+
+            // the new chunk is allocated first so a failure leaves the queue as it was
+            TcpServerSendChunk* chunk = nullptr;
+            if (size > room)
+            {
+                size_t needed = size - room;
+                if (Spare &&
+                    needed <= Spare->Storage.GetSize())
+                {
+                    chunk = Spare;
+                    Spare = nullptr;
+                }
+                else
+                {
+                    chunk = nl::memory::ConstructThrow<TcpServerSendChunk>();
+                    try
+                    {
+                        chunk->Storage = nl::memory::Memory::Allocate(nl::util::Max(needed, TcpServer_SendChunkSize));
+                    }
+                    catch (...)
+                    {
+                        nl::memory::Destroy(chunk);
+                        throw;
+                    }
+                }
+
+                chunk->Data = chunk->Storage.Get<char>();
+            }
+
+            size_t count = nl::util::Min(size, room);
+            if (count != 0)
+            {
+                Copy(Tail->Storage.Get<char>() + Tail->Length, prefix, prefix_size, p, 0, count);
+                Tail->Length += count;
+            }
+
+            if (chunk)
+            {
+                Copy(chunk->Storage.Get<char>(), prefix, prefix_size, p, count, size - count);
+                chunk->Length = size - count;
+                Link(chunk);
+            }
+
+            Length += size;
+        }
+
+        // Copies count bytes from offset of prefix and p joined together.
+        static void Copy(char* dst, const char* prefix, size_t prefix_size, const char* p, size_t offset, size_t count)
+        {
+            if (offset < prefix_size)
+            {
+                size_t part = nl::util::Min(count, prefix_size - offset);
+                memcpy(dst, prefix + offset, part);
+                dst += part;
+                offset += part;
+                count -= part;
+            }
+
+            if (count != 0)
+                memcpy(dst, p + (offset - prefix_size), count);
+        }
+
+        void AppendReference(const char* p, size_t size, TcpServerSendChunk* chunk)
+        {
+            chunk->Data = p;
+            chunk->Length = size;
+            Link(chunk);
+            Length += size;
+        }
+
+        // Describes the front of the queue in at most count segments and returns the number used.
+        int Gather(iovec* segments, int count) const
+        {
+            int used = 0;
+            for (auto chunk = Head; chunk && used < count; chunk = chunk->Next)
+            {
+                segments[used].iov_base = const_cast<char*>(chunk->Data + chunk->Offset);
+                segments[used].iov_len = chunk->Length - chunk->Offset;
+                ++used;
+            }
+
+            return used;
+        }
+
+        // Drops sent bytes from the front. Referenced chunks that are done go to released, whose callbacks have to
+        // run once the send lock is no longer held.
+        void Consume(size_t size, TcpServerSendChunk*& released)
+        {
+            Length -= size;
+
+            while (size != 0)
+            {
+                auto chunk = Head;
+                size_t count = nl::util::Min(size, chunk->Length - chunk->Offset);
+                chunk->Offset += count;
+                size -= count;
+
+                if (chunk->Offset == chunk->Length)
+                {
+                    Head = chunk->Next;
+                    if (!Head)
+                        Tail = nullptr;
+
+                    Recycle(chunk, released);
+                }
+            }
+        }
+
+        void Clear(TcpServerSendChunk*& released)
+        {
+            while (Head)
+            {
+                auto chunk = Head;
+                Head = chunk->Next;
+                Recycle(chunk, released);
+            }
+
+            Tail = nullptr;
+            Length = 0;
+        }
+
+        void Recycle(TcpServerSendChunk* chunk, TcpServerSendChunk*& released)
+        {
+            if (chunk->Release ||
+                chunk->Shared)
+            {
+                chunk->Next = released;
+                released = chunk;
+                return;
+            }
+
+            if (!Spare &&
+                chunk->Storage.GetSize() == TcpServer_SendChunkSize)
+            {
+                chunk->Next = nullptr;
+                chunk->Offset = 0;
+                chunk->Length = 0;
+                Spare = chunk;
+                return;
+            }
+
+            nl::memory::Destroy(chunk);
+        }
+
+        // Calls the release callbacks of chunks given up by Consume or Clear.
+        static void Free(TcpServerSendChunk* released)
+        {
+            while (released)
+            {
+                auto chunk = released;
+                released = chunk->Next;
+
+                if (chunk->Shared)
+                    chunk->Shared->RemoveReference();
+                else
+                    chunk->Release();
+
+                nl::memory::Destroy(chunk);
+            }
+        }
+    };
+
+    // What a change of a send queue calls for once the send lock is released.
+    struct TcpServerSendResult
+    {
+        TcpServerSendChunk* Released = nullptr;
+        bool Completed = false;
+        bool Full = false;
+        bool Drained = false;
+    };
+
+    // Fixed size receive buffers carved from slabs allocated as needed. Buffers are lent out only while received
+    // data waits to be delivered, so the memory follows the traffic of a worker and not its number of connections.
+    // Only used by its worker, so there is no locking.
+    struct TcpServerBufferPool
+    {
+        size_t BlockSize = 0;
+        size_t BlocksPerSlab = 0;
+        nl::Vector<nl::memory::Memory> Slabs;
+        nl::Vector<char*> Available;
+
+        void Initialize(size_t block_size, size_t blocks_per_slab)
+        {
+            BlockSize = block_size;
+            BlocksPerSlab = blocks_per_slab;
+            Grow();
+        }
+
+        void Grow()
+        {
+            auto slab = nl::memory::Memory::Allocate(BlockSize * BlocksPerSlab);
+            Available.Reserve((Slabs.GetCount() + 1) * BlocksPerSlab); // Return never has to allocate
+            Slabs.Add(std::move(slab));
+
+            char* p = Slabs[Slabs.GetCount() - 1].Get<char>();
+            for (size_t i = 0; i < BlocksPerSlab; ++i)
+                Available.Add(p + i * BlockSize);
+        }
+
+        char* Lend()
+        {
+            if (Available.GetCount() == 0)
+                Grow();
+
+            return Available.PopLast();
+        }
+
+        void Return(char* block)
+        {
+            Available.Add(block);
+        }
+    };
+
+    struct TcpServerClient
+    {
+        int Socket = -1;
+        DPID Dpid = 0;
+        uint32_t IP = 0; // network byte order
+        TcpServerWorker* Worker = nullptr;
+
+        // Send appends to the queue from any thread; the worker writes it
+        nl::threading::ReadWriteLock SendLock;
+        TcpServerSendQueue Queue;
+        bool FlushRequested = false; // waiting in the worker's PendingSends or hand-off list
+        bool SendBufferFull = false;
+
+        // connection timeouts; only touched by the worker, the timer checks the times when it fires
+        nl::threading::TimerId Timer = 0;
+        uint64_t ReceiveTime = 0; // data last arrived
+        uint64_t SendTime = 0; // a write started waiting for the client or made progress
+        bool Writing = false; // the last write would block (epoll) or a send is in flight (io_uring)
+
+        FrameDecoder* Frames = nullptr; // while framing is enabled; only touched by the worker
+
+#ifdef NL_HAS_IO_URING
+        // io_uring: the front of the queue stays put while the kernel sends it
+        struct TcpServerSendRequest* Sending = nullptr;
+
+        uint32_t Operations = 0; // requests the kernel still holds; the client is freed after the last one
+        bool Closing = false;
+#endif
+
+        ~TcpServerClient()
+        {
+            if (Frames)
+                nl::memory::Destroy(Frames);
+        }
+    };
+
+#ifdef NL_HAS_IO_URING
+    // Describes the front of a send queue to the kernel; lent to a client while its send is in flight.
+    struct TcpServerSendRequest
+    {
+        msghdr Message;
+        iovec Segments[TcpServer_MaxSendSegments];
+    };
+#endif
+
+    struct TcpServerSlot
+    {
+        TcpServerClient* Client = nullptr; // null while the slot is free
+        uint32_t Generation = 0;
+    };
+
+    struct TcpServerWorker
+    {
+        struct TcpServerState* State = nullptr;
+        pthread_t Thread;
+        bool ThreadStarted = false;
+
+        int Epoll = -1;
+        int Listener = -1;
+        int WakeEvent = -1;
+        TcpServerBufferPool ReceivePool;
+
+        // the connection timeouts of the worker's clients, advanced by its loop
+        nl::threading::TimerWheel Timers { TcpServer_TimerResolution };
+        uint64_t Now = 0; // TimerWheel::GetTime() of the loop, updated while timeouts are enabled
+
+#ifdef NL_HAS_IO_URING
+        nl::io::IoUring Ring;
+        io_uring_buf_ring* BufferRing = nullptr;
+        nl::Vector<char*> ProvidedBuffers; // pool buffers lent to the kernel, by buffer ID
+        nl::Vector<TcpServerSendRequest*> SendRequests; // free ones
+        size_t SendRequestCount = 0;
+        uint16_t BufferTail = 0; // published to the kernel once per loop
+        bool LegacyBuffers = false; // no buffer ring, buffers go back through IORING_OP_PROVIDE_BUFFERS
+        nl::Vector<uint16_t> ReturnedBuffers;
+        uint32_t Outstanding = 0; // requests not completed for good
+        uint64_t WakeValue = 0;
+        bool AcceptArmed = false;
+        bool WakeArmed = false;
+        __kernel_timespec TimeoutSpec; // read by the kernel when the timeout is submitted
+        uint64_t TimeoutDeadline = 0; // when the armed timeout ends
+        bool TimeoutArmed = false;
+        bool Draining = false; // stop was seen; the worker waits for its requests to complete
+#endif
+
+        // clients Send queued data for, written at the end of the loop; only touched by the worker
+        nl::Vector<TcpServerClient*> PendingSends;
+
+        // filled by Send and Stop on other threads, which signal the wake event
+        nl::threading::ReadWriteLock HandoffLock;
+        nl::Vector<TcpServerClient*> HandoffSends;
+        bool Stopping = false;
+
+        ~TcpServerWorker()
+        {
+#ifdef NL_HAS_IO_URING
+            // the ring goes first so the kernel lets go of the buffer ring before it is unmapped
+            Ring.Close();
+            if (BufferRing)
+                munmap(BufferRing, TcpServer_ProvidedBufferCount * sizeof(io_uring_buf));
+
+            for (auto request : SendRequests)
+                nl::memory::Destroy(request);
+#endif
+
+            if (WakeEvent != -1)
+                close(WakeEvent);
+
+            if (Listener != -1)
+                close(Listener);
+
+            if (Epoll != -1)
+                close(Epoll);
+        }
+    };
+
+    struct TcpServerState
+    {
+        AsynchronousTcpServer* Server = nullptr;
+        nl::Vector<TcpServerWorker*> Workers;
+        uint16_t Port = 0;
+        TcpServerBackend Backend = TcpServerBackend::Default;
+        bool Running = false;
+        size_t SendHighWatermark = 1 << 20;
+        size_t SendLowWatermark = 256 << 10;
+        uint32_t IdleTimeout = 0;
+        uint32_t ReadTimeout = 0;
+        uint32_t WriteTimeout = 0;
+        FramePrefix Framing = FramePrefix::None;
+        size_t MaxFrameSize = FrameDefaultMaxSize;
+
+        // clients by slot; freed slots are reused last in, first out
+        nl::threading::ReadWriteLock ClientsLock;
+        nl::Vector<TcpServerSlot> Slots;
+        nl::Vector<size_t> FreeSlots;
+
+        // Returns the client with the lock on the table held shared, or nullptr with the lock released if the DPID
+        // is unknown or stale.
+        TcpServerClient* AcquireClient(DPID dpid)
+        {
+            ClientsLock.AcquireShared();
+
+            // DPID_ALLPLAYERS has slot bits of zero and wraps around to an index past the end
+            size_t index = (size_t)(dpid & TcpServer_SlotMask) - 1;
+            if (index < Slots.GetCount())
+            {
+                auto& slot = Slots[index];
+                if (slot.Client &&
+                    slot.Generation == (uint32_t)(dpid >> TcpServer_SlotBits))
+                    return slot.Client;
+            }
+
+            ClientsLock.ReleaseShared();
+            return nullptr;
+        }
+
+        void ReleaseClient()
+        {
+            ClientsLock.ReleaseShared();
+        }
+
+        TcpServerClient* AddClient(int socket, uint32_t ip, TcpServerWorker* worker)
+        {
+            auto client = nl::memory::ConstructThrow<TcpServerClient>();
+            client->Socket = socket;
+            client->IP = ip;
+            client->Worker = worker;
+
+            if (Framing != FramePrefix::None)
+            {
+                client->Frames = nl::memory::Construct<FrameDecoder>(Framing, MaxFrameSize);
+                if (!client->Frames)
+                {
+                    nl::memory::Destroy(client);
+                    throw BadAllocationException();
+                }
+            }
+
+            ClientsLock.AcquireExclusive();
+
+            size_t index;
+            if (FreeSlots.GetCount() != 0)
+            {
+                index = FreeSlots.PopLast();
+            }
+            else
+            {
+                index = Slots.GetCount();
+
+                try
+                {
+                    // the slot bits of DPID_UNKNOWN stay unused
+                    if (index + 2 >= TcpServer_SlotMask)
+                        throw InvalidOperationException("The server has no room for more clients.");
+
+                    Slots.Add(TcpServerSlot());
+                    FreeSlots.Reserve(Slots.GetCount()); // RemoveClient never has to allocate
+                }
+                catch (...)
+                {
+                    ClientsLock.ReleaseExclusive();
+                    nl::memory::Destroy(client);
+                    throw;
+                }
+            }
+
+            auto& slot = Slots[index];
+            slot.Client = client;
+            client->Dpid = ((DPID)slot.Generation << TcpServer_SlotBits) | (DPID)(index + 1);
+
+            ClientsLock.ReleaseExclusive();
+            return client;
+        }
+
+        // Takes the client out of the table; waits for Send calls that are using it to return.
+        void RemoveClient(TcpServerClient* client)
+        {
+            size_t index = (size_t)(client->Dpid & TcpServer_SlotMask) - 1;
+
+            ClientsLock.AcquireExclusive();
+            auto& slot = Slots[index];
+            slot.Client = nullptr;
+            slot.Generation = (slot.Generation + 1) & TcpServer_GenerationMask;
+            FreeSlots.Add(index);
+            ClientsLock.ReleaseExclusive();
+        }
+
+        // The clients handled by the worker, for closing them when it stops.
+        void GetClients(TcpServerWorker* worker, nl::Vector<TcpServerClient*>& clients)
+        {
+            ClientsLock.AcquireShared();
+            for (auto& slot : Slots)
+            {
+                if (slot.Client &&
+                    slot.Client->Worker == worker)
+                    clients.Add(slot.Client);
+            }
+            ClientsLock.ReleaseShared();
+        }
+
+        static void RemoveFrom(nl::Vector<TcpServerClient*>& clients, TcpServerClient* client)
+        {
+            for (size_t i = 0; i < clients.GetCount(); ++i)
+            {
+                if (clients[i] == client)
+                {
+                    clients[i] = clients[clients.GetCount() - 1];
+                    clients.PopLast();
+                    return;
+                }
+            }
+        }
+
+        // Takes a client that left the table off the lists of clients waiting for their queue to be written.
+        static void ForgetSends(TcpServerWorker* worker, TcpServerClient* client)
+        {
+            if (!client->FlushRequested)
+                return;
+
+            RemoveFrom(worker->PendingSends, client);
+
+            worker->HandoffLock.AcquireExclusive();
+            RemoveFrom(worker->HandoffSends, client);
+            worker->HandoffLock.ReleaseExclusive();
+        }
+
+        // Runs on the client's worker thread.
+        void CloseClient(TcpServerWorker* worker, TcpServerClient* client)
+        {
+            StopTimer(worker, client);
+            RemoveClient(client);
+            ForgetSends(worker, client);
+            close(client->Socket);
+
+            DPID dpid = client->Dpid;
+            nl::memory::Destroy(client);
+
+            Server->OnClientDisconnected(dpid);
+        }
+
+        bool HasTimeouts() const
+        {
+            return IdleTimeout != 0 ||
+                ReadTimeout != 0 ||
+                WriteTimeout != 0;
+        }
+
+        // Starts the timeouts of a new client; returns false if there was no room for its timer.
+        bool StartTimer(TcpServerWorker* worker, TcpServerClient* client)
+        {
+            if (!HasTimeouts())
+                return true;
+
+            client->ReceiveTime = worker->Now;
+            client->SendTime = worker->Now;
+
+            uint32_t delay = UINT32_MAX;
+            for (uint32_t timeout : { IdleTimeout, ReadTimeout, WriteTimeout })
+            {
+                if (timeout != 0 &&
+                    timeout < delay)
+                    delay = timeout;
+            }
+
+            try
+            {
+                client->Timer = ScheduleTimer(worker, client->Dpid, delay);
+            }
+            catch (const Exception&)
+            {
+                return false;
+            }
+
+            return true;
+        }
+
+        static nl::threading::TimerId ScheduleTimer(TcpServerWorker* worker, DPID dpid, uint32_t delay)
+        {
+            // the worker and the DPID fit in std::function without an allocation
+            return worker->Timers.Schedule(delay, [worker, dpid]()
+                {
+                    worker->State->CheckTimeouts(worker, dpid);
+                });
+        }
+
+        static void StopTimer(TcpServerWorker* worker, TcpServerClient* client)
+        {
+            if (client->Timer != 0)
+            {
+                worker->Timers.Cancel(client->Timer);
+                client->Timer = 0;
+            }
+        }
+
+        // Returns true if timeout milliseconds passed since time, or else lowers next to when they will have.
+        static bool HasExpired(uint64_t now, uint64_t time, uint32_t timeout, uint64_t& next)
+        {
+            uint64_t deadline = time + timeout;
+            if (deadline <= now)
+                return true;
+
+            if (deadline < next)
+                next = deadline;
+
+            return false;
+        }
+
+        // The timer of a client fired on its worker thread. Activity only moves the client's timestamps, so the
+        // timer is scheduled again for whatever time is left until the earliest timeout.
+        void CheckTimeouts(TcpServerWorker* worker, DPID dpid)
+        {
+            // only the worker frees its clients, so the client stays valid on this thread without the table lock
+            auto client = AcquireClient(dpid);
+            if (!client)
+                return;
+
+            ReleaseClient();
+            client->Timer = 0;
+
+            uint64_t now = worker->Now;
+            uint64_t next = UINT64_MAX;
+
+            if (IdleTimeout != 0 &&
+                HasExpired(now, client->ReceiveTime > client->SendTime ? client->ReceiveTime : client->SendTime, IdleTimeout, next))
+            {
+                TimeOut(client, TcpServerTimeout::Idle);
+                return;
+            }
+
+            if (ReadTimeout != 0 &&
+                HasExpired(now, client->ReceiveTime, ReadTimeout, next))
+            {
+                TimeOut(client, TcpServerTimeout::Read);
+                return;
+            }
+
+            if (WriteTimeout != 0)
+            {
+                if (!client->Writing)
+                {
+                    if (now + WriteTimeout < next)
+                        next = now + WriteTimeout;
+                }
+                else if (HasExpired(now, client->SendTime, WriteTimeout, next))
+                {
+                    TimeOut(client, TcpServerTimeout::Write);
+                    return;
+                }
+            }
+
+            // the timer that fired left its entry free, so this takes it without allocating
+            client->Timer = ScheduleTimer(worker, dpid, (uint32_t)(next - now));
+        }
+
+        void TimeOut(TcpServerClient* client, TcpServerTimeout timeout)
+        {
+            Server->OnClientTimedOut(client->Dpid, timeout);
+
+            // closed by the worker once it sees the hang up, as after Disconnect
+            shutdown(client->Socket, SHUT_RDWR);
+        }
+
+        // Fires the timers that are due; the loop of the worker calls it once per pass.
+        static void AdvanceTimers(TcpServerWorker* worker)
+        {
+            worker->Now = nl::threading::TimerWheel::GetTime();
+            worker->Timers.Advance();
+        }
+
+        void Accept(TcpServerWorker* worker)
+        {
+            for (;;)
+            {
+                sockaddr_in addr;
+                socklen_t addr_length = sizeof(addr);
+
+                int socket = accept4(worker->Listener, (sockaddr*)&addr, &addr_length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (socket == -1)
+                {
+                    if (errno == EINTR ||
+                        errno == ECONNABORTED)
+                        continue;
+
+                    // EAGAIN once the backlog is empty; anything else (e.g. out of descriptors) waits for the next event
+                    return;
+                }
+
+                int nodelay = 1;
+                setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+                TcpServerClient* client;
+                try
+                {
+                    client = AddClient(socket, addr.sin_addr.s_addr, worker);
+                }
+                catch (const Exception&)
+                {
+                    close(socket);
+                    continue;
+                }
+
+                epoll_event ev = {};
+                ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                ev.data.ptr = client;
+                if (!StartTimer(worker, client) ||
+                    epoll_ctl(worker->Epoll, EPOLL_CTL_ADD, socket, &ev) == -1)
+                {
+                    StopTimer(worker, client);
+                    RemoveClient(client);
+                    close(socket);
+                    nl::memory::Destroy(client);
+                    continue;
+                }
+
+                Server->OnClientConnected(client->Dpid);
+            }
+        }
+
+        // Passes received data on, frame by frame while framing is enabled. A client breaking the framing is shut
+        // down, which the worker sees like any other hang up.
+        void Deliver(TcpServerClient* client, const char* p, size_t size)
+        {
+            if (!client->Frames)
+            {
+                Server->OnClientDataReceived(client->Dpid, p, size);
+                return;
+            }
+
+            const void* lp = p;
+            for (;;)
+            {
+                const void* frame;
+                size_t frame_size;
+                FrameStatus status;
+                try
+                {
+                    status = client->Frames->Decode(lp, size, frame, frame_size);
+                }
+                catch (const BadAllocationException&)
+                {
+                    status = FrameStatus::Invalid;
+                }
+
+                if (status == FrameStatus::Incomplete)
+                    return;
+
+                if (status == FrameStatus::Invalid)
+                {
+                    shutdown(client->Socket, SHUT_RDWR);
+                    return;
+                }
+
+                Server->OnClientDataReceived(client->Dpid, frame, frame_size);
+            }
+        }
+
+        // Returns false if the client was closed.
+        bool Receive(TcpServerWorker* worker, TcpServerClient* client)
+        {
+            char* buffer = worker->ReceivePool.Lend();
+
+            // edge triggered, so the socket is drained until it would block
+            for (;;)
+            {
+                ssize_t received = recv(client->Socket, buffer, worker->ReceivePool.BlockSize, 0);
+                if (received > 0)
+                {
+                    client->ReceiveTime = worker->Now;
+                    Deliver(client, buffer, (size_t)received);
+                    continue;
+                }
+
+                if (received == -1)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    if (errno == EAGAIN ||
+                        errno == EWOULDBLOCK)
+                    {
+                        worker->ReceivePool.Return(buffer);
+                        return true;
+                    }
+                }
+
+                worker->ReceivePool.Return(buffer);
+                CloseClient(worker, client);
+                return false;
+            }
+        }
+
+        // The send lock must be held.
+        void UpdateWatermark(TcpServerClient* client, TcpServerSendResult& result) const
+        {
+            if (!client->SendBufferFull &&
+                client->Queue.Length >= SendHighWatermark)
+            {
+                client->SendBufferFull = true;
+                result.Full = true;
+            }
+            else if (client->SendBufferFull &&
+                     client->Queue.Length <= SendLowWatermark)
+            {
+                client->SendBufferFull = false;
+                result.Drained = true;
+            }
+        }
+
+        // Has the client's worker write the queue at the end of its loop, or right away when it is waiting. The send
+        // lock must be held. A worker of another thread is added to wakes instead of being woken if it is given.
+        void RequestFlush(TcpServerClient* client, TcpServerSendResult& result, nl::Vector<TcpServerWorker*>* wakes = nullptr)
+        {
+            UpdateWatermark(client, result);
+
+            if (client->FlushRequested)
+                return;
+
+            auto worker = client->Worker;
+            if (TcpServer_CurrentWorker == worker)
+            {
+                worker->PendingSends.Add(client);
+            }
+            else
+            {
+                worker->HandoffLock.AcquireExclusive();
+                try
+                {
+                    worker->HandoffSends.Add(client);
+                }
+                catch (...)
+                {
+                    worker->HandoffLock.ReleaseExclusive();
+                    throw;
+                }
+                worker->HandoffLock.ReleaseExclusive();
+
+                if (!wakes)
+                    Wake(worker);
+                else if (wakes->Find(worker) == wakes->npos)
+                    wakes->Add(worker); // room was reserved for every worker
+            }
+
+            client->FlushRequested = true;
+        }
+
+        static void Wake(TcpServerWorker* worker)
+        {
+            uint64_t value = 1;
+            (void)!write(worker->WakeEvent, &value, sizeof(value));
+        }
+
+        // Links a chunk referencing the payload into the queue of every client; dpids is nullptr for all clients.
+        // Each worker is woken once however many of its clients were given the payload, and writes them from its
+        // own thread.
+        void Broadcast(const DPID* dpids, size_t count, TcpServerSharedPayload* payload)
+        {
+            nl::Vector<TcpServerWorker*> wakes;
+            nl::Vector<DPID> full; // OnSendBufferFull is only called once no lock is held
+            wakes.Reserve(Workers.GetCount());
+
+            ClientsLock.AcquireShared();
+            try
+            {
+                if (dpids)
+                {
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        size_t index = (size_t)(dpids[i] & TcpServer_SlotMask) - 1;
+                        if (index < Slots.GetCount() &&
+                            Slots[index].Client &&
+                            Slots[index].Generation == (uint32_t)(dpids[i] >> TcpServer_SlotBits))
+                            QueueBroadcast(Slots[index].Client, payload, wakes, full);
+                    }
+                }
+                else
+                {
+                    for (auto& slot : Slots)
+                    {
+                        if (slot.Client)
+                            QueueBroadcast(slot.Client, payload, wakes, full);
+                    }
+                }
+            }
+            catch (const Exception&)
+            {
+                // the clients queued so far still get the payload
+                ClientsLock.ReleaseShared();
+                for (auto worker : wakes)
+                    Wake(worker);
+
+                throw;
+            }
+
+            ClientsLock.ReleaseShared();
+
+            for (auto worker : wakes)
+                Wake(worker);
+
+            for (auto dpid : full)
+                Server->OnSendBufferFull(dpid);
+        }
+
+        // The table lock must be held shared.
+        void QueueBroadcast(TcpServerClient* client, TcpServerSharedPayload* payload, nl::Vector<TcpServerWorker*>& wakes, nl::Vector<DPID>& full)
+        {
+            full.PrepareAdd(1);
+
+            auto chunk = nl::memory::ConstructThrow<TcpServerSendChunk>();
+            chunk->Shared = payload;
+            payload->AddReference();
+
+            TcpServerSendResult result;
+
+            client->SendLock.AcquireExclusive();
+            client->Queue.AppendReference(payload->Data, payload->Length, chunk);
+            try
+            {
+                RequestFlush(client, result, &wakes);
+            }
+            catch (const Exception&)
+            {
+                client->SendLock.ReleaseExclusive();
+                throw;
+            }
+            client->SendLock.ReleaseExclusive();
+
+            if (result.Full)
+                full.Add(client->Dpid);
+        }
+
+        void CompleteSend(DPID dpid, const TcpServerSendResult& result)
+        {
+            TcpServerSendQueue::Free(result.Released);
+
+            if (result.Full)
+                Server->OnSendBufferFull(dpid);
+
+            if (result.Drained)
+                Server->OnSendBufferDrained(dpid);
+
+            if (result.Completed)
+                Server->OnSendCompleted(dpid);
+        }
+
+        // Moves the clients other threads queued data for to PendingSends; returns true once Stop was called.
+        static bool TakeHandoffs(TcpServerWorker* worker)
+        {
+            worker->HandoffLock.AcquireExclusive();
+            for (auto client : worker->HandoffSends)
+                worker->PendingSends.Add(client);
+
+            worker->HandoffSends.Clear();
+            bool stopping = worker->Stopping;
+            worker->HandoffLock.ReleaseExclusive();
+
+            return stopping;
+        }
+
+        // Writes the queue until the socket would block, as many chunks per system call as possible. pending is
+        // true when the client is taken from PendingSends.
+        void FlushSend(TcpServerClient* client, bool pending)
+        {
+            TcpServerSendResult result;
+
+            client->SendLock.AcquireExclusive();
+            if (pending)
+                client->FlushRequested = false;
+
+            bool failed = false;
+            bool queued = client->Queue.Length != 0;
+            bool progress = false;
+
+            while (client->Queue.Length != 0)
+            {
+                iovec segments[TcpServer_MaxSendSegments];
+
+                msghdr msg = {};
+                msg.msg_iov = segments;
+                msg.msg_iovlen = (size_t)client->Queue.Gather(segments, TcpServer_MaxSendSegments);
+
+                ssize_t sent = sendmsg(client->Socket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (sent > 0)
+                {
+                    client->Queue.Consume((size_t)sent, result.Released);
+                    progress = true;
+                    continue;
+                }
+
+                if (sent == -1 &&
+                    errno == EINTR)
+                    continue;
+
+                if (sent == -1 &&
+                    (errno == EAGAIN || errno == EWOULDBLOCK))
+                    break;
+
+                // the worker notices the broken connection through the hang up and closes it
+                shutdown(client->Socket, SHUT_RDWR);
+                client->Queue.Clear(result.Released);
+                failed = true;
+            }
+
+            // the write timeout runs from the first write that had to wait for the client until the next progress
+            if (queued &&
+                (progress || !client->Writing))
+                client->SendTime = client->Worker->Now;
+
+            client->Writing = client->Queue.Length != 0;
+
+            result.Completed = queued && !failed && client->Queue.Length == 0;
+            UpdateWatermark(client, result);
+            client->SendLock.ReleaseExclusive();
+
+            CompleteSend(client->Dpid, result);
+        }
+
+        void FlushPendingSends(TcpServerWorker* worker)
+        {
+            // callbacks can queue more, which is written in the same pass
+            for (size_t i = 0; i < worker->PendingSends.GetCount(); ++i)
+                FlushSend(worker->PendingSends[i], true);
+
+            worker->PendingSends.Clear();
+        }
+
+        void Run(TcpServerWorker* worker)
+        {
+            epoll_event events[TcpServer_MaxEvents];
+            bool stopping = false;
+            bool timeouts = HasTimeouts();
+
+            while (!stopping)
+            {
+                // the wait ends in time for the next timer
+                int wait = -1;
+                if (timeouts)
+                {
+                    uint32_t timeout = worker->Timers.GetNextTimeout();
+                    if (timeout != nl::threading::Event::Infinite)
+                        wait = timeout < INT32_MAX ? (int)timeout : INT32_MAX;
+                }
+
+                int count = epoll_wait(worker->Epoll, events, TcpServer_MaxEvents, wait);
+                if (count == -1)
+                {
+                    if (errno == EINTR)
+                        continue;
+
+                    break;
+                }
+
+                if (timeouts)
+                    worker->Now = nl::threading::TimerWheel::GetTime();
+
+                for (int i = 0; i < count; ++i)
+                {
+                    void* tag = events[i].data.ptr;
+                    uint32_t flags = events[i].events;
+
+                    if (tag == &TcpServer_ListenerTag)
+                    {
+                        Accept(worker);
+                        continue;
+                    }
+
+                    if (tag == &TcpServer_WakeTag)
+                    {
+                        uint64_t value;
+                        (void)!read(worker->WakeEvent, &value, sizeof(value));
+
+                        stopping = TakeHandoffs(worker);
+                        continue;
+                    }
+
+                    auto client = static_cast<TcpServerClient*>(tag);
+
+                    if (flags & EPOLLOUT)
+                        FlushSend(client, false);
+
+                    if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                        Receive(worker, client);
+                }
+
+                if (timeouts)
+                    AdvanceTimers(worker);
+
+                // everything the callbacks above sent goes out now, one writev per client
+                FlushPendingSends(worker);
+            }
+
+            // the worker's remaining clients are closed by the worker itself
+            nl::Vector<TcpServerClient*> clients;
+
+            GetClients(worker, clients);
+
+            for (auto client : clients)
+                CloseClient(worker, client);
+        }
+
+#ifdef NL_HAS_IO_URING
+        /////////////////////////////////////////////////////
+        // io_uring backend
+
+        // Sets up the worker's ring and hands it the receive buffers. Returns false if the kernel lacks io_uring.
+        static bool InitializeRing(TcpServerWorker* worker)
+        {
+            // the ring is set up here but driven by the worker thread, which rules out IORING_SETUP_SINGLE_ISSUER
+            if (!worker->Ring.Initialize(TcpServer_RingEntries, IORING_SETUP_COOP_TASKRUN) &&
+                !worker->Ring.Initialize(TcpServer_RingEntries))
+                return false;
+
+            worker->ReceivePool.Initialize(TcpServer_ProvidedBufferSize, TcpServer_ProvidedBufferCount);
+            worker->ProvidedBuffers.Reserve(TcpServer_ProvidedBufferCount);
+            for (uint32_t i = 0; i < TcpServer_ProvidedBufferCount; ++i)
+                worker->ProvidedBuffers.Add(worker->ReceivePool.Lend());
+
+            worker->ReturnedBuffers.Reserve(TcpServer_ProvidedBufferCount);
+
+            if (!InitializeBufferRing(worker))
+            {
+                // hand the buffers over one request at a time instead, which every kernel with multishot receive has
+                worker->LegacyBuffers = true;
+                for (uint32_t i = 0; i < TcpServer_ProvidedBufferCount; ++i)
+                    ProvideBuffer(worker, (uint16_t)i);
+            }
+
+            return true;
+        }
+
+        static bool InitializeBufferRing(TcpServerWorker* worker)
+        {
+            // the ring of buffer descriptors has to be page aligned
+            size_t ring_size = TcpServer_ProvidedBufferCount * sizeof(io_uring_buf);
+            void* mem = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+            if (mem == MAP_FAILED)
+                return false;
+
+            io_uring_buf_reg reg = {};
+            reg.ring_addr = (uint64_t)(uintptr_t)mem;
+            reg.ring_entries = TcpServer_ProvidedBufferCount;
+            reg.bgid = TcpServer_BufferGroup;
+            if (worker->Ring.Register(IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+            {
+                munmap(mem, ring_size);
+                return false;
+            }
+
+            worker->BufferRing = static_cast<io_uring_buf_ring*>(mem);
+            for (uint32_t i = 0; i < TcpServer_ProvidedBufferCount; ++i)
+                ProvideBuffer(worker, (uint16_t)i);
+
+            PublishBuffers(worker);
+            return true;
+        }
+
+        // Gives a receive buffer back to the kernel once the data in it was delivered.
+        static void ProvideBuffer(TcpServerWorker* worker, uint16_t id)
+        {
+            if (worker->LegacyBuffers)
+            {
+                worker->ReturnedBuffers.Add(id); // never grows past the reserved capacity
+                return;
+            }
+
+            // the entries start at the ring itself; C++ places io_uring_buf_ring::bufs after an empty struct from
+            // __DECLARE_FLEX_ARRAY, 8 bytes off from where the kernel reads them
+            io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(worker->BufferRing) + (worker->BufferTail & (TcpServer_ProvidedBufferCount - 1));
+            buf->addr = (uint64_t)(uintptr_t)worker->ProvidedBuffers[id];
+            buf->len = (uint32_t)TcpServer_ProvidedBufferSize;
+            buf->bid = id;
+            ++worker->BufferTail;
+        }
+
+        static void PublishBuffers(TcpServerWorker* worker)
+        {
+            if (!worker->LegacyBuffers)
+            {
+                __atomic_store_n(&worker->BufferRing->tail, worker->BufferTail, __ATOMIC_RELEASE);
+                return;
+            }
+
+            while (worker->ReturnedBuffers.GetCount() != 0)
+            {
+                auto sqe = GetSqe(worker);
+                if (!sqe)
+                    return;
+
+                uint16_t id = worker->ReturnedBuffers.PopLast();
+                sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+                sqe->fd = 1; // number of buffers
+                sqe->addr = (uint64_t)(uintptr_t)worker->ProvidedBuffers[id];
+                sqe->len = (uint32_t)TcpServer_ProvidedBufferSize;
+                sqe->off = id;
+                sqe->buf_group = TcpServer_BufferGroup;
+                sqe->user_data = TcpServer_ProvideData;
+            }
+        }
+
+        // Returns nullptr if the submission queue stays full even after handing it to the kernel.
+        static io_uring_sqe* GetSqe(TcpServerWorker* worker)
+        {
+            auto sqe = worker->Ring.GetSqe();
+            if (!sqe)
+            {
+                worker->Ring.Submit();
+                sqe = worker->Ring.GetSqe();
+                if (!sqe)
+                    return nullptr;
+            }
+
+            ++worker->Outstanding;
+            return sqe;
+        }
+
+        static bool ArmAccept(TcpServerWorker* worker)
+        {
+            auto sqe = GetSqe(worker);
+            if (!sqe)
+                return false;
+
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = worker->Listener;
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            sqe->user_data = TcpServer_AcceptData;
+            return true;
+        }
+
+        static bool ArmWake(TcpServerWorker* worker)
+        {
+            auto sqe = GetSqe(worker);
+            if (!sqe)
+                return false;
+
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = worker->WakeEvent;
+            sqe->addr = (uint64_t)(uintptr_t)&worker->WakeValue;
+            sqe->len = sizeof(worker->WakeValue);
+            sqe->user_data = TcpServer_WakeData;
+            return true;
+        }
+
+        static bool ArmReceive(TcpServerWorker* worker, TcpServerClient* client)
+        {
+            auto sqe = GetSqe(worker);
+            if (!sqe)
+                return false;
+
+            // one request keeps receiving into buffers the kernel picks from the worker's buffer ring
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = client->Socket;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = TcpServer_BufferGroup;
+            sqe->user_data = (uint64_t)(uintptr_t)client | TcpServer_ReceiveKind;
+
+            ++client->Operations;
+            return true;
+        }
+
+        // Submits as much of the queue as fits in one sendmsg unless a send is in flight; the send lock must be
+        // held. Returns false if there was no room in the submission queue.
+        static bool StartSend(TcpServerWorker* worker, TcpServerClient* client)
+        {
+            if (client->Sending ||
+                client->Closing ||
+                client->Queue.Length == 0)
+                return true;
+
+            TcpServerSendRequest* request;
+            if (worker->SendRequests.GetCount() != 0)
+            {
+                request = worker->SendRequests.PopLast();
+            }
+            else
+            {
+                // room for it to be returned without allocating
+                try
+                {
+                    worker->SendRequests.Reserve(worker->SendRequestCount + 1);
+                }
+                catch (BadAllocationException&)
+                {
+                    return false;
+                }
+
+                request = nl::memory::Construct<TcpServerSendRequest>();
+                if (!request)
+                    return false;
+
+                ++worker->SendRequestCount;
+            }
+
+            auto sqe = GetSqe(worker);
+            if (!sqe)
+            {
+                worker->SendRequests.Add(request);
+                return false;
+            }
+
+            // the chunks described here are only freed after the completion, Send keeps appending behind them
+            request->Message = {};
+            request->Message.msg_iov = request->Segments;
+            request->Message.msg_iovlen = (size_t)client->Queue.Gather(request->Segments, TcpServer_MaxSendSegments);
+
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = client->Socket;
+            sqe->addr = (uint64_t)(uintptr_t)&request->Message;
+            sqe->len = 1;
+            sqe->msg_flags = MSG_NOSIGNAL;
+            sqe->user_data = (uint64_t)(uintptr_t)client | TcpServer_SendKind;
+
+            client->Sending = request;
+            ++client->Operations;
+
+            // the write timeout runs while sends are in flight, from the first one or the last progress
+            if (!client->Writing)
+            {
+                client->SendTime = worker->Now;
+                client->Writing = true;
+            }
+
+            return true;
+        }
+
+        // Has the wait of the ring end when the next timer is due: an IORING_OP_TIMEOUT is armed for it, or moved
+        // up when a timer due earlier was scheduled since.
+        static void ArmTimeout(TcpServerWorker* worker)
+        {
+            uint32_t timeout = worker->Timers.GetNextTimeout();
+            if (timeout == nl::threading::Event::Infinite)
+                return;
+
+            uint64_t deadline = nl::threading::TimerWheel::GetTime() + timeout;
+            if (worker->TimeoutArmed &&
+                deadline >= worker->TimeoutDeadline)
+                return;
+
+            auto sqe = GetSqe(worker);
+            if (!sqe)
+                return;
+
+            worker->TimeoutSpec.tv_sec = timeout / 1000;
+            worker->TimeoutSpec.tv_nsec = (long long)(timeout % 1000) * 1000000;
+
+            if (!worker->TimeoutArmed)
+            {
+                sqe->opcode = IORING_OP_TIMEOUT;
+                sqe->addr = (uint64_t)(uintptr_t)&worker->TimeoutSpec;
+                sqe->len = 1;
+                sqe->user_data = TcpServer_TimeoutData;
+                worker->TimeoutArmed = true;
+            }
+            else
+            {
+                sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+                sqe->addr = TcpServer_TimeoutData;
+                sqe->addr2 = (uint64_t)(uintptr_t)&worker->TimeoutSpec;
+                sqe->timeout_flags = IORING_TIMEOUT_UPDATE;
+                sqe->user_data = TcpServer_CancelData;
+            }
+
+            worker->TimeoutDeadline = deadline;
+        }
+
+        // Queues a send for every client Send was called for since the last loop; they reach the kernel together.
+        static void SubmitSends(TcpServerWorker* worker)
+        {
+            auto& pending = worker->PendingSends;
+            size_t kept = 0;
+
+            for (size_t i = 0; i < pending.GetCount(); ++i)
+            {
+                auto client = pending[i];
+
+                client->SendLock.AcquireExclusive();
+                bool started = StartSend(worker, client);
+                client->FlushRequested = !started;
+                client->SendLock.ReleaseExclusive();
+
+                if (!started)
+                    pending[kept++] = client;
+            }
+
+            while (pending.GetCount() > kept)
+                pending.PopLast();
+        }
+
+        // The kernel still holds the client's requests, so the shutdown makes them complete and the client is
+        // freed by FinishClose after the last one.
+        void BeginClose(TcpServerWorker* worker, TcpServerClient* client)
+        {
+            if (client->Closing)
+                return;
+
+            client->Closing = true;
+            StopTimer(worker, client);
+            RemoveClient(client);
+            shutdown(client->Socket, SHUT_RDWR);
+
+            if (client->Operations == 0)
+                FinishClose(worker, client);
+        }
+
+        void FinishClose(TcpServerWorker* worker, TcpServerClient* client)
+        {
+            ForgetSends(worker, client);
+            close(client->Socket);
+
+            DPID dpid = client->Dpid;
+            nl::memory::Destroy(client);
+
+            Server->OnClientDisconnected(dpid);
+        }
+
+        void OnAccept(TcpServerWorker* worker, int32_t result, uint32_t flags)
+        {
+            if ((flags & IORING_CQE_F_MORE) == 0)
+                worker->AcceptArmed = false;
+
+            if (result < 0)
+                return;
+
+            int socket = result;
+            if (worker->Draining)
+            {
+                close(socket);
+                return;
+            }
+
+            // multishot accept has no room for the address of each connection
+            sockaddr_in addr = {};
+            socklen_t addr_length = sizeof(addr);
+            getpeername(socket, (sockaddr*)&addr, &addr_length);
+
+            int nodelay = 1;
+            setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+            TcpServerClient* client;
+            try
+            {
+                client = AddClient(socket, addr.sin_addr.s_addr, worker);
+            }
+            catch (const Exception&)
+            {
+                close(socket);
+                return;
+            }
+
+            if (!StartTimer(worker, client) ||
+                !ArmReceive(worker, client))
+            {
+                StopTimer(worker, client);
+                RemoveClient(client);
+                close(socket);
+                nl::memory::Destroy(client);
+                return;
+            }
+
+            Server->OnClientConnected(client->Dpid);
+        }
+
+        void OnWake(TcpServerWorker* worker)
+        {
+            worker->WakeArmed = false;
+
+            if (TakeHandoffs(worker) &&
+                !worker->Draining)
+            {
+                worker->Draining = true;
+
+                if (worker->AcceptArmed)
+                {
+                    auto sqe = GetSqe(worker);
+                    if (sqe)
+                    {
+                        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                        sqe->addr = TcpServer_AcceptData;
+                        sqe->user_data = TcpServer_CancelData;
+                    }
+                }
+
+                if (worker->TimeoutArmed)
+                {
+                    auto sqe = GetSqe(worker);
+                    if (sqe)
+                    {
+                        sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+                        sqe->addr = TcpServer_TimeoutData;
+                        sqe->user_data = TcpServer_CancelData;
+                    }
+                }
+
+                nl::Vector<TcpServerClient*> clients;
+
+                GetClients(worker, clients);
+
+                for (auto client : clients)
+                    BeginClose(worker, client);
+            }
+        }
+
+        void OnReceive(TcpServerWorker* worker, TcpServerClient* client, int32_t result, uint32_t flags)
+        {
+            bool more = (flags & IORING_CQE_F_MORE) != 0;
+            if (!more)
+                --client->Operations;
+
+            if (flags & IORING_CQE_F_BUFFER)
+            {
+                uint16_t id = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+                if (result > 0 &&
+                    !client->Closing)
+                {
+                    client->ReceiveTime = worker->Now;
+                    Deliver(client, worker->ProvidedBuffers[id], (size_t)result);
+                }
+
+                ProvideBuffer(worker, id);
+            }
+
+            if (more)
+                return;
+
+            // the kernel ends a multishot receive now and then, e.g. when it ran out of buffers
+            if (!client->Closing &&
+                (result > 0 || result == -ENOBUFS) &&
+                ArmReceive(worker, client))
+                return;
+
+            if (!client->Closing)
+                BeginClose(worker, client);
+            else if (client->Operations == 0)
+                FinishClose(worker, client);
+        }
+
+        void OnSend(TcpServerWorker* worker, TcpServerClient* client, int32_t res)
+        {
+            --client->Operations;
+
+            TcpServerSendResult result;
+
+            client->SendLock.AcquireExclusive();
+            worker->SendRequests.Add(client->Sending);
+            client->Sending = nullptr;
+            client->Writing = false; // progress, or a failure that ends the connection
+
+            if (res > 0)
+            {
+                client->Queue.Consume((size_t)res, result.Released);
+            }
+            else
+            {
+                // the receive notices the broken connection and closes the client
+                shutdown(client->Socket, SHUT_RDWR);
+                client->Queue.Clear(result.Released);
+            }
+
+            if (!client->Closing)
+            {
+                if (client->Queue.Length != 0)
+                {
+                    if (!StartSend(worker, client) &&
+                        !client->FlushRequested)
+                    {
+                        worker->PendingSends.Add(client);
+                        client->FlushRequested = true;
+                    }
+                }
+                else
+                {
+                    result.Completed = res > 0;
+                }
+
+                UpdateWatermark(client, result);
+            }
+
+            client->SendLock.ReleaseExclusive();
+
+            if (client->Closing)
+            {
+                TcpServerSendQueue::Free(result.Released);
+
+                if (client->Operations == 0)
+                    FinishClose(worker, client);
+                return;
+            }
+
+            CompleteSend(client->Dpid, result);
+        }
+
+        void RunRing(TcpServerWorker* worker)
+        {
+            bool timeouts = HasTimeouts();
+            if (timeouts)
+                worker->Now = nl::threading::TimerWheel::GetTime();
+
+            for (;;)
+            {
+                if (!worker->Draining)
+                {
+                    if (!worker->AcceptArmed)
+                        worker->AcceptArmed = ArmAccept(worker);
+
+                    if (!worker->WakeArmed)
+                        worker->WakeArmed = ArmWake(worker);
+                }
+
+                SubmitSends(worker);
+                PublishBuffers(worker);
+
+                if (timeouts &&
+                    !worker->Draining)
+                    ArmTimeout(worker);
+
+                if (worker->Draining &&
+                    worker->Outstanding == 0)
+                    break;
+
+                // one system call hands over everything queued above and waits for the next completion
+                int result = worker->Ring.Submit(1);
+                if (result < 0 &&
+                    result != -EINTR &&
+                    result != -EBUSY &&
+                    result != -EAGAIN)
+                    break;
+
+                if (timeouts)
+                    worker->Now = nl::threading::TimerWheel::GetTime();
+
+                while (auto cqe = worker->Ring.PeekCqe())
+                {
+                    uint64_t data = cqe->user_data;
+                    int32_t res = cqe->res;
+                    uint32_t flags = cqe->flags;
+                    worker->Ring.AdvanceCqe();
+
+                    if ((flags & IORING_CQE_F_MORE) == 0)
+                        --worker->Outstanding;
+
+                    if (data == TcpServer_AcceptData)
+                        OnAccept(worker, res, flags);
+                    else if (data == TcpServer_WakeData)
+                        OnWake(worker);
+                    else if (data == TcpServer_TimeoutData)
+                        worker->TimeoutArmed = false;
+                    else if (data == TcpServer_CancelData ||
+                             data == TcpServer_ProvideData)
+                        continue;
+                    else if ((data & TcpServer_KindMask) == TcpServer_SendKind)
+                        OnSend(worker, reinterpret_cast<TcpServerClient*>(data & ~TcpServer_KindMask), res);
+                    else
+                        OnReceive(worker, reinterpret_cast<TcpServerClient*>(data & ~TcpServer_KindMask), res, flags);
+                }
+
+                if (timeouts)
+                    AdvanceTimers(worker);
+            }
+        }
+#endif
+    };
+
+    static void* _TcpServerWorkerThread(void* lp)
+    {
+        auto worker = static_cast<TcpServerWorker*>(lp);
+        TcpServer_CurrentWorker = worker;
+
+#ifdef NL_HAS_IO_URING
+        if (worker->State->Backend == TcpServerBackend::IoUring)
+        {
+            worker->State->RunRing(worker);
+            return nullptr;
+        }
+#endif
+
+        worker->State->Run(worker);
+        return nullptr;
+    }
+
+    static int TcpServer_CreateListener(uint32_t bind_ip, uint16_t port, int32_t backlog)
+    {
+        int s = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+        if (s == -1)
+            throw SocketException("Failed to create socket.", errno);
+
+        // every worker listens on its own socket bound to the same port and the kernel spreads the connections
+        int enable = 1;
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        if (setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == -1)
+        {
+            int error = errno;
+            close(s);
+            throw SocketException("Failed to enable SO_REUSEPORT on socket.", error);
+        }
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = bind_ip;
+        addr.sin_port = htons(port);
+        if (bind(s, (const sockaddr*)&addr, sizeof(addr)) == -1)
+        {
+            int error = errno;
+            close(s);
+            throw SocketException("Failed to bind socket.", error);
+        }
+
+        if (listen(s, backlog) == -1)
+        {
+            int error = errno;
+            close(s);
+            throw SocketException("Failed to listen on socket.", error);
+        }
+
+        return s;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    //////////////////////////////////////////////////////////////////////////////////////////////////////////////
+    //////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    AsynchronousTcpServer::AsynchronousTcpServer() :
+        m_thread_parameters(nullptr)
+    {
+        m_state = nl::memory::ConstructThrow<TcpServerState>();
+        m_state->Server = this;
+    }
+
+    AsynchronousTcpServer::~AsynchronousTcpServer()
+    {
+        if (m_state->Running)
+            Stop();
+
+        nl::memory::Destroy(m_state);
+    }
+
+    void AsynchronousTcpServer::Start(uint32_t bind_ip, uint16_t port, int32_t backlog, int32_t thread_count, TcpServerBackend backend)
+    {
+        if (m_state->Running)
+        {
+            throw InvalidOperationException("Server already started");
+        }
+
+        if (thread_count <= 0)
+            thread_count = nl::threading::ThreadPool::GetProcessorCount();
+
+        auto state = m_state;
+        bool ring = backend == TcpServerBackend::IoUring;
+
+        try
+        {
+            for (int32_t i = 0; i < thread_count; ++i)
+            {
+                auto worker = nl::memory::ConstructThrow<TcpServerWorker>();
+                state->Workers.Add(worker);
+
+                worker->State = state;
+                worker->Listener = TcpServer_CreateListener(bind_ip, port, backlog);
+
+                // an ephemeral port is picked by the first listener and shared by the others
+                if (port == 0)
+                {
+                    sockaddr_in addr;
+                    socklen_t addr_length = sizeof(addr);
+                    getsockname(worker->Listener, (sockaddr*)&addr, &addr_length);
+                    port = ntohs(addr.sin_port);
+                }
+
+                worker->WakeEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (worker->WakeEvent == -1)
+                    throw SocketException("Failed to create the wake event of a worker.", errno);
+
+#ifdef NL_HAS_IO_URING
+                if (ring)
+                {
+                    if (TcpServerState::InitializeRing(worker))
+                        continue;
+
+                    if (i != 0)
+                        throw InvalidOperationException("Failed to set up io_uring for a server worker.");
+
+                    // the kernel does not support it, so every worker uses epoll
+                    worker->Ring.Close();
+                    ring = false;
+                }
+#else
+                ring = false;
+#endif
+
+                worker->ReceivePool.Initialize(TcpServer_ReceiveBufferSize, 1); // one receive runs at a time
+                worker->Epoll = epoll_create1(EPOLL_CLOEXEC);
+                if (worker->Epoll == -1)
+                    throw SocketException("Failed to create the epoll instance of a worker.", errno);
+
+                epoll_event ev = {};
+                ev.events = EPOLLIN | EPOLLET;
+                ev.data.ptr = &TcpServer_ListenerTag;
+                if (epoll_ctl(worker->Epoll, EPOLL_CTL_ADD, worker->Listener, &ev) == -1)
+                    throw SocketException("Failed to add the listening socket to epoll.", errno);
+
+                ev.events = EPOLLIN;
+                ev.data.ptr = &TcpServer_WakeTag;
+                if (epoll_ctl(worker->Epoll, EPOLL_CTL_ADD, worker->WakeEvent, &ev) == -1)
+                    throw SocketException("Failed to add the wake event to epoll.", errno);
+            }
+
+            state->Port = port;
+            state->Backend = ring ? TcpServerBackend::IoUring : TcpServerBackend::Default;
+
+            for (auto worker : state->Workers)
+            {
+                if (pthread_create(&worker->Thread, nullptr, _TcpServerWorkerThread, worker) != 0)
+                    throw InvalidOperationException("Failed to create server worker thread.");
+
+                worker->ThreadStarted = true;
+            }
+        }
+        catch (...)
+        {
+            state->Running = true;
+            Stop();
+            throw;
+        }
+
+        state->Running = true;
+    }
+
+    void AsynchronousTcpServer::Stop()
+    {
+        if (!m_state->Running)
+        {
+            throw InvalidOperationException("Server is not running");
+        }
+
+        auto state = m_state;
+
+        for (auto worker : state->Workers)
+        {
+            worker->HandoffLock.AcquireExclusive();
+            worker->Stopping = true;
+            worker->HandoffLock.ReleaseExclusive();
+
+            uint64_t value = 1;
+            if (worker->WakeEvent != -1)
+                (void)!write(worker->WakeEvent, &value, sizeof(value));
+        }
+
+        for (auto worker : state->Workers)
+        {
+            if (worker->ThreadStarted)
+                pthread_join(worker->Thread, nullptr);
+
+            nl::memory::Destroy(worker);
+        }
+
+        // the slots are kept so a DPID from before a restart is never given out again
+        state->Workers.Clear();
+        state->Port = 0;
+        state->Backend = TcpServerBackend::Default;
+        state->Running = false;
+    }
+
+    uint16_t AsynchronousTcpServer::GetPort() const
+    {
+        return m_state->Port;
+    }
+
+    TcpServerBackend AsynchronousTcpServer::GetBackend() const
+    {
+        return m_state->Backend;
+    }
+
+    uint32_t AsynchronousTcpServer::GetClientIP(DPID dpid)
+    {
+        auto client = m_state->AcquireClient(dpid);
+        if (!client)
+            return 0;
+
+        uint32_t ip = client->IP;
+        m_state->ReleaseClient();
+        return ip;
+    }
+
+    bool AsynchronousTcpServer::GetClientIP(DPID dpid, char* ptr)
+    {
+        auto client = m_state->AcquireClient(dpid);
+        if (!client)
+            return false;
+
+        in_addr addr;
+        addr.s_addr = client->IP;
+        m_state->ReleaseClient();
+
+        return inet_ntop(AF_INET, &addr, ptr, INET_ADDRSTRLEN) != nullptr;
+    }
+
+    void AsynchronousTcpServer::Disconnect(DPID dpid)
+    {
+        auto client = m_state->AcquireClient(dpid);
+        if (!client)
+            return;
+
+        // the worker sees the hang up and closes the client on its own thread
+        shutdown(client->Socket, SHUT_RDWR);
+        m_state->ReleaseClient();
+    }
+
+    void AsynchronousTcpServer::Send(DPID dpid, const void* lp, size_t len)
+    {
+        if (len == 0)
+            return;
+
+        if (dpid == DPID_ALLPLAYERS)
+        {
+            Broadcast(nullptr, 0, lp, len);
+            return;
+        }
+
+        auto client = m_state->AcquireClient(dpid);
+        if (!client)
+            return;
+
+        TcpServerSendResult result;
+
+        client->SendLock.AcquireExclusive();
+        try
+        {
+            client->Queue.Append(static_cast<const char*>(lp), len);
+            m_state->RequestFlush(client, result);
+        }
+        catch (const Exception&)
+        {
+            client->SendLock.ReleaseExclusive();
+            m_state->ReleaseClient();
+            throw;
+        }
+
+        client->SendLock.ReleaseExclusive();
+        m_state->ReleaseClient();
+
+        m_state->CompleteSend(dpid, result);
+    }
+
+    void AsynchronousTcpServer::Send(DPID dpid, const void* lp, size_t len, SendReleaseCallback release)
+    {
+        if (!release)
+            throw ArgumentException("A buffer sent by reference needs a release callback.");
+
+        if (dpid == DPID_ALLPLAYERS)
+        {
+            Broadcast(nullptr, 0, lp, len, std::move(release));
+            return;
+        }
+
+        auto client = len != 0 ? m_state->AcquireClient(dpid) : nullptr;
+        if (!client)
+        {
+            release();
+            return;
+        }
+
+        TcpServerSendChunk* chunk;
+        try
+        {
+            chunk = nl::memory::ConstructThrow<TcpServerSendChunk>();
+        }
+        catch (const Exception&)
+        {
+            m_state->ReleaseClient();
+            release();
+            throw;
+        }
+
+        chunk->Release = std::move(release);
+
+        TcpServerSendResult result;
+
+        // once linked the chunk belongs to the queue, which calls release when the client closes even if this throws
+        client->SendLock.AcquireExclusive();
+        client->Queue.AppendReference(static_cast<const char*>(lp), len, chunk);
+        try
+        {
+            m_state->RequestFlush(client, result);
+        }
+        catch (const Exception&)
+        {
+            client->SendLock.ReleaseExclusive();
+            m_state->ReleaseClient();
+            throw;
+        }
+
+        client->SendLock.ReleaseExclusive();
+        m_state->ReleaseClient();
+
+        m_state->CompleteSend(dpid, result);
+    }
+
+    void AsynchronousTcpServer::Broadcast(const DPID* dpids, size_t count, const void* lp, size_t len)
+    {
+        if (len == 0 ||
+            (dpids && count == 0))
+            return;
+
+        auto payload = TcpServerSharedPayload::Create(static_cast<const char*>(lp), len);
+
+        // the reference taken here keeps the payload alive until every queue has its own
+        try
+        {
+            m_state->Broadcast(dpids, count, payload);
+        }
+        catch (const Exception&)
+        {
+            payload->RemoveReference();
+            throw;
+        }
+
+        payload->RemoveReference();
+    }
+
+    void AsynchronousTcpServer::Broadcast(const DPID* dpids, size_t count, const void* lp, size_t len, SendReleaseCallback release)
+    {
+        if (!release)
+            throw ArgumentException("A buffer sent by reference needs a release callback.");
+
+        if (len == 0 ||
+            (dpids && count == 0))
+        {
+            release();
+            return;
+        }
+
+        TcpServerSharedPayload* payload;
+        try
+        {
+            payload = nl::memory::ConstructThrow<TcpServerSharedPayload>();
+        }
+        catch (const Exception&)
+        {
+            release();
+            throw;
+        }
+
+        payload->Data = static_cast<const char*>(lp);
+        payload->Length = len;
+        payload->Release = std::move(release);
+
+        try
+        {
+            m_state->Broadcast(dpids, count, payload);
+        }
+        catch (const Exception&)
+        {
+            payload->RemoveReference();
+            throw;
+        }
+
+        payload->RemoveReference();
+    }
+
+    void AsynchronousTcpServer::SendFrame(DPID dpid, const void* lp, size_t len)
+    {
+        auto framing = m_state->Framing;
+        if (framing == FramePrefix::None)
+            throw InvalidOperationException("Frames can only be sent with framing enabled.");
+
+        if (len > m_state->MaxFrameSize)
+            throw ArgumentException("The frame is larger than the maximum frame size.");
+
+        char prefix[FrameMaxPrefixSize];
+        size_t prefix_size = FrameEncodePrefix(framing, len, prefix);
+
+        if (dpid == DPID_ALLPLAYERS)
+        {
+            auto payload = TcpServerSharedPayload::Create(prefix, prefix_size, static_cast<const char*>(lp), len);
+            try
+            {
+                m_state->Broadcast(nullptr, 0, payload);
+            }
+            catch (const Exception&)
+            {
+                payload->RemoveReference();
+                throw;
+            }
+
+            payload->RemoveReference();
+            return;
+        }
+
+        auto client = m_state->AcquireClient(dpid);
+        if (!client)
+            return;
+
+        TcpServerSendResult result;
+
+        client->SendLock.AcquireExclusive();
+        try
+        {
+            client->Queue.Append(prefix, prefix_size, static_cast<const char*>(lp), len);
+            m_state->RequestFlush(client, result);
+        }
+        catch (const Exception&)
+        {
+            client->SendLock.ReleaseExclusive();
+            m_state->ReleaseClient();
+            throw;
+        }
+
+        client->SendLock.ReleaseExclusive();
+        m_state->ReleaseClient();
+
+        m_state->CompleteSend(dpid, result);
+    }
+
+    void AsynchronousTcpServer::SetSendBufferWatermarks(size_t high_watermark, size_t low_watermark)
+    {
+        if (low_watermark > high_watermark)
+            throw ArgumentException("The low watermark cannot be above the high watermark.");
+
+        if (m_state->Running)
+            throw InvalidOperationException("The watermarks cannot be changed while the server is running.");
+
+        m_state->SendHighWatermark = high_watermark;
+        m_state->SendLowWatermark = low_watermark;
+    }
+
+    void AsynchronousTcpServer::SetTimeouts(uint32_t idle_timeout, uint32_t read_timeout, uint32_t write_timeout)
+    {
+        if (m_state->Running)
+            throw InvalidOperationException("The timeouts cannot be changed while the server is running.");
+
+        m_state->IdleTimeout = idle_timeout;
+        m_state->ReadTimeout = read_timeout;
+        m_state->WriteTimeout = write_timeout;
+    }
+
+    void AsynchronousTcpServer::SetFraming(FramePrefix prefix, size_t max_frame_size)
+    {
+        if (prefix != FramePrefix::None &&
+            prefix != FramePrefix::VarInt &&
+            prefix != FramePrefix::UInt16 &&
+            prefix != FramePrefix::UInt32)
+            throw ArgumentException("The prefix type is not valid.");
+
+        if (m_state->Running)
+            throw InvalidOperationException("The framing cannot be changed while the server is running.");
+
+        m_state->Framing = prefix;
+        m_state->MaxFrameSize = max_frame_size;
+    }
+}
+
+#endif
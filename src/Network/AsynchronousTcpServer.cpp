@@ -64,7 +64,7 @@ namespace nl::network
         nl::memory::Destroy(m_thread_parameters);
     }
 
-    void AsynchronousTcpServer::Start(uint32_t bind_ip, uint16_t port, int32_t backlog, int32_t thread_count)
+    void AsynchronousTcpServer::Start(uint32_t bind_ip, uint16_t port, int32_t backlog, int32_t thread_count, TcpServerBackend backend)
     {
         if (m_state->Socket != INVALID_SOCKET)
         {
@@ -106,6 +106,22 @@ namespace nl::network
         }
     }
 
+    uint16_t AsynchronousTcpServer::GetPort() const
+    {
+        SOCKADDR_IN addr;
+        int addr_length = sizeof(addr);
+        if (m_state->Socket == INVALID_SOCKET ||
+            getsockname(m_state->Socket, (sockaddr*)&addr, &addr_length) == SOCKET_ERROR)
+            return 0;
+
+        return ntohs(addr.sin_port);
+    }
+
+    TcpServerBackend AsynchronousTcpServer::GetBackend() const
+    {
+        return TcpServerBackend::Default;
+    }
+
     uint32_t AsynchronousTcpServer::GetClientIP(DPID dpid)
     {
         return 0;
@@ -124,6 +140,41 @@ namespace nl::network
     {
     }
 
+    void AsynchronousTcpServer::Send(DPID dpid, const void* lp, size_t len, SendReleaseCallback release)
+    {
+        throw NotImplementedException();
+    }
+
+    void AsynchronousTcpServer::Broadcast(const DPID* dpids, size_t count, const void* lp, size_t len)
+    {
+        throw NotImplementedException();
+    }
+
+    void AsynchronousTcpServer::Broadcast(const DPID* dpids, size_t count, const void* lp, size_t len, SendReleaseCallback release)
+    {
+        throw NotImplementedException();
+    }
+
+    void AsynchronousTcpServer::SendFrame(DPID dpid, const void* lp, size_t len)
+    {
+        throw NotImplementedException();
+    }
+
+    void AsynchronousTcpServer::SetSendBufferWatermarks(size_t high_watermark, size_t low_watermark)
+    {
+        throw NotImplementedException();
+    }
+
+    void AsynchronousTcpServer::SetTimeouts(uint32_t idle_timeout, uint32_t read_timeout, uint32_t write_timeout)
+    {
+        throw NotImplementedException();
+    }
+
+    void AsynchronousTcpServer::SetFraming(FramePrefix prefix, size_t max_frame_size)
+    {
+        throw NotImplementedException();
+    }
+
     uint32_t AsynchronousTcpServer::WorkerThread()
     {
         // TODO: event signals and stuff...
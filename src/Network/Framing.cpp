@@ -0,0 +1,195 @@
+#include "StdAfx.h"
+
+#include <NativeLib/Network/Framing.h>
+#include <NativeLib/IO/VarInt.h>
+#include <NativeLib/Exceptions.h>
+#include <NativeLib/Util.h>
+
+namespace nl::network
+{
+    // a larger buffer is freed once its frame was handled rather than kept for the rest of the stream
+    static constexpr size_t FrameDecoder_RetainedSize = 65536;
+
+    size_t FrameEncodePrefix(FramePrefix prefix, size_t size, void* dst)
+    {
+        uint8_t* p = static_cast<uint8_t*>(dst);
+
+        switch (prefix)
+        {
+        case FramePrefix::VarInt:
+            return nl::io::VarIntEncode(size, dst);
+        case FramePrefix::UInt16:
+            if (size > UINT16_MAX)
+                throw ArgumentException("The frame is too large for a 16 bit prefix.");
+
+            p[0] = (uint8_t)size;
+            p[1] = (uint8_t)(size >> 8);
+            return 2;
+        case FramePrefix::UInt32:
+            if ((uint64_t)size > UINT32_MAX)
+                throw ArgumentException("The frame is too large for a 32 bit prefix.");
+
+            p[0] = (uint8_t)size;
+            p[1] = (uint8_t)(size >> 8);
+            p[2] = (uint8_t)(size >> 16);
+            p[3] = (uint8_t)(size >> 24);
+            return 4;
+        default:
+            throw ArgumentException("The prefix type is not valid.");
+        }
+    }
+
+    FrameDecoder::FrameDecoder(FramePrefix prefix, size_t max_frame_size) :
+        m_prefix_type(prefix),
+        m_max_frame_size(max_frame_size),
+        m_invalid(false),
+        m_prefix_length(0),
+        m_expected(0),
+        m_buffered(0),
+        m_delivered(false)
+    {
+        if (prefix != FramePrefix::VarInt &&
+            prefix != FramePrefix::UInt16 &&
+            prefix != FramePrefix::UInt32)
+            throw ArgumentException("The prefix type is not valid.");
+    }
+
+    FrameStatus FrameDecoder::Decode(const void*& lp, size_t& size, const void*& frame, size_t& frame_size)
+    {
+        // the caller is done with a frame returned from the buffer
+        if (m_delivered)
+        {
+            m_delivered = false;
+            if (m_buffer.GetSize() > FrameDecoder_RetainedSize)
+                m_buffer = nl::memory::Memory();
+        }
+
+        if (m_invalid)
+            return FrameStatus::Invalid;
+
+        auto p = static_cast<const char*>(lp);
+
+        // the rest of a frame split over receives
+        if (m_expected != 0)
+        {
+            size_t count = nl::util::Min(size, m_expected - m_buffered);
+            memcpy(m_buffer.Get<char>() + m_buffered, p, count);
+            m_buffered += count;
+            lp = p + count;
+            size -= count;
+
+            if (m_buffered < m_expected)
+                return FrameStatus::Incomplete;
+
+            frame = m_buffer.Get();
+            frame_size = m_expected;
+            m_expected = 0;
+            m_buffered = 0;
+            m_delivered = true;
+            return FrameStatus::Complete;
+        }
+
+        uint64_t length = 0;
+        int32_t used; // bytes of the prefix in the data
+        if (m_prefix_length != 0)
+        {
+            size_t count = nl::util::Min(size, sizeof(m_prefix) - m_prefix_length);
+            memcpy(m_prefix + m_prefix_length, p, count);
+
+            used = ReadPrefix(m_prefix, m_prefix_length + count, length);
+            if (used == 0)
+            {
+                m_prefix_length += count;
+                lp = p + count;
+                size -= count;
+                return FrameStatus::Incomplete;
+            }
+
+            if (used > 0)
+                used -= (int32_t)m_prefix_length;
+        }
+        else
+        {
+            if (size == 0)
+                return FrameStatus::Incomplete;
+
+            used = ReadPrefix(p, size, length);
+            if (used == 0)
+            {
+                memcpy(m_prefix, p, size);
+                m_prefix_length = size;
+                lp = p + size;
+                size = 0;
+                return FrameStatus::Incomplete;
+            }
+        }
+
+        if (used < 0 ||
+            length > m_max_frame_size)
+        {
+            m_invalid = true;
+            return FrameStatus::Invalid;
+        }
+
+        size_t left = size - (size_t)used;
+        p += used;
+
+        if (left >= length)
+        {
+            m_prefix_length = 0;
+            frame = p;
+            frame_size = (size_t)length;
+            lp = p + length;
+            size = left - (size_t)length;
+            return FrameStatus::Complete;
+        }
+
+        // allocated before anything changes, so a failure leaves the decoder as it was
+        if (m_buffer.GetSize() < length)
+            m_buffer = nl::memory::Memory::Allocate((size_t)length);
+
+        memcpy(m_buffer.Get(), p, left);
+        m_prefix_length = 0;
+        m_expected = (size_t)length;
+        m_buffered = left;
+        lp = p + left;
+        size = 0;
+        return FrameStatus::Incomplete;
+    }
+
+    void FrameDecoder::Reset()
+    {
+        m_invalid = false;
+        m_prefix_length = 0;
+        m_expected = 0;
+        m_buffered = 0;
+        m_delivered = false;
+
+        if (m_buffer.GetSize() > FrameDecoder_RetainedSize)
+            m_buffer = nl::memory::Memory();
+    }
+
+    // Returns the length of the prefix, 0 if size ends before it does or -1 if it is malformed.
+    int32_t FrameDecoder::ReadPrefix(const void* lp, size_t size, uint64_t& length) const
+    {
+        auto p = static_cast<const uint8_t*>(lp);
+
+        switch (m_prefix_type)
+        {
+        case FramePrefix::VarInt:
+            return nl::io::VarIntDecode(lp, size, length);
+        case FramePrefix::UInt16:
+            if (size < 2)
+                return 0;
+
+            length = (uint64_t)p[0] | ((uint64_t)p[1] << 8);
+            return 2;
+        default:
+            if (size < 4)
+                return 0;
+
+            length = (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24);
+            return 4;
+        }
+    }
+}
@@ -9,8 +9,12 @@ namespace nl
 {
     namespace rpc
     {
+        static constexpr size_t DataBuffer_MinimumCapacity = 256;
+        static constexpr size_t DataBuffer_RetainedCapacity = 262144; // larger memory is freed once the buffer empties
+
         DataBuffer::DataBuffer()
         {
+            m_head = 0;
             m_offset = 0;
             m_length = 0;
             m_capacity = 0;
@@ -25,11 +29,13 @@ namespace nl
 
         DataBuffer::DataBuffer(DataBuffer&& buffer) noexcept
         {
+            m_head = buffer.m_head;
             m_offset = buffer.m_offset;
             m_length = buffer.m_length;
             m_capacity = buffer.m_capacity;
             m_buffer = buffer.m_buffer;
 
+            buffer.m_head = 0;
             buffer.m_offset = 0;
             buffer.m_length = 0;
             buffer.m_capacity = 0;
@@ -38,11 +44,19 @@ namespace nl
 
         DataBuffer& DataBuffer::operator =(DataBuffer&& buffer) noexcept
         {
+            if (this == &buffer)
+                return *this;
+
+            if (m_buffer)
+                nl::systemlayer::GetSystemLayerFunctions()->FreeHeapMemory(m_buffer);
+
+            m_head = buffer.m_head;
             m_offset = buffer.m_offset;
             m_length = buffer.m_length;
             m_capacity = buffer.m_capacity;
             m_buffer = buffer.m_buffer;
 
+            buffer.m_head = 0;
             buffer.m_offset = 0;
             buffer.m_length = 0;
             buffer.m_capacity = 0;
@@ -55,7 +69,7 @@ namespace nl
             if (m_offset + length > m_length)
                 throw EndOfFileException();
 
-            memcpy(lp, m_buffer + m_offset, length);
+            memcpy(lp, m_buffer + m_head + m_offset, length);
             m_offset += length;
             return *this;
         }
@@ -64,7 +78,7 @@ namespace nl
         {
             EnsureWrite(length);
 
-            memcpy(m_buffer + m_offset, lp, length);
+            memcpy(m_buffer + m_head + m_offset, lp, length);
             m_offset += length;
             if (m_length < m_offset)
                 m_length = m_offset;
@@ -77,19 +91,16 @@ namespace nl
             int32_t length;
             *this >> length;
 
-            thread_local char buf[4096];
-            char* p = buf;
-            if (length + 1 > sizeof(buf))
-                p = (char*)nl::systemlayer::GetSystemLayerFunctions()->AllocateHeapMemory(length + 1);
-
-            Read(p, length);
-
-            auto result = nl::String(p, length);
+            if (length < 0)
+                throw EndOfFileException();
 
-            if (p != buf)
-                nl::systemlayer::GetSystemLayerFunctions()->FreeHeapMemory(p);
+            // the string is made straight from the buffer, which holds it contiguously
+            auto p = static_cast<const char*>(Peek((size_t)length));
+            if (!p)
+                throw EndOfFileException();
 
-            return result;
+            m_offset += (size_t)length;
+            return nl::String(p, (size_t)length);
         }
 
         DataBuffer& DataBuffer::WriteString(const std::string_view& str)
@@ -98,41 +109,75 @@ namespace nl
             return Write(str.data(), str.length());
         }
 
+        const void* DataBuffer::Peek(size_t length) const
+        {
+            if (m_offset + length > m_length)
+                return nullptr;
+
+            return m_buffer + m_head + m_offset;
+        }
+
         DataBuffer& DataBuffer::Delete(size_t count)
         {
             if (count > m_length)
                 throw EndOfFileException();
 
-            memmove(m_buffer, m_buffer + count, m_length - count);
+            m_head += count;
             m_length -= count;
             if (m_offset >= count)
                 m_offset -= count;
             else
                 m_offset = 0;
 
+            // an empty buffer starts over at the front of its memory for free
+            if (m_length == 0)
+            {
+                m_head = 0;
+
+                if (m_capacity > DataBuffer_RetainedCapacity)
+                {
+                    nl::systemlayer::GetSystemLayerFunctions()->FreeHeapMemory(m_buffer);
+                    m_buffer = nullptr;
+                    m_capacity = 0;
+                }
+            }
+
             return *this;
         }
 
         void DataBuffer::EnsureWrite(size_t add)
         {
-            if (m_offset + add <= m_capacity)
+            size_t needed = m_offset + add;
+            if (m_head + needed <= m_capacity)
                 return;
 
-            size_t newCapacity = m_capacity;
-            if (newCapacity == 0)
+            // moving the data to the front costs no more than what was consumed to make the room
+            if (needed <= m_capacity &&
+                m_head >= m_length)
             {
-                newCapacity = 16384;
+                memmove(m_buffer, m_buffer + m_head, m_length);
+                m_head = 0;
+                return;
             }
 
-            while (newCapacity < m_offset + add)
+            size_t newCapacity = m_capacity != 0 ? m_capacity * 2 : DataBuffer_MinimumCapacity;
+            while (newCapacity < needed)
                 newCapacity *= 2;
 
+            // a new block takes only the data, leaving the consumed front behind
+            auto buffer = (char*)nl::systemlayer::GetSystemLayerFunctions()->AllocateHeapMemory(newCapacity);
+            if (!buffer)
+                throw BadAllocationException();
+
             if (m_buffer)
-                m_buffer = (char*)nl::systemlayer::GetSystemLayerFunctions()->ReallocateHeapMemory(m_buffer, newCapacity);
-            else
-                m_buffer = (char*)nl::systemlayer::GetSystemLayerFunctions()->AllocateHeapMemory(newCapacity);
+            {
+                memcpy(buffer, m_buffer + m_head, m_length);
+                nl::systemlayer::GetSystemLayerFunctions()->FreeHeapMemory(m_buffer);
+            }
 
+            m_buffer = buffer;
+            m_head = 0;
             m_capacity = newCapacity;
         }
     }
-}
\ No newline at end of file
+}
@@ -11,6 +11,10 @@ namespace nl
     {
         DeclareGenericException(EndOfFileException, "Attempted to perform I/O operation beyond the end of the file");
 
+        // Byte buffer read and written at an offset from the start of its data. Delete drops data from the front
+        // by moving the start past it, so consuming packets one by one never copies what follows them; the data is
+        // only moved to the front of the memory when a write would otherwise have to grow it and at least as much
+        // was consumed as is left, which keeps the copying linear in the bytes written.
         class DataBuffer
         {
         public:
@@ -28,8 +32,8 @@ namespace nl
             size_t GetLength() const { return m_length; }
             size_t GetCapacity() const { return m_capacity; }
 
-            void* GetData() { return m_buffer; }
-            const void* GetData() const { return m_buffer; }
+            void* GetData() { return m_buffer + m_head; }
+            const void* GetData() const { return m_buffer + m_head; }
 
             void SetOffset(size_t offset) { m_offset = offset; }
             void SetLength(size_t length) { m_length = length; }
@@ -38,7 +42,12 @@ namespace nl
             DataBuffer& Write(const void* lp, size_t length);
             nl::String ReadString();
             DataBuffer& WriteString(const std::string_view& str);
-            
+
+            // Returns the length bytes at the offset without reading them, or nullptr if fewer are buffered. They
+            // are contiguous and stay valid until the next write.
+            const void* Peek(size_t length) const;
+
+            // Drops count bytes from the front; the offset moves back with the data.
             DataBuffer& Delete(size_t count);
 
             template <typename T>
@@ -49,6 +58,7 @@ namespace nl
 
         private:
             char* m_buffer;
+            size_t m_head; // where the data starts in m_buffer
             size_t m_offset;
             size_t m_length;
             size_t m_capacity;
@@ -0,0 +1,435 @@
+#include "StdAfx.h"
+
+#include <NativeLib/Rpc.h>
+#include <NativeLib/Platform/Platform.h>
+#include <NativeLib/Containers/Vector.h>
+#include <NativeLib/Threading/Interlocked.h>
+#include <NativeLib/Threading/ReadWriteLock.h>
+#include <NativeLib/Allocators.h>
+#include <NativeLib/Exceptions.h>
+
+#ifdef NL_PLATFORM_LINUX
+
+//!ALLOW_INCLUDE "DataBuffer.h"
+//!ALLOW_INCLUDE "RpcInternal.h"
+//!ALLOW_INCLUDE "sys/epoll.h"
+//!ALLOW_INCLUDE "sys/eventfd.h"
+//!ALLOW_INCLUDE "sys/socket.h"
+//!ALLOW_INCLUDE "sys/stat.h"
+//!ALLOW_INCLUDE "sys/uio.h"
+//!ALLOW_INCLUDE "sys/un.h"
+//!ALLOW_INCLUDE "unistd.h"
+#include "DataBuffer.h"
+#include "RpcInternal.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace nl
+{
+    namespace rpc
+    {
+        static constexpr int RpcServer_MaxEvents = 64;
+        static constexpr size_t RpcServer_ReceiveBufferSize = 65536;
+
+        // epoll data of the descriptors that are not clients
+        static char RpcServer_ListenerTag;
+        static char RpcServer_WakeTag;
+
+        struct RpcServerState
+        {
+            Server* Rpc = nullptr;
+            int Epoll = -1;
+            int Listener = -1;
+            int WakeEvent = -1; // signaled by Stop
+            nl::Vector<PipeClient*> Clients;
+            char ReceiveBuffer[RpcServer_ReceiveBufferSize];
+
+            ~RpcServerState()
+            {
+                if (WakeEvent != -1)
+                    close(WakeEvent);
+            }
+
+            void Accept()
+            {
+                for (;;)
+                {
+                    int socket = accept4(Listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (socket == -1)
+                    {
+                        if (errno == EINTR ||
+                            errno == ECONNABORTED)
+                            continue;
+
+                        // EAGAIN once the backlog is empty; other errors are left for the next connection
+                        return;
+                    }
+
+                    int32_t id = nl::threading::Interlocked::Increment(&Rpc->m_lNextClientId);
+
+                    auto client = nl::memory::Construct<PipeClient>(socket, id);
+                    if (!client)
+                    {
+                        close(socket);
+                        continue;
+                    }
+
+                    epoll_event ev = {};
+                    ev.events = EPOLLIN | EPOLLRDHUP;
+                    ev.data.ptr = client;
+
+                    try
+                    {
+                        Clients.Add(client);
+                    }
+                    catch (const Exception&)
+                    {
+                        client->Release();
+                        continue;
+                    }
+
+                    if (epoll_ctl(Epoll, EPOLL_CTL_ADD, socket, &ev) == -1)
+                    {
+                        Clients.PopLast();
+                        client->Release();
+                        continue;
+                    }
+
+                    if (Rpc->m_pfnEventHandler)
+                        Rpc->m_pfnEventHandler(Rpc, Events::ClientConnected, id);
+                }
+            }
+
+            // Returns false if the client is gone or sent a malformed packet.
+            bool Receive(PipeClient* client)
+            {
+                // level triggered, so a client sending a lot takes turns with the others
+                ssize_t received = recv(client->GetSocket(), ReceiveBuffer, sizeof(ReceiveBuffer), 0);
+                if (received == -1)
+                    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+                if (received == 0)
+                    return false;
+
+                DataBuffer& buffer = client->GetBuffer();
+                buffer.SetOffset(buffer.GetLength());
+                buffer.Write(ReceiveBuffer, (size_t)received);
+
+                return Rpc->HandlePackets(client);
+            }
+
+            // Writes what the socket did not take before. Returns false if the connection broke.
+            bool Flush(PipeClient* client)
+            {
+                auto lock = nl::threading::ReadWriteLockScope(&client->GetSendLock(), true);
+
+                DataBuffer& pending = client->GetSendBuffer();
+                while (pending.GetLength() != 0)
+                {
+                    ssize_t sent = send(client->GetSocket(), pending.GetData(), pending.GetLength(), MSG_NOSIGNAL);
+                    if (sent == -1)
+                    {
+                        if (errno == EINTR)
+                            continue;
+
+                        return errno == EAGAIN || errno == EWOULDBLOCK;
+                    }
+
+                    pending.Delete((size_t)sent);
+                }
+
+                epoll_event ev = {};
+                ev.events = EPOLLIN | EPOLLRDHUP;
+                ev.data.ptr = client;
+                epoll_ctl(Epoll, EPOLL_CTL_MOD, client->GetSocket(), &ev);
+
+                client->SetWriting(false);
+                return true;
+            }
+
+            void CloseClient(PipeClient* client)
+            {
+                // requests on the dispatch pool keep the client, and the socket, until they complete; they no longer
+                // respond once it is marked closed
+                client->GetSendLock().AcquireExclusive();
+                client->SetClosed();
+                client->GetSendLock().ReleaseExclusive();
+
+                epoll_ctl(Epoll, EPOLL_CTL_DEL, client->GetSocket(), nullptr);
+
+                size_t index = Clients.Find(client);
+                if (index != Clients.npos)
+                {
+                    Clients[index] = Clients[Clients.GetCount() - 1];
+                    Clients.PopLast();
+                }
+
+                auto id = client->GetId();
+                client->Release();
+
+                if (Rpc->m_pfnEventHandler)
+                    Rpc->m_pfnEventHandler(Rpc, Events::ClientDisconnected, id);
+            }
+
+            void Close(const char* path)
+            {
+                while (Clients.GetCount() != 0)
+                    CloseClient(Clients[Clients.GetCount() - 1]);
+
+                if (Listener != -1)
+                {
+                    close(Listener);
+                    Listener = -1;
+                    unlink(path);
+                }
+
+                if (Epoll != -1)
+                {
+                    close(Epoll);
+                    Epoll = -1;
+                }
+            }
+
+            void Open(const char* path)
+            {
+                sockaddr_un addr = {};
+                addr.sun_family = AF_UNIX;
+
+                size_t length = strlen(path);
+                if (length == 0 ||
+                    length >= sizeof(addr.sun_path))
+                    throw ArgumentException("The socket path is empty or too long.");
+
+                memcpy(addr.sun_path, path, length + 1);
+
+                // a socket file left by a server that did not shut down would make bind fail
+                struct stat st;
+                if (lstat(path, &st) == 0 &&
+                    S_ISSOCK(st.st_mode))
+                    unlink(path);
+
+                Epoll = epoll_create1(EPOLL_CLOEXEC);
+                if (Epoll == -1)
+                    throw SocketException("Failed to create the epoll instance of the RPC server.", errno);
+
+                epoll_event ev = {};
+                ev.events = EPOLLIN;
+                ev.data.ptr = &RpcServer_WakeTag;
+                if (epoll_ctl(Epoll, EPOLL_CTL_ADD, WakeEvent, &ev) == -1)
+                    throw SocketException("Failed to add the wake event to epoll.", errno);
+
+                int socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+                if (socket == -1)
+                    throw SocketException("Failed to create socket.", errno);
+
+                if (bind(socket, (sockaddr*)&addr, sizeof(addr)) == -1)
+                {
+                    int error = errno;
+                    close(socket);
+                    throw SocketException("Failed to bind socket.", error);
+                }
+
+                // from here on Close removes the socket file
+                Listener = socket;
+
+                if (listen(socket, SOMAXCONN) == -1)
+                    throw SocketException("Failed to listen on socket.", errno);
+
+                ev.data.ptr = &RpcServer_ListenerTag;
+                if (epoll_ctl(Epoll, EPOLL_CTL_ADD, socket, &ev) == -1)
+                    throw SocketException("Failed to add the listening socket to epoll.", errno);
+            }
+
+            // Returns once Stop is called.
+            void Loop()
+            {
+                epoll_event events[RpcServer_MaxEvents];
+                bool stopping = false;
+
+                while (!stopping)
+                {
+                    int count = epoll_wait(Epoll, events, RpcServer_MaxEvents, -1);
+                    if (count == -1)
+                    {
+                        if (errno == EINTR)
+                            continue;
+
+                        throw SocketException("Failed to wait for RPC server events.", errno);
+                    }
+
+                    for (int i = 0; i < count; ++i)
+                    {
+                        void* ptr = events[i].data.ptr;
+                        if (ptr == &RpcServer_WakeTag)
+                        {
+                            uint64_t value;
+                            (void)!read(WakeEvent, &value, sizeof(value));
+                            stopping = true;
+                            continue;
+                        }
+
+                        if (ptr == &RpcServer_ListenerTag)
+                        {
+                            Accept();
+                            continue;
+                        }
+
+                        auto client = static_cast<PipeClient*>(ptr);
+                        uint32_t flags = events[i].events;
+
+                        if ((flags & EPOLLOUT) &&
+                            !Flush(client))
+                        {
+                            CloseClient(client);
+                            continue;
+                        }
+
+                        if ((flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) &&
+                            !Receive(client))
+                            CloseClient(client);
+                    }
+                }
+            }
+        };
+
+        ///////////////
+
+        Server::Server()
+        {
+            m_pfnEventHandler = nullptr;
+            m_lUserData = 0;
+            m_lNextClientId = 0;
+            m_running = false;
+            m_pool = nullptr;
+            m_ordered = true;
+            m_outstanding = 0;
+
+            m_state = nl::memory::ConstructThrow<RpcServerState>();
+            m_state->Rpc = this;
+
+            m_state->WakeEvent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (m_state->WakeEvent == -1)
+            {
+                int error = errno;
+                nl::memory::Destroy(m_state);
+                throw SocketException("Failed to create the wake event of the RPC server.", error);
+            }
+        }
+
+        Server::~Server()
+        {
+            nl::memory::Destroy(m_state);
+        }
+
+        void Server::Run(const char* path)
+        {
+            if (m_running)
+                throw InvalidOperationException("The server is already running.");
+
+            m_running = true;
+
+            // the procedures still running on the pool use the server, and their responses go out before the
+            // clients are closed
+            try
+            {
+                m_state->Open(path);
+                m_state->Loop();
+            }
+            catch (...)
+            {
+                WaitForRequests();
+                m_state->Close(path);
+                m_running = false;
+                throw;
+            }
+
+            WaitForRequests();
+            m_state->Close(path);
+            m_running = false;
+        }
+
+        void Server::Stop()
+        {
+            uint64_t value = 1;
+            (void)!write(m_state->WakeEvent, &value, sizeof(value));
+        }
+
+        void Server::SendJson(class PipeClient* client, int requestId, nl::Shared<const nl::JsonObject> json)
+        {
+            nl::String str;
+            nl::GenerateJsonString(str, json);
+
+            auto lock = nl::threading::ReadWriteLockScope(&client->GetSendLock(), true);
+            if (client->IsClosed())
+                return;
+
+            // the same packet as on Windows: packet size, request id and the length prefixed string
+            int32_t header[3] = { int32_t(sizeof(int32_t) + str.GetLength()), requestId, int32_t(str.GetLength()) };
+            size_t length = sizeof(header) + str.GetLength();
+
+            // written right away unless earlier responses are still waiting for the socket
+            size_t sent = 0;
+            if (!client->IsWriting())
+            {
+                iovec segments[2] =
+                {
+                    { header, sizeof(header) },
+                    { const_cast<char*>(str.c_str()), str.GetLength() }
+                };
+
+                msghdr message = {};
+                message.msg_iov = segments;
+                message.msg_iovlen = 2;
+
+                ssize_t result;
+                do
+                {
+                    result = sendmsg(client->GetSocket(), &message, MSG_NOSIGNAL);
+                }
+                while (result == -1 && errno == EINTR);
+
+                if (result == -1)
+                {
+                    // a broken connection is closed by the loop once it sees the hang up
+                    if (errno != EAGAIN &&
+                        errno != EWOULDBLOCK)
+                        return;
+
+                    result = 0;
+                }
+
+                sent = (size_t)result;
+                if (sent == length)
+                    return;
+            }
+
+            DataBuffer& pending = client->GetSendBuffer();
+            pending.SetOffset(pending.GetLength());
+            if (sent < sizeof(header))
+            {
+                pending.Write(reinterpret_cast<const char*>(header) + sent, sizeof(header) - sent);
+                sent = sizeof(header);
+            }
+
+            pending.Write(str.c_str() + (sent - sizeof(header)), length - sent);
+
+            if (!client->IsWriting())
+            {
+                epoll_event ev = {};
+                ev.events = EPOLLIN | EPOLLRDHUP | EPOLLOUT;
+                ev.data.ptr = client;
+                epoll_ctl(m_state->Epoll, EPOLL_CTL_MOD, client->GetSocket(), &ev);
+
+                client->SetWriting(true);
+            }
+        }
+    }
+}
+
+#endif
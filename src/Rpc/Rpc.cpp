@@ -1,7 +1,5 @@
 #include "StdAfx.h"
 
-#ifdef NL_PLATFORM_WINDOWS
-
 #include <NativeLib/Rpc.h>
 #include <NativeLib/Logger.h>
 
@@ -13,9 +11,10 @@
 #include "RpcInternal.h"
 
 #include <NativeLib/SystemLayer/SystemLayer.h>
+#include <NativeLib/IO/IOEnum.h>
 #include <NativeLib/Allocators.h>
 #include <NativeLib/Threading/Interlocked.h>
-#include <NativeLib/RAII/Scoped.h>
+#include <NativeLib/Threading/ThreadPool.h>
 #include <NativeLib/RAII/Shared.h>
 
 #ifdef NL_PLATFORM_WINDOWS
@@ -29,23 +28,68 @@ namespace nl
 {
     namespace rpc
     {
-        static nl::Stack<OverlappedEx*> g_overlappedStack;
+#ifdef NL_PLATFORM_WINDOWS
+        // unused structures, taken and returned by the thread in Run and by procedures responding from the
+        // dispatch pool; reused last in, first out while their memory is still warm
+        static nl::SafeQueue<OverlappedEx> g_overlappedPool;
 
         inline OverlappedEx* AllocateOverlapped(IOEVENT event)
         {
-            if (g_overlappedStack.GetCount() == 0)
-                g_overlappedStack.Push((OverlappedEx*)nl::systemlayer::GetSystemLayerFunctions()->AllocateHeapMemory(sizeof(OverlappedEx)));
-
-            auto lpOverlapped = g_overlappedStack.Pop();
+            auto lpOverlapped = g_overlappedPool.PopHead();
+            if (!lpOverlapped)
+            {
+                lpOverlapped = (OverlappedEx*)nl::systemlayer::GetSystemLayerFunctions()->AllocateHeapMemory(sizeof(OverlappedEx));
+                if (!lpOverlapped)
+                    throw BadAllocationException();
+            }
 
-            ZeroMemory(lpOverlapped, sizeof(OverlappedEx));
+            // the data buffer is left as it is, everything in front of it is cleared
+            ZeroMemory(lpOverlapped, offsetof(OverlappedEx, Buffer));
             lpOverlapped->Event = event;
             return lpOverlapped;
         }
 
         inline void FreeOverlapped(OverlappedEx* lpOverlapped)
         {
-            g_overlappedStack.Push(lpOverlapped);
+            if (lpOverlapped->HeapBuffer)
+            {
+                nl::systemlayer::GetSystemLayerFunctions()->FreeHeapMemory(lpOverlapped->HeapBuffer);
+                lpOverlapped->HeapBuffer = nullptr;
+            }
+
+            g_overlappedPool.AddHead(lpOverlapped);
+        }
+
+        // Gathers the segments into one buffer for WriteFile, which named pipes only accept contiguously.
+        // Returns the buffer, which is the inline one unless the segments do not fit it. If no buffer can be
+        // allocated, the structure is freed and BadAllocationException is thrown.
+        static char* GatherWrite(OverlappedEx* lpOverlapped, const nl::io::IOSegment* segments, int32_t count, size_t& length)
+        {
+            length = 0;
+            for (int32_t i = 0; i < count; ++i)
+                length += segments[i].Length;
+
+            char* buffer = lpOverlapped->Buffer;
+            if (length > sizeof(lpOverlapped->Buffer))
+            {
+                lpOverlapped->HeapBuffer = (char*)nl::systemlayer::GetSystemLayerFunctions()->AllocateHeapMemory(length);
+                if (!lpOverlapped->HeapBuffer)
+                {
+                    FreeOverlapped(lpOverlapped);
+                    throw BadAllocationException();
+                }
+
+                buffer = lpOverlapped->HeapBuffer;
+            }
+
+            char* p = buffer;
+            for (int32_t i = 0; i < count; ++i)
+            {
+                memcpy(p, segments[i].Data, segments[i].Length);
+                p += segments[i].Length;
+            }
+
+            return buffer;
         }
 
         ///////////////
@@ -56,6 +100,10 @@ namespace nl
             m_hIocp = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
             m_lUserData = 0;
             m_lNextClientId = 0;
+            m_running = false;
+            m_pool = nullptr;
+            m_ordered = true;
+            m_outstanding = 0;
         }
 
         Server::~Server()
@@ -95,6 +143,7 @@ namespace nl
 
         void Server::Run(const wchar_t* pipeName)
         {
+            m_running = true;
             ConnectNewClient(pipeName);
 
             DWORD dwBytesTransferred;
@@ -155,21 +204,17 @@ namespace nl
                     buffer.SetOffset(buffer.GetLength());
                     buffer.Write(lpOverlapped->Buffer, dwBytesTransferred);
 
-                    while (buffer.GetLength() >= HEADER_SIZE)
+                    if (!HandlePackets(client))
                     {
-                        buffer.SetOffset(0);
-
-                        int packetSize, requestId;
-                        buffer >> packetSize >> requestId;
-
-                        auto remaining = int(buffer.GetLength() - buffer.GetOffset());
-                        if (remaining < packetSize)
-                            break;
+                        // no read is issued again, so the pipe closes once the writes still pending complete
+                        auto id = client->GetId();
+                        client->Release();
+                        FreeOverlapped(lpOverlapped);
 
-                        // dispatch and read packet...
-                        HandleRequest(client, buffer, requestId);
+                        if (m_pfnEventHandler)
+                            m_pfnEventHandler(this, Events::ClientDisconnected, id);
 
-                        buffer.Delete(HEADER_SIZE + packetSize);
+                        continue;
                     }
 
                     ReadFile(lpOverlapped->Client->GetPipe(), lpOverlapped->Buffer, sizeof(lpOverlapped->Buffer), nullptr, &lpOverlapped->Overlapped);
@@ -181,13 +226,218 @@ namespace nl
                     FreeOverlapped(lpOverlapped);
                 }
             }
+
+            // the procedures still running on the pool may respond to clients and use the server
+            WaitForRequests();
+            m_running = false;
+        }
+
+        void Server::Stop()
+        {
+            auto lpOverlapped = AllocateOverlapped(IOEVENT_SHUTDOWN);
+            PostQueuedCompletionStatus(m_hIocp, 0, 0, &lpOverlapped->Overlapped);
+        }
+
+        void Server::SendJson(class PipeClient* client, int requestId, nl::Shared<const nl::JsonObject> json)
+        {
+            nl::String str;
+            nl::GenerateJsonString(str, json);
+
+            // packet size, request id and the length prefix of the string followed by the string itself,
+            // copied once into the write buffer instead of going through a DataBuffer first
+            int32_t header[3] = { int32_t(sizeof(int32_t) + str.GetLength()), requestId, int32_t(str.GetLength()) };
+            const nl::io::IOSegment segments[] =
+            {
+                { header, sizeof(header) },
+                { str.c_str(), str.GetLength() }
+            };
+
+            auto lpOverlapped = AllocateOverlapped(IOEVENT_WRITE);
+
+            size_t length;
+            char* buffer = GatherWrite(lpOverlapped, segments, 2, length);
+
+            lpOverlapped->Client = client;
+            lpOverlapped->Client->AddRef();
+            WriteFile(client->GetPipe(), buffer, (DWORD)length, nullptr, &lpOverlapped->Overlapped);
+        }
+#endif
+
+        bool Server::HandlePackets(class PipeClient* client)
+        {
+            DataBuffer& buffer = client->GetBuffer();
+
+            while (buffer.GetLength() >= HEADER_SIZE)
+            {
+                buffer.SetOffset(0);
+
+                int32_t packetSize, requestId;
+                buffer >> packetSize >> requestId;
+
+                if (packetSize < 0)
+                    return false;
+
+                if (buffer.GetLength() - HEADER_SIZE < (size_t)packetSize)
+                    break;
+
+                // the request only sees its own packet, so a malformed one cannot read into the next
+                size_t length = buffer.GetLength();
+                buffer.SetLength(HEADER_SIZE + packetSize);
+
+                nl::String method;
+                nl::String jsonData;
+                try
+                {
+                    method = buffer.ReadString();
+                    jsonData = buffer.ReadString();
+                }
+                catch (const EndOfFileException&)
+                {
+                    buffer.SetLength(length);
+                    return false;
+                }
+
+                buffer.SetLength(length);
+                buffer.Delete(HEADER_SIZE + packetSize);
+
+                Dispatch(client, requestId, std::move(method), std::move(jsonData));
+            }
+
+            return true;
+        }
+
+        void Server::SetDispatch(nl::threading::ThreadPool* pool, bool ordered)
+        {
+            if (m_running)
+                throw InvalidOperationException("The dispatch cannot be changed while the server is running.");
+
+            m_pool = pool;
+            m_ordered = ordered;
+        }
+
+        void Server::Dispatch(class PipeClient* client, int requestId, nl::String&& method, nl::String&& jsonData)
+        {
+            if (!m_pool)
+            {
+                HandleRequest(client, requestId, method, jsonData);
+                return;
+            }
+
+            auto request = nl::memory::ConstructThrow<RpcRequest>();
+            request->Client = client;
+            request->Id = requestId;
+            request->Method = std::move(method);
+            request->JsonData = std::move(jsonData);
+
+            client->AddRef();
+
+            m_dispatch_lock.AcquireExclusive();
+            ++m_outstanding;
+            m_dispatch_lock.ReleaseExclusive();
+
+            if (m_ordered)
+            {
+                auto& queue = client->GetRequestQueue();
+                queue.Lock.AcquireExclusive();
+
+                if (queue.Busy)
+                {
+                    queue.Waiting.AddTail(request);
+                    queue.Lock.ReleaseExclusive();
+                    return;
+                }
+
+                queue.Busy = true;
+                queue.Lock.ReleaseExclusive();
+            }
+
+            Submit(request);
+        }
+
+        void Server::Submit(RpcRequest* request)
+        {
+            try
+            {
+                m_pool->Queue([this, request]() { Execute(request); });
+            }
+            catch (...)
+            {
+                // the pool had no room for it, so the request runs here rather than being lost
+                Execute(request);
+            }
         }
 
-        void Server::HandleRequest(class PipeClient* client, class DataBuffer& buffer, int requestId)
+        void Server::Execute(RpcRequest* request)
         {
-            const auto method = buffer.ReadString();
-            const auto jsonDataString = buffer.ReadString();
+            auto client = request->Client;
+
+            try
+            {
+                HandleRequest(client, request->Id, request->Method, request->JsonData);
+            }
+            catch (...)
+            {
+                // failed outside the procedure, most likely out of memory; the client still gets an answer if one
+                // can be sent, and the request is finished either way so the queue and the count move on
+                try
+                {
+                    SendError(client, request->Id, "Internal server error.");
+                }
+                catch (...)
+                {
+                }
+            }
+
+            // the client's next request goes to the back of the pool instead of following on this thread, so a
+            // client sending a lot takes turns with the others
+            RpcRequest* next = nullptr;
+            if (m_ordered)
+            {
+                auto& queue = client->GetRequestQueue();
+                queue.Lock.AcquireExclusive();
 
+                next = queue.Waiting.PopHead();
+                if (!next)
+                    queue.Busy = false;
+
+                queue.Lock.ReleaseExclusive();
+            }
+
+            client->Release();
+            nl::memory::Destroy(request);
+
+            if (next)
+                Submit(next);
+
+            // under the lock, so Run cannot see the count drop and return before the event was set
+            m_dispatch_lock.AcquireExclusive();
+            if (--m_outstanding == 0)
+                m_idle.Set();
+
+            m_dispatch_lock.ReleaseExclusive();
+        }
+
+        void Server::WaitForRequests()
+        {
+            for (;;)
+            {
+                m_dispatch_lock.AcquireExclusive();
+
+                bool idle = m_outstanding == 0;
+                if (!idle)
+                    m_idle.Reset();
+
+                m_dispatch_lock.ReleaseExclusive();
+
+                if (idle)
+                    break;
+
+                m_idle.Wait();
+            }
+        }
+
+        void Server::HandleRequest(class PipeClient* client, int requestId, const nl::String& method, const nl::String& jsonDataString)
+        {
             const auto& it = m_procedures.find(method);
             if (it == m_procedures.end())
             {
@@ -217,6 +467,11 @@ namespace nl
                 SendError(client, requestId, ex.GetMessage());
                 return;
             }
+            catch (...)
+            {
+                SendError(client, requestId, "Unhandled exception in procedure.");
+                return;
+            }
 
             // Send back result ...
             auto resp = nl::CreateJsonObject<nl::JsonObject>();
@@ -231,25 +486,5 @@ namespace nl
             obj->SetString("error", message);
             SendJson(client, requestId, obj);
         }
-
-        void Server::SendJson(class PipeClient* client, int requestId, nl::Shared<const nl::JsonObject> json)
-        {
-            nl::String str;
-            nl::GenerateJsonString(str, json);
-
-            DataBuffer out;
-            out << 0 << requestId; // packet size and request id
-            out.WriteString(str);
-            out.SetOffset(0);
-            out << int(out.GetLength() - HEADER_SIZE);
-
-            auto lpOverlapped = AllocateOverlapped(IOEVENT_WRITE);
-            memcpy(lpOverlapped->Buffer, out.GetData(), out.GetLength());
-            lpOverlapped->Client = client;
-            lpOverlapped->Client->AddRef();
-            WriteFile(client->GetPipe(), lpOverlapped->Buffer, (DWORD)out.GetLength(), nullptr, &lpOverlapped->Overlapped);
-        }
     }
-}
-
-#endif
\ No newline at end of file
+}
\ No newline at end of file
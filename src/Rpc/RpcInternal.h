@@ -1,9 +1,40 @@
 #pragma once
 
-#ifdef NL_PLATFORM_WINDOWS
-
 #include <NativeLib/Allocators.h>
+#include <NativeLib/Containers/Queue.h>
 #include <NativeLib/Threading/Interlocked.h>
+#include <NativeLib/Threading/ReadWriteLock.h>
+#include <NativeLib/String.h>
+
+namespace nl
+{
+    namespace rpc
+    {
+        class PipeClient;
+
+        // A request handed to the dispatch pool.
+        struct RpcRequest
+        {
+            RpcRequest* prev = nullptr;
+            RpcRequest* next = nullptr;
+
+            PipeClient* Client = nullptr; // referenced until the request completes
+            int32_t Id = 0;
+            nl::String Method;
+            nl::String JsonData;
+        };
+
+        // With ordered dispatch, the requests of a client waiting for the one it has on the pool.
+        struct RpcRequestQueue
+        {
+            nl::threading::ReadWriteLock Lock;
+            nl::Queue<RpcRequest> Waiting;
+            bool Busy = false;
+        };
+    }
+}
+
+#ifdef NL_PLATFORM_WINDOWS
 
 //!ALLOW_INCLUDE "Windows.h"
 
@@ -52,22 +83,95 @@ namespace nl
             HANDLE GetPipe() const { return m_hPipe; }
             DataBuffer& GetBuffer() { return m_buffer; }
             LONG GetId() const { return m_lClientId; }
+            RpcRequestQueue& GetRequestQueue() { return m_requests; }
 
         private:
             int32_t m_lReferences;
             void* m_hPipe;
             DataBuffer m_buffer;
             int32_t m_lClientId;
+            RpcRequestQueue m_requests;
         };
 
         struct OverlappedEx
         {
-            OVERLAPPED Overlapped;
+            OVERLAPPED Overlapped; // first, as the completions hand it back for the whole structure
             IOEVENT Event;
             PipeClient* Client;
+            char* HeapBuffer; // holds writes that do not fit Buffer, released with the structure
             char Buffer[65536];
+
+            OverlappedEx* prev; // linked into the free list while unused
+            OverlappedEx* next;
         };
     }
 }
 
-#endif
\ No newline at end of file
+#endif
+
+#ifdef NL_PLATFORM_LINUX
+
+//!ALLOW_INCLUDE "unistd.h"
+#include <unistd.h>
+
+namespace nl
+{
+    namespace rpc
+    {
+        class PipeClient
+        {
+        public:
+            PipeClient(int socket, int32_t lClientId) :
+                m_socket(socket),
+                m_lReferences(1),
+                m_lClientId(lClientId),
+                m_writing(false),
+                m_closed(false)
+            {
+            }
+
+            ~PipeClient()
+            {
+                close(m_socket);
+            }
+
+            void AddRef()
+            {
+                nl::threading::Interlocked::Increment(&m_lReferences);
+            }
+
+            void Release()
+            {
+                if (nl::threading::Interlocked::Decrement(&m_lReferences) == 0)
+                    nl::memory::Destroy(this);
+            }
+
+            int GetSocket() const { return m_socket; }
+            DataBuffer& GetBuffer() { return m_buffer; }
+            int32_t GetId() const { return m_lClientId; }
+            RpcRequestQueue& GetRequestQueue() { return m_requests; }
+
+            // responses the socket did not take right away, written as it becomes writable; the send lock covers
+            // them and the flags below, as procedures on the dispatch pool respond from their own threads
+            nl::threading::ReadWriteLock& GetSendLock() { return m_send_lock; }
+            DataBuffer& GetSendBuffer() { return m_send_buffer; }
+            bool IsWriting() const { return m_writing; }
+            void SetWriting(bool writing) { m_writing = writing; }
+            bool IsClosed() const { return m_closed; }
+            void SetClosed() { m_closed = true; }
+
+        private:
+            int m_socket;
+            int32_t m_lReferences;
+            int32_t m_lClientId;
+            DataBuffer m_buffer;
+            RpcRequestQueue m_requests;
+            nl::threading::ReadWriteLock m_send_lock;
+            DataBuffer m_send_buffer;
+            bool m_writing; // waiting for the socket to become writable
+            bool m_closed; // the server let go of the client, which only requests still reference
+        };
+    }
+}
+
+#endif
@@ -9,56 +9,322 @@
 
 #include <NativeLib/Exceptions.h>
 
+//!ALLOW_INCLUDE "fcntl.h"
+//!ALLOW_INCLUDE "unistd.h"
+//!ALLOW_INCLUDE "sys/stat.h"
+//!ALLOW_INCLUDE "sys/uio.h"
+//!ALLOW_INCLUDE "sys/sendfile.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+
 namespace nl::systemlayer::defaults
 {
+    // segments passed to a single readv or writev call, well below IOV_MAX
+    static constexpr int32_t MaxSegmentsPerCall = 64;
+
+    // file handles are the descriptor plus one so that 0 remains the invalid handle
+    static int GetDescriptor(FileHandle fp)
+    {
+        return (int)(fp - 1);
+    }
+
     static FileHandle Open(const char* filename, nl::io::CreateMode mode, bool writable)
     {
-        throw NotImplementedException();
+        int flags = O_CLOEXEC;
+        switch (mode)
+        {
+        case nl::io::CreateMode::CreateNew:
+            flags |= O_CREAT | O_EXCL;
+            break;
+        case nl::io::CreateMode::CreateAlways:
+            flags |= O_CREAT | O_TRUNC;
+            break;
+        case nl::io::CreateMode::OpenExisting:
+            break;
+        case nl::io::CreateMode::OpenAlways:
+            flags |= O_CREAT;
+            break;
+        case nl::io::CreateMode::TruncateExisting:
+            flags |= O_TRUNC;
+            break;
+        }
+
+        flags |= writable ? O_RDWR : O_RDONLY;
+
+        int fd;
+        do
+        {
+            fd = ::open(filename, flags, 0644);
+        } while (fd == -1 && errno == EINTR);
+
+        if (fd == -1)
+            return 0;
+
+        return (FileHandle)fd + 1;
     }
 
     static void Close(FileHandle fp)
     {
-        throw NotImplementedException();
+        ::close(GetDescriptor(fp));
     }
 
     static int64_t GetPosition(FileHandle fp)
     {
-        throw NotImplementedException();
+        off_t pos = ::lseek(GetDescriptor(fp), 0, SEEK_CUR);
+        if (pos == -1)
+            throw IOException(IOException::SeekFailed);
+
+        return (int64_t)pos;
     }
 
     static int64_t GetSize(FileHandle fp)
     {
-        throw NotImplementedException();
+        struct stat st;
+        if (::fstat(GetDescriptor(fp), &st) != 0)
+            throw Exception("Failed to get size");
+
+        return (int64_t)st.st_size;
     }
 
     static bool Seek(FileHandle fp, int64_t offset, nl::io::SeekMode mode)
     {
-        throw NotImplementedException();
+        int whence = SEEK_SET;
+        switch (mode)
+        {
+        case nl::io::SeekMode::Begin: whence = SEEK_SET; break;
+        case nl::io::SeekMode::Current: whence = SEEK_CUR; break;
+        case nl::io::SeekMode::End: whence = SEEK_END; break;
+        }
+
+        return ::lseek(GetDescriptor(fp), (off_t)offset, whence) != -1;
     }
 
     static int64_t Read(FileHandle fp, void* ptr, int64_t count)
     {
-        throw NotImplementedException();
+        int fd = GetDescriptor(fp);
+
+        int64_t remaining = count;
+        while (remaining != 0)
+        {
+            ssize_t n = ::read(fd, ptr, (size_t)remaining);
+            if (n == -1 && errno == EINTR)
+                continue;
+
+            if (n <= 0)
+                break;
+
+            ptr = (uint8_t*)ptr + n;
+            remaining -= n;
+        }
+
+        return count - remaining;
     }
 
     static int64_t Write(FileHandle fp, const void* ptr, int64_t count)
     {
-        throw NotImplementedException();
+        int fd = GetDescriptor(fp);
+
+        int64_t remaining = count;
+        while (remaining != 0)
+        {
+            ssize_t n = ::write(fd, ptr, (size_t)remaining);
+            if (n == -1 && errno == EINTR)
+                continue;
+
+            if (n <= 0)
+                break;
+
+            ptr = (const uint8_t*)ptr + n;
+            remaining -= n;
+        }
+
+        return count - remaining;
     }
 
     static bool Flush(FileHandle fp)
     {
-        throw NotImplementedException();
+        return ::fsync(GetDescriptor(fp)) == 0;
     }
 
     static bool SetEndOfFile(FileHandle fp)
     {
-        throw NotImplementedException();
+        int fd = GetDescriptor(fp);
+
+        off_t pos = ::lseek(fd, 0, SEEK_CUR);
+        if (pos == -1)
+            return false;
+
+        return ::ftruncate(fd, pos) == 0;
     }
 
     static bool FileOrDirectoryExists(const char* path)
     {
-        throw NotImplementedException();
+        struct stat st;
+        return ::stat(path, &st) == 0;
+    }
+
+    static int64_t ReadAt(FileHandle fp, void* ptr, int64_t count, int64_t offset)
+    {
+        int fd = GetDescriptor(fp);
+
+        int64_t remaining = count;
+        while (remaining != 0)
+        {
+            ssize_t n = ::pread(fd, ptr, (size_t)remaining, (off_t)offset);
+            if (n == -1 && errno == EINTR)
+                continue;
+
+            if (n <= 0)
+                break;
+
+            ptr = (uint8_t*)ptr + n;
+            remaining -= n;
+            offset += n;
+        }
+
+        return count - remaining;
+    }
+
+    static int64_t WriteAt(FileHandle fp, const void* ptr, int64_t count, int64_t offset)
+    {
+        int fd = GetDescriptor(fp);
+
+        int64_t remaining = count;
+        while (remaining != 0)
+        {
+            ssize_t n = ::pwrite(fd, ptr, (size_t)remaining, (off_t)offset);
+            if (n == -1 && errno == EINTR)
+                continue;
+
+            if (n <= 0)
+                break;
+
+            ptr = (const uint8_t*)ptr + n;
+            remaining -= n;
+            offset += n;
+        }
+
+        return count - remaining;
+    }
+
+    static int64_t GetNativeHandle(FileHandle fp)
+    {
+        return GetDescriptor(fp);
+    }
+
+    // Runs readv or writev until every segment is transferred or the call transfers nothing.
+    template <typename TTransfer>
+    static int64_t TransferV(const nl::io::IOSegment* segments, int32_t count, TTransfer transfer)
+    {
+        int64_t total = 0;
+        int32_t index = 0;
+        size_t offset = 0; // bytes of segments[index] already transferred
+
+        for (;;)
+        {
+            iovec vec[MaxSegmentsPerCall];
+            int vec_count = 0;
+
+            // the first segment may be partially transferred by an earlier call
+            for (int32_t i = index; i < count && vec_count < MaxSegmentsPerCall; ++i)
+            {
+                size_t skip = i == index ? offset : 0;
+                if (segments[i].Length == skip)
+                    continue;
+
+                vec[vec_count].iov_base = (uint8_t*)segments[i].Data + skip;
+                vec[vec_count].iov_len = segments[i].Length - skip;
+                ++vec_count;
+            }
+
+            if (vec_count == 0)
+                break;
+
+            ssize_t n = transfer(vec, vec_count);
+            if (n == -1 && errno == EINTR)
+                continue;
+
+            if (n <= 0)
+                break;
+
+            total += n;
+
+            size_t left = (size_t)n;
+            while (left != 0)
+            {
+                size_t available = segments[index].Length - offset;
+                if (left < available)
+                {
+                    offset += left;
+                    break;
+                }
+
+                left -= available;
+                offset = 0;
+                ++index;
+            }
+        }
+
+        return total;
+    }
+
+    static int64_t ReadV(FileHandle fp, const nl::io::IOSegment* segments, int32_t count)
+    {
+        int fd = GetDescriptor(fp);
+        return TransferV(segments, count, [fd](const iovec* vec, int vec_count) { return ::readv(fd, vec, vec_count); });
+    }
+
+    static int64_t WriteV(FileHandle fp, const nl::io::IOSegment* segments, int32_t count)
+    {
+        int fd = GetDescriptor(fp);
+        return TransferV(segments, count, [fd](const iovec* vec, int vec_count) { return ::writev(fd, vec, vec_count); });
+    }
+
+    static int64_t Copy(FileHandle source, FileHandle target, int64_t count)
+    {
+        int in = GetDescriptor(source);
+        int out = GetDescriptor(target);
+
+        // copy_file_range can share extents on file systems that support it but fails across file systems on
+        // older kernels, where sendfile still copies in the kernel
+        bool copy_range = true;
+
+        int64_t total = 0;
+        while (total < count)
+        {
+            size_t n = (size_t)(count - total < (1 << 30) ? count - total : (1 << 30));
+
+            ssize_t copied = copy_range ?
+                ::copy_file_range(in, nullptr, out, nullptr, n, 0) :
+                ::sendfile(out, in, nullptr, n);
+
+            if (copied == -1)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                if (copy_range &&
+                    total == 0 &&
+                    (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP))
+                {
+                    copy_range = false;
+                    continue;
+                }
+
+                // the positions reflect what was copied, so the caller can carry on another way
+                return total != 0 ? total : -1;
+            }
+
+            if (copied == 0)
+                break;
+
+            total += copied;
+        }
+
+        return total;
     }
 
     bool SetFileIO(SystemLayerFunctions* functions)
@@ -73,8 +339,14 @@ namespace nl::systemlayer::defaults
         functions->FileFlush = Flush;
         functions->FileSetEndOfFile = SetEndOfFile;
         functions->FileOrDirectoryExists = FileOrDirectoryExists;
+        functions->FileReadAt = ReadAt;
+        functions->FileWriteAt = WriteAt;
+        functions->FileGetNativeHandle = GetNativeHandle;
+        functions->FileReadV = ReadV;
+        functions->FileWriteV = WriteV;
+        functions->FileCopy = Copy;
         return true;
     }
 }
 
-#endif
\ No newline at end of file
+#endif
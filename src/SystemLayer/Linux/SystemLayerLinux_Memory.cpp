@@ -10,36 +10,91 @@
 #include <NativeLib/Exceptions.h>
 #include <NativeLib/Assert.h>
 
+//!ALLOW_INCLUDE "stdlib.h"
+//!ALLOW_INCLUDE "sys/mman.h"
+//!ALLOW_INCLUDE "unistd.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 namespace nl::systemlayer::defaults
 {
     static void* AllocateHeapMemory(size_t size)
     {
-        throw NotImplementedException();
+        void* lp = malloc(size);
+        nl_assert_if_debug(lp != nullptr);
+
+#ifdef _DEBUG
+        if (lp)
+            memset(lp, 0xcd, size);
+#endif
+
+        return lp;
     }
 
     static void* ReallocateHeapMemory(void* ptr, size_t new_size)
     {
-        throw NotImplementedException();
+        if (ptr == nullptr)
+            return AllocateHeapMemory(new_size);
+
+        void* new_ptr = realloc(ptr, new_size);
+        nl_assert_if_debug(new_ptr != nullptr);
+        return new_ptr;
     }
 
     static void FreeHeapMemory(void* ptr)
     {
-        throw NotImplementedException();
+        nl_assert_if_debug(ptr != nullptr);
+        free(ptr);
     }
 
     static int64_t GetVirtualMemoryPageSize()
     {
-        throw NotImplementedException();
+        return (int64_t)sysconf(_SC_PAGESIZE);
     }
 
     static void* AllocateVirtualMemory(size_t size)
     {
-        throw NotImplementedException();
+        // munmap needs the size, so it is kept in a page in front of the allocation
+        size_t page_size = (size_t)GetVirtualMemoryPageSize();
+        size_t total = page_size + ((size + page_size - 1) & ~(page_size - 1));
+
+        void* base = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        nl_assert_if_debug(base != MAP_FAILED);
+        if (base == MAP_FAILED)
+            return nullptr;
+
+        *(size_t*)base = total;
+
+        void* lp = (char*)base + page_size;
+
+#ifdef _DEBUG
+        memset(lp, 0xcd, size);
+#endif
+
+        return lp;
     }
 
     static void FreeVirtualMemory(void* ptr)
     {
-        throw NotImplementedException();
+        void* base = (char*)ptr - GetVirtualMemoryPageSize();
+        munmap(base, *(size_t*)base);
+    }
+
+    static void* ReserveVirtualMemory(size_t size)
+    {
+        void* lp = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        return lp != MAP_FAILED ? lp : nullptr;
+    }
+
+    static bool CommitVirtualMemory(void* ptr, size_t size)
+    {
+        return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+    }
+
+    static void ReleaseVirtualMemory(void* ptr, size_t size)
+    {
+        munmap(ptr, size);
     }
 
     bool SetMemory(SystemLayerFunctions* functions)
@@ -50,8 +105,11 @@ namespace nl::systemlayer::defaults
         functions->GetVirtualMemoryPageSize = GetVirtualMemoryPageSize;
         functions->AllocateVirtualMemory = AllocateVirtualMemory;
         functions->FreeVirtualMemory = FreeVirtualMemory;
+        functions->ReserveVirtualMemory = ReserveVirtualMemory;
+        functions->CommitVirtualMemory = CommitVirtualMemory;
+        functions->ReleaseVirtualMemory = ReleaseVirtualMemory;
         return true;
     }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -8,6 +8,7 @@
 #include "SystemLayerWindows.h"
 
 #include <NativeLib/Exceptions.h>
+#include <NativeLib/Util.h>
 
 //!ALLOW_INCLUDE "Windows.h"
 #include <Windows.h>
@@ -162,6 +163,97 @@ namespace nl::systemlayer::defaults
         return true;
     }
 
+    static int64_t ReadAt(FileHandle fp, void* ptr, int64_t count, int64_t offset)
+    {
+        HANDLE hFile = (HANDLE)fp;
+
+        int64_t remaining = count;
+        while (remaining != 0)
+        {
+            OVERLAPPED ov = {};
+            ov.Offset = (DWORD)offset;
+            ov.OffsetHigh = (DWORD)(offset >> 32);
+
+            DWORD dw;
+            if (!ReadFile(hFile, ptr, (DWORD)nl::util::Min<int64_t>(remaining, 0x7fffffff), &dw, &ov) ||
+                dw == 0)
+                break;
+
+            ptr = (uint8_t*)ptr + dw;
+            remaining -= dw;
+            offset += dw;
+        }
+
+        return count - remaining;
+    }
+
+    static int64_t WriteAt(FileHandle fp, const void* ptr, int64_t count, int64_t offset)
+    {
+        HANDLE hFile = (HANDLE)fp;
+
+        int64_t remaining = count;
+        while (remaining != 0)
+        {
+            OVERLAPPED ov = {};
+            ov.Offset = (DWORD)offset;
+            ov.OffsetHigh = (DWORD)(offset >> 32);
+
+            DWORD dw;
+            if (!WriteFile(hFile, ptr, (DWORD)nl::util::Min<int64_t>(remaining, 0x7fffffff), &dw, &ov) ||
+                dw == 0)
+                break;
+
+            ptr = (const uint8_t*)ptr + dw;
+            remaining -= dw;
+            offset += dw;
+        }
+
+        return count - remaining;
+    }
+
+    static int64_t GetNativeHandle(FileHandle fp)
+    {
+        return (int64_t)fp;
+    }
+
+    // WriteFileGather and ReadFileScatter only take page sized unbuffered segments, so the segments are
+    // transferred one at a time
+    static int64_t ReadV(FileHandle fp, const nl::io::IOSegment* segments, int32_t count)
+    {
+        int64_t total = 0;
+        for (int32_t i = 0; i < count; ++i)
+        {
+            int64_t read = Read(fp, segments[i].Data, (int64_t)segments[i].Length);
+            total += read;
+
+            if (read != (int64_t)segments[i].Length)
+                break;
+        }
+
+        return total;
+    }
+
+    static int64_t WriteV(FileHandle fp, const nl::io::IOSegment* segments, int32_t count)
+    {
+        int64_t total = 0;
+        for (int32_t i = 0; i < count; ++i)
+        {
+            int64_t written = Write(fp, segments[i].Data, (int64_t)segments[i].Length);
+            total += written;
+
+            if (written != (int64_t)segments[i].Length)
+                break;
+        }
+
+        return total;
+    }
+
+    static int64_t Copy(FileHandle source, FileHandle target, int64_t count)
+    {
+        // CopyFileEx works on paths only; there is no kernel copy between two open handles
+        return -1;
+    }
+
     bool SetFileIO(SystemLayerFunctions* functions)
     {
         functions->FileOpen = Open;
@@ -174,6 +266,12 @@ namespace nl::systemlayer::defaults
         functions->FileFlush = Flush;
         functions->FileSetEndOfFile = SetEndOfFile;
         functions->FileOrDirectoryExists = FileOrDirectoryExists;
+        functions->FileReadAt = ReadAt;
+        functions->FileWriteAt = WriteAt;
+        functions->FileGetNativeHandle = GetNativeHandle;
+        functions->FileReadV = ReadV;
+        functions->FileWriteV = WriteV;
+        functions->FileCopy = Copy;
         return true;
     }
 }
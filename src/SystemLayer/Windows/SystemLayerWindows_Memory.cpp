@@ -84,6 +84,21 @@ namespace nl::systemlayer::defaults
         VirtualFree(ptr, 0, MEM_RELEASE);
     }
 
+    static void* ReserveVirtualMemory(size_t size)
+    {
+        return VirtualAlloc(nullptr, (SIZE_T)size, MEM_RESERVE, PAGE_NOACCESS);
+    }
+
+    static bool CommitVirtualMemory(void* ptr, size_t size)
+    {
+        return VirtualAlloc(ptr, (SIZE_T)size, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+    }
+
+    static void ReleaseVirtualMemory(void* ptr, size_t size)
+    {
+        VirtualFree(ptr, 0, MEM_RELEASE);
+    }
+
     bool SetMemory(SystemLayerFunctions* functions)
     {
         functions->AllocateHeapMemory = AllocateHeapMemory;
@@ -92,6 +107,9 @@ namespace nl::systemlayer::defaults
         functions->GetVirtualMemoryPageSize = GetVirtualMemoryPageSize;
         functions->AllocateVirtualMemory = AllocateVirtualMemory;
         functions->FreeVirtualMemory = FreeVirtualMemory;
+        functions->ReserveVirtualMemory = ReserveVirtualMemory;
+        functions->CommitVirtualMemory = CommitVirtualMemory;
+        functions->ReleaseVirtualMemory = ReleaseVirtualMemory;
         return true;
     }
 }
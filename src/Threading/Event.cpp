@@ -0,0 +1,136 @@
+#include "StdAfx.h"
+
+#include <NativeLib/Threading/Event.h>
+#include <NativeLib/Allocators.h>
+
+//!ALLOW_INCLUDE "Windows.h"
+//!ALLOW_INCLUDE "pthread.h"
+//!ALLOW_INCLUDE "time.h"
+
+#ifdef NL_PLATFORM_WINDOWS
+#include <Windows.h>
+#endif
+
+#ifdef NL_PLATFORM_LINUX
+#include <pthread.h>
+#include <time.h>
+#endif
+
+namespace nl::threading
+{
+#ifdef NL_PLATFORM_LINUX
+    struct EventState
+    {
+        pthread_mutex_t Mutex;
+        pthread_cond_t Condition;
+        bool ManualReset;
+        bool Signaled;
+
+        EventState(bool manual_reset, bool initial_state) :
+            ManualReset(manual_reset),
+            Signaled(initial_state)
+        {
+            pthread_condattr_t attr;
+            pthread_condattr_init(&attr);
+            pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+            pthread_mutex_init(&Mutex, nullptr);
+            pthread_cond_init(&Condition, &attr);
+
+            pthread_condattr_destroy(&attr);
+        }
+
+        ~EventState()
+        {
+            pthread_cond_destroy(&Condition);
+            pthread_mutex_destroy(&Mutex);
+        }
+    };
+#endif
+
+    Event::Event(bool manual_reset, bool initial_state)
+    {
+#ifdef NL_PLATFORM_WINDOWS
+        m_ptr = CreateEventW(nullptr, manual_reset ? TRUE : FALSE, initial_state ? TRUE : FALSE, nullptr);
+        if (m_ptr == nullptr)
+            throw Win32Exception();
+#else
+        m_ptr = nl::memory::ConstructThrow<EventState>(manual_reset, initial_state);
+#endif
+    }
+
+    Event::~Event()
+    {
+#ifdef NL_PLATFORM_WINDOWS
+        CloseHandle((HANDLE)m_ptr);
+#else
+        nl::memory::Destroy(reinterpret_cast<EventState*>(m_ptr));
+#endif
+    }
+
+    void Event::Set()
+    {
+#ifdef NL_PLATFORM_WINDOWS
+        SetEvent((HANDLE)m_ptr);
+#else
+        auto state = reinterpret_cast<EventState*>(m_ptr);
+        pthread_mutex_lock(&state->Mutex);
+        state->Signaled = true;
+        if (state->ManualReset)
+            pthread_cond_broadcast(&state->Condition);
+        else
+            pthread_cond_signal(&state->Condition);
+        pthread_mutex_unlock(&state->Mutex);
+#endif
+    }
+
+    void Event::Reset()
+    {
+#ifdef NL_PLATFORM_WINDOWS
+        ResetEvent((HANDLE)m_ptr);
+#else
+        auto state = reinterpret_cast<EventState*>(m_ptr);
+        pthread_mutex_lock(&state->Mutex);
+        state->Signaled = false;
+        pthread_mutex_unlock(&state->Mutex);
+#endif
+    }
+
+    bool Event::Wait(uint32_t milliseconds)
+    {
+#ifdef NL_PLATFORM_WINDOWS
+        return WaitForSingleObject((HANDLE)m_ptr, milliseconds == Infinite ? INFINITE : (DWORD)milliseconds) == WAIT_OBJECT_0;
+#else
+        auto state = reinterpret_cast<EventState*>(m_ptr);
+
+        timespec deadline = {};
+        if (milliseconds != Infinite)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += milliseconds / 1000;
+            deadline.tv_nsec += (long)(milliseconds % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+        }
+
+        pthread_mutex_lock(&state->Mutex);
+        while (!state->Signaled)
+        {
+            if (milliseconds == Infinite)
+                pthread_cond_wait(&state->Condition, &state->Mutex);
+            else if (pthread_cond_timedwait(&state->Condition, &state->Mutex, &deadline) == ETIMEDOUT)
+                break;
+        }
+
+        bool signaled = state->Signaled;
+        if (signaled && !state->ManualReset)
+            state->Signaled = false;
+
+        pthread_mutex_unlock(&state->Mutex);
+        return signaled;
+#endif
+    }
+}
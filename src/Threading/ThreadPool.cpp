@@ -0,0 +1,200 @@
+#include "StdAfx.h"
+
+#include <NativeLib/Threading/ThreadPool.h>
+#include <NativeLib/Threading/Event.h>
+#include <NativeLib/Threading/ReadWriteLock.h>
+#include <NativeLib/Containers/Queue.h>
+#include <NativeLib/Allocators.h>
+
+//!ALLOW_INCLUDE "Windows.h"
+//!ALLOW_INCLUDE "pthread.h"
+//!ALLOW_INCLUDE "unistd.h"
+
+#ifdef NL_PLATFORM_WINDOWS
+#include <Windows.h>
+#endif
+
+#ifdef NL_PLATFORM_LINUX
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace nl::threading
+{
+    struct ThreadPoolWork
+    {
+        ThreadPoolWork* prev;
+        ThreadPoolWork* next;
+        std::function<void()> Function;
+    };
+
+    struct ThreadPoolState
+    {
+        nl::Vector<void*> Threads;
+        nl::Queue<ThreadPoolWork> Work;
+        ReadWriteLock Lock;
+        Event WorkAvailable; // auto reset; woken worker re-signals if more work remains
+        Event Idle;
+        size_t Queued;
+        size_t Pending;
+        bool Shutdown;
+
+        ThreadPoolState() :
+            WorkAvailable(false, false),
+            Idle(true, true),
+            Queued(0),
+            Pending(0),
+            Shutdown(false)
+        {
+        }
+
+        void Run()
+        {
+            for (;;)
+            {
+                WorkAvailable.Wait();
+
+                for (;;)
+                {
+                    Lock.AcquireExclusive();
+                    if (Shutdown)
+                    {
+                        Lock.ReleaseExclusive();
+                        WorkAvailable.Set(); // pass the shutdown on to the next thread
+                        return;
+                    }
+
+                    ThreadPoolWork* work = Work.PopHead();
+                    if (work && --Queued != 0)
+                        WorkAvailable.Set();
+                    Lock.ReleaseExclusive();
+
+                    if (!work)
+                        break;
+
+                    try
+                    {
+                        work->Function();
+                    }
+                    catch (...)
+                    {
+                        nl_assert_if_debug(!"Work queued on a ThreadPool must not throw");
+                    }
+
+                    nl::memory::Destroy(work);
+
+                    Lock.AcquireExclusive();
+                    if (--Pending == 0)
+                        Idle.Set();
+                    Lock.ReleaseExclusive();
+                }
+            }
+        }
+    };
+
+#ifdef NL_PLATFORM_WINDOWS
+    static DWORD WINAPI _ThreadPoolThread(LPVOID lp)
+    {
+        static_cast<ThreadPoolState*>(lp)->Run();
+        return 0;
+    }
+#else
+    static void* _ThreadPoolThread(void* lp)
+    {
+        static_cast<ThreadPoolState*>(lp)->Run();
+        return nullptr;
+    }
+#endif
+
+    ThreadPool::ThreadPool(int32_t thread_count)
+    {
+        if (thread_count <= 0)
+            thread_count = GetProcessorCount();
+
+        m_state = nl::memory::ConstructThrow<ThreadPoolState>();
+
+        for (int32_t i = 0; i < thread_count; ++i)
+        {
+#ifdef NL_PLATFORM_WINDOWS
+            HANDLE hThread = CreateThread(nullptr, 0, _ThreadPoolThread, m_state, 0, nullptr);
+            if (hThread == nullptr)
+            {
+                this->~ThreadPool();
+                throw Win32Exception();
+            }
+
+            m_state->Threads.Add(hThread);
+#else
+            pthread_t thread;
+            if (pthread_create(&thread, nullptr, _ThreadPoolThread, m_state) != 0)
+            {
+                this->~ThreadPool();
+                throw InvalidOperationException("Failed to create thread pool thread.");
+            }
+
+            m_state->Threads.Add((void*)thread);
+#endif
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        Wait();
+
+        m_state->Lock.AcquireExclusive();
+        m_state->Shutdown = true;
+        m_state->Lock.ReleaseExclusive();
+        m_state->WorkAvailable.Set();
+
+        for (auto thread : m_state->Threads)
+        {
+#ifdef NL_PLATFORM_WINDOWS
+            WaitForSingleObject((HANDLE)thread, INFINITE);
+            CloseHandle((HANDLE)thread);
+#else
+            pthread_join((pthread_t)thread, nullptr);
+#endif
+        }
+
+        nl::memory::Destroy(m_state);
+    }
+
+    int32_t ThreadPool::GetThreadCount() const
+    {
+        return (int32_t)m_state->Threads.GetCount();
+    }
+
+    void ThreadPool::Queue(std::function<void()> work)
+    {
+        auto item = nl::memory::ConstructThrow<ThreadPoolWork>();
+        item->prev = nullptr;
+        item->next = nullptr;
+        item->Function = std::move(work);
+
+        m_state->Lock.AcquireExclusive();
+        m_state->Work.AddTail(item);
+        m_state->Queued++;
+        if (m_state->Pending++ == 0)
+            m_state->Idle.Reset();
+        m_state->Lock.ReleaseExclusive();
+
+        m_state->WorkAvailable.Set();
+    }
+
+    void ThreadPool::Wait()
+    {
+        m_state->Idle.Wait();
+    }
+
+    int32_t ThreadPool::GetProcessorCount()
+    {
+#ifdef NL_PLATFORM_WINDOWS
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        return (int32_t)si.dwNumberOfProcessors;
+#else
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        return count > 0 ? (int32_t)count : 1;
+#endif
+    }
+}
@@ -0,0 +1,639 @@
+#include "StdAfx.h"
+
+#include <NativeLib/Threading/TimerWheel.h>
+#include <NativeLib/Threading/ThreadPool.h>
+#include <NativeLib/Threading/Event.h>
+#include <NativeLib/Threading/ReadWriteLock.h>
+#include <NativeLib/Containers/Vector.h>
+#include <NativeLib/Allocators.h>
+
+//!ALLOW_INCLUDE "Windows.h"
+//!ALLOW_INCLUDE "intrin.h"
+//!ALLOW_INCLUDE "pthread.h"
+//!ALLOW_INCLUDE "time.h"
+
+#ifdef NL_PLATFORM_WINDOWS
+#include <Windows.h>
+#include <intrin.h>
+#endif
+
+#ifdef NL_PLATFORM_LINUX
+#include <pthread.h>
+#include <time.h>
+#endif
+
+namespace nl::threading
+{
+    static constexpr int TimerWheel_SlotBits = 6;
+    static constexpr uint32_t TimerWheel_Slots = 1 << TimerWheel_SlotBits;
+    static constexpr uint64_t TimerWheel_SlotMask = TimerWheel_Slots - 1;
+    static constexpr int TimerWheel_Levels = 6; // 2^36 ticks, past the longest delay at 1 ms per tick
+    static constexpr uint32_t TimerWheel_Nil = 0xffffffff;
+
+    static int TimerWheel_LowestBit(uint64_t value)
+    {
+#ifdef NL_PLATFORM_WINDOWS
+        unsigned long index;
+        _BitScanForward64(&index, value);
+        return (int)index;
+#else
+        return __builtin_ctzll(value);
+#endif
+    }
+
+    static int TimerWheel_HighestBit(uint64_t value)
+    {
+#ifdef NL_PLATFORM_WINDOWS
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return (int)index;
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+    // Timers live in one array and link to each other by index, so a timer costs no allocation of its own once
+    // the array has grown to the number of timers pending at once.
+    struct TimerWheelEntry
+    {
+        uint64_t Expiry = 0; // tick
+        uint32_t Previous = TimerWheel_Nil;
+        uint32_t Next = TimerWheel_Nil; // also links the free entries
+        uint32_t Generation = 0;
+        uint32_t Interval = 0; // ticks between the calls of a periodic timer
+        uint32_t Slot = TimerWheel_Nil; // level * TimerWheel_Slots + slot; TimerWheel_Nil when free
+        std::function<void()> Callback;
+    };
+
+    struct TimerWheelState
+    {
+        uint32_t Resolution;
+        uint64_t Origin; // GetTime() of tick zero
+        uint64_t Now = 0; // the tick the wheel was advanced to
+        mutable ReadWriteLock Lock;
+
+        nl::Vector<TimerWheelEntry> Entries;
+        uint32_t FreeEntries = TimerWheel_Nil;
+        size_t Count = 0;
+
+        uint32_t Heads[TimerWheel_Levels * TimerWheel_Slots];
+        uint64_t Occupied[TimerWheel_Levels] = {}; // bit per slot with timers
+
+        // the thread of Start; Schedule wakes it when a timer is due before the tick it sleeps until
+        void* Thread = nullptr;
+        ThreadPool* Pool = nullptr;
+        Event Wake;
+        uint64_t WakeTick = UINT64_MAX;
+        bool Stopping = false;
+
+        TimerWheelState(uint32_t resolution) :
+            Resolution(resolution),
+            Origin(TimerWheel::GetTime()),
+            Wake(false, false)
+        {
+            for (auto& head : Heads)
+                head = TimerWheel_Nil;
+        }
+
+        uint64_t GetTick() const
+        {
+            return (TimerWheel::GetTime() - Origin) / Resolution;
+        }
+
+        // The first tick at or after delay milliseconds from now.
+        uint64_t GetExpiry(uint32_t delay) const
+        {
+            uint64_t expiry = (TimerWheel::GetTime() - Origin + delay + Resolution - 1) / Resolution;
+            return expiry > Now ? expiry : Now + 1;
+        }
+
+        uint32_t GetTicks(uint32_t interval) const
+        {
+            uint32_t ticks = (uint32_t)(((uint64_t)interval + Resolution - 1) / Resolution);
+            return ticks != 0 ? ticks : 1;
+        }
+
+        static TimerId MakeId(uint32_t index, uint32_t generation)
+        {
+            return ((TimerId)generation << 32) | (index + 1);
+        }
+
+        // Returns the index of the pending timer the ID refers to, or TimerWheel_Nil.
+        uint32_t Find(TimerId id) const
+        {
+            uint32_t index = (uint32_t)id - 1;
+            if (index >= Entries.GetCount())
+                return TimerWheel_Nil;
+
+            const auto& entry = Entries[index];
+            if (entry.Slot == TimerWheel_Nil ||
+                entry.Generation != (uint32_t)(id >> 32))
+                return TimerWheel_Nil;
+
+            return index;
+        }
+
+        // The lowest level whose slots reach the expiry: the one of the highest bit the expiry differs from Now in.
+        void Link(uint32_t index)
+        {
+            auto& entry = Entries[index];
+
+            uint64_t difference = entry.Expiry ^ Now;
+            int level = difference < TimerWheel_Slots ? 0 : TimerWheel_HighestBit(difference) / TimerWheel_SlotBits;
+            if (level >= TimerWheel_Levels)
+                level = TimerWheel_Levels - 1; // comes around again when the top level turns
+
+            uint32_t slot = (uint32_t)((entry.Expiry >> (level * TimerWheel_SlotBits)) & TimerWheel_SlotMask);
+            uint32_t bucket = level * TimerWheel_Slots + slot;
+
+            entry.Slot = bucket;
+            entry.Previous = TimerWheel_Nil;
+            entry.Next = Heads[bucket];
+            if (entry.Next != TimerWheel_Nil)
+                Entries[entry.Next].Previous = index;
+
+            Heads[bucket] = index;
+            Occupied[level] |= (uint64_t)1 << slot;
+        }
+
+        void Unlink(uint32_t index)
+        {
+            auto& entry = Entries[index];
+
+            if (entry.Previous != TimerWheel_Nil)
+                Entries[entry.Previous].Next = entry.Next;
+            else
+                Heads[entry.Slot] = entry.Next;
+
+            if (entry.Next != TimerWheel_Nil)
+                Entries[entry.Next].Previous = entry.Previous;
+
+            if (Heads[entry.Slot] == TimerWheel_Nil)
+                Occupied[entry.Slot / TimerWheel_Slots] &= ~((uint64_t)1 << (entry.Slot % TimerWheel_Slots));
+        }
+
+        // Takes the whole list of a slot; the entries keep their links to each other.
+        uint32_t Detach(int level, uint32_t slot)
+        {
+            uint32_t bucket = level * TimerWheel_Slots + slot;
+            uint32_t head = Heads[bucket];
+
+            Heads[bucket] = TimerWheel_Nil;
+            Occupied[level] &= ~((uint64_t)1 << slot);
+            return head;
+        }
+
+        TimerId Add(uint32_t delay, uint32_t interval, std::function<void()>& callback)
+        {
+            uint32_t index;
+            if (FreeEntries != TimerWheel_Nil)
+            {
+                index = FreeEntries;
+                FreeEntries = Entries[index].Next;
+            }
+            else
+            {
+                if (Entries.GetCount() >= TimerWheel_Nil - 1)
+                    throw InvalidOperationException("The timer wheel has no room for more timers.");
+
+                index = (uint32_t)Entries.GetCount();
+                Entries.Add(TimerWheelEntry());
+            }
+
+            auto& entry = Entries[index];
+            entry.Expiry = GetExpiry(delay);
+            entry.Interval = interval;
+            entry.Callback = std::move(callback);
+            Link(index);
+
+            ++Count;
+            return MakeId(index, entry.Generation);
+        }
+
+        void Free(uint32_t index)
+        {
+            auto& entry = Entries[index];
+            entry.Slot = TimerWheel_Nil;
+            entry.Callback = nullptr;
+            ++entry.Generation;
+            entry.Next = FreeEntries;
+            FreeEntries = index;
+
+            --Count;
+        }
+
+        // Moves the timers in the slots of the levels whose turn ended at Now down towards level zero, the
+        // highest level first so its timers can go on down with the level below.
+        void Cascade()
+        {
+            int top = 1;
+            while (top < TimerWheel_Levels - 1 &&
+                   ((Now >> ((top + 1) * TimerWheel_SlotBits)) << ((top + 1) * TimerWheel_SlotBits)) == Now)
+                ++top;
+
+            for (int level = top; level > 0; --level)
+            {
+                uint32_t slot = (uint32_t)((Now >> (level * TimerWheel_SlotBits)) & TimerWheel_SlotMask);
+                for (uint32_t index = Detach(level, slot); index != TimerWheel_Nil;)
+                {
+                    uint32_t next = Entries[index].Next;
+                    Link(index);
+                    index = next;
+                }
+            }
+        }
+
+        // Collects the callbacks of the timers in the level zero slot of Now. A periodic timer is linked again for
+        // its next period after tick, so a wheel that was not advanced for a while does not call it for every period
+        // it missed. A timer stays linked until its callback was taken, which is all that can fail.
+        void Expire(uint64_t tick, nl::Vector<std::function<void()>>& due)
+        {
+            uint32_t bucket = (uint32_t)(Now & TimerWheel_SlotMask);
+
+            uint32_t index;
+            while ((index = Heads[bucket]) != TimerWheel_Nil)
+            {
+                auto& entry = Entries[index];
+
+                due.PrepareAdd(1);
+                if (entry.Interval != 0)
+                {
+                    due.Add(entry.Callback);
+                    Unlink(index);
+
+                    entry.Expiry += entry.Interval;
+                    if (entry.Expiry <= tick)
+                        entry.Expiry = tick + entry.Interval - (tick - entry.Expiry) % entry.Interval;
+
+                    Link(index);
+                }
+                else
+                {
+                    due.Add(std::move(entry.Callback));
+                    Unlink(index);
+                    Free(index);
+                }
+            }
+        }
+
+        // Moves Now up to the tick of the clock, skipping the ticks without timers in level zero.
+        void AdvanceTo(uint64_t tick, nl::Vector<std::function<void()>>& due)
+        {
+            // whatever a previous call failed to collect
+            Expire(tick, due);
+
+            while (Now < tick)
+            {
+                uint32_t slot = (uint32_t)(Now & TimerWheel_SlotMask);
+                uint64_t pending = slot == TimerWheel_SlotMask ? 0 : Occupied[0] & (~(uint64_t)0 << (slot + 1));
+
+                uint64_t next = pending != 0 ?
+                    (Now & ~TimerWheel_SlotMask) + TimerWheel_LowestBit(pending) :
+                    (Now | TimerWheel_SlotMask) + 1;
+
+                if (next > tick)
+                {
+                    Now = tick;
+                    return;
+                }
+
+                Now = next;
+                if ((Now & TimerWheel_SlotMask) == 0)
+                    Cascade();
+
+                Expire(tick, due);
+            }
+        }
+
+        // The next tick Advance has work at: the earliest timer of level zero or else the earliest turn that moves
+        // timers down from a level above. UINT64_MAX if there is no timer.
+        uint64_t GetNextTick() const
+        {
+            if (Count == 0)
+                return UINT64_MAX;
+
+            uint64_t next = UINT64_MAX;
+            for (int level = 0; level < TimerWheel_Levels; ++level)
+            {
+                if (Occupied[level] == 0)
+                    continue;
+
+                int shift = level * TimerWheel_SlotBits;
+                uint32_t slot = (uint32_t)((Now >> shift) & TimerWheel_SlotMask);
+                uint64_t pending = slot == TimerWheel_SlotMask ? 0 : Occupied[level] & (~(uint64_t)0 << (slot + 1));
+
+                // the start of the level's turn Now is in
+                uint64_t turn = (Now >> (shift + TimerWheel_SlotBits)) << (shift + TimerWheel_SlotBits);
+
+                uint64_t tick;
+                if (pending != 0)
+                    tick = turn + ((uint64_t)TimerWheel_LowestBit(pending) << shift);
+                else
+                    tick = turn + ((uint64_t)1 << (shift + TimerWheel_SlotBits)); // the top level coming around
+
+                if (tick < next)
+                    next = tick;
+
+                if (level == 0 &&
+                    pending != 0)
+                    break;
+            }
+
+            return next;
+        }
+
+        uint32_t GetTimeout(uint64_t tick) const
+        {
+            if (tick == UINT64_MAX)
+                return Event::Infinite;
+
+            uint64_t time = Origin + tick * Resolution;
+            uint64_t now = TimerWheel::GetTime();
+            if (time <= now)
+                return 0;
+
+            return time - now < Event::Infinite ? (uint32_t)(time - now) : Event::Infinite - 1;
+        }
+
+        // Has the thread of Start recompute its wait if the timer is due before it would wake up; the lock must be
+        // held. Returns true if Wake has to be set.
+        bool NotifyThread(TimerId id)
+        {
+            if (!Thread)
+                return false;
+
+            uint64_t expiry = Entries[(uint32_t)id - 1].Expiry;
+            if (expiry >= WakeTick)
+                return false;
+
+            WakeTick = expiry;
+            return true;
+        }
+
+        void Run()
+        {
+            for (;;)
+            {
+                Lock.AcquireExclusive();
+                if (Stopping)
+                {
+                    Lock.ReleaseExclusive();
+                    return;
+                }
+
+                WakeTick = GetNextTick();
+                uint32_t timeout = GetTimeout(WakeTick);
+                Lock.ReleaseExclusive();
+
+                if (timeout != 0)
+                    Wake.Wait(timeout);
+
+                AdvanceWheel(Pool);
+            }
+        }
+
+        size_t AdvanceWheel(ThreadPool* pool)
+        {
+            nl::Vector<std::function<void()>> due;
+
+            Lock.AcquireExclusive();
+            try
+            {
+                AdvanceTo(GetTick(), due);
+            }
+            catch (...)
+            {
+                // out of memory while collecting; the timers that were not collected are still linked
+                Lock.ReleaseExclusive();
+                Fire(due, pool);
+                throw;
+            }
+            Lock.ReleaseExclusive();
+
+            Fire(due, pool);
+            return due.GetCount();
+        }
+
+        static void Fire(nl::Vector<std::function<void()>>& due, ThreadPool* pool)
+        {
+            for (auto& callback : due)
+            {
+                if (pool)
+                    pool->Queue(std::move(callback));
+                else
+                    callback();
+            }
+        }
+    };
+
+#ifdef NL_PLATFORM_WINDOWS
+    static DWORD WINAPI _TimerWheelThread(LPVOID lp)
+    {
+        static_cast<TimerWheelState*>(lp)->Run();
+        return 0;
+    }
+#else
+    static void* _TimerWheelThread(void* lp)
+    {
+        static_cast<TimerWheelState*>(lp)->Run();
+        return nullptr;
+    }
+#endif
+
+    TimerWheel::TimerWheel(uint32_t resolution)
+    {
+        if (resolution == 0)
+            throw ArgumentException("The resolution of a timer wheel must be at least one millisecond.");
+
+        m_state = nl::memory::ConstructThrow<TimerWheelState>(resolution);
+    }
+
+    TimerWheel::~TimerWheel()
+    {
+        Stop();
+        nl::memory::Destroy(m_state);
+    }
+
+    TimerId TimerWheel::Schedule(uint32_t delay, std::function<void()> callback)
+    {
+        if (!callback)
+            throw ArgumentException("A timer needs a callback.");
+
+        m_state->Lock.AcquireExclusive();
+
+        TimerId id;
+        try
+        {
+            id = m_state->Add(delay, 0, callback);
+        }
+        catch (...)
+        {
+            m_state->Lock.ReleaseExclusive();
+            throw;
+        }
+
+        bool wake = m_state->NotifyThread(id);
+        m_state->Lock.ReleaseExclusive();
+
+        if (wake)
+            m_state->Wake.Set();
+
+        return id;
+    }
+
+    TimerId TimerWheel::SchedulePeriodic(uint32_t interval, std::function<void()> callback)
+    {
+        if (!callback)
+            throw ArgumentException("A timer needs a callback.");
+
+        m_state->Lock.AcquireExclusive();
+
+        TimerId id;
+        try
+        {
+            id = m_state->Add(interval, m_state->GetTicks(interval), callback);
+        }
+        catch (...)
+        {
+            m_state->Lock.ReleaseExclusive();
+            throw;
+        }
+
+        bool wake = m_state->NotifyThread(id);
+        m_state->Lock.ReleaseExclusive();
+
+        if (wake)
+            m_state->Wake.Set();
+
+        return id;
+    }
+
+    bool TimerWheel::Reschedule(TimerId id, uint32_t delay)
+    {
+        m_state->Lock.AcquireExclusive();
+
+        uint32_t index = m_state->Find(id);
+        if (index == TimerWheel_Nil)
+        {
+            m_state->Lock.ReleaseExclusive();
+            return false;
+        }
+
+        m_state->Unlink(index);
+        m_state->Entries[index].Expiry = m_state->GetExpiry(delay);
+        m_state->Link(index);
+
+        bool wake = m_state->NotifyThread(id);
+        m_state->Lock.ReleaseExclusive();
+
+        if (wake)
+            m_state->Wake.Set();
+
+        return true;
+    }
+
+    bool TimerWheel::Cancel(TimerId id)
+    {
+        std::function<void()> callback; // destroyed once the lock is released
+
+        m_state->Lock.AcquireExclusive();
+
+        uint32_t index = m_state->Find(id);
+        if (index == TimerWheel_Nil)
+        {
+            m_state->Lock.ReleaseExclusive();
+            return false;
+        }
+
+        m_state->Unlink(index);
+        callback = std::move(m_state->Entries[index].Callback);
+        m_state->Free(index);
+        m_state->Lock.ReleaseExclusive();
+
+        return true;
+    }
+
+    size_t TimerWheel::Advance(ThreadPool* pool)
+    {
+        return m_state->AdvanceWheel(pool);
+    }
+
+    uint32_t TimerWheel::GetNextTimeout() const
+    {
+        m_state->Lock.AcquireShared();
+        uint32_t timeout = m_state->GetTimeout(m_state->GetNextTick());
+        m_state->Lock.ReleaseShared();
+
+        return timeout;
+    }
+
+    size_t TimerWheel::GetCount() const
+    {
+        m_state->Lock.AcquireShared();
+        size_t count = m_state->Count;
+        m_state->Lock.ReleaseShared();
+
+        return count;
+    }
+
+    void TimerWheel::Start(ThreadPool* pool)
+    {
+        if (m_state->Thread)
+            throw InvalidOperationException("The timer wheel is already started.");
+
+        m_state->Pool = pool;
+        m_state->Stopping = false;
+
+#ifdef NL_PLATFORM_WINDOWS
+        HANDLE hThread = CreateThread(nullptr, 0, _TimerWheelThread, m_state, 0, nullptr);
+        if (hThread == nullptr)
+            throw Win32Exception();
+
+        m_state->Lock.AcquireExclusive();
+        m_state->Thread = hThread;
+        m_state->Lock.ReleaseExclusive();
+#else
+        pthread_t thread;
+        if (pthread_create(&thread, nullptr, _TimerWheelThread, m_state) != 0)
+            throw InvalidOperationException("Failed to create the timer wheel thread.");
+
+        m_state->Lock.AcquireExclusive();
+        m_state->Thread = (void*)thread;
+        m_state->Lock.ReleaseExclusive();
+#endif
+    }
+
+    void TimerWheel::Stop()
+    {
+        if (!m_state->Thread)
+            return;
+
+        m_state->Lock.AcquireExclusive();
+        m_state->Stopping = true;
+        m_state->Lock.ReleaseExclusive();
+        m_state->Wake.Set();
+
+#ifdef NL_PLATFORM_WINDOWS
+        WaitForSingleObject((HANDLE)m_state->Thread, INFINITE);
+        CloseHandle((HANDLE)m_state->Thread);
+#else
+        pthread_join((pthread_t)m_state->Thread, nullptr);
+#endif
+
+        m_state->Lock.AcquireExclusive();
+        m_state->Thread = nullptr;
+        m_state->WakeTick = UINT64_MAX;
+        m_state->Lock.ReleaseExclusive();
+    }
+
+    uint64_t TimerWheel::GetTime()
+    {
+#ifdef NL_PLATFORM_WINDOWS
+        return GetTickCount64();
+#else
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#endif
+    }
+}